@@ -0,0 +1,581 @@
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <mutex>
+#include <numeric>
+
+#include "calc.hpp"
+#include "jobs.hpp"
+
+#include "bvh.hpp"
+
+// Centroid bins per axis for the SAH split search
+#define BVH_BIN_COUNT 16
+
+// Cost of visiting a node relative to testing a pack of 4 triangles
+#define BVH_TRAVERSAL_COST 1.f
+
+// Top nodes with more triangles are binned in parallel, smaller ones are built by a single job
+#define BVH_SUBTREE_SIZE 8192
+
+// Triangles binned per job
+#define BVH_JOB_SIZE 16384
+
+// Traversal stack size, nodes this deep are made leaves
+#define BVH_MAX_DEPTH 64
+
+// Rays traced per job
+#define BVH_RAY_JOB_SIZE 64
+
+namespace
+{
+    struct Box
+    {
+        float3 min;
+        float3 max;
+
+        static Box Empty() { return { { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } }; }
+
+        void Grow(const float3& p)
+        {
+            min = { calc::Min(min.x, p.x), calc::Min(min.y, p.y), calc::Min(min.z, p.z) };
+            max = { calc::Max(max.x, p.x), calc::Max(max.y, p.y), calc::Max(max.z, p.z) };
+        }
+
+        // Empty boxes leave the box unchanged
+        void Grow(const Box& b)
+        {
+            min = { calc::Min(min.x, b.min.x), calc::Min(min.y, b.min.y), calc::Min(min.z, b.min.z) };
+            max = { calc::Max(max.x, b.max.x), calc::Max(max.y, b.max.y), calc::Max(max.z, b.max.z) };
+        }
+
+        // Proportional to the surface area, 0 for empty boxes
+        float GetHalfArea() const
+        {
+            float3 d = max - min;
+            return d.x < 0.f ? 0.f : d.x * d.y + d.y * d.z + d.z * d.x;
+        }
+    };
+
+    struct Bins
+    {
+        Box bounds[3][BVH_BIN_COUNT];
+        int counts[3][BVH_BIN_COUNT];
+    };
+
+    struct BuildContext
+    {
+        std::vector<Box> triangleBounds;
+        std::vector<float3> centroids;
+        std::vector<int> order; // Triangles, each node owns a range
+        int maxLeafSize;
+    };
+
+    struct BuildTask
+    {
+        int node;
+        int begin;
+        int end;
+        int depth;
+    };
+
+    // Accumulate rangeFunc(result, begin, end) over [begin, end), partial results of parallel jobs are merged
+    template<typename T, typename RangeFunc, typename MergeFunc>
+    T Reduce(int begin, int end, bool parallel, const T& init, RangeFunc rangeFunc, MergeFunc merge)
+    {
+        T result = init;
+        if (!parallel || end - begin <= BVH_JOB_SIZE)
+        {
+            rangeFunc(result, begin, end);
+            return result;
+        }
+
+        std::mutex mutex;
+        jobs::ParallelFor(end - begin, BVH_JOB_SIZE, [&](int jobBegin, int jobEnd)
+        {
+            T partial = init;
+            rangeFunc(partial, begin + jobBegin, begin + jobEnd);
+            std::lock_guard<std::mutex> lock(mutex);
+            merge(result, partial);
+        });
+        return result;
+    }
+
+    inline int GetBin(float centroid, float min, float scale)
+    {
+        return calc::Min((int)((centroid - min) * scale), BVH_BIN_COUNT - 1);
+    }
+
+    // Return false if [begin, end) must be a leaf, otherwise partition it at middle and give the child bounds
+    bool SplitNode(BuildContext& context, const Box& nodeBounds, const BuildTask& task, bool parallel, int* middle, Box* leftBounds, Box* rightBounds)
+    {
+        int count = task.end - task.begin;
+        if (count <= 1 || task.depth >= BVH_MAX_DEPTH - 1)
+            return false;
+
+        const int* order = context.order.data();
+        Box centroidBounds = Reduce(task.begin, task.end, parallel, Box::Empty(),
+            [&](Box& box, int begin, int end) { for (int i = begin; i < end; ++i) box.Grow(context.centroids[order[i]]); },
+            [](Box& box, const Box& partial) { box.Grow(partial); });
+
+        float3 scales;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float extent = centroidBounds.max.e[axis] - centroidBounds.min.e[axis];
+            scales.e[axis] = extent > 0.f ? BVH_BIN_COUNT / extent : 0.f;
+        }
+
+        Bins empty;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            std::fill(empty.bounds[axis], empty.bounds[axis] + BVH_BIN_COUNT, Box::Empty());
+            std::fill(empty.counts[axis], empty.counts[axis] + BVH_BIN_COUNT, 0);
+        }
+
+        Bins bins = Reduce(task.begin, task.end, parallel, empty,
+            [&](Bins& b, int begin, int end)
+            {
+                for (int i = begin; i < end; ++i)
+                {
+                    int t = order[i];
+                    for (int axis = 0; axis < 3; ++axis)
+                    {
+                        int bin = GetBin(context.centroids[t].e[axis], centroidBounds.min.e[axis], scales.e[axis]);
+                        b.bounds[axis][bin].Grow(context.triangleBounds[t]);
+                        b.counts[axis][bin]++;
+                    }
+                }
+            },
+            [](Bins& b, const Bins& partial)
+            {
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    for (int bin = 0; bin < BVH_BIN_COUNT; ++bin)
+                    {
+                        b.bounds[axis][bin].Grow(partial.bounds[axis][bin]);
+                        b.counts[axis][bin] += partial.counts[axis][bin];
+                    }
+                }
+            });
+
+        // Sweep the split planes between bins, SAH cost scaled by the node area
+        int bestAxis = -1;
+        int bestBin = 0;
+        int bestLeftCount = 0;
+        float bestCost = FLT_MAX;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (scales.e[axis] == 0.f)
+                continue;
+
+            float rightCosts[BVH_BIN_COUNT];
+            Box right = Box::Empty();
+            int rightCount = 0;
+            for (int bin = BVH_BIN_COUNT - 1; bin > 0; --bin)
+            {
+                right.Grow(bins.bounds[axis][bin]);
+                rightCount += bins.counts[axis][bin];
+                rightCosts[bin] = right.GetHalfArea() * rightCount;
+            }
+
+            Box left = Box::Empty();
+            int leftCount = 0;
+            for (int bin = 0; bin < BVH_BIN_COUNT - 1; ++bin)
+            {
+                left.Grow(bins.bounds[axis][bin]);
+                leftCount += bins.counts[axis][bin];
+                float cost = left.GetHalfArea() * leftCount + rightCosts[bin + 1];
+                if (leftCount > 0 && leftCount < count && cost < bestCost)
+                {
+                    bestAxis = axis;
+                    bestBin = bin;
+                    bestLeftCount = leftCount;
+                    bestCost = cost;
+                    *leftBounds = left;
+                }
+            }
+        }
+
+        if (bestAxis < 0)
+        {
+            // Every centroid is at the same position, split in the middle to bound the leaf size
+            if (count <= context.maxLeafSize)
+                return false;
+
+            *middle = task.begin + count / 2;
+            *leftBounds = Box::Empty();
+            *rightBounds = Box::Empty();
+            for (int i = task.begin; i < task.end; ++i)
+                (i < *middle ? leftBounds : rightBounds)->Grow(context.triangleBounds[order[i]]);
+            return true;
+        }
+
+        // Leaves test their triangles by packs of 4, children are assumed to fill theirs
+        float nodeArea = nodeBounds.GetHalfArea();
+        if (count <= context.maxLeafSize && BVH_TRAVERSAL_COST * nodeArea + bestCost * 0.25f >= (count + 3) / 4 * nodeArea)
+            return false;
+
+        *rightBounds = Box::Empty();
+        for (int bin = bestBin + 1; bin < BVH_BIN_COUNT; ++bin)
+            rightBounds->Grow(bins.bounds[bestAxis][bin]);
+
+        float binMin = centroidBounds.min.e[bestAxis];
+        float binScale = scales.e[bestAxis];
+        std::partition(context.order.begin() + task.begin, context.order.begin() + task.end, [&](int t)
+        {
+            return GetBin(context.centroids[t].e[bestAxis], binMin, binScale) <= bestBin;
+        });
+        *middle = task.begin + bestLeftCount;
+        return true;
+    }
+
+    // Build the nodes below nodes[root.node], whose bounds are set
+    // With subtrees, nodes of at most BVH_SUBTREE_SIZE triangles are left to the caller (bins are then filled in parallel)
+    void BuildNodes(BuildContext& context, std::vector<BvhNode>& nodes, const BuildTask& root, std::vector<BuildTask>* subtrees)
+    {
+        std::vector<BuildTask> stack(1, root);
+        while (!stack.empty())
+        {
+            BuildTask task = stack.back();
+            stack.pop_back();
+
+            if (subtrees && task.end - task.begin <= BVH_SUBTREE_SIZE)
+            {
+                subtrees->push_back(task);
+                continue;
+            }
+
+            Box bounds = { nodes[task.node].min, nodes[task.node].max };
+            int middle;
+            Box left, right;
+            if (!SplitNode(context, bounds, task, subtrees != nullptr, &middle, &left, &right))
+            {
+                nodes[task.node].first = task.begin;
+                nodes[task.node].count = task.end - task.begin;
+                continue;
+            }
+
+            int first = (int)nodes.size();
+            nodes[task.node].first = first;
+            nodes[task.node].count = 0;
+            nodes.push_back({ left.min, 0, left.max, 0 });
+            nodes.push_back({ right.min, 0, right.max, 0 });
+            stack.push_back({ first + 1, middle, task.end, task.depth + 1 });
+            stack.push_back({ first, task.begin, middle, task.depth + 1 });
+        }
+    }
+
+    // Entry distance of the ray into the node box, FLT_MAX if it misses it before maxDistance
+    inline float IntersectBox(const BvhNode& node, const float3& origin, const float3& invDirection, float maxDistance)
+    {
+        float tx0 = (node.min.x - origin.x) * invDirection.x;
+        float tx1 = (node.max.x - origin.x) * invDirection.x;
+        float ty0 = (node.min.y - origin.y) * invDirection.y;
+        float ty1 = (node.max.y - origin.y) * invDirection.y;
+        float tz0 = (node.min.z - origin.z) * invDirection.z;
+        float tz1 = (node.max.z - origin.z) * invDirection.z;
+
+        float tEnter = calc::Max(calc::Max(calc::Min(tx0, tx1), calc::Min(ty0, ty1)), calc::Max(calc::Min(tz0, tz1), 0.f));
+        float tExit  = calc::Min(calc::Min(calc::Max(tx0, tx1), calc::Max(ty0, ty1)), calc::Min(calc::Max(tz0, tz1), maxDistance));
+        return tEnter <= tExit ? tEnter : FLT_MAX;
+    }
+
+#ifdef CALC_SIMD_SSE
+    inline __m128 Dot(const __m128 a[3], const __m128 b[3])
+    {
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])), _mm_mul_ps(a[2], b[2]));
+    }
+
+    inline void Cross(__m128 r[3], const __m128 a[3], const __m128 b[3])
+    {
+        r[0] = _mm_sub_ps(_mm_mul_ps(a[1], b[2]), _mm_mul_ps(a[2], b[1]));
+        r[1] = _mm_sub_ps(_mm_mul_ps(a[2], b[0]), _mm_mul_ps(a[0], b[2]));
+        r[2] = _mm_sub_ps(_mm_mul_ps(a[0], b[1]), _mm_mul_ps(a[1], b[0]));
+    }
+#endif
+
+    // Moller-Trumbore on the 4 lanes, keep the closest lane hit before hit.distance
+    bool IntersectPack(const BvhTrianglePack& pack, const int* triangles, const Ray& ray, RayHit& hit)
+    {
+        float t[4], u[4], v[4];
+        int mask = 0;
+#ifdef CALC_SIMD_SSE
+        __m128 d[3]  = { _mm_set1_ps(ray.direction.x), _mm_set1_ps(ray.direction.y), _mm_set1_ps(ray.direction.z) };
+        __m128 e1[3] = { calc::simd::Load<false>(pack.e1[0]), calc::simd::Load<false>(pack.e1[1]), calc::simd::Load<false>(pack.e1[2]) };
+        __m128 e2[3] = { calc::simd::Load<false>(pack.e2[0]), calc::simd::Load<false>(pack.e2[1]), calc::simd::Load<false>(pack.e2[2]) };
+        __m128 s[3]  = { _mm_sub_ps(_mm_set1_ps(ray.origin.x), calc::simd::Load<false>(pack.v0[0])),
+                         _mm_sub_ps(_mm_set1_ps(ray.origin.y), calc::simd::Load<false>(pack.v0[1])),
+                         _mm_sub_ps(_mm_set1_ps(ray.origin.z), calc::simd::Load<false>(pack.v0[2])) };
+
+        __m128 p[3], q[3];
+        Cross(p, d, e2);
+        Cross(q, s, e1);
+        __m128 det = Dot(e1, p);
+        __m128 invDet = _mm_div_ps(_mm_set1_ps(1.f), det);
+        __m128 tv = _mm_mul_ps(Dot(e2, q), invDet);
+        __m128 uv = _mm_mul_ps(Dot(s, p), invDet);
+        __m128 vv = _mm_mul_ps(Dot(d, q), invDet);
+
+        // Null determinants (parallel rays and unused lanes) give NaNs or infinities that fail the tests
+        __m128 zero = _mm_setzero_ps();
+        __m128 inside = _mm_and_ps(_mm_cmpneq_ps(det, zero), _mm_and_ps(_mm_cmpge_ps(uv, zero), _mm_cmpge_ps(vv, zero)));
+        inside = _mm_and_ps(inside, _mm_cmple_ps(_mm_add_ps(uv, vv), _mm_set1_ps(1.f)));
+        inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(tv, zero), _mm_cmplt_ps(tv, _mm_set1_ps(hit.distance))));
+        mask = _mm_movemask_ps(inside);
+        if (mask == 0)
+            return false;
+
+        _mm_storeu_ps(t, tv);
+        _mm_storeu_ps(u, uv);
+        _mm_storeu_ps(v, vv);
+#else
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            float3 e1 = { pack.e1[0][lane], pack.e1[1][lane], pack.e1[2][lane] };
+            float3 e2 = { pack.e2[0][lane], pack.e2[1][lane], pack.e2[2][lane] };
+            float3 s  = ray.origin - float3{ pack.v0[0][lane], pack.v0[1][lane], pack.v0[2][lane] };
+            float3 p = v3Cross(ray.direction, e2);
+            float3 q = v3Cross(s, e1);
+            float det = v3Dot(e1, p);
+            if (det == 0.f)
+                continue;
+
+            float invDet = 1.f / det;
+            t[lane] = v3Dot(e2, q) * invDet;
+            u[lane] = v3Dot(s, p) * invDet;
+            v[lane] = v3Dot(ray.direction, q) * invDet;
+            if (u[lane] >= 0.f && v[lane] >= 0.f && u[lane] + v[lane] <= 1.f && t[lane] >= 0.f && t[lane] < hit.distance)
+                mask |= 1 << lane;
+        }
+        if (mask == 0)
+            return false;
+#endif
+
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            if ((mask >> lane) & 1 && t[lane] < hit.distance)
+                hit = { triangles[lane], t[lane], u[lane], v[lane] };
+        }
+        return true;
+    }
+
+    // Front to back traversal, children farther than the closest hit are skipped
+    template<bool AnyHit>
+    void Traverse(const Bvh& bvh, const Ray& ray, RayHit& hit)
+    {
+        if (bvh.nodes.empty())
+            return;
+
+        // Large inverses instead of infinities for axis aligned rays (no 0 * inf in the slab test)
+        float3 invDirection;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float d = ray.direction.e[axis];
+            invDirection.e[axis] = 1.f / (calc::Abs(d) > 1e-20f ? d : (d < 0.f ? -1e-20f : 1e-20f));
+        }
+
+        if (IntersectBox(bvh.nodes[0], ray.origin, invDirection, hit.distance) == FLT_MAX)
+            return;
+
+        struct StackEntry
+        {
+            int node;
+            float distance;
+        };
+        StackEntry stack[BVH_MAX_DEPTH];
+        int stackSize = 0;
+        int nodeIndex = 0;
+        while (true)
+        {
+            const BvhNode& node = bvh.nodes[nodeIndex];
+            if (node.count > 0)
+            {
+                int packCount = (node.count + 3) / 4;
+                for (int p = 0; p < packCount; ++p)
+                {
+                    int pack = node.first + p;
+                    if (IntersectPack(bvh.packs[pack], &bvh.packTriangles[(size_t)pack * 4], ray, hit) && AnyHit)
+                        return;
+                }
+            }
+            else
+            {
+                float leftDistance  = IntersectBox(bvh.nodes[node.first + 0], ray.origin, invDirection, hit.distance);
+                float rightDistance = IntersectBox(bvh.nodes[node.first + 1], ray.origin, invDirection, hit.distance);
+                if (leftDistance != FLT_MAX || rightDistance != FLT_MAX)
+                {
+                    bool leftFirst = leftDistance <= rightDistance;
+                    float farDistance = leftFirst ? rightDistance : leftDistance;
+                    if (farDistance != FLT_MAX)
+                    {
+                        assert(stackSize < BVH_MAX_DEPTH);
+                        stack[stackSize++] = { leftFirst ? node.first + 1 : node.first, farDistance };
+                    }
+                    nodeIndex = leftFirst ? node.first : node.first + 1;
+                    continue;
+                }
+            }
+
+            // Pop the next node that the ray enters before the closest hit
+            do
+            {
+                if (stackSize == 0)
+                    return;
+                --stackSize;
+            } while (stack[stackSize].distance > hit.distance);
+            nodeIndex = stack[stackSize].node;
+        }
+    }
+}
+
+Bvh bvh::Build(float3Strided positions, const unsigned int* indices, int indexCount, int maxLeafSize, bool parallel)
+{
+    Bvh bvh;
+    int triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return bvh;
+
+    auto getPosition = [&positions, indices](int i)
+    {
+        return *(const float3*)(positions.data + (size_t)indices[i] * positions.stride);
+    };
+
+    BuildContext context;
+    context.triangleBounds.resize(triangleCount);
+    context.centroids.resize(triangleCount);
+    context.order.resize(triangleCount);
+    context.maxLeafSize = calc::Max(maxLeafSize, 1);
+    std::iota(context.order.begin(), context.order.end(), 0);
+
+    auto computeTriangles = [&](int begin, int end)
+    {
+        for (int t = begin; t < end; ++t)
+        {
+            Box box = Box::Empty();
+            for (int c = 0; c < 3; ++c)
+                box.Grow(getPosition(t * 3 + c));
+            context.triangleBounds[t] = box;
+            context.centroids[t] = (box.min + box.max) * 0.5f;
+        }
+    };
+
+    if (parallel)
+        jobs::ParallelFor(triangleCount, BVH_JOB_SIZE, computeTriangles);
+    else
+        computeTriangles(0, triangleCount);
+
+    Box rootBounds = Box::Empty();
+    for (const Box& box : context.triangleBounds)
+        rootBounds.Grow(box);
+    bvh.nodes.push_back({ rootBounds.min, 0, rootBounds.max, 0 });
+
+    // Top nodes first, then the subtrees below them built in parallel into their own arrays
+    std::vector<BuildTask> subtrees;
+    BuildNodes(context, bvh.nodes, { 0, 0, triangleCount, 0 }, parallel ? &subtrees : nullptr);
+
+    std::vector<std::vector<BvhNode>> subtreeNodes(subtrees.size());
+    jobs::ParallelFor((int)subtrees.size(), 1, [&](int begin, int end)
+    {
+        for (int s = begin; s < end; ++s)
+        {
+            const BuildTask& task = subtrees[s];
+            const BvhNode& root = bvh.nodes[task.node];
+            subtreeNodes[s].push_back({ root.min, 0, root.max, 0 });
+            BuildNodes(context, subtreeNodes[s], { 0, task.begin, task.end, task.depth }, nullptr);
+        }
+    });
+
+    // Subtree roots replace their placeholder, other nodes are appended
+    for (size_t s = 0; s < subtrees.size(); ++s)
+    {
+        int offset = (int)bvh.nodes.size() - 1;
+        for (size_t n = 0; n < subtreeNodes[s].size(); ++n)
+        {
+            BvhNode node = subtreeNodes[s][n];
+            if (node.count == 0)
+                node.first += offset;
+
+            if (n == 0)
+                bvh.nodes[subtrees[s].node] = node;
+            else
+                bvh.nodes.push_back(node);
+        }
+    }
+
+    // Leaves reference packs of 4 triangles instead of the triangle order
+    std::vector<int> leaves;
+    std::vector<int> leafBegins;
+    int packCount = 0;
+    for (int n = 0; n < (int)bvh.nodes.size(); ++n)
+    {
+        BvhNode& node = bvh.nodes[n];
+        if (node.count == 0)
+            continue;
+
+        leaves.push_back(n);
+        leafBegins.push_back(node.first);
+        node.first = packCount;
+        packCount += (node.count + 3) / 4;
+    }
+
+    bvh.packs.resize(packCount);
+    bvh.packTriangles.resize((size_t)packCount * 4);
+    jobs::ParallelFor((int)leaves.size(), 64, [&](int begin, int end)
+    {
+        for (int l = begin; l < end; ++l)
+        {
+            const BvhNode& node = bvh.nodes[leaves[l]];
+            for (int i = 0; i < (node.count + 3) / 4 * 4; ++i)
+            {
+                BvhTrianglePack& pack = bvh.packs[node.first + i / 4];
+                int lane = i % 4;
+                int triangle = i < node.count ? context.order[leafBegins[l] + i] : -1;
+                float3 v0 = {}, e1 = {}, e2 = {};
+                if (triangle >= 0)
+                {
+                    v0 = getPosition(triangle * 3 + 0);
+                    e1 = getPosition(triangle * 3 + 1) - v0;
+                    e2 = getPosition(triangle * 3 + 2) - v0;
+                }
+
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    pack.v0[axis][lane] = v0.e[axis];
+                    pack.e1[axis][lane] = e1.e[axis];
+                    pack.e2[axis][lane] = e2.e[axis];
+                }
+                bvh.packTriangles[(size_t)(node.first + i / 4) * 4 + lane] = triangle;
+            }
+        }
+    });
+
+    return bvh;
+}
+
+RayHit bvh::Intersect(const Bvh& bvh, const Ray& ray)
+{
+    RayHit hit = { -1, ray.maxDistance, 0.f, 0.f };
+    Traverse<false>(bvh, ray, hit);
+    return hit;
+}
+
+bool bvh::Occluded(const Bvh& bvh, const Ray& ray)
+{
+    RayHit hit = { -1, ray.maxDistance, 0.f, 0.f };
+    Traverse<true>(bvh, ray, hit);
+    return hit.triangle >= 0;
+}
+
+void bvh::IntersectRays(const Bvh& bvh, const Ray* rays, RayHit* hits, int count, bool parallel)
+{
+    auto intersectRange = [&](int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+            hits[i] = Intersect(bvh, rays[i]);
+    };
+
+    if (parallel)
+        jobs::ParallelFor(count, BVH_RAY_JOB_SIZE, intersectRange);
+    else
+        intersectRange(0, count);
+}
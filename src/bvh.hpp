@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+
+#include "types.hpp"
+#include "calc_batch.hpp"
+
+struct RayHit
+{
+    int triangle;   // Index of the first index of the triangle / 3, -1 if nothing was hit
+    float distance; // maxDistance of the ray if nothing was hit
+    float u;        // Barycentric coordinates of the second and third vertices
+    float v;
+};
+
+// Flattened node (32 bytes), the children of an inner node are stored next to each other
+struct BvhNode
+{
+    float3 min;
+    int first; // First child for inner nodes, first triangle pack for leaves
+    float3 max;
+    int count; // Triangle count for leaves (packed by 4), 0 for inner nodes
+};
+
+// 4 triangles as their first vertex and the 2 edges leaving it, one SIMD lane per triangle
+// Unused lanes have null edges and are never hit
+struct BvhTrianglePack
+{
+    float v0[3][4];
+    float e1[3][4];
+    float e2[3][4];
+};
+
+// Bounding volume hierarchy over an indexed triangle list, nodes[0] is the root
+struct Bvh
+{
+    std::vector<BvhNode> nodes;
+    std::vector<BvhTrianglePack> packs;
+    std::vector<int> packTriangles; // Triangle of each lane, -1 for unused lanes
+};
+
+// Ray queries against triangles (SIMD when available), triangles are hit from both sides
+namespace bvh
+{
+    // Binned SAH build, with parallel binning of the large top nodes then one job per subtree if parallel is true
+    // Leaves hold at most maxLeafSize triangles unless the triangles cannot be split further
+    Bvh Build(float3Strided positions, const unsigned int* indices, int indexCount, int maxLeafSize = 8, bool parallel = true);
+
+    // Closest hit along the ray
+    RayHit Intersect(const Bvh& bvh, const Ray& ray);
+
+    // Return true as soon as any triangle is hit (e.g. shadow rays)
+    bool Occluded(const Bvh& bvh, const Ray& ray);
+
+    // Closest hit of each ray, if parallel is true the rays are split across worker threads
+    void IntersectRays(const Bvh& bvh, const Ray* rays, RayHit* hits, int count, bool parallel = true);
+}
@@ -2,16 +2,127 @@
 
 #include <cmath>
 #include "types.hpp"
+#include "calc_simd.hpp"
+
+// True when evaluated by the compiler, lets constexpr functions switch to a constexpr friendly implementation
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_is_constant_evaluated)
+#define CALC_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#endif
+#elif defined(_MSC_VER) && _MSC_VER >= 1925
+#define CALC_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#endif
+
+#ifndef CALC_CONSTANT_EVALUATED
+#define CALC_CONSTANT_EVALUATED() false
+#endif
 
 namespace calc
 {
-    const float TAU = 6.28318530717f;
+    constexpr float TAU = 6.28318530717f;
 
-    inline float Cos(float v) { return std::cos(v); }
-    inline float Sin(float v) { return std::sin(v); }
-    inline float Tan(float v) { return std::tan(v); }
+    // Compile time implementations of <cmath> functions
+    // Computed in double precision with series, too slow to be used at runtime
+    namespace ct
+    {
+        constexpr double PI = 3.14159265358979323846;
+        constexpr double LN2 = 0.69314718055994530942;
+
+        constexpr double Sqrt(double x)
+        {
+            if (x <= 0.0)
+                return 0.0;
+
+            double r = x > 1.0 ? x : 1.0;
+            for (int i = 0; i < 64; ++i)
+            {
+                double next = 0.5 * (r + x / r);
+                if (next == r)
+                    break;
+                r = next;
+            }
+            return r;
+        }
+
+        constexpr double Sin(double x)
+        {
+            // Reduce to [-PI, PI]
+            long long k = (long long)(x / (2.0 * PI));
+            x -= (double)k * 2.0 * PI;
+            if (x > PI)  x -= 2.0 * PI;
+            if (x < -PI) x += 2.0 * PI;
+
+            // Taylor series
+            double term = x;
+            double sum = x;
+            for (int i = 1; i < 20; ++i)
+            {
+                term *= -x * x / ((2 * i) * (2 * i + 1));
+                sum += term;
+            }
+            return sum;
+        }
+
+        constexpr double Cos(double x) { return Sin(x + PI / 2.0); }
+        constexpr double Tan(double x) { return Sin(x) / Cos(x); }
+
+        constexpr double Exp(double x)
+        {
+            // exp(x) = 2^k * exp(r) with |r| <= ln2/2
+            long long k = (long long)(x / LN2 + (x >= 0.0 ? 0.5 : -0.5));
+            double r = x - (double)k * LN2;
+
+            double term = 1.0;
+            double sum = 1.0;
+            for (int i = 1; i < 20; ++i)
+            {
+                term *= r / i;
+                sum += term;
+            }
+
+            for (; k > 0; --k) sum *= 2.0;
+            for (; k < 0; ++k) sum *= 0.5;
+            return sum;
+        }
+
+        constexpr double Log(double x)
+        {
+            if (x <= 0.0)
+                return -1e300;
+
+            // log(x) = e * ln2 + log(m) with m in [1, 2)
+            int e = 0;
+            while (x >= 2.0) { x *= 0.5; ++e; }
+            while (x < 1.0)  { x *= 2.0; --e; }
+
+            // log(m) = 2 * atanh((m - 1) / (m + 1))
+            double y = (x - 1.0) / (x + 1.0);
+            double term = y;
+            double sum = 0.0;
+            for (int i = 0; i < 40; ++i)
+            {
+                sum += term / (2 * i + 1);
+                term *= y * y;
+            }
+            return 2.0 * sum + e * LN2;
+        }
+
+        constexpr double Pow(double a, double exp)
+        {
+            return a == 0.0 ? 0.0 : Exp(exp * Log(a));
+        }
+
+        constexpr double SRGBToLinear(double c)
+        {
+            return c <= 0.04045 ? c / 12.92 : Pow((c + 0.055) / 1.055, 2.4);
+        }
+    }
+
+    constexpr float Cos(float v) { return CALC_CONSTANT_EVALUATED() ? (float)ct::Cos(v) : std::cos(v); }
+    constexpr float Sin(float v) { return CALC_CONSTANT_EVALUATED() ? (float)ct::Sin(v) : std::sin(v); }
+    constexpr float Tan(float v) { return CALC_CONSTANT_EVALUATED() ? (float)ct::Tan(v) : std::tan(v); }
 
-    inline int Modulo(int a, int b)
+    constexpr int Modulo(int a, int b)
     {
         int r = a % b;
         return (r >= 0) ? r : r + b;
@@ -22,124 +133,137 @@ namespace calc
         return std::fmod(a, b);
     }
 
-    inline float Sqrt(float a)
+    constexpr float Sqrt(float a)
     {
-        return std::sqrt(a);
+        return CALC_CONSTANT_EVALUATED() ? (float)ct::Sqrt(a) : std::sqrt(a);
     }
 
-    inline float Pow(float a, float exp)
+    constexpr float Pow(float a, float exp)
     {
-        return std::pow(a, exp);
+        return CALC_CONSTANT_EVALUATED() ? (float)ct::Pow(a, exp) : std::pow(a, exp);
     }
 
-    inline float3 Pow(float3 a, float exp)
+    constexpr float3 Pow(float3 a, float exp)
     {
         return { Pow(a.x, exp), Pow(a.y, exp), Pow(a.z, exp) };
     }
 
     template<typename T>
-    inline T Min(T x, T minValue)
+    constexpr T Min(T x, T minValue)
     {
         return x < minValue ? x : minValue;
     }
 
     template<typename T>
-    inline T Max(T x, T maxValue)
+    constexpr T Max(T x, T maxValue)
     {
         return x > maxValue ? x : maxValue;
     }
 
     template<typename T>
-    inline T Clamp(T x, T minValue, T maxValue)
+    constexpr T Clamp(T x, T minValue, T maxValue)
     {
         return Min(Max(x, minValue), maxValue);
     }
 
+    constexpr float Abs(float x)
+    {
+        return x < 0.f ? -x : x;
+    }
+
     inline float Floor(float x)
     {
         return std::floor(x);
     }
 
+    inline float Acos(float x)
+    {
+        return std::acos(x);
+    }
+
     template<typename T>
-    inline T Lerp(T a, T b, float t)
+    constexpr T Lerp(T a, T b, float t)
     {
         return (1.f - t) * a + t * b;
     }
 
-    inline float ToRadians(float degrees) { return degrees * TAU / 360.f; }
-    inline float ToDegrees(float radians) { return radians * 360.f / TAU; }
+    constexpr float ToRadians(float degrees) { return degrees * TAU / 360.f; }
+    constexpr float ToDegrees(float radians) { return radians * 360.f / TAU; }
 }
 
-inline float2 operator-(float2 a) { return { -a.x, -a.y }; }
-inline float2 operator+(float2 a, float2 b) { return { a.x + b.x, a.y + b.y }; }
-inline float2 operator-(float2 a, float2 b) { return { a.x - b.x, a.y - b.y }; }
-inline float2 operator*(float2 a, float2 b) { return { a.x * b.x, a.y * b.y }; }
-inline float2 operator/(float2 a, float2 b) { return { a.x / b.x, a.y / b.y }; }
-
-inline float2 operator+(float2 a, float b) { return { a.x + b, a.y + b }; }
-inline float2 operator-(float2 a, float b) { return { a.x - b, a.y - b }; }
-inline float2 operator*(float2 a, float b) { return { a.x * b, a.y * b }; }
-inline float2 operator/(float2 a, float b) { return { a.x / b, a.y / b }; }
-
-inline float2& operator+=(float2& a, float2 b) { a = a + b; return a; }
-inline float2& operator-=(float2& a, float2 b) { a = a - b; return a; }
-inline float2& operator*=(float2& a, float2 b) { a = a * b; return a; }
-inline float2& operator/=(float2& a, float2 b) { a = a / b; return a; }
-
-inline float2& operator+=(float2& a, float b) { a = a + b; return a; }
-inline float2& operator-=(float2& a, float b) { a = a - b; return a; }
-inline float2& operator*=(float2& a, float b) { a = a * b; return a; }
-inline float2& operator/=(float2& a, float b) { a = a / b; return a; }
-
-inline float3 operator-(float3 a) { return { -a.x, -a.y, -a.z }; }
-inline float3 operator+(float3 a, float3 b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
-inline float3 operator-(float3 a, float3 b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
-inline float3 operator*(float3 a, float3 b) { return { a.x * b.x, a.y * b.y, a.z * b.z }; }
-inline float3 operator/(float3 a, float3 b) { return { a.x / b.x, a.y / b.y, a.z / b.z }; }
-
-inline float3 operator+(float3 a, float b) { return { a.x + b, a.y + b, a.z + b }; }
-inline float3 operator-(float3 a, float b) { return { a.x - b, a.y - b, a.z - b }; }
-inline float3 operator*(float3 a, float b) { return { a.x * b, a.y * b, a.z * b }; }
-inline float3 operator/(float3 a, float b) { return { a.x / b, a.y / b, a.z / b }; }
-
-inline float3& operator+=(float3& a, float3 b) { a = a + b; return a; }
-inline float3& operator-=(float3& a, float3 b) { a = a - b; return a; }
-inline float3& operator*=(float3& a, float3 b) { a = a * b; return a; }
-inline float3& operator/=(float3& a, float3 b) { a = a / b; return a; }
-
-inline float3& operator+=(float3& a, float b) { a = a + b; return a; }
-inline float3& operator-=(float3& a, float b) { a = a - b; return a; }
-inline float3& operator*=(float3& a, float b) { a = a * b; return a; }
-inline float3& operator/=(float3& a, float b) { a = a / b; return a; }
-
-inline float4 operator/(float4 a, float b) { return { a.x / b, a.y / b, a.z / b, a.w / b }; }
-
-inline float v2Length(float2 v)
+constexpr float2 operator-(float2 a) { return { -a.x, -a.y }; }
+constexpr float2 operator+(float2 a, float2 b) { return { a.x + b.x, a.y + b.y }; }
+constexpr float2 operator-(float2 a, float2 b) { return { a.x - b.x, a.y - b.y }; }
+constexpr float2 operator*(float2 a, float2 b) { return { a.x * b.x, a.y * b.y }; }
+constexpr float2 operator/(float2 a, float2 b) { return { a.x / b.x, a.y / b.y }; }
+
+constexpr float2 operator+(float2 a, float b) { return { a.x + b, a.y + b }; }
+constexpr float2 operator-(float2 a, float b) { return { a.x - b, a.y - b }; }
+constexpr float2 operator*(float2 a, float b) { return { a.x * b, a.y * b }; }
+constexpr float2 operator/(float2 a, float b) { return { a.x / b, a.y / b }; }
+
+constexpr float2& operator+=(float2& a, float2 b) { a = a + b; return a; }
+constexpr float2& operator-=(float2& a, float2 b) { a = a - b; return a; }
+constexpr float2& operator*=(float2& a, float2 b) { a = a * b; return a; }
+constexpr float2& operator/=(float2& a, float2 b) { a = a / b; return a; }
+
+constexpr float2& operator+=(float2& a, float b) { a = a + b; return a; }
+constexpr float2& operator-=(float2& a, float b) { a = a - b; return a; }
+constexpr float2& operator*=(float2& a, float b) { a = a * b; return a; }
+constexpr float2& operator/=(float2& a, float b) { a = a / b; return a; }
+
+constexpr float3 operator-(float3 a) { return { -a.x, -a.y, -a.z }; }
+constexpr float3 operator+(float3 a, float3 b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+constexpr float3 operator-(float3 a, float3 b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+constexpr float3 operator*(float3 a, float3 b) { return { a.x * b.x, a.y * b.y, a.z * b.z }; }
+constexpr float3 operator/(float3 a, float3 b) { return { a.x / b.x, a.y / b.y, a.z / b.z }; }
+
+constexpr float3 operator+(float3 a, float b) { return { a.x + b, a.y + b, a.z + b }; }
+constexpr float3 operator-(float3 a, float b) { return { a.x - b, a.y - b, a.z - b }; }
+constexpr float3 operator*(float3 a, float b) { return { a.x * b, a.y * b, a.z * b }; }
+constexpr float3 operator/(float3 a, float b) { return { a.x / b, a.y / b, a.z / b }; }
+
+constexpr float3& operator+=(float3& a, float3 b) { a = a + b; return a; }
+constexpr float3& operator-=(float3& a, float3 b) { a = a - b; return a; }
+constexpr float3& operator*=(float3& a, float3 b) { a = a * b; return a; }
+constexpr float3& operator/=(float3& a, float3 b) { a = a / b; return a; }
+
+constexpr float3& operator+=(float3& a, float b) { a = a + b; return a; }
+constexpr float3& operator-=(float3& a, float b) { a = a - b; return a; }
+constexpr float3& operator*=(float3& a, float b) { a = a * b; return a; }
+constexpr float3& operator/=(float3& a, float b) { a = a / b; return a; }
+
+constexpr float4 operator+(float4 a, float4 b) { return { a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w }; }
+constexpr float4 operator-(float4 a, float4 b) { return { a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w }; }
+constexpr float4 operator*(float4 a, float b) { return { a.x * b, a.y * b, a.z * b, a.w * b }; }
+constexpr float4 operator/(float4 a, float b) { return { a.x / b, a.y / b, a.z / b, a.w / b }; }
+
+constexpr float v2Length(float2 v)
 {
     return calc::Sqrt(v.x * v.x + v.y * v.y);
 }
 
-inline float v3Length(float3 v)
+constexpr float v3Length(float3 v)
 {
     return calc::Sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
 }
 
-inline float3 v3Normalize(float3 v)
+constexpr float3 v3Normalize(float3 v)
 {
     return v / v3Length(v);
 }
 
-inline float3 v3Cross(float3 a, float3 b)
+constexpr float3 v3Cross(float3 a, float3 b)
 {
     return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
 }
 
-inline float v3Dot(float3 a, float3 b)
+constexpr float v3Dot(float3 a, float3 b)
 {
     return a.x * b.x + a.y * b.y + a.z * b.z;
 }
 
-inline mat4 mat4Identity()
+constexpr mat4 mat4Identity()
 {
     return
     {
@@ -150,7 +274,7 @@ inline mat4 mat4Identity()
     };
 }
 
-inline mat4 mat4Scale(float s)
+constexpr mat4 mat4Scale(float s)
 {
     return
     {
@@ -161,7 +285,7 @@ inline mat4 mat4Scale(float s)
     };
 }
 
-inline mat4 mat4Scale(float3 s)
+constexpr mat4 mat4Scale(float3 s)
 {
     return
     {
@@ -172,7 +296,7 @@ inline mat4 mat4Scale(float3 s)
     };
 }
 
-inline mat4 mat4Translate(float3 t)
+constexpr mat4 mat4Translate(float3 t)
 {
     return
     {
@@ -183,7 +307,7 @@ inline mat4 mat4Translate(float3 t)
     };
 }
 
-inline mat4 mat4RotateX(float radians)
+constexpr mat4 mat4RotateX(float radians)
 {
     float c = calc::Cos(radians);
     float s = calc::Sin(radians);
@@ -196,7 +320,7 @@ inline mat4 mat4RotateX(float radians)
     };
 }
 
-inline mat4 mat4RotateY(float radians)
+constexpr mat4 mat4RotateY(float radians)
 {
     float c = calc::Cos(radians);
     float s = calc::Sin(radians);
@@ -209,7 +333,7 @@ inline mat4 mat4RotateY(float radians)
     };
 }
 
-inline mat4 mat4RotateZ(float radians)
+constexpr mat4 mat4RotateZ(float radians)
 {
     float c = calc::Cos(radians);
     float s = calc::Sin(radians);
@@ -222,145 +346,220 @@ inline mat4 mat4RotateZ(float radians)
     };
 }
 
-inline mat4 mat4FromQuat(quat q)
+constexpr mat4 mat4FromQuat(quat q)
 {
-    mat4 m = {};
-    float a = q.e[3];
-    float b = q.e[0];
-    float c = q.e[1];
-    float d = q.e[2];
+    float a = q.w;
+    float b = q.x;
+    float c = q.y;
+    float d = q.z;
     float a2 = a*a;
     float b2 = b*b;
     float c2 = c*c;
     float d2 = d*d;
 
-    m.c[0].e[0] = a2 + b2 - c2 - d2;
-    m.c[0].e[1] = 2.f*(b*c + a*d);
-    m.c[0].e[2] = 2.f*(b*d - a*c);
-    m.c[0].e[3] = 0.f;
-
-    m.c[1].e[0] = 2*(b*c - a*d);
-    m.c[1].e[1] = a2 - b2 + c2 - d2;
-    m.c[1].e[2] = 2.f*(c*d + a*b);
-    m.c[1].e[3] = 0.f;
-
-    m.c[2].e[0] = 2.f*(b*d + a*c);
-    m.c[2].e[1] = 2.f*(c*d - a*b);
-    m.c[2].e[2] = a2 - b2 - c2 + d2;
-    m.c[2].e[3] = 0.f;
-
-    m.c[3].e[0] = m.c[3].e[1] = m.c[3].e[2] = 0.f;
-    m.c[3].e[3] = 1.f;
-    return m;
+    return
+    {
+        a2 + b2 - c2 - d2,  2.f*(b*c + a*d),    2.f*(b*d - a*c),    0.f,
+        2.f*(b*c - a*d),    a2 - b2 + c2 - d2,  2.f*(c*d + a*b),    0.f,
+        2.f*(b*d + a*c),    2.f*(c*d - a*b),    a2 - b2 - c2 + d2,  0.f,
+        0.f,                0.f,                0.f,                1.f,
+    };
 }
 
-inline mat4 mat4Transpose(const mat4& m)
+constexpr mat4 mat4Transpose(const mat4& m)
 {
     return {
-        m.c[0].e[0], m.c[1].e[0], m.c[2].e[0], m.c[3].e[0],
-        m.c[0].e[1], m.c[1].e[1], m.c[2].e[1], m.c[3].e[1],
-        m.c[0].e[2], m.c[1].e[2], m.c[2].e[2], m.c[3].e[2],
-        m.c[0].e[3], m.c[1].e[3], m.c[2].e[3], m.c[3].e[3],
+        m.e[0], m.e[4], m.e[8],  m.e[12],
+        m.e[1], m.e[5], m.e[9],  m.e[13],
+        m.e[2], m.e[6], m.e[10], m.e[14],
+        m.e[3], m.e[7], m.e[11], m.e[15],
     };
 }
 
-inline mat4 operator*(const mat4& a, const mat4& b)
+// Scalar reference implementations (used when SIMD is not available and at compile time)
+// Matrices are accessed through e[] only to stay usable in constant expressions
+namespace calc
 {
-    mat4 res = {};
-    for (int c = 0; c < 4; ++c)
-        for (int r = 0; r < 4; ++r)
-            for (int k = 0; k < 4; ++k)
-                res.c[c].e[r] += a.c[k].e[r] * b.c[c].e[k];
-    return res;
-}
+namespace scalar
+{
+    constexpr mat4 Mat4Mul(const mat4& a, const mat4& b)
+    {
+        mat4 res = {};
+        for (int c = 0; c < 4; ++c)
+            for (int r = 0; r < 4; ++r)
+                for (int k = 0; k < 4; ++k)
+                    res.e[c * 4 + r] += a.e[k * 4 + r] * b.e[c * 4 + k];
+        return res;
+    }
 
-inline mat4& operator*=(mat4& a, const mat4& b) { a = a * b; return a; }
+    constexpr float4 Mat4MulVec(const mat4& m, float4 v)
+    {
+        return
+        {
+            v.x * m.e[0] + v.y * m.e[4] + v.z * m.e[8]  + v.w * m.e[12],
+            v.x * m.e[1] + v.y * m.e[5] + v.z * m.e[9]  + v.w * m.e[13],
+            v.x * m.e[2] + v.y * m.e[6] + v.z * m.e[10] + v.w * m.e[14],
+            v.x * m.e[3] + v.y * m.e[7] + v.z * m.e[11] + v.w * m.e[15],
+        };
+    }
 
-inline float4 operator*(const mat4& m, float4 v)
-{
-    float4 r;
-    r.x = v.x * m.c[0].e[0] + v.y * m.c[1].e[0] + v.z * m.c[2].e[0] + v.w * m.c[3].e[0];
-    r.y = v.x * m.c[0].e[1] + v.y * m.c[1].e[1] + v.z * m.c[2].e[1] + v.w * m.c[3].e[1];
-    r.z = v.x * m.c[0].e[2] + v.y * m.c[1].e[2] + v.z * m.c[2].e[2] + v.w * m.c[3].e[2];
-    r.w = v.x * m.c[0].e[3] + v.y * m.c[1].e[3] + v.z * m.c[2].e[3] + v.w * m.c[3].e[3];
-    return r;
+    constexpr mat4 Mat4Inverse(const mat4& m)
+    {
+        // m.e[c * 4 + r]
+        const float s[6] =
+        {
+            m.e[0] * m.e[5] - m.e[4] * m.e[1],
+            m.e[0] * m.e[6] - m.e[4] * m.e[2],
+            m.e[0] * m.e[7] - m.e[4] * m.e[3],
+            m.e[1] * m.e[6] - m.e[5] * m.e[2],
+            m.e[1] * m.e[7] - m.e[5] * m.e[3],
+            m.e[2] * m.e[7] - m.e[6] * m.e[3],
+        };
+
+        const float c[6] =
+        {
+            m.e[8]  * m.e[13] - m.e[12] * m.e[9],
+            m.e[8]  * m.e[14] - m.e[12] * m.e[10],
+            m.e[8]  * m.e[15] - m.e[12] * m.e[11],
+            m.e[9]  * m.e[14] - m.e[13] * m.e[10],
+            m.e[9]  * m.e[15] - m.e[13] * m.e[11],
+            m.e[10] * m.e[15] - m.e[14] * m.e[11],
+        };
+
+        // assuming it is invertible
+        float invdet = 1.0f / (s[0] * c[5] - s[1] * c[4] + s[2] * c[3] + s[3] * c[2] - s[4] * c[1] + s[5] * c[0]);
+
+        return
+        {
+            +(m.e[5]  * c[5] - m.e[6]  * c[4] + m.e[7]  * c[3]) * invdet,
+            -(m.e[1]  * c[5] - m.e[2]  * c[4] + m.e[3]  * c[3]) * invdet,
+            +(m.e[13] * s[5] - m.e[14] * s[4] + m.e[15] * s[3]) * invdet,
+            -(m.e[9]  * s[5] - m.e[10] * s[4] + m.e[11] * s[3]) * invdet,
+
+            -(m.e[4]  * c[5] - m.e[6]  * c[2] + m.e[7]  * c[1]) * invdet,
+            +(m.e[0]  * c[5] - m.e[2]  * c[2] + m.e[3]  * c[1]) * invdet,
+            -(m.e[12] * s[5] - m.e[14] * s[2] + m.e[15] * s[1]) * invdet,
+            +(m.e[8]  * s[5] - m.e[10] * s[2] + m.e[11] * s[1]) * invdet,
+
+            +(m.e[4]  * c[4] - m.e[5]  * c[2] + m.e[7]  * c[0]) * invdet,
+            -(m.e[0]  * c[4] - m.e[1]  * c[2] + m.e[3]  * c[0]) * invdet,
+            +(m.e[12] * s[4] - m.e[13] * s[2] + m.e[15] * s[0]) * invdet,
+            -(m.e[8]  * s[4] - m.e[9]  * s[2] + m.e[11] * s[0]) * invdet,
+
+            -(m.e[4]  * c[3] - m.e[5]  * c[1] + m.e[6]  * c[0]) * invdet,
+            +(m.e[0]  * c[3] - m.e[1]  * c[1] + m.e[2]  * c[0]) * invdet,
+            -(m.e[12] * s[3] - m.e[13] * s[1] + m.e[14] * s[0]) * invdet,
+            +(m.e[8]  * s[3] - m.e[9]  * s[1] + m.e[10] * s[0]) * invdet,
+        };
+    }
 }
 
-inline mat4 mat4Perspective(float yFov, float aspect, float n, float f)
+#ifdef CALC_SIMD_SSE
+namespace simd
 {
-    mat4 m;
-    float const a = 1.f / calc::Tan(yFov / 2.f);
-
-    m.c[0].e[0] = a / aspect;
-    m.c[0].e[1] = 0.f;
-    m.c[0].e[2] = 0.f;
-    m.c[0].e[3] = 0.f;
-
-    m.c[1].e[0] = 0.f;
-    m.c[1].e[1] = a;
-    m.c[1].e[2] = 0.f;
-    m.c[1].e[3] = 0.f;
+    inline mat4 Mat4Mul(const mat4& a, const mat4& b)
+    {
+        mat4 res;
+        Mat4Mul<false>(res.e, a.e, b.e);
+        return res;
+    }
 
-    m.c[2].e[0] = 0.f;
-    m.c[2].e[1] = 0.f;
-    m.c[2].e[2] = -((f + n) / (f - n));
-    m.c[2].e[3] = -1.f;
+    inline float4 Mat4MulVec(const mat4& m, float4 v)
+    {
+        float4 res;
+        Mat4MulVec<false>(res.e, m.e, v.e);
+        return res;
+    }
 
-    m.c[3].e[0] = 0.f;
-    m.c[3].e[1] = 0.f;
-    m.c[3].e[2] = -((2.f * f * n) / (f - n));
-    m.c[3].e[3] = 0.f;
+    inline mat4 Mat4Inverse(const mat4& m)
+    {
+        mat4 res;
+        Mat4Inverse<false>(res.e, m.e);
+        return res;
+    }
+}
+#endif
+}
 
-    return m;
+constexpr mat4 operator*(const mat4& a, const mat4& b)
+{
+#ifdef CALC_SIMD_SSE
+    if (!CALC_CONSTANT_EVALUATED())
+        return calc::simd::Mat4Mul(a, b);
+#endif
+    return calc::scalar::Mat4Mul(a, b);
 }
 
+constexpr mat4& operator*=(mat4& a, const mat4& b) { a = a * b; return a; }
 
-inline mat4 mat4Inverse(const mat4& m)
+constexpr float4 operator*(const mat4& m, float4 v)
 {
-    float s[6];
-    s[0] = m.c[0].e[0] * m.c[1].e[1] - m.c[1].e[0] * m.c[0].e[1];
-    s[1] = m.c[0].e[0] * m.c[1].e[2] - m.c[1].e[0] * m.c[0].e[2];
-    s[2] = m.c[0].e[0] * m.c[1].e[3] - m.c[1].e[0] * m.c[0].e[3];
-    s[3] = m.c[0].e[1] * m.c[1].e[2] - m.c[1].e[1] * m.c[0].e[2];
-    s[4] = m.c[0].e[1] * m.c[1].e[3] - m.c[1].e[1] * m.c[0].e[3];
-    s[5] = m.c[0].e[2] * m.c[1].e[3] - m.c[1].e[2] * m.c[0].e[3];
+#ifdef CALC_SIMD_SSE
+    if (!CALC_CONSTANT_EVALUATED())
+        return calc::simd::Mat4MulVec(m, v);
+#endif
+    return calc::scalar::Mat4MulVec(m, v);
+}
 
-    float c[6];
-    c[0] = m.c[2].e[0] * m.c[3].e[1] - m.c[3].e[0] * m.c[2].e[1];
-    c[1] = m.c[2].e[0] * m.c[3].e[2] - m.c[3].e[0] * m.c[2].e[2];
-    c[2] = m.c[2].e[0] * m.c[3].e[3] - m.c[3].e[0] * m.c[2].e[3];
-    c[3] = m.c[2].e[1] * m.c[3].e[2] - m.c[3].e[1] * m.c[2].e[2];
-    c[4] = m.c[2].e[1] * m.c[3].e[3] - m.c[3].e[1] * m.c[2].e[3];
-    c[5] = m.c[2].e[2] * m.c[3].e[3] - m.c[3].e[2] * m.c[2].e[3];
+// Aligned variants
+inline mat4a operator*(const mat4a& a, const mat4a& b)
+{
+#ifdef CALC_SIMD_SSE
+    mat4a res;
+    calc::simd::Mat4Mul<true>(res.e, a.e, b.e);
+    return res;
+#else
+    return calc::scalar::Mat4Mul(a.m, b.m);
+#endif
+}
 
-    // assuming it is invertible
-    float invdet = 1.0f / (s[0] * c[5] - s[1] * c[4] + s[2] * c[3] + s[3] * c[2] - s[4] * c[1] + s[5] * c[0]);
+inline mat4a& operator*=(mat4a& a, const mat4a& b) { a = a * b; return a; }
 
-    mat4 r;
-    r.c[0].e[0] = +(m.c[1].e[1] * c[5] - m.c[1].e[2] * c[4] + m.c[1].e[3] * c[3]) * invdet;
-    r.c[0].e[1] = -(m.c[0].e[1] * c[5] - m.c[0].e[2] * c[4] + m.c[0].e[3] * c[3]) * invdet;
-    r.c[0].e[2] = +(m.c[3].e[1] * s[5] - m.c[3].e[2] * s[4] + m.c[3].e[3] * s[3]) * invdet;
-    r.c[0].e[3] = -(m.c[2].e[1] * s[5] - m.c[2].e[2] * s[4] + m.c[2].e[3] * s[3]) * invdet;
+inline float4a operator*(const mat4a& m, const float4a& v)
+{
+#ifdef CALC_SIMD_SSE
+    float4a r;
+    calc::simd::Mat4MulVec<true>(r.e, m.e, v.e);
+    return r;
+#else
+    return calc::scalar::Mat4MulVec(m.m, v.v);
+#endif
+}
 
-    r.c[1].e[0] = -(m.c[1].e[0] * c[5] - m.c[1].e[2] * c[2] + m.c[1].e[3] * c[1]) * invdet;
-    r.c[1].e[1] = +(m.c[0].e[0] * c[5] - m.c[0].e[2] * c[2] + m.c[0].e[3] * c[1]) * invdet;
-    r.c[1].e[2] = -(m.c[3].e[0] * s[5] - m.c[3].e[2] * s[2] + m.c[3].e[3] * s[1]) * invdet;
-    r.c[1].e[3] = +(m.c[2].e[0] * s[5] - m.c[2].e[2] * s[2] + m.c[2].e[3] * s[1]) * invdet;
+constexpr mat4 mat4Perspective(float yFov, float aspect, float n, float f)
+{
+    float const a = 1.f / calc::Tan(yFov / 2.f);
 
-    r.c[2].e[0] = +(m.c[1].e[0] * c[4] - m.c[1].e[1] * c[2] + m.c[1].e[3] * c[0]) * invdet;
-    r.c[2].e[1] = -(m.c[0].e[0] * c[4] - m.c[0].e[1] * c[2] + m.c[0].e[3] * c[0]) * invdet;
-    r.c[2].e[2] = +(m.c[3].e[0] * s[4] - m.c[3].e[1] * s[2] + m.c[3].e[3] * s[0]) * invdet;
-    r.c[2].e[3] = -(m.c[2].e[0] * s[4] - m.c[2].e[1] * s[2] + m.c[2].e[3] * s[0]) * invdet;
+    return
+    {
+        a / aspect, 0.f, 0.f,                          0.f,
+        0.f,        a,   0.f,                          0.f,
+        0.f,        0.f, -((f + n) / (f - n)),         -1.f,
+        0.f,        0.f, -((2.f * f * n) / (f - n)),   0.f,
+    };
+}
 
-    r.c[3].e[0] = -(m.c[1].e[0] * c[3] - m.c[1].e[1] * c[1] + m.c[1].e[2] * c[0]) * invdet;
-    r.c[3].e[1] = +(m.c[0].e[0] * c[3] - m.c[0].e[1] * c[1] + m.c[0].e[2] * c[0]) * invdet;
-    r.c[3].e[2] = -(m.c[3].e[0] * s[3] - m.c[3].e[1] * s[1] + m.c[3].e[2] * s[0]) * invdet;
-    r.c[3].e[3] = +(m.c[2].e[0] * s[3] - m.c[2].e[1] * s[1] + m.c[2].e[2] * s[0]) * invdet;
+constexpr mat4 mat4Inverse(const mat4& m)
+{
+#ifdef CALC_SIMD_SSE
+    if (!CALC_CONSTANT_EVALUATED())
+        return calc::simd::Mat4Inverse(m);
+#endif
+    return calc::scalar::Mat4Inverse(m);
+}
 
+inline mat4a mat4Inverse(const mat4a& m)
+{
+#ifdef CALC_SIMD_SSE
+    mat4a r;
+    calc::simd::Mat4Inverse<true>(r.e, m.e);
     return r;
+#else
+    return calc::scalar::Mat4Inverse(m.m);
+#endif
 }
 
-inline mat3 mat3Identity()
+constexpr mat3 mat3Identity()
 {
     return
     {
@@ -370,16 +569,16 @@ inline mat3 mat3Identity()
     };
 }
 
-inline mat3 mat3Transpose(const mat3& m)
+constexpr mat3 mat3Transpose(const mat3& m)
 {
     return {
-        m.c[0].e[0], m.c[1].e[0], m.c[2].e[0],
-        m.c[0].e[1], m.c[1].e[1], m.c[2].e[1],
-        m.c[0].e[2], m.c[1].e[2], m.c[2].e[2],
+        m.e[0], m.e[3], m.e[6],
+        m.e[1], m.e[4], m.e[7],
+        m.e[2], m.e[5], m.e[8],
     };
 }
 
-inline mat3 mat3Translate(float2 t)
+constexpr mat3 mat3Translate(float2 t)
 {
     return
     {
@@ -389,7 +588,7 @@ inline mat3 mat3Translate(float2 t)
     };
 }
 
-inline mat3 mat3Rotate(float radians)
+constexpr mat3 mat3Rotate(float radians)
 {
     float c = calc::Cos(radians);
     float s = calc::Sin(radians);
@@ -401,28 +600,29 @@ inline mat3 mat3Rotate(float radians)
     };
 }
 
-inline mat3 operator*(const mat3& a, const mat3& b)
+constexpr mat3 operator*(const mat3& a, const mat3& b)
 {
     mat3 res = {};
     for (int c = 0; c < 3; ++c)
         for (int r = 0; r < 3; ++r)
             for (int k = 0; k < 3; ++k)
-                res.c[c].e[r] += a.c[k].e[r] * b.c[c].e[k];
+                res.e[c * 3 + r] += a.e[k * 3 + r] * b.e[c * 3 + k];
     return res;
 }
 
-inline mat3& operator*=(mat3& a, const mat3& b) { a = a * b; return a; }
+constexpr mat3& operator*=(mat3& a, const mat3& b) { a = a * b; return a; }
 
-inline float3 operator*(const mat3& m, float3 v)
+constexpr float3 operator*(const mat3& m, float3 v)
 {
-    float3 r;
-    r.x = v.x * m.c[0].e[0] + v.y * m.c[1].e[0] + v.z * m.c[2].e[0];
-    r.y = v.x * m.c[0].e[1] + v.y * m.c[1].e[1] + v.z * m.c[2].e[1];
-    r.z = v.x * m.c[0].e[2] + v.y * m.c[1].e[2] + v.z * m.c[2].e[2];
-    return r;
+    return
+    {
+        v.x * m.e[0] + v.y * m.e[3] + v.z * m.e[6],
+        v.x * m.e[1] + v.y * m.e[4] + v.z * m.e[7],
+        v.x * m.e[2] + v.y * m.e[5] + v.z * m.e[8],
+    };
 }
 
-inline mat3 operator*(float s, const mat3& m)
+constexpr mat3 operator*(float s, const mat3& m)
 {
     mat3 res = m;
     for (int i = 0; i < ARRAYSIZE(res.e); ++i)
@@ -430,14 +630,14 @@ inline mat3 operator*(float s, const mat3& m)
     return res;
 }
 
-inline mat3 operator+(const mat3& a, const mat3& b)
+constexpr mat3 operator+(const mat3& a, const mat3& b)
 {
     mat3 res = {};
     for (int i = 0; i < ARRAYSIZE(res.e); ++i)
         res.e[i] = a.e[i] + b.e[i];
     return res;
 }
-inline mat3 operator+=(mat3& a, const mat3& b) { a = a + b; return a; }
+constexpr mat3 operator+=(mat3& a, const mat3& b) { a = a + b; return a; }
 
 #ifdef USE_CALC_EXT
 #include "calc_ext.hpp"
@@ -0,0 +1,230 @@
+#include "calc.hpp"
+#include "jobs.hpp"
+
+#include "calc_batch.hpp"
+
+// Elements processed per job when running in parallel
+#define BATCH_JOB_SIZE 16384
+
+namespace
+{
+    struct SoAStream
+    {
+        float3SoA s;
+
+        void Load(int i, float& x, float& y, float& z) const { x = s.x[i]; y = s.y[i]; z = s.z[i]; }
+        void Store(int i, float x, float y, float z) const  { s.x[i] = x; s.y[i] = y; s.z[i] = z; }
+
+#ifdef CALC_SIMD_SSE
+        void Load4(int i, __m128& x, __m128& y, __m128& z) const
+        {
+            x = _mm_loadu_ps(s.x + i);
+            y = _mm_loadu_ps(s.y + i);
+            z = _mm_loadu_ps(s.z + i);
+        }
+
+        void Store4(int i, __m128 x, __m128 y, __m128 z) const
+        {
+            _mm_storeu_ps(s.x + i, x);
+            _mm_storeu_ps(s.y + i, y);
+            _mm_storeu_ps(s.z + i, z);
+        }
+#endif
+    };
+
+    struct StridedStream
+    {
+        float3Strided s;
+
+        float* At(int i) const { return (float*)(s.data + (size_t)i * s.stride); }
+
+        void Load(int i, float& x, float& y, float& z) const { const float* p = At(i); x = p[0]; y = p[1]; z = p[2]; }
+        void Store(int i, float x, float y, float z) const  { float* p = At(i); p[0] = x; p[1] = y; p[2] = z; }
+
+#ifdef CALC_SIMD_SSE
+        // Gather/scatter 4 elements, then transposed to SoA registers
+        void Load4(int i, __m128& x, __m128& y, __m128& z) const
+        {
+            const float* p0 = At(i + 0);
+            const float* p1 = At(i + 1);
+            const float* p2 = At(i + 2);
+            const float* p3 = At(i + 3);
+            x = _mm_setr_ps(p0[0], p1[0], p2[0], p3[0]);
+            y = _mm_setr_ps(p0[1], p1[1], p2[1], p3[1]);
+            z = _mm_setr_ps(p0[2], p1[2], p2[2], p3[2]);
+        }
+
+        void Store4(int i, __m128 x, __m128 y, __m128 z) const
+        {
+            alignas(16) float xs[4];
+            alignas(16) float ys[4];
+            alignas(16) float zs[4];
+            _mm_store_ps(xs, x);
+            _mm_store_ps(ys, y);
+            _mm_store_ps(zs, z);
+            for (int j = 0; j < 4; ++j)
+                Store(i + j, xs[j], ys[j], zs[j]);
+        }
+#endif
+    };
+
+    // Operations, each one has a scalar and a 4 wide version
+    struct TransformPointsOp
+    {
+        mat4 m;
+
+        void operator()(float& x, float& y, float& z) const
+        {
+            float rx = m.e[0] * x + m.e[4] * y + m.e[8]  * z + m.e[12];
+            float ry = m.e[1] * x + m.e[5] * y + m.e[9]  * z + m.e[13];
+            float rz = m.e[2] * x + m.e[6] * y + m.e[10] * z + m.e[14];
+            x = rx; y = ry; z = rz;
+        }
+
+#ifdef CALC_SIMD_SSE
+        void operator()(__m128& x, __m128& y, __m128& z) const
+        {
+            __m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m.e[0]), x), _mm_mul_ps(_mm_set1_ps(m.e[4]), y)), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m.e[8]),  z), _mm_set1_ps(m.e[12])));
+            __m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m.e[1]), x), _mm_mul_ps(_mm_set1_ps(m.e[5]), y)), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m.e[9]),  z), _mm_set1_ps(m.e[13])));
+            __m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m.e[2]), x), _mm_mul_ps(_mm_set1_ps(m.e[6]), y)), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m.e[10]), z), _mm_set1_ps(m.e[14])));
+            x = rx; y = ry; z = rz;
+        }
+#endif
+    };
+
+    struct TransformNormalsOp
+    {
+        mat4 m;
+
+        void operator()(float& x, float& y, float& z) const
+        {
+            float rx = m.e[0] * x + m.e[4] * y + m.e[8]  * z;
+            float ry = m.e[1] * x + m.e[5] * y + m.e[9]  * z;
+            float rz = m.e[2] * x + m.e[6] * y + m.e[10] * z;
+            x = rx; y = ry; z = rz;
+        }
+
+#ifdef CALC_SIMD_SSE
+        void operator()(__m128& x, __m128& y, __m128& z) const
+        {
+            __m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m.e[0]), x), _mm_mul_ps(_mm_set1_ps(m.e[4]), y)), _mm_mul_ps(_mm_set1_ps(m.e[8]),  z));
+            __m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m.e[1]), x), _mm_mul_ps(_mm_set1_ps(m.e[5]), y)), _mm_mul_ps(_mm_set1_ps(m.e[9]),  z));
+            __m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m.e[2]), x), _mm_mul_ps(_mm_set1_ps(m.e[6]), y)), _mm_mul_ps(_mm_set1_ps(m.e[10]), z));
+            x = rx; y = ry; z = rz;
+        }
+#endif
+    };
+
+    struct NormalizeOp
+    {
+        void operator()(float& x, float& y, float& z) const
+        {
+            float invLength = 1.f / calc::Sqrt(x * x + y * y + z * z);
+            x *= invLength; y *= invLength; z *= invLength;
+        }
+
+#ifdef CALC_SIMD_SSE
+        void operator()(__m128& x, __m128& y, __m128& z) const
+        {
+            __m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+            __m128 invLength = _mm_div_ps(_mm_set1_ps(1.f), _mm_sqrt_ps(lengthSq));
+            x = _mm_mul_ps(x, invLength);
+            y = _mm_mul_ps(y, invLength);
+            z = _mm_mul_ps(z, invLength);
+        }
+#endif
+    };
+
+    struct ScaleBiasOp
+    {
+        float3 scale;
+        float3 bias;
+
+        void operator()(float& x, float& y, float& z) const
+        {
+            x = x * scale.x + bias.x;
+            y = y * scale.y + bias.y;
+            z = z * scale.z + bias.z;
+        }
+
+#ifdef CALC_SIMD_SSE
+        void operator()(__m128& x, __m128& y, __m128& z) const
+        {
+            x = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(scale.x)), _mm_set1_ps(bias.x));
+            y = _mm_add_ps(_mm_mul_ps(y, _mm_set1_ps(scale.y)), _mm_set1_ps(bias.y));
+            z = _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(scale.z)), _mm_set1_ps(bias.z));
+        }
+#endif
+    };
+
+    template<typename Op, typename Stream>
+    void RunRange(const Op& op, const Stream& dst, const Stream& src, int begin, int end)
+    {
+        int i = begin;
+#ifdef CALC_SIMD_SSE
+        for (; i + 4 <= end; i += 4)
+        {
+            __m128 x, y, z;
+            src.Load4(i, x, y, z);
+            op(x, y, z);
+            dst.Store4(i, x, y, z);
+        }
+#endif
+        for (; i < end; ++i)
+        {
+            float x, y, z;
+            src.Load(i, x, y, z);
+            op(x, y, z);
+            dst.Store(i, x, y, z);
+        }
+    }
+
+    template<typename Op, typename Stream>
+    void Run(const Op& op, const Stream& dst, const Stream& src, int count, bool parallel)
+    {
+        if (parallel)
+            jobs::ParallelFor(count, BATCH_JOB_SIZE, [&](int begin, int end) { RunRange(op, dst, src, begin, end); });
+        else
+            RunRange(op, dst, src, 0, count);
+    }
+}
+
+void calc::batch::TransformPoints(const mat4& m, float3SoA dst, float3SoA src, int count, bool parallel)
+{
+    Run(TransformPointsOp{ m }, SoAStream{ dst }, SoAStream{ src }, count, parallel);
+}
+
+void calc::batch::TransformPoints(const mat4& m, float3Strided dst, float3Strided src, int count, bool parallel)
+{
+    Run(TransformPointsOp{ m }, StridedStream{ dst }, StridedStream{ src }, count, parallel);
+}
+
+void calc::batch::TransformNormals(const mat4& m, float3SoA dst, float3SoA src, int count, bool parallel)
+{
+    Run(TransformNormalsOp{ m }, SoAStream{ dst }, SoAStream{ src }, count, parallel);
+}
+
+void calc::batch::TransformNormals(const mat4& m, float3Strided dst, float3Strided src, int count, bool parallel)
+{
+    Run(TransformNormalsOp{ m }, StridedStream{ dst }, StridedStream{ src }, count, parallel);
+}
+
+void calc::batch::Normalize(float3SoA dst, float3SoA src, int count, bool parallel)
+{
+    Run(NormalizeOp{}, SoAStream{ dst }, SoAStream{ src }, count, parallel);
+}
+
+void calc::batch::Normalize(float3Strided dst, float3Strided src, int count, bool parallel)
+{
+    Run(NormalizeOp{}, StridedStream{ dst }, StridedStream{ src }, count, parallel);
+}
+
+void calc::batch::ScaleBias(float3 scale, float3 bias, float3SoA dst, float3SoA src, int count, bool parallel)
+{
+    Run(ScaleBiasOp{ scale, bias }, SoAStream{ dst }, SoAStream{ src }, count, parallel);
+}
+
+void calc::batch::ScaleBias(float3 scale, float3 bias, float3Strided dst, float3Strided src, int count, bool parallel)
+{
+    Run(ScaleBiasOp{ scale, bias }, StridedStream{ dst }, StridedStream{ src }, count, parallel);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "types.hpp"
+
+// Structure of arrays float3 stream
+struct float3SoA
+{
+    float* x;
+    float* y;
+    float* z;
+};
+
+// Interleaved float3 stream (e.g. an attribute inside a vertex buffer)
+struct float3Strided
+{
+    unsigned char* data; // First element
+    int stride;          // Bytes between two elements
+};
+
+inline float3Strided GetVertexStream(void* vertices, int vertexSize, int attributeOffset)
+{
+    return { (unsigned char*)vertices + attributeOffset, vertexSize };
+}
+
+// Batch operations over float3 streams (SIMD when available)
+// dst and src can be the same stream, if parallel is true the work is split across worker threads
+namespace calc
+{
+namespace batch
+{
+    // dst = (m * float4(src, 1)).xyz, m is expected to be affine
+    void TransformPoints(const mat4& m, float3SoA dst, float3SoA src, int count, bool parallel = false);
+    void TransformPoints(const mat4& m, float3Strided dst, float3Strided src, int count, bool parallel = false);
+
+    // dst = (m * float4(src, 0)).xyz, pass the inverse transpose of the model matrix for non uniform scales
+    void TransformNormals(const mat4& m, float3SoA dst, float3SoA src, int count, bool parallel = false);
+    void TransformNormals(const mat4& m, float3Strided dst, float3Strided src, int count, bool parallel = false);
+
+    // dst = normalize(src)
+    void Normalize(float3SoA dst, float3SoA src, int count, bool parallel = false);
+    void Normalize(float3Strided dst, float3Strided src, int count, bool parallel = false);
+
+    // dst = src * scale + bias
+    void ScaleBias(float3 scale, float3 bias, float3SoA dst, float3SoA src, int count, bool parallel = false);
+    void ScaleBias(float3 scale, float3 bias, float3Strided dst, float3Strided src, int count, bool parallel = false);
+}
+}
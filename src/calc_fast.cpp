@@ -0,0 +1,102 @@
+#include "jobs.hpp"
+
+#include "calc_fast.hpp"
+
+// Elements processed per job when running in parallel
+#define FAST_JOB_SIZE 16384
+
+namespace
+{
+    struct SinCosOp
+    {
+        float* sins;
+        float* coss;
+        const float* angles;
+
+        void operator()(int i) const { calc::fast::SinCos(angles[i], &sins[i], &coss[i]); }
+#ifdef CALC_SIMD_SSE
+        void Run4(int i) const
+        {
+            __m128 s, c;
+            calc::fast::SinCos(_mm_loadu_ps(angles + i), &s, &c);
+            _mm_storeu_ps(sins + i, s);
+            _mm_storeu_ps(coss + i, c);
+        }
+#endif
+    };
+
+    struct PowOp
+    {
+        float* dst;
+        const float* src;
+        float exp;
+
+        void operator()(int i) const { dst[i] = calc::fast::Pow(src[i], exp); }
+#ifdef CALC_SIMD_SSE
+        void Run4(int i) const { _mm_storeu_ps(dst + i, calc::fast::Pow(_mm_loadu_ps(src + i), _mm_set1_ps(exp))); }
+#endif
+    };
+
+    struct LinearToSRGBOp
+    {
+        float* dst;
+        const float* src;
+
+        void operator()(int i) const { dst[i] = calc::fast::LinearToSRGB(src[i]); }
+#ifdef CALC_SIMD_SSE
+        void Run4(int i) const { _mm_storeu_ps(dst + i, calc::fast::LinearToSRGB(_mm_loadu_ps(src + i))); }
+#endif
+    };
+
+    struct SRGBToLinearOp
+    {
+        float* dst;
+        const float* src;
+
+        void operator()(int i) const { dst[i] = calc::fast::SRGBToLinear(src[i]); }
+#ifdef CALC_SIMD_SSE
+        void Run4(int i) const { _mm_storeu_ps(dst + i, calc::fast::SRGBToLinear(_mm_loadu_ps(src + i))); }
+#endif
+    };
+
+    template<typename Op>
+    void RunRange(const Op& op, int begin, int end)
+    {
+        int i = begin;
+#ifdef CALC_SIMD_SSE
+        for (; i + 4 <= end; i += 4)
+            op.Run4(i);
+#endif
+        for (; i < end; ++i)
+            op(i);
+    }
+
+    template<typename Op>
+    void Run(const Op& op, int count, bool parallel)
+    {
+        if (parallel)
+            jobs::ParallelFor(count, FAST_JOB_SIZE, [&](int begin, int end) { RunRange(op, begin, end); });
+        else
+            RunRange(op, 0, count);
+    }
+}
+
+void calc::fast::SinCos(float* sins, float* coss, const float* angles, int count, bool parallel)
+{
+    Run(SinCosOp{ sins, coss, angles }, count, parallel);
+}
+
+void calc::fast::Pow(float* dst, const float* src, float exp, int count, bool parallel)
+{
+    Run(PowOp{ dst, src, exp }, count, parallel);
+}
+
+void calc::fast::LinearToSRGB(float* dst, const float* src, int count, bool parallel)
+{
+    Run(LinearToSRGBOp{ dst, src }, count, parallel);
+}
+
+void calc::fast::SRGBToLinear(float* dst, const float* src, int count, bool parallel)
+{
+    Run(SRGBToLinearOp{ dst, src }, count, parallel);
+}
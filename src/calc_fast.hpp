@@ -0,0 +1,264 @@
+#pragma once
+
+#include <cstring>
+
+#include "types.hpp"
+#include "calc_simd.hpp"
+
+// Fast approximations of <cmath> functions, call sites opt in by using calc::fast:: instead of calc::
+// Polynomials come from Cephes, measured max errors (float inputs):
+//   Sin, Cos, SinCos: 1e-7 absolute for |x| < 8192 (range reduction loses precision beyond that)
+//   Exp2:             1e-7 relative, x is clamped to [-126, 128]
+//   Log2:             6e-8 * (1 + |log2(x)|), x must be positive and normalized
+//   Pow:              Exp2(exp * Log2(a)), error grows with |exp * log2(a)|, a <= 0 returns 0
+//   LinearToSRGB, SRGBToLinear: 2e-7 absolute on [0, 1] (exact sRGB curve, not gamma 2.2)
+namespace calc
+{
+namespace fast
+{
+    namespace detail
+    {
+        constexpr float FOPI = 1.27323954473516f; // 4 / PI
+        constexpr float DP1 = 0.78515625f;        // PI / 4 split in 3 parts for an exact range reduction
+        constexpr float DP2 = 2.4187564849853515625e-4f;
+        constexpr float DP3 = 3.77489497744594108e-8f;
+
+        constexpr float SIN_P0 = -1.9515295891e-4f;
+        constexpr float SIN_P1 =  8.3321608736e-3f;
+        constexpr float SIN_P2 = -1.6666654611e-1f;
+        constexpr float COS_P0 =  2.443315711809948e-5f;
+        constexpr float COS_P1 = -1.388731625493765e-3f;
+        constexpr float COS_P2 =  4.166664568298827e-2f;
+
+        constexpr float EXP2_P0 = 1.535336188319500e-4f;
+        constexpr float EXP2_P1 = 1.339887440266574e-3f;
+        constexpr float EXP2_P2 = 9.618437357674640e-3f;
+        constexpr float EXP2_P3 = 5.550332471162809e-2f;
+        constexpr float EXP2_P4 = 2.402264791363012e-1f;
+        constexpr float EXP2_P5 = 6.931472028550421e-1f;
+
+        constexpr float LOG2_P0 =  7.0376836292e-2f;
+        constexpr float LOG2_P1 = -1.1514610310e-1f;
+        constexpr float LOG2_P2 =  1.1676998740e-1f;
+        constexpr float LOG2_P3 = -1.2420140846e-1f;
+        constexpr float LOG2_P4 =  1.4249322787e-1f;
+        constexpr float LOG2_P5 = -1.6668057665e-1f;
+        constexpr float LOG2_P6 =  2.0000714765e-1f;
+        constexpr float LOG2_P7 = -2.4999993993e-1f;
+        constexpr float LOG2_P8 =  3.3333331174e-1f;
+        constexpr float LOG2EA = 0.44269504088896340736f; // log2(e) - 1
+        constexpr float SQRT2 = 1.41421356237f;
+
+        // Polynomials valid on [-PI/4, PI/4]
+        inline float SinPoly(float x, float z) { return ((SIN_P0 * z + SIN_P1) * z + SIN_P2) * z * x + x; }
+        inline float CosPoly(float z)          { return ((COS_P0 * z + COS_P1) * z + COS_P2) * z * z - 0.5f * z + 1.f; }
+
+        inline int   AsInt(float f) { int i;   std::memcpy(&i, &f, sizeof(i)); return i; }
+        inline float AsFloat(int i) { float f; std::memcpy(&f, &i, sizeof(f)); return f; }
+    }
+
+    inline void SinCos(float x, float* s, float* c)
+    {
+        using namespace detail;
+        bool negative = x < 0.f;
+        x = negative ? -x : x;
+
+        // Octant
+        int j = ((int)(x * FOPI) + 1) & ~1;
+        float y = (float)j;
+        x = ((x - y * DP1) - y * DP2) - y * DP3;
+
+        float z = x * x;
+        float sinPoly = SinPoly(x, z);
+        float cosPoly = CosPoly(z);
+        bool swapPoly = (j & 2) != 0;
+        float sinValue = swapPoly ? cosPoly : sinPoly;
+        float cosValue = swapPoly ? sinPoly : cosPoly;
+
+        *s = (negative != ((j & 4) != 0)) ? -sinValue : sinValue;
+        *c = (((j - 2) & 4) == 0) ? -cosValue : cosValue;
+    }
+
+    inline float Sin(float x) { float s, c; SinCos(x, &s, &c); return s; }
+    inline float Cos(float x) { float s, c; SinCos(x, &s, &c); return c; }
+
+    inline float Exp2(float x)
+    {
+        using namespace detail;
+        x = x < -126.f ? -126.f : (x > 128.f ? 128.f : x);
+
+        // x = i + f with f in [-0.5, 0.5]
+        int i = (int)(x + (x < 0.f ? -0.5f : 0.5f));
+        float f = x - (float)i;
+
+        float p = (((((EXP2_P0 * f + EXP2_P1) * f + EXP2_P2) * f + EXP2_P3) * f + EXP2_P4) * f + EXP2_P5) * f + 1.f;
+
+        // 2^i in two steps so i = 128 does not overflow the exponent
+        int half = i / 2;
+        return p * AsFloat((half + 127) << 23) * AsFloat((i - half + 127) << 23);
+    }
+
+    inline float Log2(float x)
+    {
+        using namespace detail;
+
+        // x = m * 2^e with m in [sqrt(2)/2, sqrt(2)]
+        int bits = AsInt(x);
+        float e = (float)((bits >> 23) - 127);
+        float m = AsFloat((bits & 0x007fffff) | 0x3f800000);
+        if (m > SQRT2)
+        {
+            m *= 0.5f;
+            e += 1.f;
+        }
+
+        x = m - 1.f;
+        float z = x * x;
+        float y = x * z * ((((((((LOG2_P0 * x + LOG2_P1) * x + LOG2_P2) * x + LOG2_P3) * x + LOG2_P4) * x + LOG2_P5) * x + LOG2_P6) * x + LOG2_P7) * x + LOG2_P8);
+        y -= 0.5f * z;
+        return y * LOG2EA + x * LOG2EA + y + x + e;
+    }
+
+    inline float Pow(float a, float exp)
+    {
+        return a > 0.f ? Exp2(exp * Log2(a)) : 0.f;
+    }
+
+    inline float3 Pow(float3 a, float exp)
+    {
+        return { Pow(a.x, exp), Pow(a.y, exp), Pow(a.z, exp) };
+    }
+
+    inline float LinearToSRGB(float c)
+    {
+        return c <= 0.0031308f ? c * 12.92f : 1.055f * Pow(c, 1.f / 2.4f) - 0.055f;
+    }
+
+    inline float SRGBToLinear(float c)
+    {
+        return c <= 0.04045f ? c * (1.f / 12.92f) : Pow((c + 0.055f) * (1.f / 1.055f), 2.4f);
+    }
+
+#ifdef CALC_SIMD_SSE
+    // 4 wide versions, same algorithms as above with selects instead of branches
+    inline void SinCos(__m128 x, __m128* s, __m128* c)
+    {
+        using namespace detail;
+        const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000));
+        __m128 signSin = _mm_and_ps(x, signMask);
+        x = _mm_andnot_ps(signMask, x);
+
+        __m128i j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(FOPI)));
+        j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+        __m128 y = _mm_cvtepi32_ps(j);
+
+        __m128 swapSignSin = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(4)), 29));
+        __m128 signCos = _mm_castsi128_ps(_mm_slli_epi32(_mm_andnot_si128(_mm_sub_epi32(j, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+        __m128 swapPoly = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), _mm_set1_epi32(2)));
+        signSin = _mm_xor_ps(signSin, swapSignSin);
+
+        x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(DP1)));
+        x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(DP2)));
+        x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(DP3)));
+        __m128 z = _mm_mul_ps(x, x);
+
+        __m128 cosPoly = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(COS_P0), z), _mm_set1_ps(COS_P1));
+        cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, z), _mm_set1_ps(COS_P2));
+        cosPoly = _mm_mul_ps(_mm_mul_ps(cosPoly, z), z);
+        cosPoly = _mm_add_ps(_mm_sub_ps(cosPoly, _mm_mul_ps(_mm_set1_ps(0.5f), z)), _mm_set1_ps(1.f));
+
+        __m128 sinPoly = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SIN_P0), z), _mm_set1_ps(SIN_P1));
+        sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, z), _mm_set1_ps(SIN_P2));
+        sinPoly = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sinPoly, z), x), x);
+
+        __m128 sinValue = _mm_or_ps(_mm_and_ps(swapPoly, cosPoly), _mm_andnot_ps(swapPoly, sinPoly));
+        __m128 cosValue = _mm_or_ps(_mm_and_ps(swapPoly, sinPoly), _mm_andnot_ps(swapPoly, cosPoly));
+        *s = _mm_xor_ps(sinValue, signSin);
+        *c = _mm_xor_ps(cosValue, signCos);
+    }
+
+    inline __m128 Sin(__m128 x) { __m128 s, c; SinCos(x, &s, &c); return s; }
+    inline __m128 Cos(__m128 x) { __m128 s, c; SinCos(x, &s, &c); return c; }
+
+    inline __m128 Exp2(__m128 x)
+    {
+        using namespace detail;
+        x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-126.f)), _mm_set1_ps(128.f));
+
+        // Rounds to nearest
+        __m128i i = _mm_cvtps_epi32(x);
+        __m128 f = _mm_sub_ps(x, _mm_cvtepi32_ps(i));
+
+        __m128 p = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(EXP2_P0), f), _mm_set1_ps(EXP2_P1));
+        p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(EXP2_P2));
+        p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(EXP2_P3));
+        p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(EXP2_P4));
+        p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(EXP2_P5));
+        p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.f));
+
+        __m128i half = _mm_srai_epi32(i, 1);
+        __m128 scale0 = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(half, _mm_set1_epi32(127)), 23));
+        __m128 scale1 = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_sub_epi32(i, half), _mm_set1_epi32(127)), 23));
+        return _mm_mul_ps(_mm_mul_ps(p, scale0), scale1);
+    }
+
+    inline __m128 Log2(__m128 x)
+    {
+        using namespace detail;
+        __m128i bits = _mm_castps_si128(x);
+        __m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+        __m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f800000)));
+
+        __m128 above = _mm_cmpgt_ps(m, _mm_set1_ps(SQRT2));
+        m = _mm_or_ps(_mm_and_ps(above, _mm_mul_ps(m, _mm_set1_ps(0.5f))), _mm_andnot_ps(above, m));
+        e = _mm_add_ps(e, _mm_and_ps(above, _mm_set1_ps(1.f)));
+
+        x = _mm_sub_ps(m, _mm_set1_ps(1.f));
+        __m128 z = _mm_mul_ps(x, x);
+
+        __m128 y = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(LOG2_P0), x), _mm_set1_ps(LOG2_P1));
+        y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(LOG2_P2));
+        y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(LOG2_P3));
+        y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(LOG2_P4));
+        y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(LOG2_P5));
+        y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(LOG2_P6));
+        y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(LOG2_P7));
+        y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(LOG2_P8));
+        y = _mm_mul_ps(_mm_mul_ps(y, z), x);
+        y = _mm_sub_ps(y, _mm_mul_ps(_mm_set1_ps(0.5f), z));
+
+        __m128 r = _mm_mul_ps(_mm_add_ps(y, x), _mm_set1_ps(LOG2EA));
+        return _mm_add_ps(_mm_add_ps(_mm_add_ps(r, y), x), e);
+    }
+
+    inline __m128 Pow(__m128 a, __m128 exp)
+    {
+        __m128 positive = _mm_cmpgt_ps(a, _mm_setzero_ps());
+        return _mm_and_ps(positive, Exp2(_mm_mul_ps(exp, Log2(a))));
+    }
+
+    inline __m128 LinearToSRGB(__m128 c)
+    {
+        __m128 low = _mm_mul_ps(c, _mm_set1_ps(12.92f));
+        __m128 high = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(1.055f), Pow(c, _mm_set1_ps(1.f / 2.4f))), _mm_set1_ps(0.055f));
+        __m128 isLow = _mm_cmple_ps(c, _mm_set1_ps(0.0031308f));
+        return _mm_or_ps(_mm_and_ps(isLow, low), _mm_andnot_ps(isLow, high));
+    }
+
+    inline __m128 SRGBToLinear(__m128 c)
+    {
+        __m128 low = _mm_mul_ps(c, _mm_set1_ps(1.f / 12.92f));
+        __m128 high = Pow(_mm_mul_ps(_mm_add_ps(c, _mm_set1_ps(0.055f)), _mm_set1_ps(1.f / 1.055f)), _mm_set1_ps(2.4f));
+        __m128 isLow = _mm_cmple_ps(c, _mm_set1_ps(0.04045f));
+        return _mm_or_ps(_mm_and_ps(isLow, low), _mm_andnot_ps(isLow, high));
+    }
+#endif
+
+    // Array versions (SIMD when available), dst and src can be the same array
+    // If parallel is true the work is split across worker threads
+    void SinCos(float* sins, float* coss, const float* angles, int count, bool parallel = false);
+    void Pow(float* dst, const float* src, float exp, int count, bool parallel = false);
+    void LinearToSRGB(float* dst, const float* src, int count, bool parallel = false);
+    void SRGBToLinear(float* dst, const float* src, int count, bool parallel = false);
+}
+}
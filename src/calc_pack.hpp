@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "calc.hpp"
+
+// Conversions to/from compact storage formats (vertex attributes, texels)
+// Normalized formats follow the OpenGL 4.2+ rules: snorm = max(c / (2^(b-1) - 1), -1), unorm = c / (2^b - 1)
+namespace calc
+{
+namespace pack
+{
+    // IEEE half, round to nearest even (from ryg's float_to_half_fast3_rtne)
+    inline uint16_t FloatToHalf(float value)
+    {
+        uint32_t f;
+        std::memcpy(&f, &value, sizeof(f));
+        uint32_t sign = f & 0x80000000u;
+        f ^= sign;
+
+        uint16_t h;
+        if (f >= (uint32_t)(127 + 16) << 23)
+        {
+            // Overflow to infinity, keep NaN
+            h = f > (uint32_t)255 << 23 ? 0x7e00 : 0x7c00;
+        }
+        else if (f < (uint32_t)113 << 23)
+        {
+            // Subnormal, let the float addition do the rounding
+            const uint32_t magicBits = (uint32_t)((127 - 15) + (23 - 10) + 1) << 23;
+            float magic;
+            std::memcpy(&magic, &magicBits, sizeof(magic));
+            float shifted;
+            std::memcpy(&shifted, &f, sizeof(shifted));
+            shifted += magic;
+            std::memcpy(&f, &shifted, sizeof(f));
+            h = (uint16_t)(f - magicBits);
+        }
+        else
+        {
+            uint32_t mantissaOdd = (f >> 13) & 1;
+            f += ((uint32_t)(15 - 127) << 23) + 0xfff + mantissaOdd;
+            h = (uint16_t)(f >> 13);
+        }
+
+        return h | (uint16_t)(sign >> 16);
+    }
+
+    inline float HalfToFloat(uint16_t h)
+    {
+        const uint32_t shiftedExponent = 0x7c00u << 13;
+        uint32_t f = (h & 0x7fffu) << 13;
+        uint32_t exponent = f & shiftedExponent;
+        f += (uint32_t)(127 - 15) << 23;
+
+        float value;
+        if (exponent == shiftedExponent)
+        {
+            f += (uint32_t)(128 - 16) << 23; // Inf/NaN
+            std::memcpy(&value, &f, sizeof(value));
+        }
+        else if (exponent == 0)
+        {
+            // Subnormal, renormalize
+            const uint32_t magicBits = (uint32_t)113 << 23;
+            float magic;
+            std::memcpy(&magic, &magicBits, sizeof(magic));
+            f += 1 << 23;
+            std::memcpy(&value, &f, sizeof(value));
+            value -= magic;
+        }
+        else
+        {
+            std::memcpy(&value, &f, sizeof(value));
+        }
+
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        bits |= (uint32_t)(h & 0x8000) << 16;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // Round half away from zero, copysign keeps the conversions branch free
+    inline int16_t   FloatToSnorm16(float v) { return (int16_t)(Clamp(v, -1.f, 1.f) * 32767.f + std::copysign(0.5f, v)); }
+    inline uint16_t  FloatToUnorm16(float v) { return (uint16_t)(Clamp(v, 0.f, 1.f) * 65535.f + 0.5f); }
+    inline uint8_t   FloatToUnorm8(float v)  { return (uint8_t)(Clamp(v, 0.f, 1.f) * 255.f + 0.5f); }
+    inline float     Snorm16ToFloat(int16_t v) { return Max(v / 32767.f, -1.f); }
+    inline float     Unorm16ToFloat(uint16_t v) { return v / 65535.f; }
+
+    // Octahedral mapping of a unit vector to [-1, 1]^2 (Cigolle et al. 2014)
+    inline float2 OctEncode(float3 n)
+    {
+        n = n / (Abs(n.x) + Abs(n.y) + Abs(n.z));
+        if (n.z < 0.f)
+        {
+            float x = (1.f - Abs(n.y)) * (n.x >= 0.f ? 1.f : -1.f);
+            float y = (1.f - Abs(n.x)) * (n.y >= 0.f ? 1.f : -1.f);
+            return { x, y };
+        }
+        return { n.x, n.y };
+    }
+
+    inline float3 OctDecode(float2 e)
+    {
+        float3 n = { e.x, e.y, 1.f - Abs(e.x) - Abs(e.y) };
+        float t = Max(-n.z, 0.f);
+        n.x += n.x >= 0.f ? -t : t;
+        n.y += n.y >= 0.f ? -t : t;
+        return v3Normalize(n);
+    }
+
+    // GL_INT_2_10_10_10_REV, signed normalized (x in the low bits)
+    inline uint32_t FloatToSnorm1010102(float4 v)
+    {
+        auto component = [](float c, float scale, uint32_t mask) { return (uint32_t)(int32_t)(Clamp(c, -1.f, 1.f) * scale + std::copysign(0.5f, c)) & mask; };
+        return component(v.x, 511.f, 0x3ff)
+            | (component(v.y, 511.f, 0x3ff) << 10)
+            | (component(v.z, 511.f, 0x3ff) << 20)
+            | (component(v.w, 1.f,   0x3)   << 30);
+    }
+
+    inline float4 Snorm1010102ToFloat(uint32_t packed)
+    {
+        // Sign extend each field with arithmetic shifts
+        float x = (float)((int32_t)(packed << 22) >> 22) / 511.f;
+        float y = (float)((int32_t)(packed << 12) >> 22) / 511.f;
+        float z = (float)((int32_t)(packed << 2)  >> 22) / 511.f;
+        float w = (float)((int32_t)packed >> 30);
+        return { Max(x, -1.f), Max(y, -1.f), Max(z, -1.f), Max(w, -1.f) };
+    }
+}
+}
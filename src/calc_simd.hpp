@@ -0,0 +1,159 @@
+#pragma once
+
+// SIMD backend for calc.hpp
+// SSE2 is used when available (always the case on x86_64), AVX if enabled by the compiler (-mavx, /arch:AVX)
+// Define CALC_NO_SIMD to force the scalar path
+
+#if !defined(CALC_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define CALC_SIMD_SSE
+#include <emmintrin.h>
+#endif
+
+#if defined(CALC_SIMD_SSE) && defined(__AVX__)
+#define CALC_SIMD_AVX
+#include <immintrin.h>
+#endif
+
+#define CALC_SHUFFLE_MASK(x, y, z, w) ((x) | ((y) << 2) | ((z) << 4) | ((w) << 6))
+
+namespace calc
+{
+namespace simd
+{
+#ifdef CALC_SIMD_SSE
+    template<bool Aligned>
+    inline __m128 Load(const float* p) { return Aligned ? _mm_load_ps(p) : _mm_loadu_ps(p); }
+
+    template<bool Aligned>
+    inline void Store(float* p, __m128 v) { if (Aligned) _mm_store_ps(p, v); else _mm_storeu_ps(p, v); }
+
+    // Matrices are column major: r = a * b
+    template<bool Aligned>
+    inline void Mat4Mul(float* r, const float* a, const float* b)
+    {
+#ifdef CALC_SIMD_AVX
+        // Compute 2 columns per iteration, each 128 bits lane holds one column of a
+        __m256 a0 = _mm256_broadcast_ps((const __m128*)(a + 0));
+        __m256 a1 = _mm256_broadcast_ps((const __m128*)(a + 4));
+        __m256 a2 = _mm256_broadcast_ps((const __m128*)(a + 8));
+        __m256 a3 = _mm256_broadcast_ps((const __m128*)(a + 12));
+
+        // Aligned variants are only 16 bytes aligned, 256 bits accesses are always unaligned ones (same speed on aligned data)
+        for (int c = 0; c < 4; c += 2)
+        {
+            __m256 bc = _mm256_loadu_ps(b + c * 4);
+            __m256 rc = _mm256_mul_ps(a0, _mm256_shuffle_ps(bc, bc, CALC_SHUFFLE_MASK(0, 0, 0, 0)));
+            rc = _mm256_add_ps(rc, _mm256_mul_ps(a1, _mm256_shuffle_ps(bc, bc, CALC_SHUFFLE_MASK(1, 1, 1, 1))));
+            rc = _mm256_add_ps(rc, _mm256_mul_ps(a2, _mm256_shuffle_ps(bc, bc, CALC_SHUFFLE_MASK(2, 2, 2, 2))));
+            rc = _mm256_add_ps(rc, _mm256_mul_ps(a3, _mm256_shuffle_ps(bc, bc, CALC_SHUFFLE_MASK(3, 3, 3, 3))));
+            _mm256_storeu_ps(r + c * 4, rc);
+        }
+#else
+        __m128 a0 = Load<Aligned>(a + 0);
+        __m128 a1 = Load<Aligned>(a + 4);
+        __m128 a2 = Load<Aligned>(a + 8);
+        __m128 a3 = Load<Aligned>(a + 12);
+
+        // Compute every column before storing (r can alias a or b)
+        __m128 rc[4];
+        for (int c = 0; c < 4; ++c)
+        {
+            __m128 bc = Load<Aligned>(b + c * 4);
+            rc[c] = _mm_mul_ps(a0, _mm_shuffle_ps(bc, bc, CALC_SHUFFLE_MASK(0, 0, 0, 0)));
+            rc[c] = _mm_add_ps(rc[c], _mm_mul_ps(a1, _mm_shuffle_ps(bc, bc, CALC_SHUFFLE_MASK(1, 1, 1, 1))));
+            rc[c] = _mm_add_ps(rc[c], _mm_mul_ps(a2, _mm_shuffle_ps(bc, bc, CALC_SHUFFLE_MASK(2, 2, 2, 2))));
+            rc[c] = _mm_add_ps(rc[c], _mm_mul_ps(a3, _mm_shuffle_ps(bc, bc, CALC_SHUFFLE_MASK(3, 3, 3, 3))));
+        }
+
+        for (int c = 0; c < 4; ++c)
+            Store<Aligned>(r + c * 4, rc[c]);
+#endif
+    }
+
+    // r = m * v
+    template<bool Aligned>
+    inline void Mat4MulVec(float* r, const float* m, const float* v)
+    {
+        __m128 vv = Load<Aligned>(v);
+        __m128 res = _mm_mul_ps(Load<Aligned>(m + 0), _mm_shuffle_ps(vv, vv, CALC_SHUFFLE_MASK(0, 0, 0, 0)));
+        res = _mm_add_ps(res, _mm_mul_ps(Load<Aligned>(m + 4),  _mm_shuffle_ps(vv, vv, CALC_SHUFFLE_MASK(1, 1, 1, 1))));
+        res = _mm_add_ps(res, _mm_mul_ps(Load<Aligned>(m + 8),  _mm_shuffle_ps(vv, vv, CALC_SHUFFLE_MASK(2, 2, 2, 2))));
+        res = _mm_add_ps(res, _mm_mul_ps(Load<Aligned>(m + 12), _mm_shuffle_ps(vv, vv, CALC_SHUFFLE_MASK(3, 3, 3, 3))));
+        Store<Aligned>(r, res);
+    }
+
+    // 2x2 sub matrices helpers for Mat4Inverse, a __m128 holds the matrix | x y |
+    //                                                                      | z w |
+    inline __m128 Mat2Mul(__m128 a, __m128 b)
+    {
+        return _mm_add_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, CALC_SHUFFLE_MASK(0, 3, 0, 3))),
+                          _mm_mul_ps(_mm_shuffle_ps(a, a, CALC_SHUFFLE_MASK(1, 0, 3, 2)), _mm_shuffle_ps(b, b, CALC_SHUFFLE_MASK(2, 1, 2, 1))));
+    }
+
+    // adj(a) * b
+    inline __m128 Mat2AdjMul(__m128 a, __m128 b)
+    {
+        return _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, CALC_SHUFFLE_MASK(3, 3, 0, 0)), b),
+                          _mm_mul_ps(_mm_shuffle_ps(a, a, CALC_SHUFFLE_MASK(1, 1, 2, 2)), _mm_shuffle_ps(b, b, CALC_SHUFFLE_MASK(2, 3, 0, 1))));
+    }
+
+    // a * adj(b)
+    inline __m128 Mat2MulAdj(__m128 a, __m128 b)
+    {
+        return _mm_sub_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, CALC_SHUFFLE_MASK(3, 0, 3, 0))),
+                          _mm_mul_ps(_mm_shuffle_ps(a, a, CALC_SHUFFLE_MASK(1, 0, 3, 2)), _mm_shuffle_ps(b, b, CALC_SHUFFLE_MASK(2, 1, 2, 1))));
+    }
+
+    // Block matrix inversion (works on transposed matrices too as inv(transpose(m)) = transpose(inv(m)))
+    template<bool Aligned>
+    inline void Mat4Inverse(float* r, const float* m)
+    {
+        __m128 m0 = Load<Aligned>(m + 0);
+        __m128 m1 = Load<Aligned>(m + 4);
+        __m128 m2 = Load<Aligned>(m + 8);
+        __m128 m3 = Load<Aligned>(m + 12);
+
+        // Sub matrices
+        __m128 a = _mm_movelh_ps(m0, m1);
+        __m128 b = _mm_movehl_ps(m1, m0);
+        __m128 c = _mm_movelh_ps(m2, m3);
+        __m128 d = _mm_movehl_ps(m3, m2);
+
+        // Sub determinants as (|a| |b| |c| |d|)
+        __m128 detSub = _mm_sub_ps(
+            _mm_mul_ps(_mm_shuffle_ps(m0, m2, CALC_SHUFFLE_MASK(0, 2, 0, 2)), _mm_shuffle_ps(m1, m3, CALC_SHUFFLE_MASK(1, 3, 1, 3))),
+            _mm_mul_ps(_mm_shuffle_ps(m0, m2, CALC_SHUFFLE_MASK(1, 3, 1, 3)), _mm_shuffle_ps(m1, m3, CALC_SHUFFLE_MASK(0, 2, 0, 2))));
+        __m128 detA = _mm_shuffle_ps(detSub, detSub, CALC_SHUFFLE_MASK(0, 0, 0, 0));
+        __m128 detB = _mm_shuffle_ps(detSub, detSub, CALC_SHUFFLE_MASK(1, 1, 1, 1));
+        __m128 detC = _mm_shuffle_ps(detSub, detSub, CALC_SHUFFLE_MASK(2, 2, 2, 2));
+        __m128 detD = _mm_shuffle_ps(detSub, detSub, CALC_SHUFFLE_MASK(3, 3, 3, 3));
+
+        __m128 dc = Mat2AdjMul(d, c);
+        __m128 ab = Mat2AdjMul(a, b);
+        __m128 x = _mm_sub_ps(_mm_mul_ps(detD, a), Mat2Mul(b, dc));
+        __m128 w = _mm_sub_ps(_mm_mul_ps(detA, d), Mat2Mul(c, ab));
+        __m128 y = _mm_sub_ps(_mm_mul_ps(detB, c), Mat2MulAdj(d, ab));
+        __m128 z = _mm_sub_ps(_mm_mul_ps(detC, b), Mat2MulAdj(a, dc));
+
+        // |m| = |a|*|d| + |b|*|c| - tr(ab * dc)
+        __m128 tr = _mm_mul_ps(ab, _mm_shuffle_ps(dc, dc, CALC_SHUFFLE_MASK(0, 2, 1, 3)));
+        tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, CALC_SHUFFLE_MASK(2, 3, 0, 1)));
+        tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, CALC_SHUFFLE_MASK(1, 0, 3, 2)));
+        __m128 det = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), tr);
+
+        // assuming it is invertible
+        __m128 invDet = _mm_div_ps(_mm_setr_ps(1.f, -1.f, -1.f, 1.f), det);
+        x = _mm_mul_ps(x, invDet);
+        y = _mm_mul_ps(y, invDet);
+        z = _mm_mul_ps(z, invDet);
+        w = _mm_mul_ps(w, invDet);
+
+        // Apply adjugate while storing
+        Store<Aligned>(r + 0,  _mm_shuffle_ps(x, y, CALC_SHUFFLE_MASK(3, 1, 3, 1)));
+        Store<Aligned>(r + 4,  _mm_shuffle_ps(x, y, CALC_SHUFFLE_MASK(2, 0, 2, 0)));
+        Store<Aligned>(r + 8,  _mm_shuffle_ps(z, w, CALC_SHUFFLE_MASK(3, 1, 3, 1)));
+        Store<Aligned>(r + 12, _mm_shuffle_ps(z, w, CALC_SHUFFLE_MASK(2, 0, 2, 0)));
+    }
+#endif
+}
+}
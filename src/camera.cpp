@@ -59,4 +59,20 @@ void Camera::UpdateFreeFly(const CameraInputs& inputs)
 mat4 Camera::GetViewMatrix() const
 {
     return mat4RotateX(pitch) * mat4RotateY(yaw) * mat4RotateZ(roll) * mat4Translate(-position);
+}
+
+Ray Camera::GetPickingRay(float2 windowPosition, float2 windowSize, const mat4& projection) const
+{
+    // Window to normalized device coordinates, y goes up
+    float x = 2.f * windowPosition.x / windowSize.x - 1.f;
+    float y = 1.f - 2.f * windowPosition.y / windowSize.y;
+
+    mat4 inverseViewProjection = mat4Inverse(projection * GetViewMatrix());
+    float4 nearPoint = inverseViewProjection * float4(x, y, -1.f, 1.f);
+    float4 farPoint  = inverseViewProjection * float4(x, y,  1.f, 1.f);
+
+    float3 origin = nearPoint.xyz / nearPoint.w;
+    float3 direction = farPoint.xyz / farPoint.w - origin;
+    float length = v3Length(direction);
+    return { origin, direction / length, length };
 }
\ No newline at end of file
@@ -32,4 +32,8 @@ struct Camera
 
     void UpdateFreeFly(const CameraInputs& inputs);
     mat4 GetViewMatrix() const;
+
+    // World space ray from the near plane to the far plane through a window position (pixels, origin at the top left)
+    // The direction is normalized, use it with bvh::Intersect for mouse picking
+    Ray GetPickingRay(float2 windowPosition, float2 windowSize, const mat4& projection) const;
 };
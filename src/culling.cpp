@@ -0,0 +1,211 @@
+#include <atomic>
+#include <cfloat>
+
+#include "calc.hpp"
+#include "jobs.hpp"
+
+#include "culling.hpp"
+
+// Bounds tested per job when running in parallel
+#define CULLING_JOB_SIZE 4096
+
+Bounds culling::ComputeBounds(float3Strided positions, int count)
+{
+    if (count <= 0)
+        return {};
+
+    float3 min = {  FLT_MAX,  FLT_MAX,  FLT_MAX };
+    float3 max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (int i = 0; i < count; ++i)
+    {
+        const float3& p = *(const float3*)(positions.data + (size_t)i * positions.stride);
+        min = { calc::Min(min.x, p.x), calc::Min(min.y, p.y), calc::Min(min.z, p.z) };
+        max = { calc::Max(max.x, p.x), calc::Max(max.y, p.y), calc::Max(max.z, p.z) };
+    }
+
+    Bounds bounds;
+    bounds.center  = (min + max) * 0.5f;
+    bounds.extents = (max - min) * 0.5f;
+
+    // Sphere around the box center, tighter than the box corners
+    float radiusSq = 0.f;
+    for (int i = 0; i < count; ++i)
+    {
+        float3 d = *(const float3*)(positions.data + (size_t)i * positions.stride) - bounds.center;
+        radiusSq = calc::Max(radiusSq, v3Dot(d, d));
+    }
+    bounds.radius = calc::Sqrt(radiusSq);
+
+    return bounds;
+}
+
+Bounds culling::TransformBounds(const Bounds& bounds, const mat4& m)
+{
+    Bounds result;
+    result.center = (m * float4(bounds.center, 1.f)).xyz;
+
+    // Project the extents on each axis of the transformed box (Arvo)
+    const float3& e = bounds.extents;
+    result.extents.x = calc::Abs(m.e[0]) * e.x + calc::Abs(m.e[4]) * e.y + calc::Abs(m.e[8])  * e.z;
+    result.extents.y = calc::Abs(m.e[1]) * e.x + calc::Abs(m.e[5]) * e.y + calc::Abs(m.e[9])  * e.z;
+    result.extents.z = calc::Abs(m.e[2]) * e.x + calc::Abs(m.e[6]) * e.y + calc::Abs(m.e[10]) * e.z;
+
+    float scaleSq = calc::Max(v3Dot(m.c[0].xyz, m.c[0].xyz), calc::Max(v3Dot(m.c[1].xyz, m.c[1].xyz), v3Dot(m.c[2].xyz, m.c[2].xyz)));
+    result.radius = bounds.radius * calc::Sqrt(scaleSq);
+
+    return result;
+}
+
+Frustum culling::ExtractFrustum(const mat4& m)
+{
+    // Gribb/Hartmann: planes are combinations of the matrix rows
+    float4 rows[4];
+    for (int i = 0; i < 4; ++i)
+        rows[i] = { m.e[i], m.e[4 + i], m.e[8 + i], m.e[12 + i] };
+
+    Frustum frustum;
+    frustum.planes[0] = rows[3] + rows[0];
+    frustum.planes[1] = rows[3] - rows[0];
+    frustum.planes[2] = rows[3] + rows[1];
+    frustum.planes[3] = rows[3] - rows[1];
+    frustum.planes[4] = rows[3] + rows[2];
+    frustum.planes[5] = rows[3] - rows[2];
+
+    // Normalize so sphere radii can be compared with plane distances
+    for (float4& plane : frustum.planes)
+        plane = plane * (1.f / v3Length(plane.xyz));
+
+    return frustum;
+}
+
+namespace
+{
+    struct BoxTest
+    {
+        bool operator()(const float4& plane, const Bounds& b) const
+        {
+            float distance = v3Dot(plane.xyz, b.center) + plane.w;
+            float projectedExtents = calc::Abs(plane.x) * b.extents.x + calc::Abs(plane.y) * b.extents.y + calc::Abs(plane.z) * b.extents.z;
+            return distance + projectedExtents >= 0.f;
+        }
+
+#ifdef CALC_SIMD_SSE
+        // Return a mask of the bounds in front of the plane (the box and sphere tests share one signature)
+        __m128 operator()(const float4& plane, const __m128 c[3], const __m128 e[3], __m128 /*radius*/) const
+        {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), c[0]), _mm_mul_ps(_mm_set1_ps(plane.y), c[1])),
+                                         _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), c[2]), _mm_set1_ps(plane.w)));
+            __m128 projectedExtents = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(calc::Abs(plane.x)), e[0]), _mm_mul_ps(_mm_set1_ps(calc::Abs(plane.y)), e[1])),
+                                                 _mm_mul_ps(_mm_set1_ps(calc::Abs(plane.z)), e[2]));
+            return _mm_cmpge_ps(_mm_add_ps(distance, projectedExtents), _mm_setzero_ps());
+        }
+#endif
+    };
+
+    struct SphereTest
+    {
+        bool operator()(const float4& plane, const Bounds& b) const
+        {
+            return v3Dot(plane.xyz, b.center) + plane.w + b.radius >= 0.f;
+        }
+
+#ifdef CALC_SIMD_SSE
+        __m128 operator()(const float4& plane, const __m128 c[3], const __m128 /*e*/[3], __m128 radius) const
+        {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), c[0]), _mm_mul_ps(_mm_set1_ps(plane.y), c[1])),
+                                         _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), c[2]), _mm_set1_ps(plane.w)));
+            return _mm_cmpge_ps(_mm_add_ps(distance, radius), _mm_setzero_ps());
+        }
+#endif
+    };
+
+    template<typename Test>
+    int CullRange(const Test& test, const Frustum& frustum, const Bounds* bounds, int begin, int end, unsigned char* visible)
+    {
+        int visibleCount = 0;
+        int i = begin;
+#ifdef CALC_SIMD_SSE
+        for (; i + 4 <= end; i += 4)
+        {
+            // Transpose 4 bounds to SoA registers
+            const Bounds* b = &bounds[i];
+            __m128 c[3], e[3];
+            c[0] = _mm_setr_ps(b[0].center.x,  b[1].center.x,  b[2].center.x,  b[3].center.x);
+            c[1] = _mm_setr_ps(b[0].center.y,  b[1].center.y,  b[2].center.y,  b[3].center.y);
+            c[2] = _mm_setr_ps(b[0].center.z,  b[1].center.z,  b[2].center.z,  b[3].center.z);
+            e[0] = _mm_setr_ps(b[0].extents.x, b[1].extents.x, b[2].extents.x, b[3].extents.x);
+            e[1] = _mm_setr_ps(b[0].extents.y, b[1].extents.y, b[2].extents.y, b[3].extents.y);
+            e[2] = _mm_setr_ps(b[0].extents.z, b[1].extents.z, b[2].extents.z, b[3].extents.z);
+            __m128 radius = _mm_setr_ps(b[0].radius, b[1].radius, b[2].radius, b[3].radius);
+
+            __m128 inside = test(frustum.planes[0], c, e, radius);
+            for (int p = 1; p < 6; ++p)
+                inside = _mm_and_ps(inside, test(frustum.planes[p], c, e, radius));
+
+            int mask = _mm_movemask_ps(inside);
+            for (int j = 0; j < 4; ++j)
+            {
+                visible[i + j] = (mask >> j) & 1;
+                visibleCount += visible[i + j];
+            }
+        }
+#endif
+        for (; i < end; ++i)
+        {
+            bool inside = true;
+            for (int p = 0; p < 6 && inside; ++p)
+                inside = test(frustum.planes[p], bounds[i]);
+            visible[i] = inside ? 1 : 0;
+            visibleCount += visible[i];
+        }
+        return visibleCount;
+    }
+
+    template<typename Test>
+    int Cull(const Test& test, const Frustum& frustum, const Bounds* bounds, int count, unsigned char* visible, bool parallel)
+    {
+        if (!parallel)
+            return CullRange(test, frustum, bounds, 0, count, visible);
+
+        std::atomic<int> visibleCount(0);
+        jobs::ParallelFor(count, CULLING_JOB_SIZE, [&](int begin, int end)
+        {
+            visibleCount += CullRange(test, frustum, bounds, begin, end, visible);
+        });
+        return visibleCount;
+    }
+}
+
+int culling::CullBoxes(const Frustum& frustum, const Bounds* bounds, int count, unsigned char* visible, bool parallel)
+{
+    return Cull(BoxTest{}, frustum, bounds, count, visible, parallel);
+}
+
+int culling::CullSpheres(const Frustum& frustum, const Bounds* bounds, int count, unsigned char* visible, bool parallel)
+{
+    return Cull(SphereTest{}, frustum, bounds, count, visible, parallel);
+}
+
+int culling::CullCones(float3 viewPosition, const NormalCone* cones, int count, unsigned char* visible)
+{
+    int visibleCount = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        if (!visible[i])
+            continue;
+
+        // dot(normalize(d), axis) >= cutoff without the square root (cutoff >= 0)
+        float3 d = cones[i].apex - viewPosition;
+        float projection = v3Dot(d, cones[i].axis);
+        bool backfacing = projection > 0.f && projection * projection >= cones[i].cutoff * cones[i].cutoff * v3Dot(d, d);
+        visible[i] = backfacing ? 0 : 1;
+        visibleCount += visible[i];
+    }
+    return visibleCount;
+}
+
+float culling::GetProjectedSize(float length, float distance, const mat4& projection, float viewportHeight)
+{
+    // projection[1][1] is 1 / tan(fov / 2), the viewport spans 2 units at distance 1
+    return length * projection.c[1].y * 0.5f * viewportHeight / distance;
+}
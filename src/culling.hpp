@@ -0,0 +1,51 @@
+#pragma once
+
+#include "types.hpp"
+#include "calc_batch.hpp"
+
+// Axis aligned box (center/extents) and bounding sphere sharing the same center
+struct Bounds
+{
+    float3 center;
+    float3 extents; // Half size on each axis
+    float radius;
+};
+
+// Planes are stored as (normal, distance), normals point inside: dot(normal, p) + distance >= 0 for visible points
+struct Frustum
+{
+    float4 planes[6]; // Left, right, bottom, top, near, far
+};
+
+// Cone containing the normals of a group of triangles: the whole group faces away from
+// any view position p with dot(normalize(apex - p), axis) >= cutoff (cutoff > 1 never culls)
+struct NormalCone
+{
+    float3 apex;
+    float3 axis;
+    float cutoff;
+};
+
+// Frustum culling (SIMD when available)
+namespace culling
+{
+    Bounds ComputeBounds(float3Strided positions, int count);
+
+    // Bounds of the transformed box, the radius is scaled by the largest axis scale
+    Bounds TransformBounds(const Bounds& bounds, const mat4& m);
+
+    // Planes of a projection * view matrix (OpenGL clip space, -w <= z <= w), world space planes are returned
+    Frustum ExtractFrustum(const mat4& viewProjection);
+
+    // Test each bounds against the frustum and set visible[i] to 1 if it may be visible, 0 otherwise
+    // Return the number of visible bounds, if parallel is true the work is split across worker threads
+    int CullBoxes(const Frustum& frustum, const Bounds* bounds, int count, unsigned char* visible, bool parallel = false);
+    int CullSpheres(const Frustum& frustum, const Bounds* bounds, int count, unsigned char* visible, bool parallel = false);
+
+    // Backface culling of triangle groups: clear visible[i] if cone i faces away from viewPosition
+    // Return the number of groups still visible
+    int CullCones(float3 viewPosition, const NormalCone* cones, int count, unsigned char* visible);
+
+    // Height in pixels of a length seen at distance from the camera (perspective projection, see mat4Perspective)
+    float GetProjectedSize(float length, float distance, const mat4& projection, float viewportHeight);
+}
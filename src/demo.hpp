@@ -6,6 +6,8 @@
 #include "camera.hpp"
 
 struct ImGuiContext;
+class TextureStreamer;
+class ResourceLoader;
 typedef void* (*GLADloadproc)(const char* name);
 
 struct DemoInputs
@@ -13,6 +15,8 @@ struct DemoInputs
     float deltaTime;
     float2 windowSize;
     CameraInputs cameraInputs;
+    TextureStreamer* textureStreamer; // Null if demos must load their textures synchronously
+    ResourceLoader* resourceLoader;   // Null if demos must create their GL objects on the render thread
 };
 
 class Demo
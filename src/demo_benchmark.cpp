@@ -0,0 +1,497 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <glad/glad.h>
+#include <imgui.h>
+#include <tiny_obj_loader.h>
+
+#include "calc.hpp"
+#include "calc_batch.hpp"
+#include "calc_fast.hpp"
+#include "culling.hpp"
+#include "obj_parser.hpp"
+
+#include "demo_benchmark.hpp"
+
+// Written by each benchmark so the compiler cannot discard the computations
+static volatile float sink;
+
+static float RandomFloat()
+{
+    return std::rand() / (float)RAND_MAX * 2.f - 1.f;
+}
+
+// Shared input data
+static const int MATRIX_COUNT = 1024;
+static std::vector<mat4>  matrices;
+static std::vector<mat4a> matricesAligned;
+static std::vector<float4> vectors;
+
+struct BenchVertex
+{
+    float3 position;
+    float3 normal;
+    float2 uv;
+};
+
+static const int VERTEX_COUNT = 1 << 18;
+static std::vector<float> positionsX;
+static std::vector<float> positionsY;
+static std::vector<float> positionsZ;
+static std::vector<BenchVertex> vertices;
+
+// Outputs of the transform and normalize benchmarks, every run reads the same inputs
+static std::vector<float> transformedX;
+static std::vector<float> transformedY;
+static std::vector<float> transformedZ;
+static std::vector<BenchVertex> transformedVertices;
+
+static std::vector<float> values; // In [0, 1]
+static std::vector<float> results0;
+static std::vector<float> results1;
+
+static std::vector<Bounds> bounds;
+static std::vector<unsigned char> boundsVisible;
+
+static void InitBenchmarkData()
+{
+    if (!matrices.empty())
+        return;
+
+    matrices.resize(MATRIX_COUNT);
+    matricesAligned.resize(MATRIX_COUNT);
+    vectors.resize(MATRIX_COUNT);
+    for (int i = 0; i < MATRIX_COUNT; ++i)
+    {
+        // Keep matrices invertible (affine transforms)
+        float3 axis = { RandomFloat(), RandomFloat(), RandomFloat() };
+        matrices[i] = mat4Translate(axis * 10.f) * mat4RotateY(axis.x * calc::TAU) * mat4RotateX(axis.y * calc::TAU) * mat4Scale(axis.z + 2.f);
+        matricesAligned[i] = matrices[i];
+        vectors[i] = { axis, 1.f };
+    }
+
+    positionsX.resize(VERTEX_COUNT);
+    positionsY.resize(VERTEX_COUNT);
+    positionsZ.resize(VERTEX_COUNT);
+    vertices.resize(VERTEX_COUNT);
+    transformedX.resize(VERTEX_COUNT);
+    transformedY.resize(VERTEX_COUNT);
+    transformedZ.resize(VERTEX_COUNT);
+    transformedVertices.resize(VERTEX_COUNT);
+    for (int i = 0; i < VERTEX_COUNT; ++i)
+    {
+        float3 position = { RandomFloat(), RandomFloat(), RandomFloat() };
+        positionsX[i] = position.x;
+        positionsY[i] = position.y;
+        positionsZ[i] = position.z;
+        vertices[i].position = position;
+        vertices[i].normal = v3Normalize(position);
+    }
+
+    values.resize(VERTEX_COUNT);
+    results0.resize(VERTEX_COUNT);
+    results1.resize(VERTEX_COUNT);
+    for (int i = 0; i < VERTEX_COUNT; ++i)
+        values[i] = RandomFloat() * 0.5f + 0.5f;
+
+    bounds.resize(VERTEX_COUNT);
+    boundsVisible.resize(VERTEX_COUNT);
+    for (int i = 0; i < VERTEX_COUNT; ++i)
+    {
+        float3 extents = { RandomFloat() + 1.f, RandomFloat() + 1.f, RandomFloat() + 1.f };
+        bounds[i] = { float3(RandomFloat(), RandomFloat(), RandomFloat()) * 100.f, extents, v3Length(extents) };
+    }
+}
+
+// ======================================
+// calc.hpp: mat4
+// ======================================
+// Every element of every product is summed, the products cannot be discarded
+static void AccumulateMat4(float* acc, const float* e)
+{
+    for (int k = 0; k < 16; ++k)
+        acc[k] += e[k];
+}
+
+static float SumMat4(const float* acc)
+{
+    float sum = 0.f;
+    for (int k = 0; k < 16; ++k)
+        sum += acc[k];
+    return sum;
+}
+
+static void Mat4MulScalar(int iterations)
+{
+    mat4 acc = {};
+    for (int i = 0; i < iterations; ++i)
+        AccumulateMat4(acc.e, calc::scalar::Mat4Mul(matrices[i % MATRIX_COUNT], matrices[(i + 1) % MATRIX_COUNT]).e);
+    sink = SumMat4(acc.e);
+}
+
+static void Mat4MulSimd(int iterations)
+{
+    mat4 acc = {};
+    for (int i = 0; i < iterations; ++i)
+        AccumulateMat4(acc.e, (matrices[i % MATRIX_COUNT] * matrices[(i + 1) % MATRIX_COUNT]).e);
+    sink = SumMat4(acc.e);
+}
+
+static void Mat4MulSimdAligned(int iterations)
+{
+    mat4 acc = {};
+    for (int i = 0; i < iterations; ++i)
+        AccumulateMat4(acc.e, (matricesAligned[i % MATRIX_COUNT] * matricesAligned[(i + 1) % MATRIX_COUNT]).e);
+    sink = SumMat4(acc.e);
+}
+
+static void Mat4MulVecScalar(int iterations)
+{
+    float4 acc = {};
+    for (int i = 0; i < iterations; ++i)
+        acc = acc + calc::scalar::Mat4MulVec(matrices[i % MATRIX_COUNT], vectors[i % MATRIX_COUNT]);
+    sink = acc.x + acc.y + acc.z + acc.w;
+}
+
+static void Mat4MulVecSimd(int iterations)
+{
+    float4 acc = {};
+    for (int i = 0; i < iterations; ++i)
+        acc = acc + matrices[i % MATRIX_COUNT] * vectors[i % MATRIX_COUNT];
+    sink = acc.x + acc.y + acc.z + acc.w;
+}
+
+static void Mat4InverseScalar(int iterations)
+{
+    mat4 acc = {};
+    for (int i = 0; i < iterations; ++i)
+        AccumulateMat4(acc.e, calc::scalar::Mat4Inverse(matrices[i % MATRIX_COUNT]).e);
+    sink = SumMat4(acc.e);
+}
+
+static void Mat4InverseSimd(int iterations)
+{
+    mat4 acc = {};
+    for (int i = 0; i < iterations; ++i)
+        AccumulateMat4(acc.e, mat4Inverse(matrices[i % MATRIX_COUNT]).e);
+    sink = SumMat4(acc.e);
+}
+
+// ======================================
+// calc_batch.hpp
+// ======================================
+static void TransformVerticesLoop(int iterations)
+{
+    for (int i = 0; i < iterations; ++i)
+    {
+        const mat4& m = matrices[i % MATRIX_COUNT];
+        for (int j = 0; j < VERTEX_COUNT; ++j)
+            transformedVertices[j].position = (calc::scalar::Mat4MulVec(m, { vertices[j].position, 1.f })).xyz;
+    }
+    sink = transformedVertices[0].position.x;
+}
+
+static void TransformVerticesBatch(int iterations)
+{
+    float3Strided positions   = GetVertexStream(vertices.data(), sizeof(BenchVertex), offsetof(BenchVertex, position));
+    float3Strided transformed = GetVertexStream(transformedVertices.data(), sizeof(BenchVertex), offsetof(BenchVertex, position));
+    for (int i = 0; i < iterations; ++i)
+        calc::batch::TransformPoints(matrices[i % MATRIX_COUNT], transformed, positions, VERTEX_COUNT);
+    sink = transformedVertices[0].position.x;
+}
+
+static void TransformVerticesBatchParallel(int iterations)
+{
+    float3Strided positions   = GetVertexStream(vertices.data(), sizeof(BenchVertex), offsetof(BenchVertex, position));
+    float3Strided transformed = GetVertexStream(transformedVertices.data(), sizeof(BenchVertex), offsetof(BenchVertex, position));
+    for (int i = 0; i < iterations; ++i)
+        calc::batch::TransformPoints(matrices[i % MATRIX_COUNT], transformed, positions, VERTEX_COUNT, true);
+    sink = transformedVertices[0].position.x;
+}
+
+static void TransformSoALoop(int iterations)
+{
+    for (int i = 0; i < iterations; ++i)
+    {
+        const mat4& m = matrices[i % MATRIX_COUNT];
+        for (int j = 0; j < VERTEX_COUNT; ++j)
+        {
+            float4 p = calc::scalar::Mat4MulVec(m, { positionsX[j], positionsY[j], positionsZ[j], 1.f });
+            transformedX[j] = p.x;
+            transformedY[j] = p.y;
+            transformedZ[j] = p.z;
+        }
+    }
+    sink = transformedX[0];
+}
+
+static void TransformSoABatch(int iterations)
+{
+    float3SoA positions   = { positionsX.data(), positionsY.data(), positionsZ.data() };
+    float3SoA transformed = { transformedX.data(), transformedY.data(), transformedZ.data() };
+    for (int i = 0; i < iterations; ++i)
+        calc::batch::TransformPoints(matrices[i % MATRIX_COUNT], transformed, positions, VERTEX_COUNT);
+    sink = transformedX[0];
+}
+
+static void NormalizeLoop(int iterations)
+{
+    for (int i = 0; i < iterations; ++i)
+        for (int j = 0; j < VERTEX_COUNT; ++j)
+            transformedVertices[j].normal = v3Normalize(vertices[j].normal);
+    sink = transformedVertices[0].normal.x;
+}
+
+static void NormalizeBatch(int iterations)
+{
+    float3Strided normals    = GetVertexStream(vertices.data(), sizeof(BenchVertex), offsetof(BenchVertex, normal));
+    float3Strided normalized = GetVertexStream(transformedVertices.data(), sizeof(BenchVertex), offsetof(BenchVertex, normal));
+    for (int i = 0; i < iterations; ++i)
+        calc::batch::Normalize(normalized, normals, VERTEX_COUNT, true);
+    sink = transformedVertices[0].normal.x;
+}
+
+// ======================================
+// calc_fast.hpp
+// ======================================
+static void SinCosStd(int iterations)
+{
+    for (int i = 0; i < iterations; ++i)
+    {
+        for (int j = 0; j < VERTEX_COUNT; ++j)
+        {
+            float angle = values[j] * calc::TAU * (i + 1);
+            results0[j] = calc::Sin(angle);
+            results1[j] = calc::Cos(angle);
+        }
+    }
+    sink = results0[0] + results1[0];
+}
+
+static void SinCosFast(int iterations)
+{
+    for (int i = 0; i < iterations; ++i)
+    {
+        for (int j = 0; j < VERTEX_COUNT; ++j)
+            results0[j] = values[j] * calc::TAU * (i + 1);
+        calc::fast::SinCos(results0.data(), results1.data(), results0.data(), VERTEX_COUNT);
+    }
+    sink = results0[0] + results1[0];
+}
+
+static void PowStd(int iterations)
+{
+    for (int i = 0; i < iterations; ++i)
+        for (int j = 0; j < VERTEX_COUNT; ++j)
+            results0[j] = calc::Pow(values[j], 2.2f);
+    sink = results0[0];
+}
+
+static void PowFast(int iterations)
+{
+    for (int i = 0; i < iterations; ++i)
+        calc::fast::Pow(results0.data(), values.data(), 2.2f, VERTEX_COUNT);
+    sink = results0[0];
+}
+
+static void LinearToSRGBStd(int iterations)
+{
+    for (int i = 0; i < iterations; ++i)
+    {
+        for (int j = 0; j < VERTEX_COUNT; ++j)
+        {
+            float c = values[j];
+            results0[j] = c <= 0.0031308f ? c * 12.92f : 1.055f * calc::Pow(c, 1.f / 2.4f) - 0.055f;
+        }
+    }
+    sink = results0[0];
+}
+
+static void LinearToSRGBFast(int iterations)
+{
+    for (int i = 0; i < iterations; ++i)
+        calc::fast::LinearToSRGB(results0.data(), values.data(), VERTEX_COUNT);
+    sink = results0[0];
+}
+
+static void LinearToSRGBFastParallel(int iterations)
+{
+    for (int i = 0; i < iterations; ++i)
+        calc::fast::LinearToSRGB(results0.data(), values.data(), VERTEX_COUNT, true);
+    sink = results0[0];
+}
+
+// ======================================
+// culling.hpp
+// ======================================
+static Frustum BenchmarkFrustum(int i)
+{
+    mat4 projection = mat4Perspective(calc::ToRadians(60.f), 16.f / 9.f, 0.1f, 100.f);
+    return culling::ExtractFrustum(projection * mat4RotateY(i * 0.1f));
+}
+
+static void CullBoxesLoop(int iterations)
+{
+    int visibleCount = 0;
+    for (int i = 0; i < iterations; ++i)
+    {
+        Frustum frustum = BenchmarkFrustum(i);
+        for (int j = 0; j < VERTEX_COUNT; ++j)
+        {
+            const Bounds& b = bounds[j];
+            bool inside = true;
+            for (int p = 0; p < 6 && inside; ++p)
+            {
+                const float4& plane = frustum.planes[p];
+                float distance = v3Dot(plane.xyz, b.center) + plane.w;
+                inside = distance + calc::Abs(plane.x) * b.extents.x + calc::Abs(plane.y) * b.extents.y + calc::Abs(plane.z) * b.extents.z >= 0.f;
+            }
+            boundsVisible[j] = inside;
+            visibleCount += inside;
+        }
+    }
+    sink = (float)visibleCount;
+}
+
+static void CullBoxesBatch(int iterations)
+{
+    int visibleCount = 0;
+    for (int i = 0; i < iterations; ++i)
+        visibleCount += culling::CullBoxes(BenchmarkFrustum(i), bounds.data(), VERTEX_COUNT, boundsVisible.data());
+    sink = (float)visibleCount;
+}
+
+static void CullBoxesBatchParallel(int iterations)
+{
+    int visibleCount = 0;
+    for (int i = 0; i < iterations; ++i)
+        visibleCount += culling::CullBoxes(BenchmarkFrustum(i), bounds.data(), VERTEX_COUNT, boundsVisible.data(), true);
+    sink = (float)visibleCount;
+}
+
+// ======================================
+// obj_parser.hpp
+// ======================================
+static const char* BENCHMARK_OBJ = "media/fantasy_game_inn.obj";
+
+static void LoadObjTinyobj(int iterations)
+{
+    for (int i = 0; i < iterations; ++i)
+    {
+        tinyobj::attrib_t attrib;
+        std::vector<tinyobj::shape_t> shapes;
+        std::vector<tinyobj::material_t> materials;
+        std::string warning;
+        std::string error;
+        tinyobj::LoadObj(&attrib, &shapes, &materials, &warning, &error, BENCHMARK_OBJ, "media", true);
+        sink = (float)attrib.vertices.size();
+    }
+}
+
+static void LoadObjParallel(int iterations)
+{
+    for (int i = 0; i < iterations; ++i)
+    {
+        obj::Mesh mesh;
+        obj::Load(&mesh, BENCHMARK_OBJ);
+        sink = (float)mesh.positions.size();
+    }
+}
+
+DemoBenchmark::DemoBenchmark(const DemoInputs& inputs)
+{
+    InitBenchmarkData();
+
+    benchmarks.push_back({ "mat4 * mat4",           Mat4MulScalar,     Mat4MulSimd,        1000000 });
+    benchmarks.push_back({ "mat4a * mat4a",         Mat4MulScalar,     Mat4MulSimdAligned, 1000000 });
+    benchmarks.push_back({ "mat4 * float4",         Mat4MulVecScalar,  Mat4MulVecSimd,     1000000 });
+    benchmarks.push_back({ "mat4Inverse",           Mat4InverseScalar, Mat4InverseSimd,    1000000 });
+    benchmarks.push_back({ "TransformPoints (strided)",          TransformVerticesLoop, TransformVerticesBatch,         20 });
+    benchmarks.push_back({ "TransformPoints (strided, parallel)", TransformVerticesLoop, TransformVerticesBatchParallel, 20 });
+    benchmarks.push_back({ "TransformPoints (SoA)",              TransformSoALoop,      TransformSoABatch,              20 });
+    benchmarks.push_back({ "Normalize (strided, parallel)",      NormalizeLoop,         NormalizeBatch,                 20 });
+    benchmarks.push_back({ "SinCos",                             SinCosStd,             SinCosFast,                     20 });
+    benchmarks.push_back({ "Pow",                                PowStd,                PowFast,                        20 });
+    benchmarks.push_back({ "LinearToSRGB",                       LinearToSRGBStd,       LinearToSRGBFast,               20 });
+    benchmarks.push_back({ "LinearToSRGB (parallel)",            LinearToSRGBStd,       LinearToSRGBFastParallel,       20 });
+    benchmarks.push_back({ "CullBoxes",                          CullBoxesLoop,         CullBoxesBatch,                 20 });
+    benchmarks.push_back({ "CullBoxes (parallel)",               CullBoxesLoop,         CullBoxesBatchParallel,         20 });
+    benchmarks.push_back({ "Parse tavern OBJ (tinyobj / obj)",   LoadObjTinyobj,        LoadObjParallel,                10 });
+}
+
+DemoBenchmark::~DemoBenchmark()
+{
+}
+
+static double MeasureMs(void (*func)(int), int iterations)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    func(iterations);
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void DemoBenchmark::Run(Benchmark& benchmark)
+{
+    // Warm up caches before measuring
+    benchmark.reference(benchmark.iterations / 10);
+    benchmark.optimized(benchmark.iterations / 10);
+
+    benchmark.referenceMs = MeasureMs(benchmark.reference, benchmark.iterations);
+    benchmark.optimizedMs = MeasureMs(benchmark.optimized, benchmark.iterations);
+
+    printf("[%s] reference: %.3f ms, optimized: %.3f ms (x%.2f)\n", benchmark.name,
+        benchmark.referenceMs, benchmark.optimizedMs, benchmark.referenceMs / benchmark.optimizedMs);
+}
+
+void DemoBenchmark::UpdateAndRender(const DemoInputs& inputs)
+{
+#if defined(CALC_SIMD_AVX)
+    ImGui::Text("calc SIMD backend: AVX");
+#elif defined(CALC_SIMD_SSE)
+    ImGui::Text("calc SIMD backend: SSE2");
+#else
+    ImGui::Text("calc SIMD backend: none (scalar)");
+#endif
+
+    // The Makefile builds this file and the calc/culling units with -O2, other builds may not
+#if defined(_DEBUG) || (defined(__GNUC__) && !defined(__OPTIMIZE__))
+    ImGui::TextColored(ImVec4(1.f, 0.5f, 0.f, 1.f), "Unoptimized build: timings and speedups are not meaningful");
+#endif
+
+    bool runAll = ImGui::Button("Run all");
+
+    if (ImGui::BeginTable("benchmarks", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+    {
+        ImGui::TableSetupColumn("Name");
+        ImGui::TableSetupColumn("Iterations");
+        ImGui::TableSetupColumn("Reference (ms)");
+        ImGui::TableSetupColumn("Optimized (ms)");
+        ImGui::TableSetupColumn("Speedup");
+        ImGui::TableSetupColumn("");
+        ImGui::TableHeadersRow();
+
+        for (int i = 0; i < (int)benchmarks.size(); ++i)
+        {
+            Benchmark& benchmark = benchmarks[i];
+            ImGui::PushID(i);
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn(); ImGui::Text("%s", benchmark.name);
+            ImGui::TableNextColumn(); ImGui::Text("%d", benchmark.iterations);
+            ImGui::TableNextColumn(); ImGui::Text("%.3f", benchmark.referenceMs);
+            ImGui::TableNextColumn(); ImGui::Text("%.3f", benchmark.optimizedMs);
+            ImGui::TableNextColumn(); ImGui::Text("x%.2f", benchmark.optimizedMs > 0.0 ? benchmark.referenceMs / benchmark.optimizedMs : 0.0);
+            ImGui::TableNextColumn();
+            if (ImGui::SmallButton("Run") || runAll)
+                Run(benchmark);
+            ImGui::PopID();
+        }
+        ImGui::EndTable();
+    }
+
+    glViewport(0, 0, (int)inputs.windowSize.x, (int)inputs.windowSize.y);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
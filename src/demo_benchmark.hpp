@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+
+#include "demo.hpp"
+
+// CPU microbenchmarks comparing reference and optimized code paths
+class DemoBenchmark : public Demo
+{
+public:
+    DemoBenchmark(const DemoInputs& inputs);
+    ~DemoBenchmark() override;
+
+    void UpdateAndRender(const DemoInputs& inputs) override;
+    const char* Name() const override { return "Benchmark"; }
+
+private:
+    struct Benchmark
+    {
+        const char* name;
+        void (*reference)(int iterations);
+        void (*optimized)(int iterations);
+        int iterations;
+
+        double referenceMs = 0.0;
+        double optimizedMs = 0.0;
+    };
+
+    void Run(Benchmark& benchmark);
+
+    std::vector<Benchmark> benchmarks;
+};
@@ -1,3 +1,6 @@
+#include <cstddef>
+#include <cstdlib>
+#include <vector>
 
 #include "calc.hpp"
 #include "gl_helpers.hpp"
@@ -9,6 +12,13 @@ struct Vertex
 {
     float3 position;
     float3 normal;
+
+    template <typename F>
+    static void Reflect(F&& f)
+    {
+        f(VertexAttrib<VertexAttribute::POSITION, VertexFormat::FLOAT>{ 0 }, &Vertex::position);
+        f(VertexAttrib<VertexAttribute::NORMAL,   VertexFormat::FLOAT>{ 1 }, &Vertex::normal);
+    }
 };
 
 DemoCubemap::DemoCubemap(const DemoInputs& inputs)
@@ -17,37 +27,42 @@ DemoCubemap::DemoCubemap(const DemoInputs& inputs)
 
     // Upload vertex buffer
     {
-        // In memory
-        Vertex* vertices = nullptr;
-        int vertexCount = 0;
+        VertexLayout layout = GetVertexLayout<Vertex>();
 
+        // Size query, then written straight into the mapped buffer
+        int vertexCount = 0;
+        int indexCount = 0;
         {
-            VertexDescriptor descriptor = {};
-            descriptor.positionOffset = offsetof(Vertex, position);
-            descriptor.size = sizeof(Vertex);
-            descriptor.hasNormal = true;
-            descriptor.normalOffset = offsetof(Vertex, normal);
-
-            MeshBuilder builder(descriptor, (void**)&vertices, &vertexCount);
-            icosphere = builder.GenIcosphere(nullptr);
+            MeshBuilder sizeQuery(layout, nullptr, 0, &vertexCount, nullptr, 0, &indexCount);
+            sizeQuery.GenIcosphere(nullptr);
         }
 
         glGenBuffers(1, &vertexBuffer);
 
         glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-        glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertices, GL_STATIC_DRAW);
-    }
+        void* vertices = gl::MapNewBuffer(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex));
+        std::vector<unsigned int> indices(indexCount);
+        {
+            int writtenVertexCount = 0;
+            int writtenIndexCount = 0;
+            MeshBuilder builder(layout, vertices, vertexCount, &writtenVertexCount, indices.data(), indexCount, &writtenIndexCount);
+            icosphere = builder.GenIcosphere(nullptr);
+        }
+        gl::UnmapBuffer(GL_ARRAY_BUFFER);
 
-    // Vertex layout
-    {
+        // Element buffer is part of the vertex array state
         glGenVertexArrays(1, &vertexArrayObject);
         glBindVertexArray(vertexArrayObject);
 
+        glGenBuffers(1, &indexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        indexType = gl::UploadIndices(indices.data(), indexCount);
+    }
+
+    // Vertex layout
+    {
         glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*)offsetof(Vertex, position));
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*)offsetof(Vertex, normal));
+        gl::SetVertexLayout<Vertex>();
     }
 
     // Create program
@@ -111,6 +126,7 @@ DemoCubemap::~DemoCubemap()
     glDeleteProgram(program);
     glDeleteVertexArrays(1, &vertexArrayObject);
     glDeleteBuffers(1, &vertexBuffer);
+    glDeleteBuffers(1, &indexBuffer);
 }
 
 void DemoCubemap::UpdateAndRender(const DemoInputs& inputs)
@@ -136,5 +152,5 @@ void DemoCubemap::UpdateAndRender(const DemoInputs& inputs)
     glBindVertexArray(vertexArrayObject);
 
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glDrawArrays(GL_TRIANGLES, icosphere.start, icosphere.count);
+    glDrawElements(GL_TRIANGLES, icosphere.count, indexType, gl::IndexOffset(indexType, icosphere.start));
 }
\ No newline at end of file
@@ -16,6 +16,8 @@ public:
 
 private:
     GLuint vertexBuffer = 0;
+    GLuint indexBuffer = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
     GLuint vertexArrayObject = 0;
     GLuint program = 0;
     GLuint cubemap = 0;
@@ -1,6 +1,12 @@
 
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <tuple>
+#include <unordered_map>
 #include <vector>
 
 #include <imgui.h>
@@ -8,157 +14,220 @@
 
 #include "types.hpp"
 #include "calc.hpp"
+#include "calc_fast.hpp"
+#include "culling.hpp"
 #include "gl_helpers.hpp"
+#include "jobs.hpp"
+#include "mapped_file.hpp"
 #include "data.hpp"
+#include "resource_loader.hpp"
+#include "texture_streamer.hpp"
 
 #include "demo_fbo.hpp"
 
-// Vertex format
+// Vertex format, 16 bytes instead of 32 with floats
 struct Vertex
 {
-    float3 position;
-    float2 uv;
-    float3 normal;
-};
+    int16_t position[4]; // SNORM16 inside the slice bounds, w is padding
+    uint16_t uv[2];      // UNORM16, tavern and quad UVs are in [0, 1]
+    uint32_t normal;     // SNORM_10_10_10_2
 
-DemoFBO::DemoFBO(const DemoInputs& inputs)
-{
-    // Upload vertex buffer
+    template <typename F>
+    static void Reflect(F&& f)
     {
-        // In memory
-        Vertex* vertices = nullptr;
-        int vertexCount = 0;
-
-        {
-            VertexDescriptor descriptor = {};
-            descriptor.size             = sizeof(Vertex);
-            descriptor.positionOffset   = offsetof(Vertex, position);
-            descriptor.hasUV            = true;
-            descriptor.uvOffset         = offsetof(Vertex, uv);
-            descriptor.hasNormal        = true;
-            descriptor.normalOffset     = offsetof(Vertex, normal);
-
-            MeshBuilder meshBuilder(descriptor, (void**)&vertices, &vertexCount);
-
-            fullscreenQuad = meshBuilder.GenQuad(nullptr, 1.0f, 1.0f);
-            obj            = meshBuilder.LoadObj(nullptr, "media/fantasy_game_inn.obj", "media", 1.f);
-        }
-
-        // In VRAM
-        glGenBuffers(1, &vertexBuffer);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-        glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertices, GL_STATIC_DRAW);
-
-        free(vertices);
+        f(VertexAttrib<VertexAttribute::POSITION, VertexFormat::SNORM16>{ 0 },          &Vertex::position);
+        f(VertexAttrib<VertexAttribute::UV,       VertexFormat::UNORM16>{ 1 },          &Vertex::uv);
+        f(VertexAttrib<VertexAttribute::NORMAL,   VertexFormat::SNORM_10_10_10_2>{ 2 }, &Vertex::normal);
     }
+};
 
-    // Vertex layout
-    {
-        glGenVertexArrays(1, &vertexArrayObject);
-        glBindVertexArray(vertexArrayObject);
-
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*)offsetof(Vertex, position));
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*)offsetof(Vertex, uv));
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*)offsetof(Vertex, normal));
-    }
+// Tavern diffuse texture, reloaded with other mip filters by DemoMipmap
+static const char* DIFFUSE_TEXTURE_FILE = "media/fantasy_game_inn_diffuse.png";
+static const float4 DIFFUSE_PLACEHOLDER = { 0.5f, 0.5f, 0.5f, 1.f };
 
-    // Main program
+DemoFBO::DemoFBO(const DemoInputs& inputs)
+{
+    // Tavern buffers, picking BVH and main program, built on the loader thread when there is one
+    auto loadTavern = [this]()
     {
-        const char* vertexShaderSources[] = {
-            R"GLSL(
-            layout(location = 0) in vec3 aPosition;
-            layout(location = 1) in vec2 aUV;
-            layout(location = 2) in vec3 aNormal;
-
-            out vec4 vColor;
-            out vec2 vUV;
-            out vec3 vWorldPosition;
-            out vec3 vWorldNormal;
-
-            uniform mat4 projection;
-            uniform mat4 view;
-            uniform mat4 model;
-
-            void main()
+        // Upload vertex buffer
+        {
+            // Run once to get the buffer sizes, then again to write into the mapped buffer
+            // The tavern is only parsed when its cache is missing, sizes are then read from the cache tables
+            auto buildMeshes = [this](MeshBuilder& meshBuilder)
+            {
+                // Quad bounds are [-1, 1] so its positions are stored as is and the post process shader needs no dequantization
+                fullscreenQuad = meshBuilder.GenQuad(nullptr, 1.0f, 1.0f);
+
+                // Reorder the tavern for the post-transform cache and overdraw then into meshlets (the mapped buffer cannot be read back)
+                objMeshlets.clear();
+                objModel = {};
+                meshBuilder.OptimizeOnEmit(16, objCacheStats);
+                meshBuilder.BuildMeshletsOnEmit(&objMeshlets);
+                obj            = meshBuilder.LoadObj(nullptr, "media/fantasy_game_inn.obj", "media", 1.f, &objModel);
+                objDequantize  = GetDequantizeMatrix(GetVertexDescriptor<Vertex>(), obj);
+            };
+
+            int vertexCount = 0;
+            int indexCount = 0;
             {
-                vec4 worldPos4 = model * vec4(aPosition, 1.0);
-                gl_Position = projection * view * worldPos4;
-                vUV = aUV;
-                vWorldPosition = worldPos4.xyz / worldPos4.w;
-                vWorldNormal = (model * vec4(aNormal, 0.0)).xyz; // Assuming model is scaled linearly
+                MeshBuilder sizeQuery(GetVertexLayout<Vertex>(), nullptr, 0, &vertexCount, nullptr, 0, &indexCount);
+                buildMeshes(sizeQuery);
             }
-            )GLSL"
-        };
-
-        char defines[256];
-        sprintf(defines, "#define NB_LIGHTS %d\n", Tavern::CandlesCount);
-
-        const char* fragmentShaderSources[] = {
-            defines,
-            R"GLSL(
-            in vec2 vUV;
-            in vec3 vWorldPosition;
-            in vec3 vWorldNormal;
-            layout(location = 0) out vec4 finalColor;
-            layout(location = 1) out vec4 emissiveColor;
 
-            uniform sampler2D diffuseTexture;  // Texture channel 0
-            uniform sampler2D emissiveTexture; // Texture channel 1
-
-            uniform vec3 ambientColor       = vec3(0.0063, 0.0014, 0.0008);
-            uniform vec3 moonDiffuseColor   = vec3(0.0410, 0.0900, 0.2420);
-            uniform vec3 candleDiffuseColor = vec3(1.0000, 1.0000, 0.0711);
+            // Vertices are written straight to the buffer, indices are narrowed by UploadIndices
+            glGenBuffers(1, &vertexBuffer);
+            glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+            void* vertices = gl::MapNewBuffer(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex));
+            std::vector<unsigned int> indices(indexCount);
+            std::vector<float3> positions; // Unquantized, for the picking BVH
+            {
+                int writtenVertexCount = 0;
+                int writtenIndexCount = 0;
+                MeshBuilder meshBuilder(GetVertexLayout<Vertex>(), vertices, vertexCount, &writtenVertexCount, indices.data(), indexCount, &writtenIndexCount);
+                meshBuilder.CopyPositionsOnEmit(&positions);
+                buildMeshes(meshBuilder);
+            }
+            gl::UnmapBuffer(GL_ARRAY_BUFFER);
 
-            uniform vec3 candleWorldPositions[NB_LIGHTS];
-            uniform float candleQuadAttenuation = 1.0;
+            printf("Tavern vertex cache: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+                objCacheStats[0].acmr, objCacheStats[1].acmr, objCacheStats[0].atvr, objCacheStats[1].atvr);
 
-            void main()
+            // Culling inputs stored contiguously
+            meshletBounds.resize(objMeshlets.size());
+            meshletCones.resize(objMeshlets.size());
+            for (size_t m = 0; m < objMeshlets.size(); ++m)
             {
-                vec3 worldNormal = normalize(vWorldNormal); 
+                meshletBounds[m] = objMeshlets[m].bounds;
+                meshletCones[m]  = objMeshlets[m].cone;
+            }
+            printf("Tavern meshlets: %d\n", (int)objMeshlets.size());
 
-                vec3 moonVec = normalize(vec3(-5.0, 4.0, 3.0));
+            // Submeshes are emitted one after the other, and their meshlets with them
+            // Without a LOD chain the base mesh is drawn as one submesh with the default material
+            if (objModel.lods.empty())
+            {
+                objModel.submeshes.assign(1, { obj.start, obj.count, -1 });
+                objModel.lods.push_back({ obj, 0.f, 0, 1 });
+            }
+            submeshMeshletStarts.resize(objModel.submeshes.size() + 1);
+            for (size_t s = 0, m = 0; s < objModel.submeshes.size(); ++s)
+            {
+                while (m < objMeshlets.size() && objMeshlets[m].start < objModel.submeshes[s].start)
+                    ++m;
+                submeshMeshletStarts[s] = (int)m;
+            }
+            submeshMeshletStarts.back() = (int)objMeshlets.size();
+            printf("Tavern: %d materials, %d submeshes at full detail\n", (int)objModel.materials.size(), objModel.lods[0].submeshCount);
+            for (size_t l = 1; l < objModel.lods.size(); ++l)
+                printf("Tavern LOD %d: %d triangles, error %.3f\n", (int)l, objModel.lods[l].slice.count / 3, objModel.lods[l].error);
+
+            glGenBuffers(1, &indexBuffer);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+            // Picking BVH over the full detail triangles as uploaded (the vertex buffer was only written)
+            objBvh = bvh::Build(GetVertexStream(positions.data(), sizeof(float3), 0), indices.data() + obj.start, obj.count);
+            printf("Tavern BVH: %d nodes, %d triangle packs\n", (int)objBvh.nodes.size(), (int)objBvh.packs.size());
+
+            indexType = gl::UploadIndices(indices.data(), indexCount);
+        }
 
-                vec3 lightDiffuse = vec3(0.0);
-                lightDiffuse += max(dot(moonVec, worldNormal), 0.0) * moonDiffuseColor;
-                
-                // Compute candle diffuse lighting
-                for (int i = 0; i < NB_LIGHTS; ++i)
+        // Main program
+        {
+            const char* vertexShaderSources[] = {
+                R"GLSL(
+                layout(location = 0) in vec3 aPosition;
+                layout(location = 1) in vec2 aUV;
+                layout(location = 2) in vec3 aNormal;
+
+                out vec4 vColor;
+                out vec2 vUV;
+                out vec3 vWorldPosition;
+                out vec3 vWorldNormal;
+
+                uniform mat4 projection;
+                uniform mat4 view;
+                uniform mat4 model;
+                uniform mat4 dequantize; // Stored to object space positions
+
+                void main()
                 {
-                    vec3 candleToFragVec = candleWorldPositions[i] - vWorldPosition;
-                    float dist = length(candleToFragVec);
-                    vec3 dir = normalize(candleToFragVec);
-                    float attenuation = 1.0 / (1.0 + candleQuadAttenuation * (dist * dist));
-                    lightDiffuse += attenuation * max(dot(dir, worldNormal), 0.0) * candleDiffuseColor;
+                    vec4 worldPos4 = model * dequantize * vec4(aPosition, 1.0);
+                    gl_Position = projection * view * worldPos4;
+                    vUV = aUV;
+                    vWorldPosition = worldPos4.xyz / worldPos4.w;
+                    vWorldNormal = (model * vec4(aNormal, 0.0)).xyz; // Assuming model is scaled linearly
                 }
+                )GLSL"
+            };
+
+            char defines[256];
+            sprintf(defines, "#define NB_LIGHTS %d\n", Tavern::CandlesCount);
+
+            const char* fragmentShaderSources[] = {
+                defines,
+                R"GLSL(
+                in vec2 vUV;
+                in vec3 vWorldPosition;
+                in vec3 vWorldNormal;
+                layout(location = 0) out vec4 finalColor;
+                layout(location = 1) out vec4 emissiveColor;
+
+                uniform sampler2D diffuseTexture;  // Texture channel 0
+                uniform sampler2D emissiveTexture; // Texture channel 1
+                uniform vec3 materialDiffuse  = vec3(1.0); // Multiply the textures
+                uniform vec3 materialEmissive = vec3(1.0);
+
+                uniform vec3 ambientColor       = vec3(0.0063, 0.0014, 0.0008);
+                uniform vec3 moonDiffuseColor   = vec3(0.0410, 0.0900, 0.2420);
+                uniform vec3 candleDiffuseColor = vec3(1.0000, 1.0000, 0.0711);
+
+                uniform vec3 candleWorldPositions[NB_LIGHTS];
+                uniform float candleQuadAttenuation = 1.0;
+
+                void main()
+                {
+                    vec3 worldNormal = normalize(vWorldNormal); 
 
-                vec3 diffuse = texture(diffuseTexture, vUV).rgb * lightDiffuse;
-                vec3 emissive = texture(emissiveTexture, vUV).rgb;
+                    vec3 moonVec = normalize(vec3(-5.0, 4.0, 3.0));
 
-                finalColor    = vec4(ambientColor + diffuse + emissive, 1.0);
-                emissiveColor = vec4(emissive, 1.0);
+                    vec3 lightDiffuse = vec3(0.0);
+                    lightDiffuse += max(dot(moonVec, worldNormal), 0.0) * moonDiffuseColor;
+                
+                    // Compute candle diffuse lighting
+                    for (int i = 0; i < NB_LIGHTS; ++i)
+                    {
+                        vec3 candleToFragVec = candleWorldPositions[i] - vWorldPosition;
+                        float dist = length(candleToFragVec);
+                        vec3 dir = normalize(candleToFragVec);
+                        float attenuation = 1.0 / (1.0 + candleQuadAttenuation * (dist * dist));
+                        lightDiffuse += attenuation * max(dot(dir, worldNormal), 0.0) * candleDiffuseColor;
+                    }
+
+                    vec3 diffuse = texture(diffuseTexture, vUV).rgb * materialDiffuse * lightDiffuse;
+                    vec3 emissive = texture(emissiveTexture, vUV).rgb * materialEmissive;
+
+                    finalColor    = vec4(ambientColor + diffuse + emissive, 1.0);
+                    emissiveColor = vec4(emissive, 1.0);
             
-                // Show normals only
-                //finalColor    = vec4(worldNormal, 1.0);
-
-                //finalColor      = vec4(texture(diffuseTexture, vUV).rgb, 1.0);
-            }
-            )GLSL"
-        };
+                    // Show normals only
+                    //finalColor    = vec4(worldNormal, 1.0);
 
-        mainProgram = gl::CreateProgram(
-            ARRAYSIZE(vertexShaderSources),
-            vertexShaderSources,
-            ARRAYSIZE(fragmentShaderSources),
-            fragmentShaderSources
-        );
-
-        glUseProgram(mainProgram);
-        glUniform3fv(glGetUniformLocation(mainProgram, "candleWorldPositions"), Tavern::CandlesCount, Tavern::CandlesPositions[0].e);
-    }
+                    //finalColor      = vec4(texture(diffuseTexture, vUV).rgb, 1.0);
+                }
+                )GLSL"
+            };
+
+            mainProgram = gl::CreateProgram(
+                ARRAYSIZE(vertexShaderSources),
+                vertexShaderSources,
+                ARRAYSIZE(fragmentShaderSources),
+                fragmentShaderSources
+            );
+
+            glUseProgram(mainProgram);
+            glUniform3fv(glGetUniformLocation(mainProgram, "candleWorldPositions"), Tavern::CandlesCount, Tavern::CandlesPositions[0].e);
+        }
+    };
 
     // Post process program
     postProcessProgram = gl::CreateBasicProgram(
@@ -194,19 +263,90 @@ DemoFBO::DemoFBO(const DemoInputs& inputs)
     glUseProgram(postProcessProgram);
     glUniformMatrix4fv(glGetUniformLocation(postProcessProgram, "colorTransform"), 1, GL_FALSE, mat4Identity().e);
 
+    // Images are streamed in when a streamer is available, the demo starts with placeholder colors
+    TextureStreamer* textureStreamer = inputs.textureStreamer;
+    auto loadTexture = [textureStreamer](const char* file, float4 placeholder)
+    {
+        if (textureStreamer != nullptr)
+            return textureStreamer->Request(file, TextureUsage::LINEAR_COLOR, MipFilter::KAISER, true, placeholder);
+
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        gl::UploadImage(file, true);
+        gl::SetTextureDefaultParams();
+        return texture;
+    };
+
     // Load diffuse/emissive texture
     {
+        diffuseTexture = loadTexture(DIFFUSE_TEXTURE_FILE, DIFFUSE_PLACEHOLDER); // 2048x2048
+        emissiveTexture = loadTexture("media/fantasy_game_inn_emissive.png", { 0.f, 0.f, 0.f, 1.f });
+    }
+
+    // Vertex arrays are not shared between contexts, the tavern one is created once its buffers are ready
+    // Materials are known once the model is loaded
+    auto finishTavern = [this, loadTexture]()
+    {
+        // Element buffer is part of the vertex array state
+        glGenVertexArrays(1, &vertexArrayObject);
+        glBindVertexArray(vertexArrayObject);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        gl::SetVertexLayout<Vertex>();
+
+        // Load material textures, faces without material use the tavern textures
         {
-            glGenTextures(1, &diffuseTexture);
-            glBindTexture(GL_TEXTURE_2D, diffuseTexture);
-            gl::UploadImage("media/fantasy_game_inn_diffuse.png", true); // 2048x2048
-            gl::SetTextureDefaultParams();
+            // Missing maps sample white and are scaled by the material color
+            GLuint whiteTexture;
+            glGenTextures(1, &whiteTexture);
+            glBindTexture(GL_TEXTURE_2D, whiteTexture);
+            gl::UploadColoredTexture(1.f, 1.f, 1.f, 1.f);
+            gl::SetTextureDefaultParams(false);
+            materialTextures.push_back(whiteTexture);
+
+            std::unordered_map<std::string, GLuint> pathTextures;
+            auto getTexture = [&](const std::string& path, float4 placeholder)
+            {
+                if (path.empty())
+                    return whiteTexture;
+
+                auto found = pathTextures.find(path);
+                if (found != pathTextures.end())
+                    return found->second;
+
+                uint64_t fileSize, fileTime;
+                if (!GetFileInfo(path.c_str(), &fileSize, &fileTime))
+                {
+                    fprintf(stderr, "Material texture '%s' not found\n", path.c_str());
+                    return pathTextures[path] = whiteTexture;
+                }
+
+                GLuint texture = loadTexture(path.c_str(), placeholder);
+                materialTextures.push_back(texture);
+                return pathTextures[path] = texture;
+            };
+
+            // MTL colors are in display space like the maps
+            materialStates.push_back({ diffuseTexture, emissiveTexture, { 1.f, 1.f, 1.f }, { 1.f, 1.f, 1.f } });
+            for (const obj::Material& material : objModel.materials)
+            {
+                materialStates.push_back({ getTexture(material.diffuseTexture, { 0.5f, 0.5f, 0.5f, 1.f }), getTexture(material.emissiveTexture, { 0.f, 0.f, 0.f, 1.f }),
+                    calc::fast::Pow(material.diffuseColor, 2.2f), calc::fast::Pow(material.emissiveColor, 2.2f) });
+            }
         }
 
-        glGenTextures(1, &emissiveTexture);
-        glBindTexture(GL_TEXTURE_2D, emissiveTexture);
-        gl::UploadImage("media/fantasy_game_inn_emissive.png", true);
-        gl::SetTextureDefaultParams();
+        tavernLoaded = true;
+    };
+
+    if (inputs.resourceLoader != nullptr)
+    {
+        inputs.resourceLoader->Load(loadTavern, finishTavern);
+    }
+    else
+    {
+        loadTavern();
+        finishTavern();
     }
 
     // Create framebuffer (for post process pass)
@@ -291,16 +431,38 @@ void DemoFBO::Framebuffer::Delete()
     glDeleteRenderbuffers(1, &depthRenderbuffer);
 }
 
+void DemoFBO::ReloadDiffuseTexture(TextureStreamer* textureStreamer, MipFilter mipFilter)
+{
+    if (textureStreamer == nullptr)
+    {
+        glBindTexture(GL_TEXTURE_2D, diffuseTexture);
+        gl::UploadImage(DIFFUSE_TEXTURE_FILE, true, true, mipFilter);
+        return;
+    }
+
+    // Levels of the current texture may still be streaming, it is never written here
+    GLuint texture = textureStreamer->Request(DIFFUSE_TEXTURE_FILE, TextureUsage::LINEAR_COLOR, mipFilter, true, DIFFUSE_PLACEHOLDER);
+    for (MaterialState& state : materialStates)
+    {
+        if (state.diffuseTexture == diffuseTexture)
+            state.diffuseTexture = texture;
+    }
+    textureStreamer->Release(diffuseTexture);
+    diffuseTexture = texture;
+}
+
 DemoFBO::~DemoFBO()
 {
     // Delete OpenGL objects
     framebuffer.Delete();
     glDeleteTextures(1, &diffuseTexture);
     glDeleteTextures(1, &emissiveTexture);
+    glDeleteTextures((GLsizei)materialTextures.size(), materialTextures.data());
     glDeleteProgram(mainProgram);
     glDeleteProgram(postProcessProgram);
     glDeleteVertexArrays(1, &vertexArrayObject);
     glDeleteBuffers(1, &vertexBuffer);
+    glDeleteBuffers(1, &indexBuffer);
 }
 
 static void EditFloatUniform(GLuint program, const char* name, float speed = 0.01f)
@@ -325,10 +487,10 @@ static void EditColorUniform(GLuint program, const char* name)
 
     float3 value;
     glGetUniformfv(program, location, value.e);
-    value = calc::Pow(value, 1.f / gamma);
+    value = calc::fast::Pow(value, 1.f / gamma);
     if (ImGui::ColorEdit3(name, value.e, ImGuiColorEditFlags_Float))
     {
-        value = calc::Pow(value, gamma);
+        value = calc::fast::Pow(value, gamma);
         glUniform3fv(location, 1, value.e);
     }
 }
@@ -344,6 +506,14 @@ void DemoFBO::UpdateAndRender(const DemoInputs& inputs)
     // Update camera
     mainCamera.UpdateFreeFly(inputs.cameraInputs);
 
+    // Nothing to draw until the loader thread hands over the tavern
+    if (!tavernLoaded)
+    {
+        ImGui::Text("Loading tavern...");
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        return;
+    }
+
     // Show debug info
     static bool applyPostprocess = false;
     static bool showEmissive = false;
@@ -357,6 +527,32 @@ void DemoFBO::UpdateAndRender(const DemoInputs& inputs)
         ImGui::Image((ImTextureID)(size_t)framebuffer.emissiveTexture, imageSize, ImVec2(0, 1), ImVec2(1, 0));
     }
 
+    ImGui::SliderInt("Instance grid size", &instanceGridSize, 1, 64);
+    ImGui::Checkbox("Frustum culling", &frustumCulling);
+    ImGui::Text("Instances: %d tested, %d visible", testedCount, visibleCount);
+    ImGui::Checkbox("LOD selection", &lodSelection);
+    if (lodSelection)
+    {
+        ImGui::SliderFloat("LOD error (pixels)", &lodErrorPixels, 0.25f, 16.f, "%.2f");
+        for (size_t l = 0; l < lodInstanceCounts.size(); ++l)
+        {
+            ImGui::Text("LOD %d: %d instances", (int)l, lodInstanceCounts[l]);
+            if (l + 1 < lodInstanceCounts.size())
+                ImGui::SameLine();
+        }
+    }
+    ImGui::Text("Triangles drawn: %d", drawnTriangleCount);
+    ImGui::Checkbox("Meshlet culling", &meshletCulling);
+    if (meshletCulling)
+        ImGui::Text("Meshlets: %d tested, %d visible", testedMeshletCount, visibleMeshletCount);
+    ImGui::Text("Draws: %d (%d ranges), %d state changes", (int)draws.size(), drawRangeCount, stateChangeCount);
+    ImGui::Text("Tavern vertex cache: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f",
+        objCacheStats[0].acmr, objCacheStats[1].acmr, objCacheStats[0].atvr, objCacheStats[1].atvr);
+    if (pickedInstance >= 0)
+        ImGui::Text("Picked instance %d, triangle %d at (%.2f, %.2f, %.2f)", pickedInstance, pickedTriangle, pickedPosition.x, pickedPosition.y, pickedPosition.z);
+    else
+        ImGui::Text("Left click to pick a tavern instance");
+
     // Setup main program uniforms
     mat4 projection = mat4Perspective(calc::ToRadians(60.f), inputs.windowSize.x / inputs.windowSize.y, 0.1f, 400.f);
     mat4 view       = mainCamera.GetViewMatrix();
@@ -415,6 +611,11 @@ void DemoFBO::UpdateAndRender(const DemoInputs& inputs)
             glDisable(GL_FRAMEBUFFER_SRGB);
     }
 
+    // Mouse picking against the instances just drawn
+    ImGuiIO& io = ImGui::GetIO();
+    if (ImGui::IsMouseClicked(ImGuiMouseButton_Left) && !io.WantCaptureMouse && ImGui::IsMousePosValid())
+        PickTavern(mainCamera.GetPickingRay({ io.MousePos.x, io.MousePos.y }, inputs.windowSize, projection));
+
     if (applyPostprocess)
     {
         // Render framebuffer to screen using postprocess shader and a fullscreen quad
@@ -427,7 +628,7 @@ void DemoFBO::UpdateAndRender(const DemoInputs& inputs)
             glBindTexture(GL_TEXTURE_2D, showEmissive ? framebuffer.emissiveTexture : framebuffer.finalTexture);
             glBindVertexArray(vertexArrayObject);
 
-            glDrawArrays(GL_TRIANGLES, fullscreenQuad.start, fullscreenQuad.count);
+            glDrawElements(GL_TRIANGLES, fullscreenQuad.count, indexType, gl::IndexOffset(indexType, fullscreenQuad.start));
             glDisable(GL_FRAMEBUFFER_SRGB);
         }
 
@@ -446,27 +647,270 @@ void DemoFBO::UpdateAndRender(const DemoInputs& inputs)
 
 void DemoFBO::RenderTavern(const mat4& projection, const mat4& view, const mat4& model)
 {
+    if (!tavernLoaded)
+        return;
+
     // Setup main program uniforms
     {
         glUseProgram(mainProgram);
 
         glUniformMatrix4fv(glGetUniformLocation(mainProgram, "projection"), 1, GL_FALSE, projection.e);
         glUniformMatrix4fv(glGetUniformLocation(mainProgram, "view"), 1, GL_FALSE, view.e);
-        glUniformMatrix4fv(glGetUniformLocation(mainProgram, "model"), 1, GL_FALSE, model.e);
+        glUniformMatrix4fv(glGetUniformLocation(mainProgram, "dequantize"), 1, GL_FALSE, objDequantize.e);
 
         glUniform1i(glGetUniformLocation(mainProgram, "diffuseTexture"), 0);
         glUniform1i(glGetUniformLocation(mainProgram, "emissiveTexture"), 1);
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, diffuseTexture);
+        glBindVertexArray(vertexArrayObject);
+    }
 
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, emissiveTexture);
+    // Place instances on a grid centered on the model origin and compute their world bounds
+    int instanceCount = instanceGridSize * instanceGridSize;
+    instanceModels.resize(instanceCount);
+    instanceBounds.resize(instanceCount);
+    instanceVisible.resize(instanceCount);
 
-        glBindVertexArray(vertexArrayObject);
+    float3 spacing = obj.bounds.extents * 2.2f;
+    float gridCenter = (instanceGridSize - 1) * 0.5f;
+    for (int i = 0; i < instanceCount; ++i)
+    {
+        float3 offset = { ((i % instanceGridSize) - gridCenter) * spacing.x, 0.f, ((i / instanceGridSize) - gridCenter) * spacing.z };
+        instanceModels[i] = model * mat4Translate(offset);
+        instanceBounds[i] = culling::TransformBounds(obj.bounds, instanceModels[i]);
+    }
+
+    // Cull instances outside the camera frustum
+    testedCount = instanceCount;
+    if (frustumCulling)
+    {
+        Frustum frustum = culling::ExtractFrustum(projection * view);
+        visibleCount = culling::CullBoxes(frustum, instanceBounds.data(), instanceCount, instanceVisible.data(), true);
+    }
+    else
+    {
+        std::fill(instanceVisible.begin(), instanceVisible.end(), 1);
+        visibleCount = instanceCount;
+    }
+
+    // Select the level of each visible instance from the screen size of its error
+    int levelCount = (int)objModel.lods.size();
+    instanceLods.assign(instanceCount, 0);
+    lodInstanceCounts.assign(levelCount, 0);
+    if (lodSelection)
+    {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        float3 cameraPosition = mat4Inverse(view).c[3].xyz;
+        for (int i = 0; i < instanceCount; ++i)
+        {
+            if (!instanceVisible[i])
+                continue;
+
+            // Closest point of the bounding sphere, errors scale with the instance
+            const Bounds& bounds = instanceBounds[i];
+            float distance = v3Length(bounds.center - cameraPosition) - bounds.radius;
+            float errorScale = bounds.radius / obj.bounds.radius;
+            int level = 0;
+            while (distance > 0.f && level + 1 < levelCount
+                && culling::GetProjectedSize(objModel.lods[level + 1].error * errorScale, distance, projection, (float)viewport[3]) <= lodErrorPixels)
+                level++;
+
+            instanceLods[i] = level;
+            lodInstanceCounts[level]++;
+        }
+    }
+
+    // Index ranges of each visible instance per submesh of its level, ranges of a submesh start at its first meshlet
+    int meshletCount = (int)objMeshlets.size();
+    int submeshCount = (int)objModel.submeshes.size();
+    if (meshletCulling)
+        meshletVisible.resize((size_t)instanceCount * meshletCount);
+    drawIndexCounts.resize((size_t)instanceCount * meshletCount);
+    drawIndexOffsets.resize((size_t)instanceCount * meshletCount);
+    std::vector<int> submeshRangeCounts((size_t)instanceCount * submeshCount, 0);
+    std::vector<int> triangleCounts(instanceCount, 0);
+    std::vector<int> instanceTestedMeshletCounts(instanceCount, 0);
+    std::vector<int> instanceVisibleMeshletCounts(instanceCount, 0);
+    jobs::ParallelFor(instanceCount, 1, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+        {
+            if (!instanceVisible[i])
+                continue;
+
+            // Meshlets are culled in object space
+            const MeshLod& level = objModel.lods[instanceLods[i]];
+            mat4 modelView = view * instanceModels[i];
+            Frustum frustum = culling::ExtractFrustum(projection * modelView);
+            float3 cameraPosition = mat4Inverse(modelView).c[3].xyz;
+            for (int s = level.firstSubmesh; s < level.firstSubmesh + level.submeshCount; ++s)
+            {
+                int first = submeshMeshletStarts[s];
+                size_t firstRange = (size_t)i * meshletCount + first;
+                GLsizei* counts = &drawIndexCounts[firstRange];
+                const GLvoid** offsets = &drawIndexOffsets[firstRange];
+                int rangeCount = 0;
+                if (!meshletCulling)
+                {
+                    const MeshSubmesh& submesh = objModel.submeshes[s];
+                    counts[0] = submesh.count;
+                    offsets[0] = gl::IndexOffset(indexType, submesh.start);
+                    rangeCount = 1;
+                    triangleCounts[i] += submesh.count / 3;
+                }
+                else
+                {
+                    int submeshMeshletCount = submeshMeshletStarts[s + 1] - first;
+                    unsigned char* visible = &meshletVisible[firstRange];
+                    culling::CullSpheres(frustum, &meshletBounds[first], submeshMeshletCount, visible);
+                    instanceVisibleMeshletCounts[i] += culling::CullCones(cameraPosition, &meshletCones[first], submeshMeshletCount, visible);
+                    instanceTestedMeshletCounts[i] += submeshMeshletCount;
+
+                    // Consecutive meshlets are contiguous in the index buffer, ranges never span two submeshes
+                    int rangeEnd = -1;
+                    for (int m = 0; m < submeshMeshletCount; ++m)
+                    {
+                        if (!visible[m])
+                            continue;
+
+                        const Meshlet& meshlet = objMeshlets[first + m];
+                        if (meshlet.start == rangeEnd)
+                        {
+                            counts[rangeCount - 1] += meshlet.count;
+                        }
+                        else
+                        {
+                            counts[rangeCount] = meshlet.count;
+                            offsets[rangeCount] = gl::IndexOffset(indexType, meshlet.start);
+                            rangeCount++;
+                        }
+                        rangeEnd = meshlet.start + meshlet.count;
+                        triangleCounts[i] += meshlet.count / 3;
+                    }
+                }
+                submeshRangeCounts[(size_t)i * submeshCount + s] = rangeCount;
+            }
+        }
+    });
+
+    testedMeshletCount = 0;
+    visibleMeshletCount = 0;
+    drawnTriangleCount = 0;
+    for (int i = 0; i < instanceCount; ++i)
+    {
+        testedMeshletCount += instanceTestedMeshletCounts[i];
+        visibleMeshletCount += instanceVisibleMeshletCounts[i];
+        drawnTriangleCount += triangleCounts[i];
+    }
+
+    // Sort the draws by state, instances stay in grid order for a given state
+    draws.clear();
+    drawRangeCount = 0;
+    for (int i = 0; i < instanceCount; ++i)
+    {
+        if (!instanceVisible[i])
+            continue;
 
-        glDrawArrays(GL_TRIANGLES, obj.start, obj.count);
+        const MeshLod& level = objModel.lods[instanceLods[i]];
+        for (int s = level.firstSubmesh; s < level.firstSubmesh + level.submeshCount; ++s)
+        {
+            int rangeCount = submeshRangeCounts[(size_t)i * submeshCount + s];
+            if (rangeCount == 0)
+                continue;
+
+            int material = objModel.submeshes[s].materialId + 1;
+            const MaterialState& state = materialStates[material];
+            draws.push_back({ mainProgram, state.diffuseTexture, state.emissiveTexture, i, material, i * meshletCount + submeshMeshletStarts[s], rangeCount });
+            drawRangeCount += rangeCount;
+        }
+    }
+    std::stable_sort(draws.begin(), draws.end(), [](const Draw& a, const Draw& b)
+    {
+        return std::tie(a.program, a.diffuseTexture, a.emissiveTexture) < std::tie(b.program, b.diffuseTexture, b.emissiveTexture);
+    });
+
+    // Bind program and textures when they change, then per draw uniforms when they change
+    {
+        GLint modelLocation = glGetUniformLocation(mainProgram, "model");
+        GLint diffuseColorLocation = glGetUniformLocation(mainProgram, "materialDiffuse");
+        GLint emissiveColorLocation = glGetUniformLocation(mainProgram, "materialEmissive");
+        GLuint boundProgram = mainProgram;
+        GLuint boundDiffuse = 0;
+        GLuint boundEmissive = 0;
+        int boundMaterial = -1;
+        int boundInstance = -1;
+        stateChangeCount = 0;
+        for (const Draw& draw : draws)
+        {
+            if (stateChangeCount == 0 || draw.program != boundProgram || draw.diffuseTexture != boundDiffuse || draw.emissiveTexture != boundEmissive)
+            {
+                if (draw.program != boundProgram)
+                    glUseProgram(draw.program);
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, draw.diffuseTexture);
+                glActiveTexture(GL_TEXTURE1);
+                glBindTexture(GL_TEXTURE_2D, draw.emissiveTexture);
+                boundProgram = draw.program;
+                boundDiffuse = draw.diffuseTexture;
+                boundEmissive = draw.emissiveTexture;
+                stateChangeCount++;
+            }
+
+            if (draw.material != boundMaterial)
+            {
+                glUniform3fv(diffuseColorLocation, 1, materialStates[draw.material].diffuseColor.e);
+                glUniform3fv(emissiveColorLocation, 1, materialStates[draw.material].emissiveColor.e);
+                boundMaterial = draw.material;
+            }
+
+            if (draw.instance != boundInstance)
+            {
+                glUniformMatrix4fv(modelLocation, 1, GL_FALSE, instanceModels[draw.instance].e);
+                boundInstance = draw.instance;
+            }
+
+            if (draw.rangeCount == 1)
+                glDrawElements(GL_TRIANGLES, drawIndexCounts[draw.firstRange], indexType, drawIndexOffsets[draw.firstRange]);
+            else
+                glMultiDrawElements(GL_TRIANGLES, &drawIndexCounts[draw.firstRange], indexType, &drawIndexOffsets[draw.firstRange], draw.rangeCount);
+        }
 
         glActiveTexture(GL_TEXTURE0);
     }
 }
+
+void DemoFBO::PickTavern(const Ray& ray)
+{
+    // One object space ray per visible instance, traced as a batch
+    std::vector<Ray> rays;
+    std::vector<int> instances;
+    for (int i = 0; i < (int)instanceModels.size(); ++i)
+    {
+        if (!instanceVisible[i])
+            continue;
+
+        mat4 worldToObject = mat4Inverse(instanceModels[i]);
+        rays.push_back({ (worldToObject * float4(ray.origin, 1.f)).xyz, (worldToObject * float4(ray.direction, 0.f)).xyz, ray.maxDistance });
+        instances.push_back(i);
+    }
+
+    std::vector<RayHit> hits(rays.size());
+    bvh::IntersectRays(objBvh, rays.data(), hits.data(), (int)rays.size());
+
+    // Affine transforms keep the distances along the ray, hits of different instances compare directly
+    pickedInstance = -1;
+    pickedTriangle = -1;
+    float closest = ray.maxDistance;
+    for (size_t h = 0; h < hits.size(); ++h)
+    {
+        if (hits[h].triangle < 0 || hits[h].distance > closest)
+            continue;
+
+        closest = hits[h].distance;
+        pickedInstance = instances[h];
+        pickedTriangle = obj.start / 3 + hits[h].triangle;
+    }
+
+    if (pickedInstance >= 0)
+        pickedPosition = ray.origin + ray.direction * closest;
+}
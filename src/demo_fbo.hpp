@@ -1,8 +1,14 @@
 #pragma once
 
+#include <cstdint>
+#include <vector>
+
 #include "glad/glad.h"
 
+#include "bvh.hpp"
+#include "culling.hpp"
 #include "mesh_builder.hpp"
+#include "mip_filter.hpp"
 
 #include "demo.hpp"
 
@@ -17,8 +23,15 @@ public:
     void RenderTavern(const mat4& projection, const mat4& view, const mat4& model);
     void RenderTavernWithPostprocess(const mat4& projection, const mat4& view, const mat4& model);
 
+    // Closest visible tavern instance hit by a world space ray (instances of the last rendered frame)
+    void PickTavern(const Ray& ray);
+
     GLuint GetDiffuseTexture() const { return diffuseTexture; }
 
+    // Load the tavern diffuse texture again with another mip filter, through the streamer if any
+    // Streamed textures are replaced by a new request (drawn with the placeholder until its levels arrive), the old one is released
+    void ReloadDiffuseTexture(TextureStreamer* textureStreamer, MipFilter mipFilter);
+
 protected:
     struct Framebuffer
     {
@@ -38,7 +51,10 @@ protected:
     Camera mainCamera = {};
 
     GLuint vertexBuffer = 0;
+    GLuint indexBuffer = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
     GLuint vertexArrayObject = 0;
+    bool tavernLoaded = false; // Buffers and main program are created, maybe on the resource loader thread
 
     // First pass data (render offscreen)
     Framebuffer framebuffer = {};
@@ -47,9 +63,72 @@ protected:
     GLuint emissiveTexture = 0;
     MeshSlice fullscreenQuad = {};
 
+    // Material of each submesh, the default one (tavern textures) first then objModel.materials
+    struct MaterialState
+    {
+        GLuint diffuseTexture;
+        GLuint emissiveTexture;
+        float3 diffuseColor;  // Linear
+        float3 emissiveColor;
+    };
+    std::vector<MaterialState> materialStates;
+    std::vector<GLuint> materialTextures; // Loaded once per path, plus the white fallback
+
     // Second pass data (postprocess)
     GLuint postProcessProgram = 0;
     MeshSlice obj = {};
+    ObjModel objModel; // Full detail (obj) first, then coarser levels sharing its dequantization
+    mat4 objDequantize = mat4Identity();
+    VertexCacheStats objCacheStats[2] = {}; // Before and after optimization
+
+    // Tavern instances drawn on a grid, culled against the camera frustum
+    int instanceGridSize = 1;
+    bool frustumCulling = true;
+    std::vector<mat4> instanceModels;
+    std::vector<Bounds> instanceBounds;
+    std::vector<unsigned char> instanceVisible;
+    int testedCount = 0;
+    int visibleCount = 0;
+
+    // Coarsest level whose error projects to at most lodErrorPixels, per instance
+    bool lodSelection = true;
+    float lodErrorPixels = 1.f;
+    std::vector<int> instanceLods;
+    std::vector<int> lodInstanceCounts;
+    int drawnTriangleCount = 0;
+
+    // Tavern meshlets culled per visible instance (frustum and normal cone), drawn as merged index ranges
+    bool meshletCulling = true;
+    std::vector<Meshlet> objMeshlets;
+    std::vector<int> submeshMeshletStarts; // First meshlet of each submesh, then the meshlet count
+    std::vector<Bounds> meshletBounds;
+    std::vector<NormalCone> meshletCones;
+    std::vector<unsigned char> meshletVisible;  // Meshlet count per instance
+    std::vector<GLsizei> drawIndexCounts;       // Meshlet count per instance, ranges of a submesh start at its first meshlet
+    std::vector<const GLvoid*> drawIndexOffsets;
+    int testedMeshletCount = 0;
+    int visibleMeshletCount = 0;
+    int drawRangeCount = 0;
+
+    // One draw per visible instance and submesh of its level, sorted so state only changes between different programs or textures
+    struct Draw
+    {
+        GLuint program; // Sorted by program, then diffuse texture, then emissive texture
+        GLuint diffuseTexture;
+        GLuint emissiveTexture;
+        int instance;
+        int material;   // In materialStates
+        int firstRange; // In drawIndexCounts and drawIndexOffsets
+        int rangeCount;
+    };
+    std::vector<Draw> draws;
+    int stateChangeCount = 0;
+
+    // Full detail tavern triangles in object space, picked with the left mouse button
+    Bvh objBvh;
+    int pickedInstance = -1;
+    int pickedTriangle = -1; // In the index buffer (first index is 3 * pickedTriangle)
+    float3 pickedPosition = {};
 
     float time = 0.f;
 };
\ No newline at end of file
@@ -1,12 +1,19 @@
 
+#include <chrono>
 #include <vector>
 #include <imgui.h>
+#include <stb_image.h>
 
 #include "calc.hpp"
+#include "calc_fast.hpp"
 
 #include "gl_helpers.hpp"
 #include "demo_mipmap.hpp"
 
+static const char* DIFFUSE_TEXTURE_FILE = "media/fantasy_game_inn_diffuse.png";
+
+static const MipFilter MIP_FILTERS[] = { MipFilter::BOX, MipFilter::KAISER, MipFilter::LANCZOS };
+
 DemoMipmap::DemoMipmap(const DemoInputs& inputs)
     : demoFBO(inputs)
 {
@@ -77,6 +84,40 @@ void DemoMipmap::UpdateAndRender(const DemoInputs& inputs)
 
             ImGui::EndCombo();
         }
+
+        // Mip levels are built on the CPU, reloading is only slow the first time (then read from the texture cache)
+        if (ImGui::BeginCombo("mip filter", mip::GetFilterName(mipFilter)))
+        {
+            for (MipFilter filter : MIP_FILTERS)
+            {
+                if (ImGui::Selectable(mip::GetFilterName(filter), filter == mipFilter) && filter != mipFilter)
+                {
+                    // Streamed textures get a new texture, the sampling state is applied to it again
+                    mipFilter = filter;
+                    demoFBO.ReloadDiffuseTexture(inputs.textureStreamer, mipFilter);
+                    glBindTexture(GL_TEXTURE_2D, demoFBO.GetDiffuseTexture());
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
+                    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_LOD, (float)minLevel);
+                }
+            }
+
+            ImGui::EndCombo();
+        }
+
+        // Show a single level up close to compare the filters (with a mipmap texture filter)
+        // The base level belongs to the texture streamer, which raises it while finer levels arrive
+        int maxLevel = 0;
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+        if (ImGui::SliderInt("min level", &minLevel, 0, calc::Min(maxLevel, 16)))
+            glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_LOD, (float)minLevel);
+
+        if (ImGui::Button("Measure mip chain cost"))
+            MeasureMipFilters();
+        for (MipFilter filter : MIP_FILTERS)
+        {
+            if (mipFilterTimes[(int)filter] > 0.0)
+                ImGui::Text("%s: %.1f ms", mip::GetFilterName(filter), mipFilterTimes[(int)filter]);
+        }
     }
 
     mat4 projection = mat4Perspective(calc::ToRadians(60.f), inputs.windowSize.x / inputs.windowSize.y, 0.1f, 400.f);
@@ -90,3 +131,46 @@ void DemoMipmap::UpdateAndRender(const DemoInputs& inputs)
     demoFBO.RenderTavern(projection, view, mat4Identity());
     glDisable(GL_FRAMEBUFFER_SRGB);
 }
+
+// CPU cost of the whole mip chain of the tavern diffuse texture for each filter
+void DemoMipmap::MeasureMipFilters()
+{
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    unsigned char* colors = stbi_load(DIFFUSE_TEXTURE_FILE, &width, &height, &channels, 4);
+    if (colors == nullptr)
+        return;
+
+    std::vector<float4> level0((size_t)width * height);
+    float* values = level0[0].e;
+    for (size_t i = 0; i < level0.size() * 4; ++i)
+        values[i] = colors[i] / 255.f;
+    calc::fast::SRGBToLinear(values, values, (int)level0.size() * 4, true);
+    stbi_image_free(colors);
+
+    std::vector<float4> levels[2];
+    for (MipFilter filter : MIP_FILTERS)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        const float4* src = level0.data();
+        int srcWidth = width;
+        int srcHeight = height;
+        for (int i = 0; srcWidth > 1 || srcHeight > 1; ++i)
+        {
+            int dstWidth  = calc::Max(srcWidth  / 2, 1);
+            int dstHeight = calc::Max(srcHeight / 2, 1);
+            std::vector<float4>& dst = levels[i % 2];
+            dst.resize((size_t)dstWidth * dstHeight);
+            mip::Downsample(filter, dst.data(), dstWidth, dstHeight, src, srcWidth, srcHeight);
+
+            src = dst.data();
+            srcWidth = dstWidth;
+            srcHeight = dstHeight;
+        }
+
+        auto end = std::chrono::high_resolution_clock::now();
+        mipFilterTimes[(int)filter] = std::chrono::duration<double, std::milli>(end - start).count();
+    }
+}
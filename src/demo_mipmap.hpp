@@ -1,6 +1,7 @@
 #pragma once
 
 #include "demo_fbo.hpp"
+#include "mip_filter.hpp"
 
 class DemoMipmap : public Demo
 {
@@ -12,7 +13,13 @@ public:
     const char* Name() const override { return "Mipmap"; }
 
 private:
+    void MeasureMipFilters();
+
     DemoFBO demoFBO;
 
     Camera mainCamera = {};
+
+    MipFilter mipFilter = MipFilter::KAISER; // Of the tavern diffuse texture
+    int minLevel = 0; // Finest level sampled, applied as GL_TEXTURE_MIN_LOD
+    double mipFilterTimes[3] = {}; // Milliseconds to build the diffuse mip chain per filter, 0 until measured
 };
\ No newline at end of file
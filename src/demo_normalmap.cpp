@@ -13,7 +13,16 @@ struct Vertex
     float3 position;
     float2 uv;
     float3 normal;
-    // TODO: Add tangent
+    float4 tangent; // w is the bitangent sign
+
+    template <typename F>
+    static void Reflect(F&& f)
+    {
+        f(VertexAttrib<VertexAttribute::POSITION, VertexFormat::FLOAT>{ 0 }, &Vertex::position);
+        f(VertexAttrib<VertexAttribute::UV,       VertexFormat::FLOAT>{ 1 }, &Vertex::uv);
+        f(VertexAttrib<VertexAttribute::NORMAL,   VertexFormat::FLOAT>{ 2 }, &Vertex::normal);
+        f(VertexAttrib<VertexAttribute::TANGENT,  VertexFormat::FLOAT>{ 3 }, &Vertex::tangent);
+    }
 };
 
 DemoNormalMap::DemoNormalMap(const DemoInputs& inputs)
@@ -23,65 +32,62 @@ DemoNormalMap::DemoNormalMap(const DemoInputs& inputs)
 
     // Upload vertex buffer
     {
-        // In memory
-        int vertexCount = 0;
-        Vertex* vertices = (Vertex*)calloc(6, sizeof(Vertex));
+        VertexLayout layout = GetVertexLayout<Vertex>();
+
+        // Quad first (6 vertices), then the sphere sized by a query pass
+        int vertexCount = 6;
+        int indexCount = 0;
+        {
+            MeshBuilder sizeQuery(layout, nullptr, 0, &vertexCount, nullptr, 0, &indexCount);
+            sizeQuery.GenUVSphere(nullptr, 48, 64);
+        }
+
+        glGenBuffers(1, &vertexBuffer);
+
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        Vertex* vertices = (Vertex*)gl::MapNewBuffer(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex));
+        std::vector<unsigned int> indices(indexCount);
 
         // Create quad
         {
             Vertex quadVertices[6] = 
             {
-                // Quad (6 vertices)
-                // TODO: Add tangent for each vertex
-                { { 0.5f,-0.5f, 0.f }, { 1.f, 0.f }, { 0.f, 0.f, 1.f } },
-                { {-0.5f,-0.5f, 0.f }, { 0.f, 0.f }, { 0.f, 0.f, 1.f } },
-                { { 0.5f, 0.5f, 0.f }, { 1.f, 1.f }, { 0.f, 0.f, 1.f } },
-
-                { { 0.5f, 0.5f, 0.f }, { 1.f, 1.f }, { 0.f, 0.f, 1.f } },
-                { {-0.5f, 0.5f, 0.f }, { 0.f, 1.f }, { 0.f, 0.f, 1.f } },
-                { {-0.5f,-0.5f, 0.f }, { 0.f, 0.f }, { 0.f, 0.f, 1.f } },
+                // Quad (6 vertices), u follows +x and v follows +y
+                { { 0.5f,-0.5f, 0.f }, { 1.f, 0.f }, { 0.f, 0.f, 1.f }, { 1.f, 0.f, 0.f, 1.f } },
+                { {-0.5f,-0.5f, 0.f }, { 0.f, 0.f }, { 0.f, 0.f, 1.f }, { 1.f, 0.f, 0.f, 1.f } },
+                { { 0.5f, 0.5f, 0.f }, { 1.f, 1.f }, { 0.f, 0.f, 1.f }, { 1.f, 0.f, 0.f, 1.f } },
+
+                { { 0.5f, 0.5f, 0.f }, { 1.f, 1.f }, { 0.f, 0.f, 1.f }, { 1.f, 0.f, 0.f, 1.f } },
+                { {-0.5f, 0.5f, 0.f }, { 0.f, 1.f }, { 0.f, 0.f, 1.f }, { 1.f, 0.f, 0.f, 1.f } },
+                { {-0.5f,-0.5f, 0.f }, { 0.f, 0.f }, { 0.f, 0.f, 1.f }, { 1.f, 0.f, 0.f, 1.f } },
             };
             memcpy(vertices, quadVertices, 6 * sizeof(Vertex));
             quad.start = 0;
             quad.count = 6;
-            vertexCount += 6;
         }
 
         // Create sphere
         {
-            VertexDescriptor descriptor = {};
-            descriptor.size             = sizeof(Vertex);
-            descriptor.positionOffset   = offsetof(Vertex, position);
-            descriptor.hasUV            = true;
-            descriptor.uvOffset         = offsetof(Vertex, uv);
-            descriptor.hasNormal        = true;
-            descriptor.normalOffset     = offsetof(Vertex, normal);
-            // TODO: Add tangent property
-
-            MeshBuilder builder(descriptor, (void**)&vertices, &vertexCount);
+            int writtenVertexCount = 6;
+            int writtenIndexCount = 0;
+            MeshBuilder builder(layout, vertices, vertexCount, &writtenVertexCount, indices.data(), indexCount, &writtenIndexCount);
             sphere = builder.GenUVSphere(nullptr, 48, 64);
         }
+        gl::UnmapBuffer(GL_ARRAY_BUFFER);
 
-        glGenBuffers(1, &vertexBuffer);
+        // Element buffer is part of the vertex array state (only the sphere is indexed)
+        glGenVertexArrays(1, &vertexArrayObject);
+        glBindVertexArray(vertexArrayObject);
 
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-        glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertices, GL_STATIC_DRAW);
-        free(vertices);
+        glGenBuffers(1, &indexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        indexType = gl::UploadIndices(indices.data(), indexCount);
     }
 
     // Vertex layout
     {
-        glGenVertexArrays(1, &vertexArrayObject);
-        glBindVertexArray(vertexArrayObject);
-
         glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*)offsetof(Vertex, position));
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*)offsetof(Vertex, uv));
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*)offsetof(Vertex, normal));
-        // TODO: Add tangent attribute
+        gl::SetVertexLayout<Vertex>();
     }
 
     program = gl::CreateBasicProgram(
@@ -90,11 +96,12 @@ DemoNormalMap::DemoNormalMap(const DemoInputs& inputs)
         layout(location = 0) in vec3 aPosition;
         layout(location = 1) in vec2 aUV;
         layout(location = 2) in vec3 aNormal;
-        // TODO: Add and use tangent attribute
+        layout(location = 3) in vec4 aTangent;
 
         out vec2 vUV;
         out vec3 vWorldPosition;
         out vec3 vWorldNormal;
+        out vec4 vWorldTangent;
 
         uniform mat4 projection;
         uniform mat4 view;
@@ -104,6 +111,7 @@ DemoNormalMap::DemoNormalMap(const DemoInputs& inputs)
         {
             gl_Position = projection * view * model * vec4(aPosition, 1.0);
             vWorldNormal = mat3(model) * aNormal; // Assume uniform scale
+            vWorldTangent = vec4(mat3(model) * aTangent.xyz, aTangent.w);
             vWorldPosition = (model * vec4(aPosition, 1.0)).xyz;
             vUV = aUV;
         }
@@ -114,6 +122,7 @@ DemoNormalMap::DemoNormalMap(const DemoInputs& inputs)
         in vec2 vUV;
         in vec3 vWorldPosition;
         in vec3 vWorldNormal;
+        in vec4 vWorldTangent;
 
         layout(location = 0) out vec4 fragColor;
 
@@ -130,7 +139,15 @@ DemoNormalMap::DemoNormalMap(const DemoInputs& inputs)
 
         void main()
         {
-            vec3 worldNormal = normalize(vWorldNormal);
+            // Tangent frame, bitangent rebuilt per pixel as expected by MikkTSpace
+            vec3 geometryNormal = normalize(vWorldNormal);
+            vec3 tangent = normalize(vWorldTangent.xyz - geometryNormal * dot(geometryNormal, vWorldTangent.xyz));
+            vec3 bitangent = vWorldTangent.w * cross(geometryNormal, tangent);
+            vec3 tangentNormal;
+            tangentNormal.xy = texture(normalTexture, vUV).rg * 2.0 - 1.0; // BC5, z is rebuilt
+            tangentNormal.z = sqrt(max(1.0 - dot(tangentNormal.xy, tangentNormal.xy), 0.0));
+            vec3 worldNormal = normalize(mat3(tangent, bitangent, geometryNormal) * tangentNormal);
+
             vec3 L = normalize(lightWorldPosition - vWorldPosition);
 
             vec3 albedo = texture(albedoTexture, vUV).rgb;
@@ -140,14 +157,13 @@ DemoNormalMap::DemoNormalMap(const DemoInputs& inputs)
             fragColor = vec4(diffuse * albedo, 1.0);
             
             if (debugShowNormalMap)
-                fragColor = texture(normalTexture, vUV);
+                fragColor = vec4(tangentNormal * 0.5 + 0.5, 1.0);
 
             if (debugShowGeometryNormals)
                 fragColor = vec4(normalize(vWorldNormal), 1.0);
             
-            // TODO: Show calculated normal
-            //if (debugShowNormals)
-            //    
+            if (debugShowNormals)
+                fragColor = vec4(worldNormal, 1.0);
 
             if (debugDisableLight)
                 fragColor = vec4(albedo, 1.0);
@@ -165,7 +181,7 @@ DemoNormalMap::DemoNormalMap(const DemoInputs& inputs)
     {
         glGenTextures(1, &normalTexture);
         glBindTexture(GL_TEXTURE_2D, normalTexture);
-        gl::UploadImage("media/scpgdgca_2K_Normal.jpg");
+        gl::UploadNormalMap("media/scpgdgca_2K_Normal.jpg");
         gl::SetTextureDefaultParams();
     }
 
@@ -191,7 +207,9 @@ DemoNormalMap::~DemoNormalMap()
     glDeleteTextures(1, &normalTexture);
     glDeleteTextures(1, &albedoTexture);
     glDeleteProgram(program);
-
+    glDeleteVertexArrays(1, &vertexArrayObject);
+    glDeleteBuffers(1, &vertexBuffer);
+    glDeleteBuffers(1, &indexBuffer);
 }
 
 void DemoNormalMap::UpdateAndRender(const DemoInputs& inputs)
@@ -252,7 +270,7 @@ void DemoNormalMap::UpdateAndRender(const DemoInputs& inputs)
         {
             mat4 model = mat4Translate({ 0.5f, 0.f, 0.f }) * mat4Scale(0.5f);
             glUniformMatrix4fv(glGetUniformLocation(program, "model"), 1, GL_FALSE, model.e);
-            glDrawArrays(GL_TRIANGLES, sphere.start, sphere.count);
+            glDrawElements(GL_TRIANGLES, sphere.count, indexType, gl::IndexOffset(indexType, sphere.start));
         }
     }
 
@@ -263,6 +281,6 @@ void DemoNormalMap::UpdateAndRender(const DemoInputs& inputs)
         glBindTexture(GL_TEXTURE_2D, whiteTexture);
         mat4 model = mat4Translate(lightPosition) * mat4Scale(0.05f);
         glUniformMatrix4fv(glGetUniformLocation(program, "model"), 1, GL_FALSE, model.e);
-        glDrawArrays(GL_TRIANGLES, sphere.start, sphere.count);
+        glDrawElements(GL_TRIANGLES, sphere.count, indexType, gl::IndexOffset(indexType, sphere.start));
     }
 }
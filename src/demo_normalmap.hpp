@@ -17,6 +17,8 @@ private:
     Camera camera = {};
 
     GLuint vertexBuffer = 0;
+    GLuint indexBuffer = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
     GLuint vertexArrayObject = 0;
     GLuint program = 0;
 
@@ -16,6 +16,14 @@ struct Vertex
     float3 position;
     float4 color;
     float2 uv;
+
+    template <typename F>
+    static void Reflect(F&& f)
+    {
+        f(VertexAttrib<VertexAttribute::POSITION, VertexFormat::FLOAT>{ 0 }, &Vertex::position);
+        f(VertexAttrib<VertexAttribute::COLOR,    VertexFormat::FLOAT>{ 1 }, &Vertex::color);
+        f(VertexAttrib<VertexAttribute::UV,       VertexFormat::FLOAT>{ 2 }, &Vertex::uv);
+    }
 };
 
 DemoQuad::DemoQuad(const DemoInputs& inputs)
@@ -54,12 +62,7 @@ DemoQuad::DemoQuad(const DemoInputs& inputs)
         glBindVertexArray(vertexArrayObject);
 
         glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*)offsetof(Vertex, position));
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*)offsetof(Vertex, color));
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*)offsetof(Vertex, uv));
+        gl::SetVertexLayout<Vertex>();
     }
 
     // Create program
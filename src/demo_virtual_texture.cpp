@@ -0,0 +1,190 @@
+#include <cstddef>
+
+#include <glad/glad.h>
+#include <imgui.h>
+
+#include "types.hpp"
+#include "calc.hpp"
+#include "gl_helpers.hpp"
+
+#include "demo_virtual_texture.hpp"
+
+// Streamed through a small cache so that tiles are evicted while moving around
+#define VT_DEMO_TEXTURE "media/fantasy_game_inn_diffuse.png"
+#define VT_DEMO_CACHE_TILES 8
+
+// Ground plane side, the texture covers it once
+#define VT_DEMO_PLANE_SIZE 64.f
+
+// Vertex format, named apart from the Vertex of other demos as each one instantiates gl::SetVertexLayout
+struct PlaneVertex
+{
+    float3 position;
+    float2 uv;
+
+    template <typename F>
+    static void Reflect(F&& f)
+    {
+        f(VertexAttrib<VertexAttribute::POSITION, VertexFormat::FLOAT>{ 0 }, &PlaneVertex::position);
+        f(VertexAttrib<VertexAttribute::UV,       VertexFormat::FLOAT>{ 1 }, &PlaneVertex::uv);
+    }
+};
+
+DemoVirtualTexture::DemoVirtualTexture(const DemoInputs& inputs)
+    : virtualTexture(VT_DEMO_TEXTURE, 1, VT_DEMO_CACHE_TILES)
+{
+    mainCamera.position = { 0.f, 2.f, 0.f };
+
+    // Upload vertex buffer
+    {
+        // Quad (6 vertices) on the ground
+        PlaneVertex vertices[] =
+        {
+            { { 0.5f, 0.f, 0.5f }, { 1.f, 0.f } },
+            { {-0.5f, 0.f, 0.5f }, { 0.f, 0.f } },
+            { { 0.5f, 0.f,-0.5f }, { 1.f, 1.f } },
+
+            { { 0.5f, 0.f,-0.5f }, { 1.f, 1.f } },
+            { {-0.5f, 0.f,-0.5f }, { 0.f, 1.f } },
+            { {-0.5f, 0.f, 0.5f }, { 0.f, 0.f } },
+        };
+
+        glGenBuffers(1, &vertexBuffer);
+
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    }
+
+    // Vertex layout
+    {
+        glGenVertexArrays(1, &vertexArrayObject);
+        glBindVertexArray(vertexArrayObject);
+
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        gl::SetVertexLayout<PlaneVertex>();
+    }
+
+    // Create programs, the feedback pass draws the same geometry and outputs the tiles to stream instead of colors
+    {
+        const char* vertexShaderSources[] = {
+            R"GLSL(
+            layout(location = 0) in vec3 aPosition;
+            layout(location = 1) in vec2 aUV;
+
+            out vec2 vUV;
+
+            uniform mat4 projection;
+            uniform mat4 view;
+            uniform mat4 model;
+            void main()
+            {
+                gl_Position = projection * view * model * vec4(aPosition, 1.0);
+                vUV = aUV;
+            }
+            )GLSL"
+        };
+
+        const char* fragmentShaderSources[] = {
+            VIRTUAL_TEXTURE_GLSL,
+            R"GLSL(
+            in vec2 vUV;
+            out vec4 fragColor;
+
+            void main()
+            {
+                fragColor = SampleVirtualTexture(vUV);
+            }
+            )GLSL"
+        };
+
+        const char* feedbackShaderSources[] = {
+            VIRTUAL_TEXTURE_GLSL,
+            R"GLSL(
+            in vec2 vUV;
+            out vec4 fragColor;
+
+            void main()
+            {
+                fragColor = VirtualTextureFeedback(vUV);
+            }
+            )GLSL"
+        };
+
+        program = gl::CreateProgram(ARRAYSIZE(vertexShaderSources), vertexShaderSources, ARRAYSIZE(fragmentShaderSources), fragmentShaderSources);
+        feedbackProgram = gl::CreateProgram(ARRAYSIZE(vertexShaderSources), vertexShaderSources, ARRAYSIZE(feedbackShaderSources), feedbackShaderSources);
+    }
+}
+
+DemoVirtualTexture::~DemoVirtualTexture()
+{
+    // Delete OpenGL objects
+    glDeleteProgram(program);
+    glDeleteProgram(feedbackProgram);
+    glDeleteVertexArrays(1, &vertexArrayObject);
+    glDeleteBuffers(1, &vertexBuffer);
+}
+
+void DemoVirtualTexture::UpdateAndRender(const DemoInputs& inputs)
+{
+    mainCamera.UpdateFreeFly(inputs.cameraInputs);
+
+    // Tiles requested by the previous frames are streamed in before drawing
+    VirtualTexture* textures[] = { &virtualTexture };
+    feedback.Resolve(textures, ARRAYSIZE(textures));
+    virtualTexture.Update(tilesPerFrame);
+
+    {
+        const VirtualTextureHeader& header = virtualTexture.GetHeader();
+        ImGui::Text("%dx%d texels, %d levels, %d tiles of %dx%d texels", header.width, header.height, header.levelCount, header.tileCount, header.tileSize, header.tileSize);
+        ImGui::Text("Cache: %d/%d tiles resident", virtualTexture.GetResidentCount(), virtualTexture.GetSlotCount());
+        ImGui::Text("Feedback: %d tiles requested, %d missing, %d loaded this frame",
+            virtualTexture.GetRequestedCount(), virtualTexture.GetMissingCount(), virtualTexture.GetLoadedCount());
+        ImGui::SliderInt("Tiles per frame", &tilesPerFrame, 1, 64);
+        ImGui::Checkbox("Show feedback", &showFeedback);
+
+        ImVec2 imageSize = { 256, 256 };
+        ImGui::Image((ImTextureID)(size_t)virtualTexture.GetTileCache(), imageSize, ImVec2(0, 1), ImVec2(1, 0));
+        if (showFeedback)
+        {
+            // Raw tile coordinates and levels, dark as they are small values
+            ImGui::SameLine();
+            ImGui::Image((ImTextureID)(size_t)feedback.GetColorTexture(), imageSize, ImVec2(0, 1), ImVec2(1, 0));
+        }
+    }
+
+    mat4 projection = mat4Perspective(calc::ToRadians(60.f), inputs.windowSize.x / inputs.windowSize.y, 0.01f, 200.f);
+    mat4 view       = mainCamera.GetViewMatrix();
+    mat4 model      = mat4Scale(VT_DEMO_PLANE_SIZE);
+
+    auto drawPlane = [&](GLuint drawProgram, float levelBias)
+    {
+        glUseProgram(drawProgram);
+        glUniformMatrix4fv(glGetUniformLocation(drawProgram, "projection"), 1, GL_FALSE, projection.e);
+        glUniformMatrix4fv(glGetUniformLocation(drawProgram, "view"), 1, GL_FALSE, view.e);
+        glUniformMatrix4fv(glGetUniformLocation(drawProgram, "model"), 1, GL_FALSE, model.e);
+        virtualTexture.Bind(drawProgram, 0, levelBias);
+
+        glBindVertexArray(vertexArrayObject);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    };
+
+    glEnable(GL_DEPTH_TEST);
+
+    // Feedback pass, read back during the next frames
+    feedback.Begin((int)inputs.windowSize.x, (int)inputs.windowSize.y);
+    drawPlane(feedbackProgram, feedback.GetLevelBias());
+    feedback.End();
+
+    // Main pass
+    glViewport(0, 0, (int)inputs.windowSize.x, (int)inputs.windowSize.y);
+    // The clear color is restored for the other demos
+    float previousClearColor[4];
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, previousClearColor);
+    glClearColor(0.2f, 0.2f, 0.2f, 1.f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glClearColor(previousClearColor[0], previousClearColor[1], previousClearColor[2], previousClearColor[3]);
+
+    glEnable(GL_FRAMEBUFFER_SRGB);
+    drawPlane(program, 0.f);
+    glDisable(GL_FRAMEBUFFER_SRGB);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "glad/glad.h"
+
+#include "camera.hpp"
+#include "virtual_texture.hpp"
+#include "demo.hpp"
+
+class DemoVirtualTexture : public Demo
+{
+public:
+    DemoVirtualTexture(const DemoInputs& inputs);
+    ~DemoVirtualTexture() override;
+
+    void UpdateAndRender(const DemoInputs& inputs) override;
+    const char* Name() const override { return "Virtual texture"; }
+
+private:
+    GLuint vertexBuffer = 0;
+    GLuint vertexArrayObject = 0;
+    GLuint program = 0;
+    GLuint feedbackProgram = 0;
+
+    VirtualTexture virtualTexture;
+    VirtualTextureFeedback feedback;
+    int tilesPerFrame = VT_TILES_PER_FRAME;
+    bool showFeedback = false;
+
+    Camera mainCamera = {};
+};
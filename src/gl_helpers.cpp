@@ -1,7 +1,11 @@
 
+#include <atomic>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include <stb_perlin.h>
@@ -9,50 +13,381 @@
 
 #include "types.hpp"
 #include "calc.hpp"
+#include "calc_fast.hpp"
+#include "calc_pack.hpp"
+#include "jobs.hpp"
+#include "mapped_file.hpp"
+#include "mip_filter.hpp"
+#include "texture_compression.hpp"
 #include "gl_helpers.hpp"
 
-// Implement dumb caching to avoid decompressing textures
-static bool LoadTextureFromCache(void** data, const char* filename, int* width, int* height, int* channels, bool linear, bool flip)
+// Textures are cached in their final GPU format with the whole mip chain, loading is a single read and one upload per level
+// Bump the version when the layout or the encoding changes, outdated files are rebuilt
+#define TEXTURE_CACHE_VERSION 3
+
+// Rows per job when decoding and encoding mip levels
+#define TEXTURE_JOB_ROWS 32
+
+// EXT_texture_compression_s3tc and EXT_texture_sRGB formats, not part of the core profile
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT        0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT       0x83F3
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT       0x8C4C
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+static bool IsExtensionSupported(const char* name)
+{
+    GLint extensionCount = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+    for (GLint i = 0; i < extensionCount; ++i)
+    {
+        if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+            return true;
+    }
+    return false;
+}
+
+bool gl::IsS3TCSupported()
+{
+    static const bool supported = IsExtensionSupported("GL_EXT_texture_compression_s3tc") && IsExtensionSupported("GL_EXT_texture_sRGB");
+    return supported;
+}
+
+// Return false for uncompressed formats
+static bool GetBlockFormat(GLenum internalFormat, BlockFormat* format)
+{
+    switch (internalFormat)
+    {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:       *format = BlockFormat::BC1; return true;
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+    case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT: *format = BlockFormat::BC3; return true;
+    case GL_COMPRESSED_RED_RGTC1:                *format = BlockFormat::BC4; return true;
+    case GL_COMPRESSED_RG_RGTC2:                 *format = BlockFormat::BC5; return true;
+    default:                                     return false;
+    }
+}
+
+static std::string GetTextureCacheName(const char* filename, TextureUsage usage, MipFilter mipFilter, bool flip)
 {
     std::string cachedFile = filename;
-    cachedFile += flip ? "_flip" : "_noflip";
-    cachedFile += linear ? ".texf" : ".tex";
+    cachedFile += flip ? "_flip_" : "_noflip_";
+    cachedFile += mip::GetFilterName(mipFilter);
+    switch (usage)
+    {
+    case TextureUsage::COLOR:        cachedFile += ".tex";  break;
+    case TextureUsage::LINEAR_COLOR: cachedFile += ".texl"; break;
+    case TextureUsage::NORMAL_MAP:   cachedFile += ".texn"; break;
+    }
     cachedFile += ".cache";
+    return cachedFile;
+}
 
-    FILE* file = fopen(cachedFile.c_str(), "rb");
+static bool LoadTextureFromCache(TextureData* texture, const char* filename, TextureUsage usage, MipFilter mipFilter, bool flip)
+{
+    FILE* file = fopen(GetTextureCacheName(filename, usage, mipFilter, flip).c_str(), "rb");
     if (file == nullptr)
         return false;
 
-    size_t dataSize = 0;
-    fread(&dataSize, sizeof(size_t), 1, file);
-    fread(width,     sizeof(int), 1, file);
-    fread(height,    sizeof(int), 1, file);
-    fread(channels,  sizeof(int), 1, file);
-    *data = malloc(dataSize);
-    fread(*data, 1, dataSize, file);
+    TextureCacheHeader& header = texture->header;
+    bool valid = fread(&header, sizeof(TextureCacheHeader), 1, file) == 1
+              && memcmp(header.magic, "TEXC", 4) == 0
+              && header.version == TEXTURE_CACHE_VERSION
+              && header.levelCount > 0 && header.levelCount <= 32;
+
+    // Rebuilt uncompressed on drivers without S3TC
+    valid = valid && gl::IsFormatSupported(header.internalFormat);
+
+    if (valid)
+    {
+        texture->levels.resize(header.levelCount);
+        valid = fread(texture->levels.data(), sizeof(TextureLevel), header.levelCount, file) == (size_t)header.levelCount;
+    }
+
+    // Every level must lie in the data left in the file, uploads would otherwise read out of bounds
+    uint64_t dataSize = 0;
+    if (valid)
+    {
+        long dataStart = ftell(file);
+        valid = fseek(file, 0, SEEK_END) == 0;
+        long fileSize = ftell(file);
+        valid = valid && dataStart >= 0 && fileSize >= dataStart && fseek(file, dataStart, SEEK_SET) == 0;
+        for (const TextureLevel& level : texture->levels)
+        {
+            uint64_t levelEnd = (uint64_t)level.offset + level.size;
+            valid = valid && level.width > 0 && level.height > 0 && levelEnd <= (uint64_t)(fileSize - dataStart);
+            dataSize = calc::Max(dataSize, levelEnd);
+        }
+    }
+
+    if (valid)
+    {
+        texture->data.resize((size_t)dataSize);
+        valid = fread(texture->data.data(), 1, texture->data.size(), file) == texture->data.size();
+    }
     fclose(file);
 
-    printf("Texture loaded from cache: %s (%d bytes)\n", filename, (int)dataSize);
+    if (!valid)
+    {
+        printf("Texture cache outdated: %s\n", filename);
+        return false;
+    }
+
+    printf("Texture loaded from cache: %s (%d bytes, %d levels)\n", filename, (int)texture->data.size(), header.levelCount);
 
     return true;
 }
 
-static void SaveTextureToCache(const void* data, size_t dataSize, const char* filename, int width, int height, int channels, bool linear, bool flip)
+// Written to a file of its own then moved over the cache, so concurrent loads of the same image never read a partial cache
+static void SaveTextureToCache(const TextureData& texture, const char* filename, TextureUsage usage, MipFilter mipFilter, bool flip)
 {
-    std::string cachedFile = filename;
-    cachedFile += flip ? "_flip" : "_noflip";
-    cachedFile += linear ? ".texf" : ".tex";
-    cachedFile += ".cache";
+    static std::atomic<unsigned> saveCount = { 0 };
+    std::string cachedFile = GetTextureCacheName(filename, usage, mipFilter, flip);
+    std::string tempFile = cachedFile + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + "." + std::to_string(saveCount++) + ".tmp";
+    FILE* file = fopen(tempFile.c_str(), "wb");
+    if (file == nullptr)
+        return;
 
-    FILE* file = fopen(cachedFile.c_str(), "wb");
-    fwrite(&dataSize, sizeof(size_t), 1, file);
-    fwrite(&width,    sizeof(int), 1, file);
-    fwrite(&height,   sizeof(int), 1, file);
-    fwrite(&channels, sizeof(int), 1, file);
-    fwrite(data, 1, dataSize, file);
-    fclose(file);
+    bool written = fwrite(&texture.header, sizeof(TextureCacheHeader), 1, file) == 1
+                && fwrite(texture.levels.data(), sizeof(TextureLevel), texture.levels.size(), file) == texture.levels.size()
+                && fwrite(texture.data.data(), 1, texture.data.size(), file) == texture.data.size();
+    written &= fclose(file) == 0;
+
+    // Concurrent saves write the same texture, whichever moves last wins (on Windows an open cache is not replaced)
+    if (!written || !MoveFileOver(tempFile.c_str(), cachedFile.c_str()))
+    {
+        remove(tempFile.c_str());
+        return;
+    }
+
+    printf("Texture saved to cache: %s (%d bytes, %d levels)\n", filename, (int)texture.data.size(), texture.header.levelCount);
+}
+
+// 8 bits sRGB to linear conversion table, same curve as the GL_SRGB8 formats decoding
+struct LinearTable
+{
+    float values[256];
+
+    constexpr LinearTable() : values()
+    {
+        for (int i = 0; i < 256; ++i)
+            values[i] = (float)calc::ct::SRGBToLinear(i / 255.0);
+    }
+};
+
+static constexpr LinearTable LINEAR_TABLE;
+
+// Alpha is never gamma corrected (2nd channel of 2 channels images, 4th of 4 channels images)
+static int GetColorChannelCount(int channels)
+{
+    return (channels % 2) ? channels : channels - 1;
+}
+
+static bool IsSRGBFormat(GLenum internalFormat)
+{
+    return internalFormat == GL_SRGB8 || internalFormat == GL_SRGB8_ALPHA8
+        || internalFormat == GL_COMPRESSED_SRGB_S3TC_DXT1_EXT || internalFormat == GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+}
+
+// 8 bits images are block compressed, sRGB if sampled as linear colors (decoded by the hardware):
+//   1 channel: BC4, 2 channels and normal maps: BC5, 3 channels and opaque 4 channels: BC1, 4 channels: BC3
+// Without S3TC, 3 and 4 channels images are stored as RGB(A)8 or sRGB8(_ALPHA8)
+// Linear 1 and 2 channels images (no sRGB format) and HDR images are stored as 16 bits floats
+static void ChooseTextureFormat(TextureCacheHeader* header, bool hdr, bool opaque, TextureUsage usage)
+{
+    const GLenum formats[]      = { GL_RED,  GL_RG,    GL_RGB,    GL_RGBA    };
+    const GLenum unormFormats[] = { GL_R8,   GL_RG8,   GL_RGB8,   GL_RGBA8   };
+    const GLenum halfFormats[]  = { GL_R16F, GL_RG16F, GL_RGB16F, GL_RGBA16F };
+
+    int i = header->channels - 1;
+    bool linear = usage == TextureUsage::LINEAR_COLOR;
+    header->format = formats[i];
+    header->type = GL_UNSIGNED_BYTE;
+    if (hdr || (linear && header->channels < 3))
+    {
+        header->internalFormat = halfFormats[i];
+        header->type = GL_HALF_FLOAT;
+    }
+    else if (header->channels == 1)
+    {
+        header->internalFormat = GL_COMPRESSED_RED_RGTC1;
+    }
+    else if (header->channels == 2 || usage == TextureUsage::NORMAL_MAP)
+    {
+        header->internalFormat = GL_COMPRESSED_RG_RGTC2;
+    }
+    else if (gl::IsS3TCSupported())
+    {
+        if (header->channels == 3 || opaque)
+            header->internalFormat = linear ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        else
+            header->internalFormat = linear ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    }
+    else
+    {
+        header->internalFormat = linear ? (header->channels == 3 ? GL_SRGB8 : GL_SRGB8_ALPHA8) : unormFormats[i];
+    }
+}
+
+// Convert 8 bits texels to the space mip levels are filtered in (linear if the image is sampled as linear colors)
+static void DecodeTexels(float4* dst, const stbi_uc* src, int count, int channels, bool linear)
+{
+    int colorChannels = linear ? GetColorChannelCount(channels) : 0;
+    for (int i = 0; i < count; ++i)
+    {
+        dst[i] = { 0.f, 0.f, 0.f, 1.f };
+        for (int c = 0; c < colorChannels; ++c)
+            dst[i].e[c] = LINEAR_TABLE.values[src[c]];
+        for (int c = colorChannels; c < channels; ++c)
+            dst[i].e[c] = src[c] / 255.f;
+
+        src += channels;
+    }
+}
+
+static void EncodeTexels(unsigned char* dst, const float4* src, int count, const TextureCacheHeader& header)
+{
+    int channels = header.channels;
+    if (header.type == GL_HALF_FLOAT)
+    {
+        uint16_t* halves = (uint16_t*)dst;
+        for (int i = 0; i < count; ++i)
+        {
+            for (int c = 0; c < channels; ++c)
+                halves[i * channels + c] = calc::pack::FloatToHalf(src[i].e[c]);
+        }
+        return;
+    }
+
+    int colorChannels = IsSRGBFormat(header.internalFormat) ? GetColorChannelCount(channels) : 0;
+    for (int i = 0; i < count; ++i)
+    {
+        for (int c = 0; c < colorChannels; ++c)
+            dst[i * channels + c] = calc::pack::FloatToUnorm8(calc::fast::LinearToSRGB(src[i].e[c]));
+        for (int c = colorChannels; c < channels; ++c)
+            dst[i * channels + c] = calc::pack::FloatToUnorm8(src[i].e[c]);
+    }
+}
 
-    printf("Texture saved to cache: %s (%d bytes)\n", filename, (int)dataSize);
+// Decode the image and build every mip level in its GPU format, return false if the image cannot be read
+static bool LoadTextureFromImage(TextureData* texture, const char* file, TextureUsage usage, MipFilter mipFilter)
+{
+    bool linear = usage == TextureUsage::LINEAR_COLOR;
+
+    // HDR images are converted to 8 bits by stbi_load() unless sampled as linear colors
+    bool hdr = linear && stbi_is_hdr(file);
+
+    int width    = 0;
+    int height   = 0;
+    int channels = 0;
+    float* hdrColors = nullptr;
+    stbi_uc* colors = nullptr;
+    if (hdr)
+        hdrColors = stbi_loadf(file, &width, &height, &channels, 0);
+    else
+        colors = stbi_load(file, &width, &height, &channels, 0);
+
+    if (hdrColors == nullptr && colors == nullptr)
+    {
+        fprintf(stderr, "Failed to load image '%s'\n", file);
+        return false;
+    }
+    printf("Load image '%s' (%dx%d %d channels)\n", file, width, height, channels);
+
+    TextureCacheHeader& header = texture->header;
+    memcpy(header.magic, "TEXC", 4);
+    header.version  = TEXTURE_CACHE_VERSION;
+    header.width    = width;
+    header.height   = height;
+    header.channels = channels;
+
+    bool opaque = true;
+    if (colors != nullptr && channels == 4)
+    {
+        for (int i = 0; i < width * height && opaque; ++i)
+            opaque = colors[i * 4 + 3] == 255;
+    }
+    ChooseTextureFormat(&header, hdr, opaque, usage);
+
+    BlockFormat blockFormat = BlockFormat::BC1;
+    bool compressed = GetBlockFormat(header.internalFormat, &blockFormat);
+
+    header.levelCount = 1;
+    while ((calc::Max(width, height) >> header.levelCount) > 0)
+        header.levelCount++;
+
+    // Filtered as 4 channels for SIMD
+    std::vector<float4> texels((size_t)width * height);
+    for (size_t i = 0; hdr && i < texels.size(); ++i)
+    {
+        texels[i] = { 0.f, 0.f, 0.f, 1.f };
+        for (int c = 0; c < channels; ++c)
+            texels[i].e[c] = hdrColors[i * channels + c];
+    }
+    if (!hdr)
+    {
+        jobs::ParallelFor(height, TEXTURE_JOB_ROWS, [&](int begin, int end)
+        {
+            size_t first = (size_t)begin * width;
+            DecodeTexels(&texels[first], colors + first * channels, (end - begin) * width, channels, linear);
+        });
+    }
+
+    int texelSize = channels * (header.type == GL_HALF_FLOAT ? 2 : 1);
+    std::vector<float4> nextTexels;
+    std::vector<unsigned char> uncompressedTexels; // Levels > 0 of compressed textures, before compression
+    texture->levels.resize(header.levelCount);
+    texture->data.clear();
+    for (int i = 0; i < header.levelCount; ++i)
+    {
+        TextureLevel& level = texture->levels[i];
+        level.width  = calc::Max(width  >> i, 1);
+        level.height = calc::Max(height >> i, 1);
+        level.offset = (uint32_t)texture->data.size();
+        level.size   = (uint32_t)(compressed ? bc::GetEncodedSize(blockFormat, level.width, level.height) : level.width * level.height * texelSize);
+        texture->data.resize(level.offset + level.size);
+
+        // Level 0 of 8 bits images is stored (or compressed) as is
+        unsigned char* levelData = &texture->data[level.offset];
+        const unsigned char* levelBytes = colors;
+        bool storedAsIs = i == 0 && colors != nullptr && header.type == GL_UNSIGNED_BYTE;
+        if (!storedAsIs)
+        {
+            unsigned char* encodedTexels = levelData;
+            if (compressed)
+            {
+                uncompressedTexels.resize((size_t)level.width * level.height * texelSize);
+                encodedTexels = uncompressedTexels.data();
+            }
+
+            const float4* levelTexels = texels.data();
+            jobs::ParallelFor(level.height, TEXTURE_JOB_ROWS, [&](int begin, int end)
+            {
+                size_t first = (size_t)begin * level.width;
+                EncodeTexels(encodedTexels + first * texelSize, levelTexels + first, (end - begin) * level.width, header);
+            });
+            levelBytes = encodedTexels;
+        }
+
+        if (compressed)
+            bc::Encode(blockFormat, levelData, levelBytes, level.width, level.height, channels);
+        else if (storedAsIs)
+            memcpy(levelData, colors, level.size);
+
+        if (i + 1 < header.levelCount)
+        {
+            int nextWidth  = calc::Max(width  >> (i + 1), 1);
+            int nextHeight = calc::Max(height >> (i + 1), 1);
+            nextTexels.resize((size_t)nextWidth * nextHeight);
+            mip::Downsample(mipFilter, nextTexels.data(), nextWidth, nextHeight, texels.data(), level.width, level.height);
+            texels.swap(nextTexels);
+        }
+    }
+
+    stbi_image_free(hdrColors);
+    stbi_image_free(colors);
+    return true;
 }
 
 GLuint gl::CreateShader(GLenum type, int sourceCount, const char** sources)
@@ -135,44 +470,88 @@ void gl::UploadPerlinNoise(int width, int height, float z, float lacunarity, flo
     glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, pixels.data());
 }
 
-void gl::UploadImage(const char* file, bool linear, bool flip)
+bool gl::LoadTexture(TextureData* texture, const char* file, TextureUsage usage, MipFilter mipFilter, bool flip)
 {
-    int width    = 0;
-    int height   = 0;
-    int channels = 0;
+    stbi_set_flip_vertically_on_load_thread(flip);
 
-    stbi_set_flip_vertically_on_load(flip);
-    void* colors;
+    if (LoadTextureFromCache(texture, file, usage, mipFilter, flip))
+        return true;
 
-    if (!LoadTextureFromCache(&colors, file, &width, &height, &channels, linear, flip))
-    {
-        if (linear)
-            colors = stbi_loadf(file, &width, &height, &channels, 0);
-        else
-            colors = stbi_load(file, &width, &height, &channels, 0);
+    if (!LoadTextureFromImage(texture, file, usage, mipFilter))
+        return false;
 
-        if (colors == nullptr)
-            fprintf(stderr, "Failed to load image '%s'\n", file);
-        else
-            printf("Load image '%s' (%dx%d %d channels)\n", file, width, height, channels);
+    SaveTextureToCache(*texture, file, usage, mipFilter, flip);
+    return true;
+}
 
-        int byteSize = width * height * channels * (linear ? sizeof(float) : sizeof(char));
-        SaveTextureToCache(colors, byteSize, file, width, height, channels, linear, flip);
-    }
+bool gl::IsCompressedFormat(GLenum internalFormat)
+{
+    BlockFormat blockFormat;
+    return GetBlockFormat(internalFormat, &blockFormat);
+}
 
-    GLenum format;
-    switch (channels)
+bool gl::IsFormatSupported(GLenum internalFormat)
+{
+    BlockFormat blockFormat;
+    if (!GetBlockFormat(internalFormat, &blockFormat))
+        return true;
+
+    return (blockFormat != BlockFormat::BC1 && blockFormat != BlockFormat::BC3) || IsS3TCSupported();
+}
+
+int gl::GetTextureRowAlignment(const TextureData& texture)
+{
+    return IsCompressedFormat(texture.header.internalFormat) ? 4 : 1;
+}
+
+void gl::UploadTextureLevel(const TextureData& texture, int level, const void* data)
+{
+    const TextureCacheHeader& header = texture.header;
+    const TextureLevel& levelInfo = texture.levels[level];
+    if (GetTextureRowAlignment(texture) > 1)
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, header.internalFormat, levelInfo.width, levelInfo.height, 0, levelInfo.size, data);
+    else
+        glTexImage2D(GL_TEXTURE_2D, level, header.internalFormat, levelInfo.width, levelInfo.height, 0, header.format, header.type, data);
+}
+
+void gl::UploadTextureRows(const TextureData& texture, int level, int firstRow, int rowCount, const void* data)
+{
+    const TextureCacheHeader& header = texture.header;
+    const TextureLevel& levelInfo = texture.levels[level];
+    rowCount = calc::Min(rowCount, levelInfo.height - firstRow);
+    int rowAlignment = GetTextureRowAlignment(texture);
+    if (rowAlignment > 1)
     {
-    case 1:          format = GL_RED;  break;
-    case 2:          format = GL_RG;   break;
-    case 3:          format = GL_RGB;  break;
-    case 4: default: format = GL_RGBA; break;
+        int rowGroupCount = (levelInfo.height + rowAlignment - 1) / rowAlignment;
+        int size = (int)(levelInfo.size / rowGroupCount) * ((rowCount + rowAlignment - 1) / rowAlignment);
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, firstRow, levelInfo.width, rowCount, header.internalFormat, size, data);
     }
+    else
+    {
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, firstRow, levelInfo.width, rowCount, header.format, header.type, data);
+    }
+}
+
+static void UploadTexture(const char* file, TextureUsage usage, MipFilter mipFilter, bool flip)
+{
+    TextureData texture;
+    if (!gl::LoadTexture(&texture, file, usage, mipFilter, flip))
+        return;
 
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, linear ? GL_FLOAT : GL_UNSIGNED_BYTE, colors);
+    for (int i = 0; i < texture.header.levelCount; ++i)
+        gl::UploadTextureLevel(texture, i, &texture.data[texture.levels[i].offset]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture.header.levelCount - 1);
+}
 
-    stbi_image_free(colors);
+void gl::UploadImage(const char* file, bool linear, bool flip, MipFilter mipFilter)
+{
+    UploadTexture(file, linear ? TextureUsage::LINEAR_COLOR : TextureUsage::COLOR, mipFilter, flip);
+}
+
+void gl::UploadNormalMap(const char* file, bool flip, MipFilter mipFilter)
+{
+    UploadTexture(file, TextureUsage::NORMAL_MAP, mipFilter, flip);
 }
 
 void gl::UploadColoredTexture(float r, float g, float b, float a)
@@ -186,7 +565,11 @@ void gl::SetTextureDefaultParams(bool genMipmap)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     if (genMipmap)
     {
-        glGenerateMipmap(GL_TEXTURE_2D);
+        // Keep the levels uploaded with the texture (e.g. from the texture cache)
+        GLint level1Width = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 1, GL_TEXTURE_WIDTH, &level1Width);
+        if (level1Width == 0)
+            glGenerateMipmap(GL_TEXTURE_2D);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     }
     else
@@ -290,3 +673,57 @@ void gl::UploadCubemap(const char* filename)
         }
     }
 }
+
+GLenum gl::UploadIndices(const unsigned int* indices, int indexCount, GLenum usage)
+{
+    unsigned int maxIndex = 0;
+    for (int i = 0; i < indexCount; ++i)
+        maxIndex = calc::Max(maxIndex, indices[i]);
+
+    if (maxIndex > 0xFFFF)
+    {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indices, usage);
+        return GL_UNSIGNED_INT;
+    }
+
+    std::vector<unsigned short> shortIndices(indices, indices + indexCount);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned short), shortIndices.data(), usage);
+    return GL_UNSIGNED_SHORT;
+}
+
+void* gl::MapNewBuffer(GLenum target, size_t size, GLenum usage)
+{
+    glBufferData(target, size, nullptr, usage);
+    if (size == 0)
+        return nullptr;
+
+    return glMapBufferRange(target, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+}
+
+bool gl::UnmapBuffer(GLenum target)
+{
+    if (glUnmapBuffer(target) == GL_TRUE)
+        return true;
+
+    fprintf(stderr, "Buffer content lost while mapped\n");
+    return false;
+}
+
+void gl::SetVertexAttrib(GLuint location, VertexFormat format, int componentCount, int stride, int offset)
+{
+    GLenum type = GL_FLOAT;
+    GLboolean normalized = GL_FALSE;
+    switch (format)
+    {
+    case VertexFormat::FLOAT:            type = GL_FLOAT; break;
+    case VertexFormat::HALF:             type = GL_HALF_FLOAT; break;
+    case VertexFormat::SNORM16:          type = GL_SHORT;                   normalized = GL_TRUE; break;
+    case VertexFormat::UNORM16:          type = GL_UNSIGNED_SHORT;          normalized = GL_TRUE; break;
+    case VertexFormat::OCT16:            type = GL_SHORT;                   normalized = GL_TRUE; componentCount = 2; break;
+    case VertexFormat::SNORM_10_10_10_2: type = GL_INT_2_10_10_10_REV;      normalized = GL_TRUE; componentCount = 4; break;
+    case VertexFormat::UNORM8:           type = GL_UNSIGNED_BYTE;           normalized = GL_TRUE; componentCount = 4; break;
+    }
+
+    glEnableVertexAttribArray(location);
+    glVertexAttribPointer(location, componentCount, type, normalized, stride, (const GLvoid*)(size_t)offset);
+}
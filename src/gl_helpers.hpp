@@ -1,16 +1,122 @@
 #pragma once
 
 
+#include <cstdint>
+#include <vector>
+
 #include <glad/glad.h>
 
+#include "mesh_builder.hpp"
+#include "mip_filter.hpp"
+#include "vertex_layout.hpp"
+
+enum class TextureUsage
+{
+    COLOR,        // Sampled as stored
+    LINEAR_COLOR, // Sampled as linear colors
+    NORMAL_MAP,   // Tangent space xy
+};
+
+// Texture cache file header, then levelCount TextureLevel and the data of every level
+struct TextureCacheHeader
+{
+    char     magic[4]; // "TEXC"
+    uint32_t version;
+    uint32_t internalFormat;
+    uint32_t format;
+    uint32_t type;
+    int32_t  width;
+    int32_t  height;
+    int32_t  channels;
+    int32_t  levelCount;
+};
+
+struct TextureLevel
+{
+    int32_t  width;
+    int32_t  height;
+    uint32_t offset; // In TextureData::data
+    uint32_t size;
+};
+
+// Every mip level of a texture in its GPU format
+struct TextureData
+{
+    TextureCacheHeader header;
+    std::vector<TextureLevel> levels;
+    std::vector<unsigned char> data;
+};
+
 namespace gl
 {
     GLuint CreateShader(GLenum type, int sourceCount, const char** sources);
     GLuint CreateBasicProgram(const char* vsStr, const char* fsStr);
     GLuint CreateProgram(int vsStrsCount, const char** vsStrs, int fsStrsCount, const char** fsStrs);
     void UploadPerlinNoise(int width, int height, float z, float lacunarity = 2.f, float gain = 0.5f, float offset = 1.f, int octaves = 6);
-    void UploadImage(const char* file, bool linear = false, bool flip = true);
+
+    // Upload every mip level of an image, cached next to it in its GPU format (block compressed, 16 bits floats if HDR)
+    // If linear is true the colors are sampled as linear values (sRGB formats) and mip levels are filtered in linear space
+    void UploadImage(const char* file, bool linear = false, bool flip = true, MipFilter mipFilter = MipFilter::KAISER);
+
+    // Tangent space normal map stored as BC5, only x and y are kept (z = sqrt(1 - x^2 - y^2) in the shader)
+    void UploadNormalMap(const char* file, bool flip = true, MipFilter mipFilter = MipFilter::KAISER);
     void UploadColoredTexture(float r, float g, float b, float a);
     void UploadCubemap(const char* filename);
+
+    // BC1 and BC3 (RGTC formats BC4 and BC5 are core), the first call needs a current context
+    bool IsS3TCSupported();
+
+    // Block compressed formats are uploaded with glCompressedTex*Image2D by 4x4 texels blocks
+    bool IsCompressedFormat(GLenum internalFormat);
+
+    // False for S3TC formats on drivers without the extensions
+    bool IsFormatSupported(GLenum internalFormat);
+
+    // Read a texture from its cache, or decode the image and save the cache (see UploadImage)
+    // No GL call once IsS3TCSupported() was called, so textures can be loaded on any thread
+    bool LoadTexture(TextureData* texture, const char* file, TextureUsage usage, MipFilter mipFilter = MipFilter::KAISER, bool flip = true);
+
+    // Rows uploaded at once must be a multiple of this (4 for block compressed formats, except the last rows)
+    int GetTextureRowAlignment(const TextureData& texture);
+
+    // Specify a level of the bound GL_TEXTURE_2D, data can be null or an offset in the bound GL_PIXEL_UNPACK_BUFFER
+    void UploadTextureLevel(const TextureData& texture, int level, const void* data);
+
+    // Update rows [firstRow, firstRow + rowCount) of a level specified by UploadTextureLevel
+    // data holds these rows only (rows are tightly packed)
+    void UploadTextureRows(const TextureData& texture, int level, int firstRow, int rowCount, const void* data);
+
+    // Mipmaps are only generated if level 1 was not uploaded
     void SetTextureDefaultParams(bool genMipmap = true);
+
+    // Upload indices to the bound GL_ELEMENT_ARRAY_BUFFER, stored as 16 bits when every index fits
+    // Return the index type to use with glDrawElements
+    GLenum UploadIndices(const unsigned int* indices, int indexCount, GLenum usage = GL_STATIC_DRAW);
+
+    // Allocate the bound buffer and map it for writing only, the previous content is discarded
+    // Return null if size is 0, unmap with UnmapBuffer before drawing
+    void* MapNewBuffer(GLenum target, size_t size, GLenum usage = GL_STATIC_DRAW);
+
+    // Return false (and print an error) if the content was lost while mapped and must be written again
+    bool UnmapBuffer(GLenum target);
+
+    // Offset of the first index inside the element buffer (glDrawElements last parameter)
+    inline const GLvoid* IndexOffset(GLenum indexType, int firstIndex)
+    {
+        return (const GLvoid*)((size_t)firstIndex * (indexType == GL_UNSIGNED_SHORT ? 2 : 4));
+    }
+
+    // Enable and describe a vertex attribute of the bound GL_ARRAY_BUFFER stored as format
+    // Packed formats (OCT16, SNORM_10_10_10_2, UNORM8) use their own component count
+    void SetVertexAttrib(GLuint location, VertexFormat format, int componentCount, int stride, int offset);
+
+    // Enable and describe every attribute declared by V::Reflect (see vertex_layout.hpp) for the bound GL_ARRAY_BUFFER
+    template <typename V>
+    void SetVertexLayout()
+    {
+        V::Reflect([](auto attrib, auto member)
+        {
+            SetVertexAttrib(attrib.location, attrib.format(), GetVertexAttributeSize(attrib.attribute()), sizeof(V), vertex_layout::GetOffset(member));
+        });
+    }
 }
\ No newline at end of file
@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "jobs.hpp"
+
+namespace
+{
+    // Shared state of one ParallelFor call
+    struct RangeJob
+    {
+        std::function<void(int, int)> func;
+        int count;
+        int batchSize;
+        std::atomic<int> nextBatch;
+        std::atomic<int> remainingBatches;
+
+        // Process batches until none is left, returns false when nothing was done
+        bool Work()
+        {
+            int batchCount = (count + batchSize - 1) / batchSize;
+            bool worked = false;
+            for (int batch = nextBatch++; batch < batchCount; batch = nextBatch++)
+            {
+                int begin = batch * batchSize;
+                int end = std::min(begin + batchSize, count);
+                func(begin, end);
+                remainingBatches--;
+                worked = true;
+            }
+            return worked;
+        }
+    };
+
+    class ThreadPool
+    {
+    public:
+        ThreadPool()
+        {
+            int workerCount = std::max((int)std::thread::hardware_concurrency() - 1, 1);
+            for (int i = 0; i < workerCount; ++i)
+                workers.emplace_back([this]() { WorkerLoop(); });
+        }
+
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                quit = true;
+            }
+            wakeUp.notify_all();
+            for (std::thread& worker : workers)
+                worker.join();
+        }
+
+        int GetWorkerCount() const { return (int)workers.size(); }
+
+        void Push(const std::shared_ptr<RangeJob>& job, int helperCount)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (int i = 0; i < helperCount; ++i)
+                    queue.push_back(job);
+            }
+            if (helperCount == 1)
+                wakeUp.notify_one();
+            else
+                wakeUp.notify_all();
+        }
+
+    private:
+        void WorkerLoop()
+        {
+            while (true)
+            {
+                std::shared_ptr<RangeJob> job;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    wakeUp.wait(lock, [this]() { return quit || !queue.empty(); });
+                    if (quit)
+                        return;
+                    job = queue.front();
+                    queue.pop_front();
+                }
+                job->Work();
+            }
+        }
+
+        std::vector<std::thread> workers;
+        std::deque<std::shared_ptr<RangeJob>> queue;
+        std::mutex mutex;
+        std::condition_variable wakeUp;
+        bool quit = false;
+    };
+
+    ThreadPool& GetPool()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+}
+
+int jobs::GetThreadCount()
+{
+    return GetPool().GetWorkerCount() + 1;
+}
+
+void jobs::ParallelFor(int count, int minBatchSize, const std::function<void(int begin, int end)>& func)
+{
+    if (count <= 0)
+        return;
+
+    // Split in a few batches per thread to balance uneven workloads
+    int threadCount = GetThreadCount();
+    int batchSize = std::max(minBatchSize, (count + threadCount * 4 - 1) / (threadCount * 4));
+    int batchCount = (count + batchSize - 1) / batchSize;
+
+    if (batchCount == 1)
+    {
+        func(0, count);
+        return;
+    }
+
+    std::shared_ptr<RangeJob> job = std::make_shared<RangeJob>();
+    job->func = func;
+    job->count = count;
+    job->batchSize = batchSize;
+    job->nextBatch = 0;
+    job->remainingBatches = batchCount;
+
+    GetPool().Push(job, std::min(batchCount - 1, threadCount - 1));
+
+    job->Work();
+
+    // Wait for batches still processed by workers
+    while (job->remainingBatches > 0)
+        std::this_thread::yield();
+}
+
+void jobs::Run(const std::function<void()>& func)
+{
+    std::shared_ptr<RangeJob> job = std::make_shared<RangeJob>();
+    job->func = [func](int, int) { func(); };
+    job->count = 1;
+    job->batchSize = 1;
+    job->nextBatch = 0;
+    job->remainingBatches = 1;
+
+    GetPool().Push(job, 1);
+}
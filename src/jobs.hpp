@@ -0,0 +1,19 @@
+#pragma once
+
+#include <functional>
+
+// Minimal worker thread pool
+namespace jobs
+{
+    // Number of threads used by ParallelFor (workers + calling thread)
+    int GetThreadCount();
+
+    // Call func(begin, end) on sub-ranges of [0, count) with at least minBatchSize elements each
+    // The calling thread takes part in the work and this function returns once every range is processed
+    // Can be called from inside another ParallelFor
+    void ParallelFor(int count, int minBatchSize, const std::function<void(int begin, int end)>& func);
+
+    // Call func on a worker thread and return immediately (e.g. file loading)
+    // func can call ParallelFor, tasks still queued when the program exits are dropped
+    void Run(const std::function<void()>& func);
+}
@@ -23,12 +23,16 @@
 
 #include "types.hpp"
 #include "calc.hpp"
+#include "resource_loader.hpp"
+#include "texture_streamer.hpp"
 #include "demo_fbo.hpp"
 #include "demo_quad.hpp"
 #include "demo_mipmap.hpp"
 #include "demo_texture_3d.hpp"
 #include "demo_cubemap.hpp"
 #include "demo_normalmap.hpp"
+#include "demo_benchmark.hpp"
+#include "demo_virtual_texture.hpp"
 #include "demo_dll_wrapper.hpp"
 
 // TODO: Add demo include here
@@ -141,8 +145,16 @@ int main(int argc, char* argv[])
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init("#version 330");
 
+    // Init background loading, the hidden loader window shares the objects of the main context
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* loaderWindow = glfwCreateWindow(1, 1, "IBL loader", nullptr, window);
+    ResourceLoader* resourceLoader = loaderWindow != nullptr ? new ResourceLoader(loaderWindow) : nullptr;
+    TextureStreamer* textureStreamer = new TextureStreamer();
+
     // Init demo
     DemoInputs demoInputs = {};
+    demoInputs.textureStreamer = textureStreamer;
+    demoInputs.resourceLoader = resourceLoader;
     demoInputs.windowSize.x = (float)initWidth;
     demoInputs.windowSize.y = (float)initHeight;
 
@@ -154,6 +166,8 @@ int main(int argc, char* argv[])
     demos.push_back(new DemoTexture3D(demoInputs));
     demos.push_back(new DemoCubemap(demoInputs));
     demos.push_back(new DemoNormalMap(demoInputs));
+    demos.push_back(new DemoBenchmark(demoInputs));
+    demos.push_back(new DemoVirtualTexture(demoInputs));
     // TODO: Here, add other demos
     //demos.push_back(new DemoBloom(demoInputs));
 
@@ -230,6 +244,17 @@ int main(int argc, char* argv[])
         demoInputs.windowSize   = { ImGui::GetIO().DisplaySize.x,ImGui::GetIO().DisplaySize.y };
         demoInputs.cameraInputs = getCameraInputs(mouseCaptured, mouseDX, mouseDY);
 
+        // Hand over background loads, then upload streamed textures (completions can request some)
+        if (resourceLoader != nullptr)
+        {
+            resourceLoader->Update();
+            if (resourceLoader->GetPendingCount() > 0)
+                ImGui::Text("Loading %d resources", resourceLoader->GetPendingCount());
+        }
+        textureStreamer->Update();
+        if (textureStreamer->GetPendingCount() > 0)
+            ImGui::Text("Streaming %d textures (%.1f KB this frame)", textureStreamer->GetPendingCount(), textureStreamer->GetUploadedBytes() / 1024.f);
+
         // Render current demo
         demos[demoId]->UpdateAndRender(demoInputs);
 
@@ -241,9 +266,11 @@ int main(int argc, char* argv[])
         glfwSwapBuffers(window);
     }
 
-    // Cleanup
+    // Cleanup, the loader thread is stopped first as its loads write into the demos
+    delete resourceLoader;
     for (Demo* demo : demos)
         delete demo;
+    delete textureStreamer;
 
 #ifdef USE_PAUL_DLL
     FreeLibrary(paulDemoLib);
@@ -251,6 +278,8 @@ int main(int argc, char* argv[])
     ImGui_ImplGlfw_Shutdown();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui::DestroyContext();
+    if (loaderWindow != nullptr)
+        glfwDestroyWindow(loaderWindow);
     glfwDestroyWindow(window);
     glfwTerminate();
 
@@ -0,0 +1,143 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mapped_file.hpp"
+
+#ifdef _WIN32
+
+bool GetFileInfo(const char* filename, uint64_t* size, uint64_t* modificationTime)
+{
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExA(filename, GetFileExInfoStandard, &attributes))
+        return false;
+
+    *size = ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+    *modificationTime = ((uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+    return true;
+}
+
+bool MoveFileOver(const char* source, const char* destination)
+{
+    return MoveFileExA(source, destination, MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+bool MappedFile::Open(const char* filename)
+{
+    Close();
+
+    fileHandle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+    {
+        fileHandle = nullptr;
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+    {
+        Close();
+        return false;
+    }
+
+    mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mappingHandle != nullptr)
+        data = (const unsigned char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+
+    if (data == nullptr)
+    {
+        Close();
+        return false;
+    }
+
+    size = (size_t)fileSize.QuadPart;
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (data)
+        UnmapViewOfFile(data);
+    if (mappingHandle)
+        CloseHandle(mappingHandle);
+    if (fileHandle)
+        CloseHandle(fileHandle);
+
+    data = nullptr;
+    size = 0;
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+}
+
+#else
+
+bool GetFileInfo(const char* filename, uint64_t* size, uint64_t* modificationTime)
+{
+    struct stat info;
+    if (stat(filename, &info) != 0)
+        return false;
+
+    *size = (uint64_t)info.st_size;
+    *modificationTime = (uint64_t)info.st_mtime;
+    return true;
+}
+
+bool MoveFileOver(const char* source, const char* destination)
+{
+    return rename(source, destination) == 0;
+}
+
+bool MappedFile::Open(const char* filename)
+{
+    Close();
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    // The mapping keeps its own reference to the file
+    void* mapping = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+
+    // Data is read front to back once
+    madvise(mapping, (size_t)info.st_size, MADV_SEQUENTIAL);
+
+    data = (const unsigned char*)mapping;
+    size = (size_t)info.st_size;
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (data)
+        munmap((void*)data, size);
+
+    data = nullptr;
+    size = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
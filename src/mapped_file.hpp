@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Size and last write time of a file (time unit is platform dependent, only compare it for equality)
+// Return false if the file does not exist
+bool GetFileInfo(const char* filename, uint64_t* size, uint64_t* modificationTime);
+
+// Rename source to destination, replacing it atomically: readers open either the old or the new file, never a partial one
+// Return false if destination cannot be replaced (e.g. open without delete sharing on Windows), source is then left as is
+bool MoveFileOver(const char* source, const char* destination);
+
+// Read only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const char* filename);
+    void Close();
+
+    const unsigned char* Data() const { return data; }
+    size_t Size() const { return size; }
+
+private:
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+};
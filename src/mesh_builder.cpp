@@ -1,427 +1,2831 @@
 // This is a personal academic project. Dear PVS-Studio, please check it.
 // PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
 
-#include <tiny_obj_loader.h>
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
 
 #include "calc.hpp"
+#include "calc_batch.hpp"
+#include "calc_fast.hpp"
+#include "calc_pack.hpp"
+#include "jobs.hpp"
+#include "mapped_file.hpp"
+#include "obj_parser.hpp"
 
 #include "mesh_builder.hpp"
 
-#define OBJ_CACHE_VERSION 1
+#define OBJ_CACHE_MAGIC 0x4a424f49 // "IOBJ"
+#define OBJ_CACHE_VERSION 7
+#define OBJ_CACHE_ALIGNMENT 4096 // Page size, vertices start on a page boundary
 
-struct FullVertex
+// Vertex cache size the cached index buffers are optimized for (the OptimizeOnEmit default)
+#define OBJ_CACHE_OPTIMIZE_SIZE 16
+
+// Soup vertices written per job when importing OBJ files
+#define OBJ_JOB_SIZE 16384
+
+// Larger OBJ files are imported out of core (ImportObjToCache) with the given budget, unless set with ImportObjOutOfCore
+#define OBJ_STREAMING_THRESHOLD ((uint64_t)512 << 20)
+#define OBJ_STREAMING_BUDGET ((size_t)256 << 20)
+
+// LOD chains end when a level keeps more than this ratio of the previous level triangles
+#define LOD_MIN_REDUCTION 0.9f
+
+// Triangles processed per job by the tangent generator
+#define TANGENT_JOB_SIZE 4096
+
+// Vertices or triangles written per job by the procedural generators
+#define GEN_JOB_SIZE 4096
+
+// Mapped vertices expanded or scaled on the stack at once when emitted from the OBJ cache
+#define EMIT_BLOCK_SIZE 256
+
+// Base meshes (built at compile time)
+static constexpr FullVertex TRIANGLE_VERTICES[] =
 {
-    float3 position;
-    float3 normal;
-    float2 uv;
-    float4 color;
-    float4 tangent;
+    // position             normal             uv              color                 tangent
+    { { 0.5f,-0.5f, 0.f }, { 0.f, 0.f, 1.f }, { 1.0f, 0.0f }, { 1.f, 0.f, 0.f, 1.f }, { 1.f, 0.f, 0.f, 1.f } },
+    { {-0.5f,-0.5f, 0.f }, { 0.f, 0.f, 1.f }, { 0.0f, 0.0f }, { 0.f, 1.f, 0.f, 1.f }, { 1.f, 0.f, 0.f, 1.f } },
+    { { 0.0f, 0.5f, 0.f }, { 0.f, 0.f, 1.f }, { 0.5f, 1.0f }, { 0.f, 0.f, 1.f, 1.f }, { 1.f, 0.f, 0.f, 1.f } },
+};
+
+// Scaled by halfWidth/halfHeight in GenQuad
+static constexpr FullVertex QUAD_VERTICES[] =
+{
+    // position          normal             uv            color                 tangent
+    { { 1.f,-1.f, 0.f }, { 0.f, 0.f, 1.f }, { 1.f, 0.f }, { 1.f, 1.f, 1.f, 1.f }, { 1.f, 0.f, 0.f, 1.f } },
+    { {-1.f,-1.f, 0.f }, { 0.f, 0.f, 1.f }, { 0.f, 0.f }, { 1.f, 1.f, 1.f, 1.f }, { 1.f, 0.f, 0.f, 1.f } },
+    { { 1.f, 1.f, 0.f }, { 0.f, 0.f, 1.f }, { 1.f, 1.f }, { 1.f, 1.f, 1.f, 1.f }, { 1.f, 0.f, 0.f, 1.f } },
+
+    { { 1.f, 1.f, 0.f }, { 0.f, 0.f, 1.f }, { 1.f, 1.f }, { 1.f, 1.f, 1.f, 1.f }, { 1.f, 0.f, 0.f, 1.f } },
+    { {-1.f, 1.f, 0.f }, { 0.f, 0.f, 1.f }, { 0.f, 1.f }, { 1.f, 1.f, 1.f, 1.f }, { 1.f, 0.f, 0.f, 1.f } },
+    { {-1.f,-1.f, 0.f }, { 0.f, 0.f, 1.f }, { 0.f, 0.f }, { 1.f, 1.f, 1.f, 1.f }, { 1.f, 0.f, 0.f, 1.f } },
+};
+
+// Icosahedron positions (normalized when subdivided)
+static constexpr float ICOSAHEDRON_H = (float)((1.0 + calc::ct::Sqrt(5.0)) / 2.0); // Golden ratio
+static constexpr float ICOSAHEDRON_W = 1.f;
+
+static constexpr float3 ICOSAHEDRON_POSITIONS[] =
+{
+    {-ICOSAHEDRON_W, ICOSAHEDRON_H, 0.f },
+    { ICOSAHEDRON_W, ICOSAHEDRON_H, 0.f },
+    {-ICOSAHEDRON_W,-ICOSAHEDRON_H, 0.f },
+    { ICOSAHEDRON_W,-ICOSAHEDRON_H, 0.f },
+
+    { 0.f,-ICOSAHEDRON_W, ICOSAHEDRON_H },
+    { 0.f, ICOSAHEDRON_W, ICOSAHEDRON_H },
+    { 0.f,-ICOSAHEDRON_W,-ICOSAHEDRON_H },
+    { 0.f, ICOSAHEDRON_W,-ICOSAHEDRON_H },
+
+    { ICOSAHEDRON_H, 0.f,-ICOSAHEDRON_W },
+    { ICOSAHEDRON_H, 0.f, ICOSAHEDRON_W },
+    {-ICOSAHEDRON_H, 0.f,-ICOSAHEDRON_W },
+    {-ICOSAHEDRON_H, 0.f, ICOSAHEDRON_W },
+};
+
+// Triangles
+static constexpr int ICOSAHEDRON_INDICES[] =
+{
+    0, 11,  5,
+    0,  5,  1,
+    0,  1,  7,
+    0,  7, 10,
+    0, 10, 11,
+
+    1,  5,  9,
+    5, 11,  4,
+   11, 10,  2,
+   10,  7,  6,
+    7,  1,  8,
+
+    3,  9,  4,
+    3,  4,  2,
+    3,  2,  6,
+    3,  6,  8,
+    3,  8,  9,
+
+    4,  9,  5,
+    2,  4, 11,
+    6,  2, 10,
+    8,  6,  7,
+    9,  8,  1,
 };
 
-static void ConvertVertices(void* dst, const FullVertex* src, int count, const VertexDescriptor& descriptor)
+int GetVertexFormatSize(VertexFormat format, int componentCount)
+{
+    switch (format)
+    {
+    case VertexFormat::FLOAT:            return componentCount * 4;
+    case VertexFormat::HALF:             return componentCount * 2;
+    case VertexFormat::SNORM16:          return componentCount * 2;
+    case VertexFormat::UNORM16:          return componentCount * 2;
+    case VertexFormat::OCT16:            return 4;
+    case VertexFormat::SNORM_10_10_10_2: return 4;
+    case VertexFormat::UNORM8:           return 4;
+    default:                             return 0;
+    }
+}
+
+mat4 GetDequantizeMatrix(const VertexDescriptor& descriptor, const MeshSlice& slice)
+{
+    if (descriptor.positionFormat != VertexFormat::SNORM16)
+        return mat4Identity();
+
+    return mat4Translate(slice.bounds.center) * mat4Scale(GetQuantizationScale(slice.bounds));
+}
+
+// Write componentCount floats with a per component format
+static void WriteComponents(unsigned char* dst, VertexFormat format, const float* values, int componentCount)
+{
+    for (int c = 0; c < componentCount; ++c)
+    {
+        switch (format)
+        {
+        case VertexFormat::FLOAT:   ((float*)dst)[c]    = values[c]; break;
+        case VertexFormat::HALF:    ((uint16_t*)dst)[c] = calc::pack::FloatToHalf(values[c]); break;
+        case VertexFormat::SNORM16: ((int16_t*)dst)[c]  = calc::pack::FloatToSnorm16(values[c]); break;
+        case VertexFormat::UNORM16: ((uint16_t*)dst)[c] = calc::pack::FloatToUnorm16(values[c]); break;
+        case VertexFormat::UNORM8:  dst[c]              = calc::pack::FloatToUnorm8(values[c]); break;
+        default: assert(false); break;
+        }
+    }
+}
+
+// Unit vectors (normals, tangents with sign in w)
+static void WriteDirection(unsigned char* dst, VertexFormat format, float4 value, int componentCount)
+{
+    switch (format)
+    {
+    case VertexFormat::OCT16:
+    {
+        float2 e = calc::pack::OctEncode(value.xyz);
+        ((int16_t*)dst)[0] = calc::pack::FloatToSnorm16(e.x);
+        ((int16_t*)dst)[1] = calc::pack::FloatToSnorm16(e.y);
+        break;
+    }
+    case VertexFormat::SNORM_10_10_10_2:
+    {
+        uint32_t packed = calc::pack::FloatToSnorm1010102(value);
+        memcpy(dst, &packed, sizeof(packed));
+        break;
+    }
+    default:
+        WriteComponents(dst, format, value.e, componentCount);
+        break;
+    }
+}
+
+static void ConvertVertices(void* dst, const FullVertex* src, int count, const VertexDescriptor& descriptor, const Bounds& bounds)
 {
+    bool quantizePositions = descriptor.positionFormat == VertexFormat::SNORM16;
+    float3 quantizeScale = float3{ 1.f, 1.f, 1.f } / GetQuantizationScale(bounds);
+
     unsigned char* dstBuffer = (unsigned char*)dst;
     for (int i = 0; i < count; ++i)
     {
         const FullVertex* srcVertex = src + i;
         unsigned char* vertexStart = dstBuffer + (i * descriptor.size);
 
-        float3* dstPos = (float3*)(vertexStart + descriptor.positionOffset);
-        *dstPos = srcVertex->position;
+        float3 position = srcVertex->position;
+        if (quantizePositions)
+            position = (position - bounds.center) * quantizeScale;
+        WriteComponents(vertexStart + descriptor.positionOffset, descriptor.positionFormat, position.e, 3);
 
         if (descriptor.hasNormal)
+            WriteDirection(vertexStart + descriptor.normalOffset, descriptor.normalFormat, float4(srcVertex->normal, 0.f), 3);
+
+        if (descriptor.hasUV)
+            WriteComponents(vertexStart + descriptor.uvOffset, descriptor.uvFormat, srcVertex->uv.e, 2);
+
+        if (descriptor.hasColor)
+            WriteComponents(vertexStart + descriptor.colorOffset, descriptor.colorFormat, srcVertex->color.e, 4);
+
+        if (descriptor.hasTangent)
+            WriteDirection(vertexStart + descriptor.tangentOffset, descriptor.tangentFormat, srcVertex->tangent, 4);
+    }
+}
+
+// Object space position of a converted vertex
+static float3 ReadPosition(const unsigned char* vertex, const VertexDescriptor& descriptor, const mat4& dequantize)
+{
+    const unsigned char* src = vertex + descriptor.positionOffset;
+    float3 position;
+    for (int c = 0; c < 3; ++c)
+    {
+        switch (descriptor.positionFormat)
         {
-            float3* dstNormal = (float3*)(vertexStart + descriptor.normalOffset);
-            *dstNormal = srcVertex->normal;
+        case VertexFormat::HALF:    position.e[c] = calc::pack::HalfToFloat(((const uint16_t*)src)[c]); break;
+        case VertexFormat::SNORM16: position.e[c] = calc::pack::Snorm16ToFloat(((const int16_t*)src)[c]); break;
+        default:                    position.e[c] = ((const float*)src)[c]; break;
         }
+    }
+    return (dequantize * float4(position, 1.f)).xyz;
+}
 
-        if (descriptor.hasUV)
+static Bounds ComputeBounds(const FullVertex* vertices, int count)
+{
+    return culling::ComputeBounds(GetVertexStream((void*)vertices, sizeof(FullVertex), offsetof(FullVertex, position)), count);
+}
+
+static unsigned int HashVertex(const FullVertex& vertex)
+{
+    // FNV-1a over the vertex bytes (FullVertex has no padding)
+    const unsigned char* bytes = (const unsigned char*)&vertex;
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < sizeof(FullVertex); ++i)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+// Merge bitwise identical vertices, remap[i] is the index of vertices[i] inside unique
+static void WeldVertices(const FullVertex* vertices, int count, std::vector<FullVertex>& unique, std::vector<int>& remap)
+{
+    // Open addressing table, at least twice as big as the vertex count
+    unsigned int tableSize = 1;
+    while (tableSize < (unsigned int)count * 2)
+        tableSize *= 2;
+    std::vector<int> table(tableSize, -1);
+
+    unique.clear();
+    unique.reserve(count);
+    remap.resize(count);
+    for (int i = 0; i < count; ++i)
+    {
+        unsigned int slot = HashVertex(vertices[i]) & (tableSize - 1);
+        while (table[slot] != -1 && memcmp(&unique[table[slot]], &vertices[i], sizeof(FullVertex)) != 0)
+            slot = (slot + 1) & (tableSize - 1);
+
+        if (table[slot] == -1)
         {
-            float2* dstUV = (float2*)(vertexStart + descriptor.uvOffset);
-            *dstUV = srcVertex->uv;
+            table[slot] = (int)unique.size();
+            unique.push_back(vertices[i]);
         }
+        remap[i] = table[slot];
+    }
+}
 
-        if (descriptor.hasColor)
+// Vector orthogonal to n, used when the UVs do not define a tangent
+static float3 GetOrthogonal(float3 n)
+{
+    float3 axis = calc::Abs(n.x) < 0.9f ? float3{ 1.f, 0.f, 0.f } : float3{ 0.f, 1.f, 0.f };
+    return v3Normalize(v3Cross(v3Cross(n, axis), n));
+}
+
+// Tangents of a triangle soup following MikkTSpace: the UV gradient of each face is projected on the corner normal
+// and weighted by the corner angle, then summed over the corners sharing position/normal/uv and orientation
+// w is the bitangent sign: bitangent = w * cross(normal, tangent), measured against the normals so triangle winding does not matter
+static void GenerateTangents(FullVertex* vertices, int count, bool parallel)
+{
+    int triangleCount = count / 3;
+    std::vector<float3> cornerTangents(count);
+    std::vector<FullVertex> keys(vertices, vertices + count);
+
+    auto computeFaces = [&](int begin, int end)
+    {
+        for (int f = begin; f < end; ++f)
         {
-            float4* dstColor = (float4*)(vertexStart + descriptor.colorOffset);
-            *dstColor = srcVertex->color;
+            FullVertex* v = &vertices[f * 3];
+            float3 e1 = v[1].position - v[0].position;
+            float3 e2 = v[2].position - v[0].position;
+            float2 d1 = v[1].uv - v[0].uv;
+            float2 d2 = v[2].uv - v[0].uv;
+
+            // UV gradients (up to 1 / signedArea), the tangent is kept only for non degenerate faces
+            float signedArea = d1.x * d2.y - d2.x * d1.y;
+            float areaSign = signedArea >= 0.f ? 1.f : -1.f;
+            float3 faceTangent   = (e1 * d2.y - e2 * d1.y) * areaSign;
+            float3 faceBitangent = (e2 * d1.x - e1 * d2.x) * areaSign;
+            float faceTangentLength = v3Length(faceTangent);
+
+            // Slivers (area tiny compared to the squared edge lengths) give noise instead of gradients
+            float3 cross = v3Cross(e1, e2);
+            float edgesSq = v3Dot(e1, e1) + v3Dot(e2, e2);
+            bool degenerate = signedArea == 0.f || faceTangentLength <= 0.f || v3Dot(cross, cross) <= 1e-12f * edgesSq * edgesSq;
+            if (!degenerate)
+                faceTangent = faceTangent / faceTangentLength;
+
+            // Without normals fall back to the UV winding like MikkTSpace
+            // Degenerate faces join the non mirrored group of their vertices and take its tangent
+            float3 faceNormal = v[0].normal + v[1].normal + v[2].normal;
+            float orientation = areaSign;
+            if (degenerate)
+                orientation = 1.f;
+            else if (v3Dot(faceNormal, faceNormal) > 0.f)
+                orientation = v3Dot(v3Cross(faceNormal, faceTangent), faceBitangent) >= 0.f ? 1.f : -1.f;
+
+            for (int c = 0; c < 3; ++c)
+            {
+                int i = f * 3 + c;
+                const float3& n = v[c].normal;
+
+                // Group key: same vertex and same orientation
+                keys[i].color   = {};
+                keys[i].tangent = { 0.f, 0.f, 0.f, orientation };
+
+                if (degenerate)
+                {
+                    cornerTangents[i] = {};
+                    continue;
+                }
+
+                // Angle between the edges leaving the corner, in the tangent plane
+                float3 edge0 = v[(c + 1) % 3].position - v[c].position;
+                float3 edge1 = v[(c + 2) % 3].position - v[c].position;
+                edge0 = edge0 - n * v3Dot(n, edge0);
+                edge1 = edge1 - n * v3Dot(n, edge1);
+                float lengths = v3Length(edge0) * v3Length(edge1);
+                float angle = lengths > 0.f ? calc::Acos(calc::Clamp(v3Dot(edge0, edge1) / lengths, -1.f, 1.f)) : 0.f;
+
+                float3 t = faceTangent - n * v3Dot(n, faceTangent);
+                float tLength = v3Length(t);
+                cornerTangents[i] = tLength > 0.f ? t * (angle / tLength) : float3{};
+            }
         }
+    };
 
-        if (descriptor.hasTangent)
+    if (parallel)
+        jobs::ParallelFor(triangleCount, TANGENT_JOB_SIZE, computeFaces);
+    else
+        computeFaces(0, triangleCount);
+
+    std::vector<FullVertex> groups;
+    std::vector<int> groupIndices;
+    WeldVertices(keys.data(), count, groups, groupIndices);
+
+    std::vector<float3> groupTangents(groups.size(), float3{});
+    for (int i = 0; i < count; ++i)
+        groupTangents[groupIndices[i]] += cornerTangents[i];
+
+    auto writeTangents = [&](int begin, int end)
+    {
+        for (int i = begin * 3; i < end * 3; ++i)
         {
-            float4* dstTangent = (float4*)(vertexStart + descriptor.tangentOffset);
-            *dstTangent = srcVertex->tangent;
+            const FullVertex& group = groups[groupIndices[i]];
+            float3 t = groupTangents[groupIndices[i]];
+            t = t - group.normal * v3Dot(group.normal, t);
+            float tLength = v3Length(t);
+            t = tLength > 1e-8f ? t / tLength : GetOrthogonal(group.normal);
+            vertices[i].tangent = float4(t, group.tangent.w);
         }
-    }
+    };
+
+    if (parallel)
+        jobs::ParallelFor(triangleCount, TANGENT_JOB_SIZE, writeTangents);
+    else
+        writeTangents(0, triangleCount);
 }
 
-MeshBuilder::MeshBuilder(const VertexDescriptor& descriptor, void** verticesPtr, int* vertexCount)
-    : descriptor(descriptor)
+// Index buffer optimization (see below), also applied on emit
+static VertexCacheStats AnalyzeVertexCache(const unsigned int* indices, int indexCount, int vertexCount, int cacheSize);
+static void OptimizeIndices(unsigned int* localIndices, int indexCount, int vertexCount, float3Strided positions, int cacheSize, std::vector<int>& vertexOrder);
+static void BuildMeshlets(unsigned int* localIndices, int indexCount, int vertexCount, float3Strided positions, int maxVertices, int maxTriangles, int indexStart, std::vector<Meshlet>& meshlets);
+
+MeshBuilder::MeshBuilder(const VertexLayout& layout, void** verticesPtr, int* vertexCount, unsigned int** indicesPtr, int* indexCount)
+    : descriptor(layout.descriptor)
+    , convert(layout.convert)
     , verticesPtr(verticesPtr)
     , vertexCount(vertexCount)
+    , indicesPtr(indicesPtr)
+    , indexCount(indexCount)
+    , vertexCapacity(*vertexCount)
+    , indexCapacity(indexCount ? *indexCount : 0)
+    , objImportThreshold(OBJ_STREAMING_THRESHOLD)
+    , objImportBudget(OBJ_STREAMING_BUDGET)
 {
 }
 
-void* MeshBuilder::GetDst(int* startIndex, int count)
+MeshBuilder::MeshBuilder(const VertexLayout& layout, void* vertices, int vertexCapacity, int* vertexCount,
+                         unsigned int* indices, int indexCapacity, int* indexCount)
+    : descriptor(layout.descriptor)
+    , convert(layout.convert)
+    , verticesPtr(&fixedVertices)
+    , vertexCount(vertexCount)
+    , indicesPtr(indexCount ? &fixedIndices : nullptr)
+    , indexCount(indexCount)
+    , vertexCapacity(vertexCapacity)
+    , indexCapacity(indexCapacity)
+    , fixedCapacity(true)
+    , countOnly(vertices == nullptr)
+    , fixedVertices(vertices)
+    , fixedIndices(indices)
+    , objImportThreshold(OBJ_STREAMING_THRESHOLD)
+    , objImportBudget(OBJ_STREAMING_BUDGET)
 {
-    void* dst;
+}
 
-    // TODO: Check space is sufficient if startIndex is set
-    if (startIndex)
-        dst = (unsigned char*)(*verticesPtr) + *startIndex * descriptor.size;
-    else
-        dst = Grow(count);
+void MeshBuilder::Reserve(int vertexCapacity, int indexCapacity)
+{
+    assert(!fixedCapacity);
+
+    if (vertexCapacity > this->vertexCapacity)
+    {
+        *verticesPtr = realloc(*verticesPtr, (size_t)vertexCapacity * descriptor.size);
+        this->vertexCapacity = vertexCapacity;
+    }
+
+    if (indicesPtr && indexCapacity > this->indexCapacity)
+    {
+        *indicesPtr = (unsigned int*)realloc(*indicesPtr, (size_t)indexCapacity * sizeof(unsigned int));
+        this->indexCapacity = indexCapacity;
+    }
+}
+
+void MeshBuilder::OptimizeOnEmit(int cacheSize, VertexCacheStats* stats)
+{
+    assert(indicesPtr != nullptr);
+    emitCacheSize = cacheSize;
+    emitStats = stats;
+}
+
+void MeshBuilder::BuildMeshletsOnEmit(std::vector<Meshlet>* meshlets, int maxVertices, int maxTriangles)
+{
+    assert(indicesPtr != nullptr && maxVertices >= 3 && maxTriangles >= 1);
+    emitMeshlets = meshlets;
+    meshletMaxVertices = maxVertices;
+    meshletMaxTriangles = maxTriangles;
+}
+
+void MeshBuilder::CopyPositionsOnEmit(std::vector<float3>* positions)
+{
+    emitPositions = positions;
+}
+
+void MeshBuilder::ImportObjOutOfCore(uint64_t minFileSize, size_t memoryBudget)
+{
+    objImportThreshold = minFileSize;
+    objImportBudget = memoryBudget;
+}
 
-    return dst;
+void* MeshBuilder::GetDst(int* startIndex, int count)
+{
+    if (startIndex == nullptr)
+        return Grow(count);
+
+    assert(*startIndex + count <= vertexCapacity);
+    if (countOnly || *startIndex + count > vertexCapacity)
+        return nullptr;
+    if (emitPositions && emitPositions->size() < (size_t)(*startIndex + count))
+        emitPositions->resize(*startIndex + count);
+    return (unsigned char*)(*verticesPtr) + (size_t)*startIndex * descriptor.size;
 }
 
+// Null if nothing must be written (size query or overflow of a fixed destination)
 void* MeshBuilder::Grow(int count)
 {
     int oldCount = *vertexCount;
     *vertexCount += count;
-    void* newPtr = realloc(*verticesPtr, *vertexCount * descriptor.size);
-    *verticesPtr = newPtr;
+    if (countOnly)
+        return nullptr;
 
-    return (unsigned char*)*verticesPtr + (oldCount * descriptor.size);
+    if (*vertexCount > vertexCapacity)
+    {
+        assert(!fixedCapacity && "Vertex destination too small, sizes must come from the same meshes");
+        if (fixedCapacity)
+            return nullptr;
+        Reserve(std::max(*vertexCount, vertexCapacity * 2), indexCapacity);
+    }
+
+    // Sized here as vertices are converted in parallel
+    if (emitPositions && emitPositions->size() < (size_t)*vertexCount)
+        emitPositions->resize(*vertexCount);
+    return (unsigned char*)*verticesPtr + ((size_t)oldCount * descriptor.size);
 }
 
-MeshSlice MeshBuilder::GenTriangle(int* startIndex)
+unsigned int* MeshBuilder::GrowIndices(int count)
 {
-    FullVertex vertices[] =
+    int oldCount = *indexCount;
+    *indexCount += count;
+    if (countOnly)
+        return nullptr;
+
+    if (*indexCount > indexCapacity)
     {
-        // position             normal             uv              color
-        { { 0.5f,-0.5f, 0.f }, { 0.f, 0.f, 1.f }, { 1.0f, 0.0f }, { 1.f, 0.f, 0.f, 1.f } },
-        { {-0.5f,-0.5f, 0.f }, { 0.f, 0.f, 1.f }, { 0.0f, 0.0f }, { 0.f, 1.f, 0.f, 1.f } },
-        { { 0.0f, 0.5f, 0.f }, { 0.f, 0.f, 1.f }, { 0.5f, 1.0f }, { 0.f, 0.f, 1.f, 1.f } },
-    };
+        assert(!fixedCapacity && "Index destination too small, sizes must come from the same meshes");
+        if (fixedCapacity)
+            return nullptr;
+        Reserve(vertexCapacity, std::max(*indexCount, indexCapacity * 2));
+    }
 
-    int count = ARRAYSIZE(vertices);
+    return *indicesPtr + oldCount;
+}
 
-    ConvertVertices(GetDst(startIndex, count), vertices, count, descriptor);
+void MeshBuilder::Convert(void* dst, const FullVertex* vertices, int count, const Bounds& bounds) const
+{
+    if (convert)
+        convert(dst, vertices, count, bounds);
+    else
+        ConvertVertices(dst, vertices, count, descriptor, bounds);
 
-    return { *vertexCount - count, count };
+    if (emitPositions)
+    {
+        float3* positions = emitPositions->data() + ((const unsigned char*)dst - (const unsigned char*)*verticesPtr) / descriptor.size;
+        for (int i = 0; i < count; ++i)
+            positions[i] = vertices[i].position;
+    }
 }
 
-MeshSlice MeshBuilder::GenQuad(int* startIndex, float halfWidth, float halfHeight)
+MeshSlice MeshBuilder::Emit(int* startIndex, const FullVertex* vertices, int count, const Bounds* knownBounds)
 {
-    FullVertex vertices[] =
+    Bounds bounds = knownBounds ? *knownBounds : ComputeBounds(vertices, count);
+
+    if (indicesPtr == nullptr)
     {
-        // position                        normal             uv            color
-        { { halfWidth,-halfHeight, 0.f }, { 0.f, 0.f, 1.f }, { 1.f, 0.f }, { 1.f, 1.f, 1.f, 1.f } },
-        { {-halfWidth,-halfHeight, 0.f }, { 0.f, 0.f, 1.f }, { 0.f, 0.f }, { 1.f, 1.f, 1.f, 1.f } },
-        { { halfWidth, halfHeight, 0.f }, { 0.f, 0.f, 1.f }, { 1.f, 1.f }, { 1.f, 1.f, 1.f, 1.f } },
+        int start = startIndex ? *startIndex : *vertexCount;
+        if (void* dst = GetDst(startIndex, count))
+            Convert(dst, vertices, count, bounds);
+        return { start, count, bounds, start, count };
+    }
 
-        { { halfWidth, halfHeight, 0.f }, { 0.f, 0.f, 1.f }, { 1.f, 1.f }, { 1.f, 1.f, 1.f, 1.f } },
-        { {-halfWidth, halfHeight, 0.f }, { 0.f, 0.f, 1.f }, { 0.f, 1.f }, { 1.f, 1.f, 1.f, 1.f } },
-        { {-halfWidth,-halfHeight, 0.f }, { 0.f, 0.f, 1.f }, { 0.f, 0.f }, { 1.f, 1.f, 1.f, 1.f } },
-    };
-    int count = ARRAYSIZE(vertices);
+    // Indexed meshes are always appended
+    assert(startIndex == nullptr);
+
+    // Attributes missing from the output must not prevent welding
+    std::vector<FullVertex> used(vertices, vertices + count);
+    for (FullVertex& vertex : used)
+    {
+        if (!descriptor.hasNormal)  vertex.normal  = {};
+        if (!descriptor.hasUV)      vertex.uv      = {};
+        if (!descriptor.hasColor)   vertex.color   = {};
+        if (!descriptor.hasTangent) vertex.tangent = {};
+    }
 
-    ConvertVertices(GetDst(startIndex, count), vertices, count, descriptor);
+    std::vector<FullVertex> unique;
+    std::vector<int> remap;
+    WeldVertices(used.data(), count, unique, remap);
 
-    return { *vertexCount - count, count };
+    std::vector<unsigned int> localIndices(remap.begin(), remap.end());
+    return EmitIndexed(nullptr, unique, localIndices, bounds);
 }
 
-MeshSlice MeshBuilder::GenIcosphereFace(int* index, float3 a, float3 b, float3 c, int depth)
+MeshSlice MeshBuilder::EmitIndexed(int* startIndex, std::vector<FullVertex>& vertices, std::vector<unsigned int>& localIndices, const Bounds& bounds)
 {
-    int startIndex = *index;
-    if (depth == 0)
+    int count = (int)localIndices.size();
+    if (indicesPtr == nullptr)
     {
-        a = v3Normalize(a);
-        b = v3Normalize(b);
-        c = v3Normalize(c);
-
-        FullVertex vertices[] =
+        std::vector<FullVertex> soup(count);
+        jobs::ParallelFor(count, GEN_JOB_SIZE, [&](int begin, int end)
         {
-            { a * 0.5f, a, { 0.f, 0.f }, { 1.f, 1.f, 1.f, 1.f } },
-            { b * 0.5f, b, { 0.f, 0.f }, { 1.f, 1.f, 1.f, 1.f } },
-            { c * 0.5f, c, { 0.f, 0.f }, { 1.f, 1.f, 1.f, 1.f } },
-        };
-        int count = ARRAYSIZE(vertices);
-        ConvertVertices(GetDst(index, count), vertices, count, descriptor);
-        *index += count;
+            for (int i = begin; i < end; ++i)
+                soup[i] = vertices[localIndices[i]];
+        });
+        return Emit(startIndex, soup.data(), count, &bounds);
     }
-    else
+
+    assert(startIndex == nullptr);
+
+    int vertexStart = *vertexCount;
+    int uniqueCount = (int)vertices.size();
+    int indexStart = *indexCount;
+    void* dstVertices = Grow(uniqueCount);
+    unsigned int* dstIndices = GrowIndices(count);
+    MeshSlice slice = { indexStart, count, bounds, vertexStart, uniqueCount };
+    if (dstVertices == nullptr || dstIndices == nullptr)
+        return slice;
+
+    // Processed with the full precision positions, then written once
+    bool optimize = emitCacheSize > 0 && count > 0;
+    if (optimize)
     {
-        float3 mab = a + (b-a) * 0.5f;
-        float3 mbc = b + (c-b) * 0.5f;
-        float3 mca = c + (a-c) * 0.5f;
+        if (emitStats)
+            emitStats[0] = ::AnalyzeVertexCache(localIndices.data(), count, uniqueCount, emitCacheSize);
+
+        std::vector<int> vertexOrder;
+        OptimizeIndices(localIndices.data(), count, uniqueCount, GetVertexStream(vertices.data(), sizeof(FullVertex), offsetof(FullVertex, position)), emitCacheSize, vertexOrder);
+
+        std::vector<FullVertex> reordered(uniqueCount);
+        for (int v = 0; v < uniqueCount; ++v)
+            reordered[vertexOrder[v]] = vertices[v];
+        vertices.swap(reordered);
+    }
 
-        GenIcosphereFace(index, a, mab, mca, depth-1);
-        GenIcosphereFace(index, b, mbc, mab, depth-1);
-        GenIcosphereFace(index, c, mca, mbc, depth-1);
-        GenIcosphereFace(index, mab, mbc, mca, depth-1);
+    if (emitMeshlets != nullptr && count > 0)
+    {
+        float3Strided positions = GetVertexStream(vertices.data(), sizeof(FullVertex), offsetof(FullVertex, position));
+        ::BuildMeshlets(localIndices.data(), count, uniqueCount, positions, meshletMaxVertices, meshletMaxTriangles, indexStart, *emitMeshlets);
     }
 
-    return { startIndex, *index - startIndex };
+    if (optimize && emitStats)
+        emitStats[1] = ::AnalyzeVertexCache(localIndices.data(), count, uniqueCount, emitCacheSize);
+
+    Convert(dstVertices, vertices.data(), uniqueCount, bounds);
+    for (int i = 0; i < count; ++i)
+        dstIndices[i] = (unsigned int)vertexStart + localIndices[i];
+
+    return slice;
 }
 
-MeshSlice MeshBuilder::GenIcosphere(int* startIndex, int depth)
+MeshSlice MeshBuilder::EmitWelded(int* startIndex, const FullVertex* vertices, int uniqueCount, const unsigned int* localIndices, int count,
+                                  const Bounds& bounds, float scale, int optimizedCacheSize, const VertexCacheStats* optimizedStats)
 {
-    // Create iscosahedron positions (radius = 1)
-    float t = 1.f + sqrtf(5.f) / 2.f; // Golden ratio
-    float h = t;
-    float w = 1.f;
+    // Counts are known without reading the mesh
+    if (countOnly)
+    {
+        if (indicesPtr == nullptr)
+        {
+            int start = startIndex ? *startIndex : *vertexCount;
+            GetDst(startIndex, count);
+            return { start, count, bounds, start, count };
+        }
+
+        MeshSlice slice = { *indexCount, count, bounds, *vertexCount, uniqueCount };
+        Grow(uniqueCount);
+        GrowIndices(count);
+        return slice;
+    }
 
-    float3 positions[]
+    // The stored order is kept unless another cache size is asked for, which needs the whole slice
+    bool optimize = emitCacheSize > 0 && count > 0;
+    if (indicesPtr != nullptr && optimize && emitCacheSize != optimizedCacheSize)
     {
-        {-w, h, 0.f },
-        { w, h, 0.f },
-        {-w,-h, 0.f },
-        { w,-h, 0.f },
+        std::vector<FullVertex> copy(vertices, vertices + uniqueCount);
+        std::vector<unsigned int> indices(localIndices, localIndices + count);
+        for (FullVertex& vertex : copy)
+            vertex.position *= scale;
+        return EmitIndexed(startIndex, copy, indices, bounds);
+    }
 
-        { 0.f,-w, h },
-        { 0.f, w, h },
-        { 0.f,-w,-h },
-        { 0.f, w,-h },
+    // Otherwise mapped vertices are read in place, or expanded and scaled through a block on the stack
+    auto convertRange = [&](void* dst, const unsigned int* gather, int begin, int end)
+    {
+        if (gather == nullptr && scale == 1.f)
+        {
+            Convert((unsigned char*)dst + (size_t)begin * descriptor.size, vertices + begin, end - begin, bounds);
+            return;
+        }
 
-        { h, 0.f,-w },
-        { h, 0.f, w },
-        {-h, 0.f,-w },
-        {-h, 0.f, w },
+        FullVertex block[EMIT_BLOCK_SIZE];
+        for (int first = begin; first < end; first += EMIT_BLOCK_SIZE)
+        {
+            int blockCount = calc::Min(EMIT_BLOCK_SIZE, end - first);
+            for (int i = 0; i < blockCount; ++i)
+            {
+                block[i] = vertices[gather ? gather[first + i] : first + i];
+                block[i].position *= scale;
+            }
+            Convert((unsigned char*)dst + (size_t)first * descriptor.size, block, blockCount, bounds);
+        }
     };
 
-    // Triangles
-    int indices[] =
-    {
-        0, 11,  5,
-        0,  5,  1,
-        0,  1,  7,
-        0,  7, 10,
-        0, 10, 11,
-
-        1,  5,  9,
-        5, 11,  4,
-       11, 10,  2,
-       10,  7,  6,
-        7,  1,  8,
-
-        3,  9,  4,
-        3,  4,  2,
-        3,  2,  6,
-        3,  6,  8,
-        3,  8,  9,
-
-        4,  9,  5,
-        2,  4, 11,
-        6,  2, 10,
-        8,  6,  7,
-        9,  8,  1,
-    };
+    if (indicesPtr == nullptr)
+    {
+        int start = startIndex ? *startIndex : *vertexCount;
+        if (void* dst = GetDst(startIndex, count))
+        {
+            jobs::ParallelFor(count, GEN_JOB_SIZE, [&](int begin, int end)
+            {
+                convertRange(dst, localIndices, begin, end);
+            });
+        }
+        return { start, count, bounds, start, count };
+    }
 
-    int count = (int)(ARRAYSIZE(indices) * calc::Pow(4, (float)depth));
-    GetDst(startIndex, count);
-    int index = *vertexCount - count;
-    int indexTmp = index;
+    assert(startIndex == nullptr);
 
-    for (int i = 0; i < ARRAYSIZE(indices); i += 3)
-        GenIcosphereFace(&indexTmp, positions[indices[i+0]], positions[indices[i+1]], positions[indices[i+2]], depth);
+    int vertexStart = *vertexCount;
+    int indexStart = *indexCount;
+    void* dstVertices = Grow(uniqueCount);
+    unsigned int* dstIndices = GrowIndices(count);
+    MeshSlice slice = { indexStart, count, bounds, vertexStart, uniqueCount };
+    if (dstVertices == nullptr || dstIndices == nullptr)
+        return slice;
 
-    return { index, count };
-}
+    // Meshlets reorder a copy of the indices, vertices keep their order
+    const unsigned int* indices = localIndices;
+    std::vector<unsigned int> meshletIndices;
+    if (emitMeshlets != nullptr && count > 0)
+    {
+        meshletIndices.assign(localIndices, localIndices + count);
+        float3Strided positions = GetVertexStream((void*)vertices, sizeof(FullVertex), offsetof(FullVertex, position));
+        ::BuildMeshlets(meshletIndices.data(), count, uniqueCount, positions, meshletMaxVertices, meshletMaxTriangles, indexStart, *emitMeshlets);
+        indices = meshletIndices.data();
+    }
 
-MeshSlice MeshBuilder::GenUVSphere(int* startIndex, int lat, int lon)
-{
-    int count = lon * lat * 6;
-    GetDst(startIndex, count);
-    int index = *vertexCount - count;
-    MeshSlice slice = { index, count };
-
-    for (int i = 0; i < lat; ++i)
-    {
-        // Theta varies from 0 to 180
-        float theta        = calc::TAU / 2.f * (float)(i+0) / lat;
-        float thetaCos     = calc::Cos(theta);
-        float thetaSin     = calc::Sin(theta);
-
-        float thetaNext    = calc::TAU / 2.f * (float)(i+1) / lat;
-        float thetaNextCos = calc::Cos(thetaNext);
-        float thetaNextSin = calc::Sin(thetaNext);
-
-        for (int j = 0; j < lon; ++j)
-        {
-            // Phi varies from 0 to 360
-            float phi        = calc::TAU * (float)(j+0) / lon;
-            float phiCos     = calc::Cos(phi);
-            float phiSin     = calc::Sin(phi);
-
-            float phiNext    = calc::TAU * (float)(j+1) / lon;
-            float phiNextCos = calc::Cos(phiNext);
-            float phiNextSin = calc::Sin(phiNext);
-
-            // Compute positions
-            float3 p0 = {     thetaSin * phiCos,         thetaCos,     thetaSin * phiSin     };
-            float3 p1 = {     thetaSin * phiNextCos,     thetaCos,     thetaSin * phiNextSin };
-            float3 p2 = { thetaNextSin * phiCos,     thetaNextCos, thetaNextSin * phiSin     };
-            float3 p3 = { thetaNextSin * phiNextCos, thetaNextCos, thetaNextSin * phiNextSin };
-            float3 t0 = {                phiSin,              0.f,                phiCos     };
-            float3 t1 = {            phiNextSin,              0.f,                phiNextCos };
-            float3 t2 = {                phiSin,              0.f,                phiCos     };
-            float3 t3 = {            phiNextSin,              0.f,                phiNextCos };
-
-            FullVertex quad[6];
-            quad[0].position = quad[0].normal = p0;
-            quad[1].position = quad[1].normal = p1;
-            quad[2].position = quad[2].normal = p2;
-            quad[3].position = quad[3].normal = p2;
-            quad[4].position = quad[4].normal = p1;
-            quad[5].position = quad[5].normal = p3;
-
-            for (int i = 0; i < 6; ++i)
-                quad[i].position *= 0.5f; // pos between -0.5 and 0.5 (unit sphere)
-            
-            quad[0].tangent = float4(t0, 1.f);
-            quad[1].tangent = float4(t1, 1.f);
-            quad[2].tangent = float4(t2, 1.f);
-            quad[3].tangent = float4(t2, 1.f);
-            quad[4].tangent = float4(t1, 1.f);
-            quad[5].tangent = float4(t3, 1.f);
-
-            // Set uv
-            float u0 = 1.f - (j + 0.f) / (float)lon;
-            float u1 = 1.f - (j + 1.f) / (float)lon;
-            float v0 = 1.f - (i + 0.f) / (float)lat;
-            float v1 = 1.f - (i + 1.f) / (float)lat;
-
-            quad[0].uv = { u0, v0 };
-            quad[1].uv = { u1, v0 };
-            quad[2].uv = { u0, v1 };
-            quad[3].uv = quad[2].uv;
-            quad[4].uv = quad[1].uv;
-            quad[5].uv = { u1, v1 };
-
-            ConvertVertices(GetDst(&index, 6), quad, 6, descriptor);
-            index += 6;
-        }
+    if (optimize && emitStats)
+    {
+        emitStats[0] = optimizedStats[0];
+        emitStats[1] = emitMeshlets ? ::AnalyzeVertexCache(indices, count, uniqueCount, emitCacheSize) : optimizedStats[1];
     }
 
+    // Destinations are only written to, in parallel
+    jobs::ParallelFor(uniqueCount, GEN_JOB_SIZE, [&](int begin, int end)
+    {
+        convertRange(dstVertices, nullptr, begin, end);
+    });
+    jobs::ParallelFor(count, GEN_JOB_SIZE, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+            dstIndices[i] = (unsigned int)vertexStart + indices[i];
+    });
+
     return slice;
 }
 
-// Implement dumb caching to avoid parsing .obj again and again
-static bool LoadObjFromCache(std::vector<FullVertex>& mesh, const char* filename)
+MeshSlice MeshBuilder::GenTriangle(int* startIndex)
 {
-    std::string cachedFile = filename;
-    cachedFile += ".cache";
+    FullVertex vertices[ARRAYSIZE(TRIANGLE_VERTICES)];
+    std::copy(TRIANGLE_VERTICES, TRIANGLE_VERTICES + ARRAYSIZE(TRIANGLE_VERTICES), vertices);
+    if (descriptor.hasTangent)
+        GenerateTangents(vertices, ARRAYSIZE(vertices), false);
 
-    FILE* file = fopen(cachedFile.c_str(), "rb");
-    if (file == nullptr)
-        return false;
+    return Emit(startIndex, vertices, ARRAYSIZE(vertices));
+}
 
-    size_t version;
-    fread(&version, sizeof(size_t), 1, file);
-    if (version != OBJ_CACHE_VERSION)
+MeshSlice MeshBuilder::GenQuad(int* startIndex, float halfWidth, float halfHeight)
+{
+    FullVertex vertices[ARRAYSIZE(QUAD_VERTICES)];
+    int count = ARRAYSIZE(vertices);
+    for (int i = 0; i < count; ++i)
     {
-        printf("Cached version mismatch for %s, reload...\n", filename);
-        return false;
+        vertices[i] = QUAD_VERTICES[i];
+        vertices[i].position *= float3(halfWidth, halfHeight, 1.f);
     }
 
-    size_t vertexCount = 0;
-    fread(&vertexCount, sizeof(size_t), 1, file);
-    mesh.resize(vertexCount);
-    fread(mesh.data(), sizeof(FullVertex), vertexCount, file);
-    fclose(file);
-
-    printf("Model loaded from cache: %s (%d vertices)\n", filename, (int)vertexCount);
+    if (descriptor.hasTangent)
+        GenerateTangents(vertices, count, false);
 
-    return true;
+    return Emit(startIndex, vertices, count);
 }
 
-static void SaveObjToCache(const std::vector<FullVertex>& mesh, const char* filename)
+// Edge of the subdivided icosahedron, split at its midpoint on the next level
+struct IcosphereEdge
 {
-    std::string cachedFile = filename;
-    cachedFile += ".cache";
-
-    FILE* file = fopen(cachedFile.c_str(), "wb");
-    size_t version = OBJ_CACHE_VERSION;
-    fwrite(&version, sizeof(size_t), 1, file);
-    size_t vertexCount = mesh.size();
-    fwrite(&vertexCount, sizeof(size_t), 1, file);
-    fwrite(&mesh[0], sizeof(FullVertex), vertexCount, file);
-    fclose(file);
+    unsigned int v0;
+    unsigned int v1;
+};
 
-    printf("Model saved to cache: %s (%d vertices)\n", filename, (int)vertexCount);
+// Half of a split edge (see GenIcosphere) that touches one of its ends
+static unsigned int GetIcosphereHalfEdge(const IcosphereEdge& edge, unsigned int e, unsigned int vertex)
+{
+    return e * 2 + (vertex == edge.v1 ? 1 : 0);
 }
 
-MeshSlice MeshBuilder::LoadObj(int* startIndex, const char* objFile, const char* mtlDir, float scale)
+MeshSlice MeshBuilder::GenIcosphere(int* startIndex, int depth)
 {
-    std::vector<FullVertex> vertices;
-    if (!LoadObjFromCache(vertices, objFile))
+    // Flat subdivision of the icosahedron faces, projected on the sphere once at the end
+    std::vector<float3> positions(ICOSAHEDRON_POSITIONS, ICOSAHEDRON_POSITIONS + ARRAYSIZE(ICOSAHEDRON_POSITIONS));
+    std::vector<unsigned int> indices(ICOSAHEDRON_INDICES, ICOSAHEDRON_INDICES + ARRAYSIZE(ICOSAHEDRON_INDICES));
+
+    // Triangles know their edges (a-b, b-c, c-a) so midpoints are computed once per edge
+    std::vector<IcosphereEdge> edges;
+    std::vector<unsigned int> triangleEdges(indices.size());
+    for (size_t i = 0; i < indices.size(); ++i)
     {
-        tinyobj::attrib_t attrib;
-        std::vector<tinyobj::shape_t> shapes;
-        std::vector<tinyobj::material_t> materials;
-        std::string warning;
-        std::string error;
-
-        bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &warning, &error, objFile, mtlDir, true);
-        if (!warning.empty())
-            printf("%s\n", warning.c_str());
+        unsigned int a = indices[i];
+        unsigned int b = indices[i - i % 3 + (i + 1) % 3];
+        auto found = std::find_if(edges.begin(), edges.end(), [a, b](const IcosphereEdge& edge) { return edge.v0 == b && edge.v1 == a; });
+        triangleEdges[i] = (unsigned int)(found - edges.begin());
+        if (found == edges.end())
+            edges.push_back({ a, b });
+    }
 
-        if (!error.empty())
-            fprintf(stderr, "%s\n", error.c_str());
+    // Each level adds the midpoint of edge e as vertex vertexCount + e, splits it into edges 2e and 2e + 1,
+    // and adds 3 inner edges per triangle
+    for (int level = 0; level < depth; ++level)
+    {
+        unsigned int vertexCount = (unsigned int)positions.size();
+        unsigned int edgeCount = (unsigned int)edges.size();
+        int triangleCount = (int)indices.size() / 3;
 
-        if (!ret)
-            return { 0, 0 };
+        positions.resize(vertexCount + edgeCount);
+        std::vector<IcosphereEdge> nextEdges((size_t)edgeCount * 2 + (size_t)triangleCount * 3);
+        std::vector<unsigned int> nextIndices(indices.size() * 4);
+        std::vector<unsigned int> nextTriangleEdges(indices.size() * 4);
 
-        // TODO: Precompute total vertex count to prealloc
+        jobs::ParallelFor((int)edgeCount, GEN_JOB_SIZE, [&](int begin, int end)
+        {
+            for (int e = begin; e < end; ++e)
+            {
+                const IcosphereEdge& edge = edges[e];
+                unsigned int midpoint = vertexCount + e;
+                positions[midpoint] = (positions[edge.v0] + positions[edge.v1]) * 0.5f;
+                nextEdges[e * 2 + 0] = { edge.v0, midpoint };
+                nextEdges[e * 2 + 1] = { midpoint, edge.v1 };
+            }
+        });
 
-        // Loop over shapes
-        for (size_t s = 0; s < shapes.size(); s++)
+        jobs::ParallelFor(triangleCount, GEN_JOB_SIZE, [&](int begin, int end)
         {
-            // Loop over faces(polygon)
-            size_t index_offset = 0;
-            for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++)
+            for (int t = begin; t < end; ++t)
             {
-                int fv = shapes[s].mesh.num_face_vertices[f];
+                const unsigned int* corners = &indices[t * 3];
+                const unsigned int* cornerEdges = &triangleEdges[t * 3];
+                unsigned int midpoints[3] = { vertexCount + cornerEdges[0], vertexCount + cornerEdges[1], vertexCount + cornerEdges[2] };
+                unsigned int inner = edgeCount * 2 + t * 3;
 
-                // Loop over vertices in the face.
-                for (int v = 0; v < fv; v++)
+                // One triangle per corner (corner, next midpoint, previous midpoint), then the center one
+                for (int c = 0; c < 3; ++c)
                 {
-                    // access to vertex
-                    tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
+                    int previous = (c + 2) % 3;
+                    nextEdges[inner + c] = { midpoints[c], midpoints[previous] };
+
+                    unsigned int* triangle = &nextIndices[(t * 4 + c) * 3];
+                    triangle[0] = corners[c];
+                    triangle[1] = midpoints[c];
+                    triangle[2] = midpoints[previous];
+
+                    unsigned int* triangleEdge = &nextTriangleEdges[(t * 4 + c) * 3];
+                    triangleEdge[0] = GetIcosphereHalfEdge(edges[cornerEdges[c]], cornerEdges[c], corners[c]);
+                    triangleEdge[1] = inner + c;
+                    triangleEdge[2] = GetIcosphereHalfEdge(edges[cornerEdges[previous]], cornerEdges[previous], corners[c]);
+                }
 
-                    FullVertex vert = {};
+                unsigned int* center = &nextIndices[(t * 4 + 3) * 3];
+                center[0] = midpoints[0];
+                center[1] = midpoints[1];
+                center[2] = midpoints[2];
 
-                    vert.position.x = attrib.vertices[3 * idx.vertex_index + 0];
-                    vert.position.y = attrib.vertices[3 * idx.vertex_index + 1];
-                    vert.position.z = attrib.vertices[3 * idx.vertex_index + 2];
+                unsigned int* centerEdges = &nextTriangleEdges[(t * 4 + 3) * 3];
+                centerEdges[0] = inner + 1;
+                centerEdges[1] = inner + 2;
+                centerEdges[2] = inner + 0;
+            }
+        });
 
-                    if (!attrib.normals.empty())
-                    {
-                        vert.normal.x = attrib.normals[3 * idx.normal_index + 0];
-                        vert.normal.y = attrib.normals[3 * idx.normal_index + 1];
-                        vert.normal.z = attrib.normals[3 * idx.normal_index + 2];
-                    }
+        edges.swap(nextEdges);
+        indices.swap(nextIndices);
+        triangleEdges.swap(nextTriangleEdges);
+    }
 
-                    if (!attrib.texcoords.empty())
-                    {
-                        vert.uv.u = attrib.texcoords[2 * idx.texcoord_index + 0];
-                        vert.uv.v = attrib.texcoords[2 * idx.texcoord_index + 1];
-                    }
+    // No UVs: tangents are only guaranteed to be orthogonal to the normals
+    std::vector<FullVertex> vertices(positions.size());
+    jobs::ParallelFor((int)vertices.size(), GEN_JOB_SIZE, [&](int begin, int end)
+    {
+        for (int v = begin; v < end; ++v)
+        {
+            float3 n = v3Normalize(positions[v]);
+            vertices[v] = { n * 0.5f, n, { 0.f, 0.f }, { 1.f, 1.f, 1.f, 1.f }, float4(GetOrthogonal(n), 1.f) };
+        }
+    });
 
-                    // Optional: vertex colors
-                    if (!attrib.colors.empty())
-                    {
-                        vert.color.r = attrib.colors[3 * idx.vertex_index + 0];
-                        vert.color.g = attrib.colors[3 * idx.vertex_index + 1];
-                        vert.color.b = attrib.colors[3 * idx.vertex_index + 2];
-                    }
+    Bounds bounds = ComputeBounds(vertices.data(), (int)vertices.size());
+    return EmitIndexed(startIndex, vertices, indices, bounds);
+}
+
+MeshSlice MeshBuilder::GenUVSphere(int* startIndex, int lat, int lon)
+{
+    assert(lat > 0 && lon > 0);
+
+    // Ring and segment angles, theta varies from 0 to 180 and phi from 0 to 360
+    std::vector<float> angles(lat + 1 + lon + 1);
+    for (int i = 0; i <= lat; ++i)
+        angles[i] = calc::TAU / 2.f * (float)i / lat;
+    for (int j = 0; j <= lon; ++j)
+        angles[lat + 1 + j] = calc::TAU * (float)j / lon;
+
+    std::vector<float> sins(angles.size());
+    std::vector<float> coss(angles.size());
+    calc::fast::SinCos(sins.data(), coss.data(), angles.data(), (int)angles.size());
+    const float* phiSins = &sins[lat + 1];
+    const float* phiCoss = &coss[lat + 1];
+
+    // Grid of rings, the first and last vertices of a ring are at the UV seam and each pole vertex has its own u
+    int ringSize = lon + 1;
+    int ringsPerJob = calc::Max(1, GEN_JOB_SIZE / ringSize);
+    std::vector<FullVertex> vertices((size_t)(lat + 1) * ringSize);
+    jobs::ParallelFor(lat + 1, ringsPerJob, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+        {
+            for (int j = 0; j <= lon; ++j)
+            {
+                FullVertex& vertex = vertices[(size_t)i * ringSize + j];
+                float3 n = { sins[i] * phiCoss[j], coss[i], sins[i] * phiSins[j] };
+                vertex = {};
+                vertex.position = n * 0.5f; // pos between -0.5 and 0.5 (unit sphere)
+                vertex.normal = n;
+                vertex.uv = { 1.f - (float)j / lon, 1.f - (float)i / lat };
+
+                // u decreases along phi and v along theta
+                vertex.tangent = { phiSins[j], 0.f, -phiCoss[j], 1.f };
+            }
+        }
+    });
 
-                    vertices.push_back(vert);
+    // Two triangles per quad, except the degenerate ones touching the poles
+    // Ring i > 0 starts after lon triangles for the first ring and 2 * lon for the others
+    std::vector<unsigned int> indices((size_t)lon * (lat - 1) * 6);
+    jobs::ParallelFor(lat, ringsPerJob, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+        {
+            unsigned int* dst = &indices[(i == 0 ? 0 : (size_t)lon * (2 * i - 1)) * 3];
+            for (int j = 0; j < lon; ++j)
+            {
+                unsigned int v0 = (unsigned int)(i * ringSize + j);
+                unsigned int v1 = v0 + 1;
+                unsigned int v2 = v0 + ringSize;
+                unsigned int v3 = v2 + 1;
+                if (i > 0)
+                {
+                    *dst++ = v0;
+                    *dst++ = v1;
+                    *dst++ = v2;
+                }
+                if (i < lat - 1)
+                {
+                    *dst++ = v2;
+                    *dst++ = v1;
+                    *dst++ = v3;
                 }
-                index_offset += fv;
             }
         }
+    });
 
-        SaveObjToCache(vertices, objFile);
-    }
+    Bounds bounds = ComputeBounds(vertices.data(), (int)vertices.size());
+    return EmitIndexed(startIndex, vertices, indices, bounds);
+}
+
+// ======================================
+// OBJ cache
+// ======================================
+
+// Parsed OBJ meshes are stored next to the source as <file>.cache, welded and optimized for the vertex cache:
+//   ObjCacheHeader | strings | padding | FullVertex[vertexCount] (page aligned) | uint32_t[indexCount]
+//   | ObjCacheLod[lodCount] | ObjCacheSubmesh[submeshCount * (lodCount + 1)] | ObjCacheChunk[chunkCount]
+// Strings are the mtllib files then the material names (in usemtl order), each null terminated
+// Tables are written last so out of core imports can stream the vertices before knowing how many chunks they make
+// The file is mapped, indexed builders convert the vertices and copy the indices straight from the mapping
+
+// Welded triangles, indices are relative to vertexStart
+struct ObjCacheChunk
+{
+    uint32_t vertexStart;
+    uint32_t vertexCount;
+    uint32_t indexStart;
+    uint32_t indexCount;
+    VertexCacheStats stats[2]; // Before and after the optimization for ObjCacheHeader::optimizeCacheSize
+};
+
+// Triangles of one material in consecutive chunks
+// In memory loads weld each submesh into one chunk, out of core imports make one chunk per import window
+struct ObjCacheSubmesh
+{
+    uint32_t chunkStart;
+    uint32_t chunkCount;
+    int32_t materialId; // In usemtl order, -1 if none (material of the first face for out of core imports)
+};
+
+// Simplified level, its submeshes follow those of the previous level
+struct ObjCacheLod
+{
+    float error; // Unscaled
+};
 
-    for (FullVertex& vertex : vertices)
-        vertex.position *= scale;
+struct ObjCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+
+    // Source file, the cache is stale if the size changes or if the time and content hash change
+    uint64_t sourceSize;
+    uint64_t sourceTime;
+    uint64_t sourceHash;
+
+    VertexDescriptor vertexFormat; // Layout of the stored vertices (FullVertex)
+    Bounds bounds;                 // Full detail level
+    uint32_t optimizeCacheSize;    // Vertex cache size the chunks are optimized for
+
+    uint32_t libraryCount;
+    uint32_t materialCount;
+    uint32_t stringOffset; // Bytes from the file start
+    uint32_t stringSize;
+
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint64_t vertexOffset; // Multiple of OBJ_CACHE_ALIGNMENT
+    uint64_t indexOffset;
+
+    LodSettings lodSettings; // Zero if no LOD chain was generated
+    uint32_t lodCount;
+    uint32_t submeshCount;   // Per level
+    uint32_t chunkCount;
+    uint64_t lodOffset;
+    uint64_t submeshOffset;
+    uint64_t chunkOffset;
+};
 
-    int count = (int)vertices.size();
-    ConvertVertices(GetDst(startIndex, count), vertices.data(), count, descriptor);
+// Cache contents, mapped or built in memory by a cold load
+struct ObjCacheData
+{
+    const FullVertex* vertices;
+    const unsigned int* indices;
+    const ObjCacheLod* lods;
+    const ObjCacheSubmesh* submeshes; // Full detail level first
+    const ObjCacheChunk* chunks;
+    int vertexCount;
+    int indexCount;
+    int lodCount;
+    int submeshCount; // Per level
+    int chunkCount;
+    int optimizeCacheSize;
+    Bounds bounds;
+};
+
+static std::string GetObjCacheFile(const char* objFile)
+{
+    return std::string(objFile) + ".cache";
+}
+
+static bool WriteElements(FILE* file, const void* data, size_t elementSize, size_t count)
+{
+    return count == 0 || fwrite(data, elementSize, count, file) == count;
+}
+
+// Spill files can exceed the 2 GB reach of fseek
+static bool SeekFile(FILE* file, uint64_t offset)
+{
+#ifdef _WIN32
+    return _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+    return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+static std::vector<char> PackObjStrings(const std::vector<std::string>& libraries, const std::vector<std::string>& materials)
+{
+    std::vector<char> strings;
+    for (const std::vector<std::string>* list : { &libraries, &materials })
+        for (const std::string& string : *list)
+            strings.insert(strings.end(), string.c_str(), string.c_str() + string.size() + 1);
+    return strings;
+}
+
+static void UnpackObjStrings(const ObjCacheHeader* header, std::vector<std::string>& libraries, std::vector<std::string>& materials)
+{
+    const char* p = (const char*)header + header->stringOffset;
+    for (uint32_t i = 0; i < header->libraryCount; ++i, p += strlen(p) + 1)
+        libraries.push_back(p);
+    for (uint32_t i = 0; i < header->materialCount; ++i, p += strlen(p) + 1)
+        materials.push_back(p);
+}
+
+static VertexDescriptor GetFullVertexDescriptor()
+{
+    // Zero the padding so descriptors can be compared with memcmp
+    VertexDescriptor descriptor;
+    memset(&descriptor, 0, sizeof(descriptor));
+    descriptor.size           = sizeof(FullVertex);
+    descriptor.positionOffset = offsetof(FullVertex, position);
+    descriptor.hasNormal      = true;
+    descriptor.normalOffset   = offsetof(FullVertex, normal);
+    descriptor.hasUV          = true;
+    descriptor.uvOffset       = offsetof(FullVertex, uv);
+    descriptor.hasColor       = true;
+    descriptor.colorOffset    = offsetof(FullVertex, color);
+    descriptor.hasTangent     = true;
+    descriptor.tangentOffset  = offsetof(FullVertex, tangent);
+    return descriptor;
+}
+
+// FNV-1a 64 bits
+static uint64_t HashFileContent(const char* filename)
+{
+    MappedFile source;
+    if (!source.Open(filename))
+        return 0;
+
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < source.Size(); ++i)
+        hash = (hash ^ source.Data()[i]) * 1099511628211ull;
+    return hash;
+}
+
+// Tables, strings and chunk ranges are inside the mapping (indices are not checked, they are read as they are emitted)
+static bool IsObjCacheValid(const MappedFile& cache, const ObjCacheHeader* header)
+{
+    auto fits = [&cache](uint64_t offset, uint64_t count, size_t elementSize)
+    {
+        return offset <= cache.Size() && count * elementSize <= cache.Size() - offset;
+    };
+
+    VertexDescriptor vertexFormat = GetFullVertexDescriptor();
+    uint64_t submeshCount = cache.Size() < sizeof(ObjCacheHeader) ? 0 : (uint64_t)header->submeshCount * (header->lodCount + 1);
+    if (cache.Size() < sizeof(ObjCacheHeader)
+        || header->magic != OBJ_CACHE_MAGIC
+        || header->version != OBJ_CACHE_VERSION
+        || memcmp(&header->vertexFormat, &vertexFormat, sizeof(vertexFormat)) != 0
+        || !fits(header->vertexOffset, header->vertexCount, sizeof(FullVertex))
+        || !fits(header->indexOffset, header->indexCount, sizeof(uint32_t))
+        || !fits(header->lodOffset, header->lodCount, sizeof(ObjCacheLod))
+        || !fits(header->submeshOffset, submeshCount, sizeof(ObjCacheSubmesh))
+        || !fits(header->chunkOffset, header->chunkCount, sizeof(ObjCacheChunk))
+        || !fits(header->stringOffset, header->stringSize, 1)
+        || (uint64_t)header->libraryCount + header->materialCount > header->stringSize
+        || std::count(cache.Data() + header->stringOffset, cache.Data() + header->stringOffset + header->stringSize, 0) != header->libraryCount + header->materialCount
+        || (header->stringSize > 0 && cache.Data()[header->stringOffset + header->stringSize - 1] != 0))
+        return false;
+
+    const ObjCacheSubmesh* submeshes = (const ObjCacheSubmesh*)(cache.Data() + header->submeshOffset);
+    const ObjCacheChunk* chunks = (const ObjCacheChunk*)(cache.Data() + header->chunkOffset);
+    return std::all_of(submeshes, submeshes + submeshCount, [header](const ObjCacheSubmesh& submesh)
+           {
+               return (uint64_t)submesh.chunkStart + submesh.chunkCount <= header->chunkCount;
+           })
+        && std::all_of(chunks, chunks + header->chunkCount, [header](const ObjCacheChunk& chunk)
+           {
+               return (uint64_t)chunk.vertexStart + chunk.vertexCount <= header->vertexCount
+                   && (uint64_t)chunk.indexStart + chunk.indexCount <= header->indexCount;
+           });
+}
+
+// Map the cache of objFile and return its header, or null if it is missing, invalid or stale
+static const ObjCacheHeader* MapObjCache(MappedFile& cache, const char* objFile)
+{
+    std::string cachedFile = GetObjCacheFile(objFile);
+
+    uint64_t sourceSize, sourceTime;
+    if (!GetFileInfo(objFile, &sourceSize, &sourceTime) || !cache.Open(cachedFile.c_str()))
+        return nullptr;
+
+    const ObjCacheHeader* header = (const ObjCacheHeader*)cache.Data();
+    if (!IsObjCacheValid(cache, header))
+    {
+        printf("Cached version mismatch for %s, reload...\n", objFile);
+        cache.Close();
+        return nullptr;
+    }
+
+    // Touched but unchanged sources (checkout, copy) are detected with the hash
+    if (header->sourceSize != sourceSize || (header->sourceTime != sourceTime && header->sourceHash != HashFileContent(objFile)))
+    {
+        printf("Cache of %s is out of date, reload...\n", objFile);
+        cache.Close();
+        return nullptr;
+    }
+
+    // Store the new time so the source is hashed only once (the cache cannot be written while mapped on Windows)
+    if (header->sourceTime != sourceTime)
+    {
+        cache.Close();
+        if (FILE* file = fopen(cachedFile.c_str(), "r+b"))
+        {
+            fseek(file, offsetof(ObjCacheHeader, sourceTime), SEEK_SET);
+            fwrite(&sourceTime, sizeof(sourceTime), 1, file);
+            fclose(file);
+        }
+        if (!cache.Open(cachedFile.c_str()))
+            return nullptr;
+        header = (const ObjCacheHeader*)cache.Data();
+    }
+
+    return header;
+}
+
+static ObjCacheData GetObjCacheData(const ObjCacheHeader* header)
+{
+    const unsigned char* file = (const unsigned char*)header;
+    ObjCacheData data;
+    data.vertices          = (const FullVertex*)(file + header->vertexOffset);
+    data.indices           = (const unsigned int*)(file + header->indexOffset);
+    data.lods              = (const ObjCacheLod*)(file + header->lodOffset);
+    data.submeshes         = (const ObjCacheSubmesh*)(file + header->submeshOffset);
+    data.chunks            = (const ObjCacheChunk*)(file + header->chunkOffset);
+    data.vertexCount       = (int)header->vertexCount;
+    data.indexCount        = (int)header->indexCount;
+    data.lodCount          = (int)header->lodCount;
+    data.submeshCount      = (int)header->submeshCount;
+    data.chunkCount        = (int)header->chunkCount;
+    data.optimizeCacheSize = (int)header->optimizeCacheSize;
+    data.bounds            = header->bounds;
+    return data;
+}
+
+// Everything but the counts, bounds, LOD settings and table offsets, return false if the source is missing
+static bool InitObjCacheHeader(ObjCacheHeader* header, uint32_t stringSize, const char* objFile)
+{
+    memset(header, 0, sizeof(*header));
+    header->magic             = OBJ_CACHE_MAGIC;
+    header->version           = OBJ_CACHE_VERSION;
+    header->sourceHash        = HashFileContent(objFile);
+    header->vertexFormat      = GetFullVertexDescriptor();
+    header->optimizeCacheSize = OBJ_CACHE_OPTIMIZE_SIZE;
+    header->stringOffset      = sizeof(ObjCacheHeader);
+    header->stringSize        = stringSize;
+    header->vertexOffset      = (header->stringOffset + stringSize + OBJ_CACHE_ALIGNMENT - 1) / OBJ_CACHE_ALIGNMENT * OBJ_CACHE_ALIGNMENT;
+    return GetFileInfo(objFile, &header->sourceSize, &header->sourceTime);
+}
+
+// Open the cache and write everything before the vertices
+static FILE* CreateObjCache(const ObjCacheHeader& header, const std::vector<char>& strings, const char* objFile)
+{
+    std::string cachedFile = GetObjCacheFile(objFile);
+    FILE* file = fopen(cachedFile.c_str(), "wb");
+    if (file == nullptr)
+    {
+        fprintf(stderr, "Failed to write cache '%s'\n", cachedFile.c_str());
+        return nullptr;
+    }
+
+    ObjCacheHeader pending = {};
+    fwrite(&pending, sizeof(pending), 1, file);
+    fwrite(strings.data(), 1, strings.size(), file);
+    std::vector<unsigned char> padding((size_t)header.vertexOffset - header.stringOffset - header.stringSize);
+    fwrite(padding.data(), 1, padding.size(), file);
+    return file;
+}
+
+// Write the tables after the indices then close the cache
+// The header is written last so an interrupted save leaves an invalid magic
+static bool FinishObjCache(FILE* file, ObjCacheHeader& header, const ObjCacheLod* lods, const ObjCacheSubmesh* submeshes, const ObjCacheChunk* chunks)
+{
+    size_t submeshCount = (size_t)header.submeshCount * (header.lodCount + 1);
+    header.indexOffset   = header.vertexOffset + (uint64_t)header.vertexCount * sizeof(FullVertex);
+    header.lodOffset     = header.indexOffset + (uint64_t)header.indexCount * sizeof(uint32_t);
+    header.submeshOffset = header.lodOffset + (uint64_t)header.lodCount * sizeof(ObjCacheLod);
+    header.chunkOffset   = header.submeshOffset + submeshCount * sizeof(ObjCacheSubmesh);
+
+    bool written = WriteElements(file, lods, sizeof(ObjCacheLod), header.lodCount)
+                && WriteElements(file, submeshes, sizeof(ObjCacheSubmesh), submeshCount)
+                && WriteElements(file, chunks, sizeof(ObjCacheChunk), header.chunkCount)
+                && fseek(file, 0, SEEK_SET) == 0
+                && fwrite(&header, sizeof(header), 1, file) == 1;
+    return fclose(file) == 0 && written;
+}
+
+static void SaveObjToCache(const ObjCacheData& data, const LodSettings* lodSettings,
+                           const std::vector<std::string>& libraries, const std::vector<std::string>& materials, const char* objFile)
+{
+    ObjCacheHeader header;
+    std::vector<char> strings = PackObjStrings(libraries, materials);
+    if (!InitObjCacheHeader(&header, (uint32_t)strings.size(), objFile))
+        return;
+    header.bounds        = data.bounds;
+    header.libraryCount  = (uint32_t)libraries.size();
+    header.materialCount = (uint32_t)materials.size();
+    header.vertexCount   = (uint32_t)data.vertexCount;
+    header.indexCount    = (uint32_t)data.indexCount;
+    header.lodCount      = (uint32_t)data.lodCount;
+    header.submeshCount  = (uint32_t)data.submeshCount;
+    header.chunkCount    = (uint32_t)data.chunkCount;
+    if (lodSettings)
+        header.lodSettings = *lodSettings;
+
+    FILE* file = CreateObjCache(header, strings, objFile);
+    if (file == nullptr)
+        return;
+
+    if (!WriteElements(file, data.vertices, sizeof(FullVertex), data.vertexCount)
+        || !WriteElements(file, data.indices, sizeof(unsigned int), data.indexCount)
+        || !FinishObjCache(file, header, data.lods, data.submeshes, data.chunks))
+    {
+        fprintf(stderr, "Failed to write cache of '%s'\n", objFile);
+        remove(GetObjCacheFile(objFile).c_str());
+        return;
+    }
+
+    printf("Model saved to cache: %s (%d vertices, %d indices, %d LODs)\n", objFile, data.vertexCount, data.indexCount, data.lodCount);
+}
+
+// Triangle soup of one material while the cache is built
+struct ObjSoupSubmesh
+{
+    int vertexStart;
+    int vertexCount;
+    int materialId;
+};
+
+// Simplify each submesh of the last level into the next one, appended to vertices and submeshes
+// Level errors add up so they stay relative to the full detail soup
+static void GenerateObjLods(std::vector<FullVertex>& vertices, std::vector<ObjSoupSubmesh>& submeshes, const LodSettings& settings, std::vector<ObjCacheLod>& lods)
+{
+    int submeshCount = (int)submeshes.size();
+    float maxError = settings.maxError * ComputeBounds(vertices.data(), (int)vertices.size()).radius;
+    float error = 0.f;
+    size_t previousVertexCount = vertices.size();
+
+    std::vector<std::vector<FullVertex>> simplified(submeshCount);
+    std::vector<float> errors(submeshCount);
+    for (int level = 1; level <= settings.levelCount; ++level)
+    {
+        size_t previousSubmeshes = (size_t)(level - 1) * submeshCount;
+        jobs::ParallelFor(submeshCount, 1, [&](int begin, int end)
+        {
+            for (int s = begin; s < end; ++s)
+            {
+                const ObjSoupSubmesh& submesh = submeshes[previousSubmeshes + s];
+                int targetTriangleCount = (int)(submesh.vertexCount / 3 * settings.triangleRatio);
+                errors[s] = SimplifyTriangles(&vertices[submesh.vertexStart], submesh.vertexCount, targetTriangleCount, maxError - error, simplified[s]);
+            }
+        });
+
+        size_t vertexCount = 0;
+        float levelError = 0.f;
+        for (int s = 0; s < submeshCount; ++s)
+        {
+            vertexCount += simplified[s].size();
+            levelError = calc::Max(levelError, errors[s]);
+        }
+        if (vertexCount == 0 || vertexCount > previousVertexCount * LOD_MIN_REDUCTION)
+            break;
+
+        error += levelError;
+        lods.push_back({ error });
+        for (int s = 0; s < submeshCount; ++s)
+        {
+            ObjSoupSubmesh submesh = submeshes[previousSubmeshes + s];
+            submesh.vertexStart = (int)vertices.size();
+            submesh.vertexCount = (int)simplified[s].size();
+            submeshes.push_back(submesh);
+            vertices.insert(vertices.end(), simplified[s].begin(), simplified[s].end());
+        }
+        previousVertexCount = vertexCount;
+    }
+}
+
+// Weld a triangle soup on every attribute and optimize it for a vertex cache of OBJ_CACHE_OPTIMIZE_SIZE
+// stats receives the vertex cache stats before and after the optimization
+static void WeldObjChunk(const FullVertex* soup, int count, std::vector<FullVertex>& vertices, std::vector<unsigned int>& indices, VertexCacheStats* stats)
+{
+    std::vector<int> remap;
+    WeldVertices(soup, count, vertices, remap);
+    indices.assign(remap.begin(), remap.end());
+
+    int uniqueCount = (int)vertices.size();
+    stats[0] = AnalyzeVertexCache(indices.data(), count, uniqueCount, OBJ_CACHE_OPTIMIZE_SIZE);
+    if (count > 0)
+    {
+        std::vector<int> vertexOrder;
+        OptimizeIndices(indices.data(), count, uniqueCount, GetVertexStream(vertices.data(), sizeof(FullVertex), offsetof(FullVertex, position)), OBJ_CACHE_OPTIMIZE_SIZE, vertexOrder);
+
+        std::vector<FullVertex> reordered(uniqueCount);
+        for (int v = 0; v < uniqueCount; ++v)
+            reordered[vertexOrder[v]] = vertices[v];
+        vertices.swap(reordered);
+    }
+    stats[1] = AnalyzeVertexCache(indices.data(), count, uniqueCount, OBJ_CACHE_OPTIMIZE_SIZE);
+}
+
+// Weld each soup submesh (every level) into one chunk, in parallel
+static void WeldObjSubmeshes(const std::vector<FullVertex>& soup, const std::vector<ObjSoupSubmesh>& soupSubmeshes, std::vector<FullVertex>& vertices,
+                             std::vector<unsigned int>& indices, std::vector<ObjCacheSubmesh>& submeshes, std::vector<ObjCacheChunk>& chunks)
+{
+    int count = (int)soupSubmeshes.size();
+    std::vector<std::vector<FullVertex>> weldedVertices(count);
+    std::vector<std::vector<unsigned int>> weldedIndices(count);
+    chunks.assign(count, ObjCacheChunk{});
+    jobs::ParallelFor(count, 1, [&](int begin, int end)
+    {
+        for (int s = begin; s < end; ++s)
+            WeldObjChunk(soup.data() + soupSubmeshes[s].vertexStart, soupSubmeshes[s].vertexCount, weldedVertices[s], weldedIndices[s], chunks[s].stats);
+    });
+
+    submeshes.resize(count);
+    for (int s = 0; s < count; ++s)
+    {
+        chunks[s].vertexStart = (uint32_t)vertices.size();
+        chunks[s].vertexCount = (uint32_t)weldedVertices[s].size();
+        chunks[s].indexStart  = (uint32_t)indices.size();
+        chunks[s].indexCount  = (uint32_t)weldedIndices[s].size();
+        submeshes[s] = { (uint32_t)s, 1, soupSubmeshes[s].materialId };
+
+        vertices.insert(vertices.end(), weldedVertices[s].begin(), weldedVertices[s].end());
+        indices.insert(indices.end(), weldedIndices[s].begin(), weldedIndices[s].end());
+        std::vector<FullVertex>().swap(weldedVertices[s]);
+        std::vector<unsigned int>().swap(weldedIndices[s]);
+    }
+}
+
+// Soup vertex of an OBJ corner, colors is null if no vertex has one
+static FullVertex GetObjVertex(const obj::Index& index, const float3* positions, const float3* colors, const float2* uvs, const float3* normals)
+{
+    FullVertex vertex = {};
+    vertex.color = { 1.f, 1.f, 1.f, 1.f };
+
+    if (index.position >= 0)
+    {
+        vertex.position = positions[index.position];
+        if (colors)
+            vertex.color = float4(colors[index.position], 1.f);
+    }
+    if (index.normal >= 0)
+        vertex.normal = normals[index.normal];
+    if (index.uv >= 0)
+        vertex.uv = uvs[index.uv];
+    return vertex;
+}
+
+// Box of both, the sphere contains both spheres
+static Bounds MergeBounds(const Bounds& a, const Bounds& b)
+{
+    float3 aMin = a.center - a.extents, aMax = a.center + a.extents;
+    float3 bMin = b.center - b.extents, bMax = b.center + b.extents;
+    float3 min = { calc::Min(aMin.x, bMin.x), calc::Min(aMin.y, bMin.y), calc::Min(aMin.z, bMin.z) };
+    float3 max = { calc::Max(aMax.x, bMax.x), calc::Max(aMax.y, bMax.y), calc::Max(aMax.z, bMax.z) };
+
+    Bounds bounds;
+    bounds.center  = (min + max) * 0.5f;
+    bounds.extents = (max - min) * 0.5f;
+    bounds.radius  = calc::Max(v3Length(a.center - bounds.center) + a.radius, v3Length(b.center - bounds.center) + b.radius);
+    return bounds;
+}
+
+bool ImportObjToCache(const char* objFile, size_t memoryBudget)
+{
+    // Parsed text is expanded up to ~5x (24 bytes per "v x y z" line, 40 per "f a b c" line)
+    // De-indexed vertices take ~500 bytes each with the tangent generation, welding and optimization
+    size_t windowSize = std::max(memoryBudget / 8, (size_t)64 << 10);
+    int windowTriangles = (int)std::min(std::max(memoryBudget / (512 * 3), (size_t)1024), (size_t)1 << 24);
+
+    // Spill files next to the source, removed when done
+    const char* spillNames[] = { ".positions.tmp", ".colors.tmp", ".uvs.tmp", ".normals.tmp", ".corners.tmp", ".materials.tmp", ".sorted.tmp", ".indices.tmp" };
+    enum { SPILL_POSITIONS, SPILL_COLORS, SPILL_UVS, SPILL_NORMALS, SPILL_CORNERS, SPILL_MATERIALS, SPILL_SORTED, SPILL_INDICES, SPILL_COUNT };
+    std::string spillFiles[SPILL_COUNT];
+    FILE* spills[SPILL_COUNT] = {};
+    auto removeSpills = [&]()
+    {
+        for (int i = 0; i < SPILL_COUNT; ++i)
+        {
+            if (spills[i])
+                fclose(spills[i]);
+            spills[i] = nullptr;
+            remove(spillFiles[i].c_str());
+        }
+    };
+
+    FILE* source = fopen(objFile, "rb");
+    if (source == nullptr)
+    {
+        fprintf(stderr, "Failed to open '%s'\n", objFile);
+        return false;
+    }
+
+    for (int i = 0; i < SPILL_COUNT; ++i)
+    {
+        spillFiles[i] = std::string(objFile) + spillNames[i];
+        spills[i] = fopen(spillFiles[i].c_str(), "wb");
+        if (spills[i] == nullptr)
+        {
+            fprintf(stderr, "Failed to write '%s'\n", spillFiles[i].c_str());
+            fclose(source);
+            removeSpills();
+            return false;
+        }
+    }
+
+    // Pass 1: parse the source in windows ending at a line boundary, spill elements, corners and material ids
+    obj::Parser parser;
+    obj::Mesh mesh;
+    std::vector<char> window(windowSize);
+    size_t carried = 0;
+    size_t positionCount = 0, uvCount = 0, normalCount = 0, triangleCount = 0;
+    std::vector<size_t> groupCounts(1, 0); // Triangles per material id + 1
+    bool hasColors = false;
+    bool failed = false;
+    for (bool end = false; !end && !failed;)
+    {
+        size_t size = carried + fread(window.data() + carried, 1, windowSize - carried, source);
+        end = size < windowSize;
+        if (ferror(source))
+        {
+            fprintf(stderr, "Failed to read '%s'\n", objFile);
+            failed = true;
+            break;
+        }
+
+        size_t textSize = size;
+        if (!end)
+        {
+            while (textSize > 0 && window[textSize - 1] != '\n')
+                --textSize;
+            if (textSize == 0)
+            {
+                fprintf(stderr, "'%s': line longer than the import window (%d bytes)\n", objFile, (int)windowSize);
+                failed = true;
+                break;
+            }
+        }
+
+        parser.Parse(&mesh, window.data(), textSize);
+        hasColors |= !mesh.colors.empty();
+        if (mesh.colors.empty())
+            mesh.colors.assign(mesh.positions.size(), float3{ 1.f, 1.f, 1.f });
+
+        failed = !WriteElements(spills[SPILL_POSITIONS], mesh.positions.data(), sizeof(float3), mesh.positions.size())
+            || !WriteElements(spills[SPILL_COLORS], mesh.colors.data(), sizeof(float3), mesh.colors.size())
+            || !WriteElements(spills[SPILL_UVS], mesh.uvs.data(), sizeof(float2), mesh.uvs.size())
+            || !WriteElements(spills[SPILL_NORMALS], mesh.normals.data(), sizeof(float3), mesh.normals.size())
+            || !WriteElements(spills[SPILL_CORNERS], mesh.indices.data(), sizeof(obj::Index), mesh.indices.size())
+            || !WriteElements(spills[SPILL_MATERIALS], mesh.materialIds.data(), sizeof(int), mesh.materialIds.size());
+
+        groupCounts.resize(mesh.materialNames.size() + 1, 0);
+        for (int materialId : mesh.materialIds)
+            groupCounts[materialId + 1]++;
+
+        positionCount += mesh.positions.size();
+        uvCount       += mesh.uvs.size();
+        normalCount   += mesh.normals.size();
+        triangleCount += mesh.materialIds.size();
+
+        carried = size - textSize;
+        memmove(window.data(), window.data() + textSize, carried);
+    }
+    parser.Finish(&mesh, objFile);
+    fclose(source);
+    for (int i = 0; i < SPILL_SORTED; ++i)
+    {
+        failed |= fclose(spills[i]) != 0;
+        spills[i] = nullptr;
+    }
+
+    if (failed || triangleCount * 3 > (size_t)INT32_MAX)
+    {
+        if (!failed)
+            fprintf(stderr, "'%s': too many triangles\n", objFile);
+        removeSpills();
+        return false;
+    }
+
+    // Free the last window before sorting
+    std::vector<char>().swap(window);
+    obj::Mesh parsed;
+    parsed.materialNames.swap(mesh.materialNames);
+    parsed.materialLibraries.swap(mesh.materialLibraries);
+    mesh = {};
+
+    // Corners bucketed by material as in memory loads (faces without material first), in file order inside a bucket
+    // Windows of triangles are split by material, each run is written at the cursor of its bucket
+    std::vector<obj::Shape> groups;
+    int groupCount = (int)groupCounts.size();
+    std::vector<size_t> groupNext(groupCount, 0);
+    for (int g = 0; g < groupCount; ++g)
+    {
+        if (groupCounts[g] > 0)
+            groups.push_back({ "", (int)groupNext[g], (int)groupCounts[g], g - 1 });
+        if (g + 1 < groupCount)
+            groupNext[g + 1] = groupNext[g] + groupCounts[g];
+    }
+    {
+        FILE* corners = fopen(spillFiles[SPILL_CORNERS].c_str(), "rb");
+        FILE* materials = fopen(spillFiles[SPILL_MATERIALS].c_str(), "rb");
+        failed = corners == nullptr || materials == nullptr;
+
+        std::vector<obj::Index> windowCorners;
+        std::vector<int> windowMaterials;
+        std::vector<obj::Index> sorted;
+        std::vector<int> windowStarts(groupCount + 1);
+        for (size_t first = 0; first < triangleCount && !failed; first += windowTriangles)
+        {
+            int count = (int)std::min((size_t)windowTriangles, triangleCount - first);
+            windowCorners.resize((size_t)count * 3);
+            windowMaterials.resize(count);
+            sorted.resize((size_t)count * 3);
+            if (fread(windowCorners.data(), sizeof(obj::Index), windowCorners.size(), corners) != windowCorners.size()
+                || fread(windowMaterials.data(), sizeof(int), windowMaterials.size(), materials) != windowMaterials.size())
+            {
+                failed = true;
+                break;
+            }
+
+            std::fill(windowStarts.begin(), windowStarts.end(), 0);
+            for (int materialId : windowMaterials)
+                windowStarts[materialId + 2]++;
+            for (int g = 0; g < groupCount; ++g)
+                windowStarts[g + 1] += windowStarts[g];
+
+            std::vector<int> next(windowStarts.begin(), windowStarts.end() - 1);
+            for (int t = 0; t < count; ++t)
+                std::copy(&windowCorners[(size_t)t * 3], &windowCorners[(size_t)t * 3] + 3, &sorted[(size_t)next[windowMaterials[t] + 1]++ * 3]);
+
+            for (int g = 0; g < groupCount && !failed; ++g)
+            {
+                int runCount = windowStarts[g + 1] - windowStarts[g];
+                if (runCount == 0)
+                    continue;
+                failed = !SeekFile(spills[SPILL_SORTED], (uint64_t)groupNext[g] * 3 * sizeof(obj::Index))
+                      || !WriteElements(spills[SPILL_SORTED], &sorted[(size_t)windowStarts[g] * 3], sizeof(obj::Index), (size_t)runCount * 3);
+                groupNext[g] += runCount;
+            }
+        }
+
+        if (corners)
+            fclose(corners);
+        if (materials)
+            fclose(materials);
+        failed |= fclose(spills[SPILL_SORTED]) != 0;
+        spills[SPILL_SORTED] = nullptr;
+    }
+    if (failed)
+    {
+        fprintf(stderr, "Failed to sort the triangles of '%s' by material\n", objFile);
+        removeSpills();
+        return false;
+    }
+
+    ObjCacheHeader header;
+    FILE* cache = nullptr;
+    std::vector<char> strings = PackObjStrings(parsed.materialLibraries, parsed.materialNames);
+    if (!InitObjCacheHeader(&header, (uint32_t)strings.size(), objFile) || (cache = CreateObjCache(header, strings, objFile)) == nullptr)
+    {
+        removeSpills();
+        return false;
+    }
+    header.libraryCount  = (uint32_t)parsed.materialLibraries.size();
+    header.materialCount = (uint32_t)parsed.materialNames.size();
+    header.submeshCount  = (uint32_t)groups.size();
+
+    std::vector<ObjCacheSubmesh> submeshes(groups.size());
+    for (size_t s = 0; s < groups.size(); ++s)
+        submeshes[s] = { 0, 0, groups[s].materialId };
+    std::vector<ObjCacheChunk> chunks;
+
+    // Pass 2: de-index windows of sorted triangles from the mapped elements, weld the materials of each window into chunks
+    // Vertices are appended to the cache, indices are spilled until the vertex count is known
+    // Mapped pages are backed by the spill files and can be evicted, they are not part of the budget
+    MappedFile elements[SPILL_CORNERS];
+    size_t elementCounts[SPILL_CORNERS] = { positionCount, hasColors ? positionCount : 0, uvCount, normalCount };
+    for (int i = 0; i < SPILL_CORNERS; ++i)
+        failed |= elementCounts[i] > 0 && !elements[i].Open(spillFiles[i].c_str());
+
+    FILE* corners = failed ? nullptr : fopen(spillFiles[SPILL_SORTED].c_str(), "rb");
+    const float3* positions = (const float3*)elements[SPILL_POSITIONS].Data();
+    const float3* colors    = (const float3*)elements[SPILL_COLORS].Data();
+    const float2* uvs       = (const float2*)elements[SPILL_UVS].Data();
+    const float3* normals   = (const float3*)elements[SPILL_NORMALS].Data();
+
+    std::vector<obj::Index> indices;
+    std::vector<FullVertex> vertices;
+    std::vector<FullVertex> welded;
+    std::vector<unsigned int> weldedIndices;
+    size_t vertexCount = 0, indexCount = 0;
+    size_t group = 0;
+    for (size_t first = 0; corners && first < triangleCount && !failed; first += windowTriangles)
+    {
+        int count = (int)std::min((size_t)windowTriangles, triangleCount - first);
+        indices.resize((size_t)count * 3);
+        vertices.resize((size_t)count * 3);
+        if (fread(indices.data(), sizeof(obj::Index), indices.size(), corners) != indices.size())
+        {
+            failed = true;
+            break;
+        }
+
+        jobs::ParallelFor(count * 3, OBJ_JOB_SIZE, [&](int begin, int end)
+        {
+            for (int i = begin; i < end; ++i)
+                vertices[i] = GetObjVertex(indices[i], positions, colors, uvs, normals);
+        });
+
+        // Tangents and welding of the materials in the window, materials crossing a window edge are split there
+        for (; group < groups.size() && (size_t)groups[group].firstTriangle < first + count && !failed; ++group)
+        {
+            size_t groupEnd = (size_t)groups[group].firstTriangle + groups[group].triangleCount;
+            size_t begin = std::max((size_t)groups[group].firstTriangle, first);
+            size_t end = std::min(groupEnd, first + count);
+            if (end > begin)
+            {
+                FullVertex* soup = &vertices[(begin - first) * 3];
+                int soupCount = (int)(end - begin) * 3;
+                GenerateTangents(soup, soupCount, true);
+
+                ObjCacheChunk chunk = {};
+                WeldObjChunk(soup, soupCount, welded, weldedIndices, chunk.stats);
+                chunk.vertexStart = (uint32_t)vertexCount;
+                chunk.vertexCount = (uint32_t)welded.size();
+                chunk.indexStart  = (uint32_t)indexCount;
+                chunk.indexCount  = (uint32_t)soupCount;
+
+                Bounds bounds = ComputeBounds(welded.data(), (int)welded.size());
+                header.bounds = chunks.empty() ? bounds : MergeBounds(header.bounds, bounds);
+                if (submeshes[group].chunkCount++ == 0)
+                    submeshes[group].chunkStart = (uint32_t)chunks.size();
+                chunks.push_back(chunk);
+                vertexCount += welded.size();
+                indexCount += soupCount;
+
+                failed = !WriteElements(cache, welded.data(), sizeof(FullVertex), welded.size())
+                      || !WriteElements(spills[SPILL_INDICES], weldedIndices.data(), sizeof(unsigned int), weldedIndices.size());
+            }
+            if (groupEnd > end)
+                break; // Continues in the next window
+        }
+    }
+
+    if (corners)
+        fclose(corners);
+    for (MappedFile& file : elements)
+        file.Close();
+    std::vector<obj::Index>().swap(indices);
+    std::vector<FullVertex>().swap(vertices);
+    std::vector<FullVertex>().swap(welded);
+    std::vector<unsigned int>().swap(weldedIndices);
+
+    // Indices after the vertices, copied in blocks of the parse window size
+    failed |= fclose(spills[SPILL_INDICES]) != 0;
+    spills[SPILL_INDICES] = failed ? nullptr : fopen(spillFiles[SPILL_INDICES].c_str(), "rb");
+    failed |= spills[SPILL_INDICES] == nullptr;
+    if (!failed)
+    {
+        std::vector<char> block(windowSize);
+        for (size_t size; (size = fread(block.data(), 1, block.size(), spills[SPILL_INDICES])) > 0 && !failed;)
+            failed = fwrite(block.data(), 1, size, cache) != size;
+    }
+    removeSpills();
+
+    std::string cachedFile = GetObjCacheFile(objFile);
+    header.vertexCount = (uint32_t)vertexCount;
+    header.indexCount  = (uint32_t)indexCount;
+    header.chunkCount  = (uint32_t)chunks.size();
+    if (failed || !FinishObjCache(cache, header, nullptr, submeshes.data(), chunks.data()))
+    {
+        if (failed)
+            fclose(cache);
+        fprintf(stderr, "Failed to import '%s' to '%s'\n", objFile, cachedFile.c_str());
+        remove(cachedFile.c_str());
+        return false;
+    }
+
+    printf("Model imported to cache: %s (%d vertices, %d indices, %d MB budget)\n", objFile, (int)header.vertexCount, (int)header.indexCount, (int)(memoryBudget >> 20));
+    return true;
+}
+
+MeshSlice MeshBuilder::LoadObj(int* startIndex, const char* objFile, const char* mtlDir, float scale)
+{
+    return LoadObj(startIndex, objFile, mtlDir, scale, nullptr);
+}
+
+// Materials in usemtl order from the mtllib files, missing ones are defaults
+static std::vector<obj::Material> LoadObjMaterials(const std::vector<std::string>& libraries, const std::vector<std::string>& names, const char* mtlDir)
+{
+    std::string directory = mtlDir && mtlDir[0] ? std::string(mtlDir) + "/" : std::string();
+    std::vector<obj::Material> loaded;
+    for (const std::string& library : libraries)
+        obj::LoadMaterials(&loaded, (directory + library).c_str());
+
+    std::vector<obj::Material> materials;
+    materials.reserve(names.size());
+    for (const std::string& name : names)
+    {
+        auto found = std::find_if(loaded.begin(), loaded.end(), [&name](const obj::Material& material) { return material.name == name; });
+        if (found == loaded.end())
+        {
+            fprintf(stderr, "Material '%s' not found\n", name.c_str());
+            materials.push_back(obj::GetDefaultMaterial(name));
+            continue;
+        }
+
+        materials.push_back(*found);
+        for (std::string* texture : { &materials.back().diffuseTexture, &materials.back().emissiveTexture, &materials.back().normalTexture })
+            if (!texture->empty())
+                *texture = directory + *texture;
+    }
+    return materials;
+}
+
+MeshSlice MeshBuilder::LoadObj(int* startIndex, const char* objFile, const char* mtlDir, float scale, ObjModel* model, const LodSettings& lodSettings)
+{
+    // Destinations at a given start receive the submeshes one after the other
+    int cursor = startIndex ? *startIndex : 0;
+
+    // One slice per submesh covering its chunks, consecutive so the level slice covers them all
+    // Every level is quantized with the full detail bounds
+    auto emitLevel = [&](const ObjCacheData& cache, int level)
+    {
+        Bounds bounds = { cache.bounds.center * scale, cache.bounds.extents * calc::Abs(scale), cache.bounds.radius * calc::Abs(scale) };
+        float error = level > 0 ? cache.lods[level - 1].error : 0.f;
+        const ObjCacheSubmesh* submeshes = cache.submeshes + (size_t)level * cache.submeshCount;
+
+        MeshLod lod = { {}, error * calc::Abs(scale), model ? (int)model->submeshes.size() : 0, 0 };
+        for (int s = 0; s < cache.submeshCount; ++s)
+        {
+            MeshSlice slice = {};
+            int chunkCount = 0;
+            for (uint32_t c = submeshes[s].chunkStart; c < submeshes[s].chunkStart + submeshes[s].chunkCount; ++c)
+            {
+                const ObjCacheChunk& chunk = cache.chunks[c];
+                if (chunk.indexCount == 0)
+                    continue;
+
+                MeshSlice chunkSlice = EmitWelded(startIndex ? &cursor : nullptr, cache.vertices + chunk.vertexStart, (int)chunk.vertexCount,
+                                                  cache.indices + chunk.indexStart, (int)chunk.indexCount, bounds, scale, cache.optimizeCacheSize, chunk.stats);
+                cursor += (int)chunk.indexCount;
+                if (chunkCount++ == 0)
+                {
+                    slice = chunkSlice;
+                }
+                else
+                {
+                    slice.count += chunkSlice.count;
+                    slice.vertexCount += chunkSlice.vertexCount;
+                }
+            }
+            if (chunkCount == 0)
+                continue;
+
+            if (lod.submeshCount++ == 0)
+            {
+                lod.slice = slice;
+            }
+            else
+            {
+                lod.slice.count += slice.count;
+                lod.slice.vertexCount += slice.vertexCount;
+            }
+            if (model)
+                model->submeshes.push_back({ slice.start, slice.count, submeshes[s].materialId });
+        }
+        return lod;
+    };
+
+    // Full detail level then the LOD chain (vertex cache stats stay those of the full detail level)
+    auto emitModel = [&](const ObjCacheData& cache, const std::vector<std::string>& libraries, const std::vector<std::string>& materialNames)
+    {
+        MeshLod full = emitLevel(cache, 0);
+        if (model)
+        {
+            model->lods.push_back(full);
+            VertexCacheStats* stats = emitStats;
+            emitStats = nullptr;
+            for (int l = 1; l <= cache.lodCount; ++l)
+                model->lods.push_back(emitLevel(cache, l));
+            emitStats = stats;
+
+            // Size queries only need the counts
+            if (!countOnly)
+                model->materials = LoadObjMaterials(libraries, materialNames, mtlDir);
+        }
+        return full.slice;
+    };
+
+    {
+        MappedFile cache;
+        const ObjCacheHeader* header = MapObjCache(cache, objFile);
+
+        // Large files are imported out of core then used from the cache
+        uint64_t sourceSize, sourceTime;
+        bool outOfCore = GetFileInfo(objFile, &sourceSize, &sourceTime) && sourceSize > objImportThreshold;
+        if (header == nullptr && outOfCore && ImportObjToCache(objFile, objImportBudget))
+            header = MapObjCache(cache, objFile);
+
+        if (header && model && !outOfCore && memcmp(&header->lodSettings, &lodSettings, sizeof(LodSettings)) != 0)
+        {
+            printf("LOD settings of %s changed, reload...\n", objFile);
+            header = nullptr;
+        }
+
+        if (header)
+        {
+            printf("Model loaded from cache: %s (%d vertices, %d indices, %d LODs)\n", objFile, (int)header->vertexCount, (int)header->indexCount, (int)header->lodCount);
+            std::vector<std::string> libraries, materialNames;
+            UnpackObjStrings(header, libraries, materialNames);
+            return emitModel(GetObjCacheData(header), libraries, materialNames);
+        }
+    }
+
+    std::vector<FullVertex> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<ObjCacheSubmesh> submeshes;
+    std::vector<ObjCacheChunk> chunks;
+    std::vector<ObjCacheLod> lods;
+    std::vector<std::string> libraries, materialNames;
+    int submeshCount;
+    Bounds bounds;
+    {
+        obj::Mesh mesh;
+        if (!obj::Load(&mesh, objFile))
+            return {};
+
+        // Triangles grouped by material (faces without material first), in file order inside a group
+        int triangleCount = (int)mesh.materialIds.size();
+        int groupCount = (int)mesh.materialNames.size() + 1;
+        std::vector<int> groupStarts(groupCount + 1, 0);
+        for (int materialId : mesh.materialIds)
+            groupStarts[materialId + 2]++;
+        for (int g = 0; g < groupCount; ++g)
+            groupStarts[g + 1] += groupStarts[g];
+
+        std::vector<int> triangleOrder(triangleCount);
+        {
+            std::vector<int> next(groupStarts.begin(), groupStarts.end() - 1);
+            for (int t = 0; t < triangleCount; ++t)
+                triangleOrder[next[mesh.materialIds[t] + 1]++] = t;
+        }
+
+        // Triangle soup written in parallel into its final size
+        std::vector<FullVertex> soup((size_t)triangleCount * 3);
+        jobs::ParallelFor(triangleCount * 3, OBJ_JOB_SIZE, [&](int begin, int end)
+        {
+            const float3* colors = mesh.colors.empty() ? nullptr : mesh.colors.data();
+            for (int i = begin; i < end; ++i)
+            {
+                const obj::Index& index = mesh.indices[(size_t)triangleOrder[i / 3] * 3 + i % 3];
+                soup[i] = GetObjVertex(index, mesh.positions.data(), colors, mesh.uvs.data(), mesh.normals.data());
+            }
+        });
+
+        std::vector<ObjSoupSubmesh> soupSubmeshes;
+        for (int g = 0; g < groupCount; ++g)
+        {
+            if (groupStarts[g + 1] > groupStarts[g])
+                soupSubmeshes.push_back({ groupStarts[g] * 3, (groupStarts[g + 1] - groupStarts[g]) * 3, g - 1 });
+        }
+
+        libraries.swap(mesh.materialLibraries);
+        materialNames.swap(mesh.materialNames);
+        mesh = {};
+
+        // Tangents are computed once per submesh and stored in the cache
+        // Tangents are also split in jobs inside each submesh, meshes with one or two materials still use every thread
+        jobs::ParallelFor((int)soupSubmeshes.size(), 1, [&](int begin, int end)
+        {
+            for (int s = begin; s < end; ++s)
+                GenerateTangents(&soup[soupSubmeshes[s].vertexStart], soupSubmeshes[s].vertexCount, true);
+        });
+
+        submeshCount = (int)soupSubmeshes.size();
+        bounds = ComputeBounds(soup.data(), (int)soup.size());
+        if (model)
+            GenerateObjLods(soup, soupSubmeshes, lodSettings, lods);
+        WeldObjSubmeshes(soup, soupSubmeshes, vertices, indices, submeshes, chunks);
+    }
+
+    ObjCacheData cache;
+    cache.vertices          = vertices.data();
+    cache.indices           = indices.data();
+    cache.lods              = lods.data();
+    cache.submeshes         = submeshes.data();
+    cache.chunks            = chunks.data();
+    cache.vertexCount       = (int)vertices.size();
+    cache.indexCount        = (int)indices.size();
+    cache.lodCount          = (int)lods.size();
+    cache.submeshCount      = submeshCount;
+    cache.chunkCount        = (int)chunks.size();
+    cache.optimizeCacheSize = OBJ_CACHE_OPTIMIZE_SIZE;
+    cache.bounds            = bounds;
+    SaveObjToCache(cache, model ? &lodSettings : nullptr, libraries, materialNames, objFile);
+
+    return emitModel(cache, libraries, materialNames);
+}
+
+// ======================================
+// Index buffer optimization
+// ======================================
+
+// Simulate a FIFO post-transform cache over local indices (relative to the slice first vertex)
+static VertexCacheStats AnalyzeVertexCache(const unsigned int* indices, int indexCount, int vertexCount, int cacheSize)
+{
+    std::vector<int> cacheTime(vertexCount, -cacheSize - 1); // Time at which the vertex entered the cache
+    std::vector<bool> used(vertexCount, false);
+    int time = 0;
+    int transformCount = 0;
+    int usedCount = 0;
+    for (int i = 0; i < indexCount; ++i)
+    {
+        unsigned int v = indices[i];
+        if (time - cacheTime[v] > cacheSize)
+        {
+            cacheTime[v] = time++;
+            transformCount++;
+        }
+        if (!used[v])
+        {
+            used[v] = true;
+            usedCount++;
+        }
+    }
+
+    VertexCacheStats stats;
+    stats.acmr = indexCount > 0 ? transformCount / (indexCount / 3.f) : 0.f;
+    stats.atvr = usedCount > 0 ? transformCount / (float)usedCount : 0.f;
+    return stats;
+}
+
+// Tipsify (Sander, Nehab, Barczak 2007), reorder triangles for a cache of cacheSize vertices
+// clusterStarts receives the first triangle of each cluster (starts after each dead end)
+static void OptimizeVertexCache(unsigned int* dst, const unsigned int* indices, int indexCount, int vertexCount, int cacheSize, std::vector<int>& clusterStarts)
+{
+    int triangleCount = indexCount / 3;
+
+    // Vertex to triangles adjacency
+    std::vector<int> liveCount(vertexCount, 0);
+    for (int i = 0; i < indexCount; ++i)
+        liveCount[indices[i]]++;
+
+    std::vector<int> adjacencyOffsets(vertexCount + 1, 0);
+    for (int v = 0; v < vertexCount; ++v)
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveCount[v];
+
+    std::vector<int> adjacency(indexCount);
+    {
+        std::vector<int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (int i = 0; i < indexCount; ++i)
+            adjacency[fill[indices[i]]++] = i / 3;
+    }
+
+    std::vector<int> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<unsigned int> deadEnds;
+    std::vector<unsigned int> candidates;
+    deadEnds.reserve(indexCount);
+
+    int fanning = 0;
+    int time = cacheSize + 1;
+    int cursor = 0;
+    int outputCount = 0;
+    clusterStarts.clear();
+    clusterStarts.push_back(0);
+
+    // Skip vertices without live triangles
+    while (fanning < vertexCount && liveCount[fanning] == 0)
+        fanning++;
+    if (fanning == vertexCount)
+        fanning = -1;
+
+    while (fanning >= 0)
+    {
+        // Emit every remaining triangle around the fanning vertex
+        candidates.clear();
+        for (int a = adjacencyOffsets[fanning]; a < adjacencyOffsets[fanning + 1]; ++a)
+        {
+            int t = adjacency[a];
+            if (emitted[t])
+                continue;
+
+            for (int c = 0; c < 3; ++c)
+            {
+                unsigned int v = indices[t * 3 + c];
+                dst[outputCount++] = v;
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                liveCount[v]--;
+                if (time - cacheTime[v] > cacheSize)
+                    cacheTime[v] = time++;
+            }
+            emitted[t] = true;
+        }
+
+        // Next fanning vertex: the oldest candidate still in cache after its remaining triangles are emitted
+        int next = -1;
+        int bestPriority = -1;
+        for (unsigned int v : candidates)
+        {
+            if (liveCount[v] <= 0)
+                continue;
+
+            int priority = 0;
+            if (time - cacheTime[v] + 2 * liveCount[v] <= cacheSize)
+                priority = time - cacheTime[v];
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                next = (int)v;
+            }
+        }
+
+        if (next == -1)
+        {
+            // Dead end, continue from a recently used vertex or from the next live one in input order
+            while (!deadEnds.empty() && next == -1)
+            {
+                unsigned int v = deadEnds.back();
+                deadEnds.pop_back();
+                if (liveCount[v] > 0)
+                    next = (int)v;
+            }
+            while (next == -1 && cursor < vertexCount)
+            {
+                if (liveCount[cursor] > 0)
+                    next = cursor;
+                cursor++;
+            }
+
+            if (next != -1 && outputCount < indexCount)
+                clusterStarts.push_back(outputCount / 3);
+        }
+
+        fanning = next;
+    }
+}
+
+// Sort clusters so the ones facing away from the mesh center (likely occluders) are drawn first
+// Simplified version of the Tipsify fast overdraw pass, clusters are not split further
+static void OptimizeOverdraw(unsigned int* dst, const unsigned int* indices, int indexCount, const std::vector<int>& clusterStarts, float3Strided positions)
+{
+    auto position = [&](unsigned int v) -> const float3& { return *(const float3*)(positions.data + (size_t)v * positions.stride); };
+
+    int triangleCount = indexCount / 3;
+    int clusterCount = (int)clusterStarts.size();
+
+    // Area weighted mesh centroid
+    float3 meshCentroid = {};
+    float meshArea = 0.f;
+    std::vector<float3> clusterCentroids(clusterCount);
+    std::vector<float3> clusterNormals(clusterCount);
+    for (int c = 0; c < clusterCount; ++c)
+    {
+        int end = c + 1 < clusterCount ? clusterStarts[c + 1] : triangleCount;
+        float3 centroid = {};
+        float3 normal = {};
+        float area = 0.f;
+        for (int t = clusterStarts[c]; t < end; ++t)
+        {
+            const float3& p0 = position(indices[t * 3 + 0]);
+            const float3& p1 = position(indices[t * 3 + 1]);
+            const float3& p2 = position(indices[t * 3 + 2]);
+            float3 n = v3Cross(p1 - p0, p2 - p0); // Length is twice the area
+            float triangleArea = v3Length(n);
+            centroid += (p0 + p1 + p2) * (triangleArea / 3.f);
+            normal += n;
+            area += triangleArea;
+        }
+        meshCentroid += centroid;
+        meshArea += area;
+        clusterCentroids[c] = area > 0.f ? centroid / area : position(indices[clusterStarts[c] * 3]);
+        clusterNormals[c] = normal;
+    }
+    if (meshArea > 0.f)
+        meshCentroid = meshCentroid / meshArea;
+
+    std::vector<float> sortKeys(clusterCount);
+    std::vector<int> order(clusterCount);
+    for (int c = 0; c < clusterCount; ++c)
+    {
+        float normalLength = v3Length(clusterNormals[c]);
+        sortKeys[c] = normalLength > 0.f ? v3Dot(clusterCentroids[c] - meshCentroid, clusterNormals[c]) / normalLength : 0.f;
+        order[c] = c;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return sortKeys[a] > sortKeys[b]; });
+
+    int outputCount = 0;
+    for (int c : order)
+    {
+        int begin = clusterStarts[c] * 3;
+        int end = c + 1 < clusterCount ? clusterStarts[c + 1] * 3 : indexCount;
+        memcpy(dst + outputCount, indices + begin, (end - begin) * sizeof(unsigned int));
+        outputCount += end - begin;
+    }
+}
+
+VertexCacheStats MeshBuilder::AnalyzeVertexCache(const MeshSlice& slice, int cacheSize) const
+{
+    assert(indicesPtr != nullptr && !countOnly);
+
+    std::vector<unsigned int> localIndices(slice.count);
+    for (int i = 0; i < slice.count; ++i)
+        localIndices[i] = (*indicesPtr)[slice.start + i] - slice.vertexStart;
+
+    return ::AnalyzeVertexCache(localIndices.data(), slice.count, slice.vertexCount, cacheSize);
+}
+
+// Triangle order for the vertex cache then for overdraw on the resulting clusters, then vertex order for fetch locality
+// Local indices are rewritten for the new vertex order, vertexOrder[v] is the new location of vertex v
+static void OptimizeIndices(unsigned int* localIndices, int indexCount, int vertexCount, float3Strided positions, int cacheSize, std::vector<int>& vertexOrder)
+{
+    std::vector<unsigned int> cacheOrder(indexCount);
+    std::vector<int> clusterStarts;
+    OptimizeVertexCache(cacheOrder.data(), localIndices, indexCount, vertexCount, cacheSize, clusterStarts);
+    OptimizeOverdraw(localIndices, cacheOrder.data(), indexCount, clusterStarts, positions);
+
+    // Vertex fetch: store vertices in the order they are first referenced
+    vertexOrder.assign(vertexCount, -1);
+    int nextVertex = 0;
+    for (int i = 0; i < indexCount; ++i)
+    {
+        unsigned int v = localIndices[i];
+        if (vertexOrder[v] == -1)
+            vertexOrder[v] = nextVertex++;
+        localIndices[i] = vertexOrder[v];
+    }
+    for (int v = 0; v < vertexCount; ++v)
+    {
+        if (vertexOrder[v] == -1)
+            vertexOrder[v] = nextVertex++;
+    }
+}
+
+void MeshBuilder::Optimize(const MeshSlice& slice, int cacheSize)
+{
+    assert(indicesPtr != nullptr && !countOnly);
+    if (slice.count == 0)
+        return;
+
+    unsigned int* indices = *indicesPtr + slice.start;
+    unsigned char* vertices = (unsigned char*)*verticesPtr + (size_t)slice.vertexStart * descriptor.size;
+
+    std::vector<unsigned int> localIndices(slice.count);
+    for (int i = 0; i < slice.count; ++i)
+        localIndices[i] = indices[i] - slice.vertexStart;
+
+    std::vector<float3> positions(slice.vertexCount);
+    mat4 dequantize = GetDequantizeMatrix(descriptor, slice);
+    for (int v = 0; v < slice.vertexCount; ++v)
+        positions[v] = ReadPosition(vertices + (size_t)v * descriptor.size, descriptor, dequantize);
+
+    std::vector<int> remap;
+    OptimizeIndices(localIndices.data(), slice.count, slice.vertexCount, GetVertexStream(positions.data(), sizeof(float3), 0), cacheSize, remap);
+
+    std::vector<unsigned char> reordered((size_t)slice.vertexCount * descriptor.size);
+    for (int v = 0; v < slice.vertexCount; ++v)
+        memcpy(&reordered[(size_t)remap[v] * descriptor.size], vertices + (size_t)v * descriptor.size, descriptor.size);
+    memcpy(vertices, reordered.data(), reordered.size());
+
+    for (int i = 0; i < slice.count; ++i)
+        indices[i] = localIndices[i] + slice.vertexStart;
+}
+
+// ======================================
+// Meshlets
+// ======================================
+
+// Bounds and normal cone of a meshlet (cone construction from meshoptimizer's meshopt_computeMeshletBounds)
+static void ComputeMeshletBounds(Meshlet& meshlet, const unsigned int* localIndices, const std::vector<int>& vertices, float3Strided positions)
+{
+    auto position = [&positions](unsigned int v) { return *(const float3*)(positions.data + (size_t)v * positions.stride); };
+
+    std::vector<float3> points(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i)
+        points[i] = position(vertices[i]);
+    meshlet.bounds = culling::ComputeBounds(GetVertexStream(points.data(), sizeof(float3), 0), (int)points.size());
+
+    // Degenerate faces have no normal and do not constrain the cone
+    int triangleCount = meshlet.count / 3;
+    std::vector<float3> normals;
+    normals.reserve(triangleCount);
+    std::vector<int> normalTriangles;
+    normalTriangles.reserve(triangleCount);
+    float3 axis = { 0.f, 0.f, 0.f };
+    for (int t = 0; t < triangleCount; ++t)
+    {
+        const unsigned int* triangle = &localIndices[t * 3];
+        float3 p0 = position(triangle[0]);
+        float3 n = v3Cross(position(triangle[1]) - p0, position(triangle[2]) - p0);
+        float length = v3Length(n);
+        if (length <= 0.f)
+            continue;
+
+        normals.push_back(n / length);
+        normalTriangles.push_back(t);
+        axis += n / length;
+    }
+
+    // Cones wider than ~85 degrees cannot cull anything useful
+    meshlet.cone = { meshlet.bounds.center, { 0.f, 0.f, 1.f }, 2.f };
+    float axisLength = v3Length(axis);
+    if (normals.empty() || axisLength <= 0.f)
+        return;
+    axis = axis / axisLength;
+
+    float minDot = 1.f;
+    for (const float3& n : normals)
+        minDot = calc::Min(minDot, v3Dot(axis, n));
+    if (minDot <= 0.1f)
+        return;
+
+    // Apex behind every face plane along the axis, the cone half angle is widened by 90 degrees: sin(acos(minDot))
+    float maxT = 0.f;
+    for (size_t i = 0; i < normals.size(); ++i)
+    {
+        float3 p0 = position(localIndices[normalTriangles[i] * 3]);
+        float t = v3Dot(meshlet.bounds.center - p0, normals[i]) / v3Dot(axis, normals[i]);
+        maxT = calc::Max(maxT, t);
+    }
+
+    meshlet.cone.apex   = meshlet.bounds.center - axis * maxT;
+    meshlet.cone.axis   = axis;
+    meshlet.cone.cutoff = calc::Sqrt(1.f - minDot * minDot);
+}
+
+// Greedy partition: a meshlet starts at the first remaining triangle and grows over the triangles sharing its vertices,
+// preferring those adding the fewest vertices then those whose vertices have the fewest remaining triangles (borders first)
+static void BuildMeshlets(unsigned int* localIndices, int indexCount, int vertexCount, float3Strided positions, int maxVertices, int maxTriangles, int indexStart, std::vector<Meshlet>& meshlets)
+{
+    int triangleCount = indexCount / 3;
+
+    // Triangles using each vertex
+    std::vector<int> adjacencyStart(vertexCount + 1, 0);
+    for (int i = 0; i < indexCount; ++i)
+        adjacencyStart[localIndices[i] + 1]++;
+    for (int v = 0; v < vertexCount; ++v)
+        adjacencyStart[v + 1] += adjacencyStart[v];
+
+    std::vector<int> adjacency(indexCount);
+    std::vector<int> remaining(vertexCount);
+    for (int v = 0; v < vertexCount; ++v)
+        remaining[v] = adjacencyStart[v + 1] - adjacencyStart[v];
+    {
+        std::vector<int> cursor(adjacencyStart.begin(), adjacencyStart.end() - 1);
+        for (int i = 0; i < indexCount; ++i)
+            adjacency[cursor[localIndices[i]]++] = i / 3;
+    }
+
+    std::vector<unsigned char> emitted(triangleCount, 0);
+    std::vector<int> slot(vertexCount, -1); // Position in the current meshlet vertices, -1 if absent
+    std::vector<int> vertices;
+    std::vector<unsigned int> ordered;
+    ordered.reserve(indexCount);
+
+    auto newVertexCount = [&](int triangle)
+    {
+        const unsigned int* t = &localIndices[triangle * 3];
+        return (slot[t[0]] < 0) + (slot[t[1]] < 0 && t[1] != t[0]) + (slot[t[2]] < 0 && t[2] != t[0] && t[2] != t[1]);
+    };
+
+    int seed = 0;
+    for (;;)
+    {
+        while (seed < triangleCount && emitted[seed])
+            ++seed;
+        if (seed == triangleCount)
+            break;
+
+        Meshlet meshlet = {};
+        meshlet.start = (int)ordered.size();
+        vertices.clear();
+
+        for (int triangle = seed; triangle >= 0;)
+        {
+            const unsigned int* t = &localIndices[triangle * 3];
+            for (int c = 0; c < 3; ++c)
+            {
+                if (slot[t[c]] < 0)
+                {
+                    slot[t[c]] = (int)vertices.size();
+                    vertices.push_back((int)t[c]);
+                }
+                remaining[t[c]]--;
+                ordered.push_back(t[c]);
+            }
+            emitted[triangle] = 1;
+            meshlet.count += 3;
+            if (meshlet.count == maxTriangles * 3)
+                break;
+
+            // Best remaining neighbor that fits
+            triangle = -1;
+            int bestNew = 4;
+            int bestScore = 0;
+            for (int v : vertices)
+            {
+                for (int a = adjacencyStart[v]; a < adjacencyStart[v + 1]; ++a)
+                {
+                    int candidate = adjacency[a];
+                    if (emitted[candidate])
+                        continue;
+
+                    int added = newVertexCount(candidate);
+                    if ((int)vertices.size() + added > maxVertices || added > bestNew)
+                        continue;
+
+                    const unsigned int* ct = &localIndices[candidate * 3];
+                    int score = remaining[ct[0]] + remaining[ct[1]] + remaining[ct[2]];
+                    if (added < bestNew || score < bestScore)
+                    {
+                        triangle = candidate;
+                        bestNew = added;
+                        bestScore = score;
+                    }
+                }
+            }
+
+            // Disconnected pieces: continue with the next triangle in index order, close in the cache optimized order
+            if (triangle < 0)
+            {
+                while (seed < triangleCount && emitted[seed])
+                    ++seed;
+                if (seed < triangleCount && (int)vertices.size() + newVertexCount(seed) <= maxVertices)
+                    triangle = seed;
+            }
+        }
+
+        for (int v : vertices)
+            slot[v] = -1;
+
+        meshlet.vertexCount = (int)vertices.size();
+        ComputeMeshletBounds(meshlet, &ordered[meshlet.start], vertices, positions);
+        meshlet.start += indexStart;
+        meshlets.push_back(meshlet);
+    }
+
+    std::copy(ordered.begin(), ordered.end(), localIndices);
+}
+
+void MeshBuilder::BuildMeshlets(const MeshSlice& slice, std::vector<Meshlet>& meshlets, int maxVertices, int maxTriangles)
+{
+    assert(indicesPtr != nullptr && !countOnly && maxVertices >= 3 && maxTriangles >= 1);
+    if (slice.count == 0)
+        return;
+
+    unsigned int* indices = *indicesPtr + slice.start;
+    const unsigned char* vertices = (const unsigned char*)*verticesPtr + (size_t)slice.vertexStart * descriptor.size;
+
+    std::vector<unsigned int> localIndices(slice.count);
+    for (int i = 0; i < slice.count; ++i)
+        localIndices[i] = indices[i] - slice.vertexStart;
+
+    std::vector<float3> positions(slice.vertexCount);
+    mat4 dequantize = GetDequantizeMatrix(descriptor, slice);
+    for (int v = 0; v < slice.vertexCount; ++v)
+        positions[v] = ReadPosition(vertices + (size_t)v * descriptor.size, descriptor, dequantize);
+
+    ::BuildMeshlets(localIndices.data(), slice.count, slice.vertexCount, GetVertexStream(positions.data(), sizeof(float3), 0),
+                    maxVertices, maxTriangles, slice.start, meshlets);
+
+    for (int i = 0; i < slice.count; ++i)
+        indices[i] = localIndices[i] + slice.vertexStart;
+}
+
+// ======================================
+// Simplification
+// ======================================
+
+// Sum of squared distances to area weighted planes (Garland, Heckbert 1997)
+struct Quadric
+{
+    float a00, a11, a22, a10, a20, a21; // Symmetric n * n^T
+    float b0, b1, b2;                   // n * d
+    float c;                            // d * d
+    float weight;
+};
+
+static Quadric MakePlaneQuadric(float3 normal, float3 point, float weight)
+{
+    float d = -v3Dot(normal, point);
+    Quadric q;
+    q.a00 = normal.x * normal.x * weight;
+    q.a11 = normal.y * normal.y * weight;
+    q.a22 = normal.z * normal.z * weight;
+    q.a10 = normal.y * normal.x * weight;
+    q.a20 = normal.z * normal.x * weight;
+    q.a21 = normal.z * normal.y * weight;
+    q.b0 = normal.x * d * weight;
+    q.b1 = normal.y * d * weight;
+    q.b2 = normal.z * d * weight;
+    q.c = d * d * weight;
+    q.weight = weight;
+    return q;
+}
+
+static void AddQuadric(Quadric& q, const Quadric& r)
+{
+    q.a00 += r.a00; q.a11 += r.a11; q.a22 += r.a22;
+    q.a10 += r.a10; q.a20 += r.a20; q.a21 += r.a21;
+    q.b0 += r.b0; q.b1 += r.b1; q.b2 += r.b2;
+    q.c += r.c;
+    q.weight += r.weight;
+}
+
+// Weighted mean of the squared distances from p to the planes
+static float GetQuadricError(const Quadric& q, float3 p)
+{
+    float rx = q.a00 * p.x + q.a10 * p.y + q.a20 * p.z + 2.f * q.b0;
+    float ry = q.a10 * p.x + q.a11 * p.y + q.a21 * p.z + 2.f * q.b1;
+    float rz = q.a20 * p.x + q.a21 * p.y + q.a22 * p.z + 2.f * q.b2;
+    float error = rx * p.x + ry * p.y + rz * p.z + q.c;
+    return q.weight > 0.f ? calc::Abs(error) / q.weight : 0.f;
+}
+
+// Border planes weigh more than faces so silhouettes of open meshes are kept
+#define SIMPLIFY_BORDER_WEIGHT 10.f
+
+// Collapses rejected if a face normal turns by more than ~75 degrees
+#define SIMPLIFY_MIN_NORMAL_DOT 0.25f
+
+// How a position can move: interior vertices anywhere, border and seam vertices only along their border or seam
+enum class SimplifyVertexKind : unsigned char
+{
+    MANIFOLD,
+    BORDER,
+    SEAM,
+    LOCKED, // Corners of borders or seams, non manifold
+};
+
+// Squared distance between the attributes of two vertices
+static float GetAttributeDistance(const FullVertex& a, const FullVertex& b)
+{
+    float3 normal = a.normal - b.normal;
+    float4 color = a.color - b.color;
+    float du = a.uv.x - b.uv.x;
+    float dv = a.uv.y - b.uv.y;
+    return v3Dot(normal, normal) + du * du + dv * dv + v3Dot(color.xyz, color.xyz) + color.w * color.w;
+}
+
+static uint64_t GetEdgeKey(int a, int b)
+{
+    return a < b ? ((uint64_t)a << 32) | (uint32_t)b : ((uint64_t)b << 32) | (uint32_t)a;
+}
+
+float SimplifyTriangles(const FullVertex* vertices, int count, int targetTriangleCount, float maxError, std::vector<FullVertex>& simplified)
+{
+    // Attribute vertices (full weld) and the position each one lies on
+    std::vector<FullVertex> unique;
+    std::vector<int> indices;
+    WeldVertices(vertices, count, unique, indices);
+    int uniqueCount = (int)unique.size();
+
+    std::vector<int> positionIds(uniqueCount);
+    std::vector<float3> positions;
+    {
+        unsigned int tableSize = 1;
+        while (tableSize < (unsigned int)uniqueCount * 2)
+            tableSize *= 2;
+        std::vector<int> table(tableSize, -1);
+        for (int v = 0; v < uniqueCount; ++v)
+        {
+            const float3& p = unique[v].position;
+            unsigned int hash = 2166136261u;
+            const unsigned char* bytes = (const unsigned char*)&p;
+            for (size_t i = 0; i < sizeof(float3); ++i)
+                hash = (hash ^ bytes[i]) * 16777619u;
+
+            unsigned int slot = hash & (tableSize - 1);
+            while (table[slot] != -1 && memcmp(&positions[table[slot]], &p, sizeof(float3)) != 0)
+                slot = (slot + 1) & (tableSize - 1);
+            if (table[slot] == -1)
+            {
+                table[slot] = (int)positions.size();
+                positions.push_back(p);
+            }
+            positionIds[v] = table[slot];
+        }
+    }
+    int positionCount = (int)positions.size();
+
+    // Attribute vertices of each position
+    std::vector<int> siblingStart(positionCount + 1, 0);
+    std::vector<int> siblings(uniqueCount);
+    for (int v = 0; v < uniqueCount; ++v)
+        siblingStart[positionIds[v] + 1]++;
+    for (int p = 0; p < positionCount; ++p)
+        siblingStart[p + 1] += siblingStart[p];
+    {
+        std::vector<int> cursor(siblingStart.begin(), siblingStart.end() - 1);
+        for (int v = 0; v < uniqueCount; ++v)
+            siblings[cursor[positionIds[v]]++] = v;
+    }
+
+    auto removeDegenerateTriangles = [&]()
+    {
+        size_t kept = 0;
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            int p0 = positionIds[indices[i]], p1 = positionIds[indices[i + 1]], p2 = positionIds[indices[i + 2]];
+            if (p0 == p1 || p1 == p2 || p2 == p0)
+                continue;
+            for (int c = 0; c < 3; ++c)
+                indices[kept + c] = indices[i + c];
+            kept += 3;
+        }
+        indices.resize(kept);
+    };
+    removeDegenerateTriangles();
+
+    // Half edges of the position mesh sorted by edge: group sizes give borders (1) and non manifold edges (> 2)
+    struct HalfEdge
+    {
+        uint64_t key;
+        int from; // Attribute vertices
+        int to;
+    };
+    std::vector<HalfEdge> halfEdges;
+    std::vector<uint64_t> borderEdges;
+    std::vector<uint64_t> seamEdges;
+    std::vector<SimplifyVertexKind> kinds(positionCount);
+
+    auto classify = [&]()
+    {
+        halfEdges.resize(indices.size());
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            int from = indices[i];
+            int to = indices[i % 3 == 2 ? i - 2 : i + 1];
+            halfEdges[i] = { GetEdgeKey(positionIds[from], positionIds[to]), from, to };
+        }
+        std::sort(halfEdges.begin(), halfEdges.end(), [](const HalfEdge& a, const HalfEdge& b) { return a.key < b.key; });
+
+        std::vector<unsigned char> borderCounts(positionCount, 0), seamCounts(positionCount, 0), locked(positionCount, 0);
+        auto count = [](std::vector<unsigned char>& counts, int p) { counts[p] = (unsigned char)calc::Min(counts[p] + 1, 255); };
+        borderEdges.clear();
+        seamEdges.clear();
+        for (size_t begin = 0, end; begin < halfEdges.size(); begin = end)
+        {
+            for (end = begin + 1; end < halfEdges.size() && halfEdges[end].key == halfEdges[begin].key; ++end) {}
+
+            int a = (int)(halfEdges[begin].key >> 32);
+            int b = (int)(halfEdges[begin].key & 0xffffffffu);
+            if (end - begin == 1)
+            {
+                borderEdges.push_back(halfEdges[begin].key);
+                count(borderCounts, a);
+                count(borderCounts, b);
+            }
+            else if (end - begin == 2)
+            {
+                // Opposite half edges sharing both attribute vertices are smooth
+                const HalfEdge& e0 = halfEdges[begin];
+                const HalfEdge& e1 = halfEdges[begin + 1];
+                if (e0.from != e1.to || e0.to != e1.from)
+                {
+                    seamEdges.push_back(halfEdges[begin].key);
+                    count(seamCounts, a);
+                    count(seamCounts, b);
+                }
+            }
+            else
+            {
+                locked[a] = locked[b] = 1;
+            }
+        }
+
+        for (int p = 0; p < positionCount; ++p)
+        {
+            if (locked[p])
+                kinds[p] = SimplifyVertexKind::LOCKED;
+            else if (borderCounts[p] > 0)
+                kinds[p] = borderCounts[p] == 2 && seamCounts[p] == 0 ? SimplifyVertexKind::BORDER : SimplifyVertexKind::LOCKED;
+            else if (seamCounts[p] > 0)
+                kinds[p] = seamCounts[p] == 2 ? SimplifyVertexKind::SEAM : SimplifyVertexKind::LOCKED;
+            else
+                kinds[p] = SimplifyVertexKind::MANIFOLD;
+        }
+    };
+    classify();
+
+    // Face planes, and planes perpendicular to the faces along the borders
+    std::vector<Quadric> quadrics(positionCount);
+    memset(quadrics.data(), 0, quadrics.size() * sizeof(Quadric));
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        int p[3] = { positionIds[indices[i]], positionIds[indices[i + 1]], positionIds[indices[i + 2]] };
+        float3 normal = v3Cross(positions[p[1]] - positions[p[0]], positions[p[2]] - positions[p[0]]);
+        float area = v3Length(normal);
+        if (area <= 0.f)
+            continue;
+
+        normal = normal / area;
+        Quadric q = MakePlaneQuadric(normal, positions[p[0]], area);
+        for (int c = 0; c < 3; ++c)
+            AddQuadric(quadrics[p[c]], q);
+
+        for (int c = 0; c < 3; ++c)
+        {
+            int a = p[c], b = p[(c + 1) % 3];
+            if (!std::binary_search(borderEdges.begin(), borderEdges.end(), GetEdgeKey(a, b)))
+                continue;
+
+            float3 edge = positions[b] - positions[a];
+            float length = v3Length(edge);
+            if (length <= 0.f)
+                continue;
+            Quadric border = MakePlaneQuadric(v3Normalize(v3Cross(edge, normal)), positions[a], length * length * SIMPLIFY_BORDER_WEIGHT);
+            AddQuadric(quadrics[a], border);
+            AddQuadric(quadrics[b], border);
+        }
+    }
+
+    // Passes of independent collapses, cheapest first
+    struct Collapse
+    {
+        int from; // Positions
+        int to;
+        float error;
+    };
+    std::vector<Collapse> collapses;
+    std::vector<int> triangleStart(positionCount + 1);
+    std::vector<int> triangles;
+    std::vector<unsigned char> touched(positionCount);
+    std::vector<int> attributeRemap(uniqueCount);
+    float maxSquaredError = maxError * maxError;
+    float resultError = 0.f;
+
+    auto isEdge = [](const std::vector<uint64_t>& edges, int a, int b) { return std::binary_search(edges.begin(), edges.end(), GetEdgeKey(a, b)); };
+    auto canCollapse = [&](int from, int to)
+    {
+        switch (kinds[from])
+        {
+        case SimplifyVertexKind::MANIFOLD: return true;
+        case SimplifyVertexKind::BORDER:   return (kinds[to] == SimplifyVertexKind::BORDER || kinds[to] == SimplifyVertexKind::LOCKED) && isEdge(borderEdges, from, to);
+        case SimplifyVertexKind::SEAM:     return (kinds[to] == SimplifyVertexKind::SEAM || kinds[to] == SimplifyVertexKind::LOCKED) && isEdge(seamEdges, from, to);
+        default:                           return false;
+        }
+    };
+
+    while ((int)indices.size() / 3 > targetTriangleCount)
+    {
+        // Cheapest valid collapse of each position
+        collapses.clear();
+        {
+            std::vector<Collapse> best(positionCount, { -1, -1, FLT_MAX });
+            for (size_t i = 0; i < indices.size(); ++i)
+            {
+                int a = positionIds[indices[i]];
+                int b = positionIds[indices[i % 3 == 2 ? i - 2 : i + 1]];
+                for (int direction = 0; direction < 2; ++direction, std::swap(a, b))
+                {
+                    if (!canCollapse(a, b))
+                        continue;
+
+                    Quadric q = quadrics[a];
+                    AddQuadric(q, quadrics[b]);
+                    float error = GetQuadricError(q, positions[b]);
+                    if (error < best[a].error)
+                        best[a] = { a, b, error };
+                }
+            }
+            for (const Collapse& collapse : best)
+                if (collapse.from >= 0 && collapse.error <= maxSquaredError)
+                    collapses.push_back(collapse);
+        }
+        if (collapses.empty())
+            break;
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+        // Triangles around each position
+        std::fill(triangleStart.begin(), triangleStart.end(), 0);
+        for (int v : indices)
+            triangleStart[positionIds[v] + 1]++;
+        for (int p = 0; p < positionCount; ++p)
+            triangleStart[p + 1] += triangleStart[p];
+        triangles.resize(indices.size());
+        {
+            std::vector<int> cursor(triangleStart.begin(), triangleStart.end() - 1);
+            for (size_t i = 0; i < indices.size(); ++i)
+                triangles[cursor[positionIds[indices[i]]]++] = (int)(i / 3);
+        }
+
+        // Each triangle changes at most once per pass: the one ring of a collapsed position is frozen
+        std::fill(touched.begin(), touched.end(), 0);
+        for (int v = 0; v < uniqueCount; ++v)
+            attributeRemap[v] = v;
+
+        int triangleCount = (int)indices.size() / 3;
+        int appliedCount = 0;
+        for (const Collapse& collapse : collapses)
+        {
+            if (triangleCount <= targetTriangleCount)
+                break;
+            if (touched[collapse.from] || touched[collapse.to])
+                continue;
+
+            // Reject collapses folding a face over
+            float3 target = positions[collapse.to];
+            bool flips = false;
+            int removedCount = 0;
+            for (int t = triangleStart[collapse.from]; t < triangleStart[collapse.from + 1] && !flips; ++t)
+            {
+                const int* triangle = &indices[triangles[t] * 3];
+                int p[3] = { positionIds[triangle[0]], positionIds[triangle[1]], positionIds[triangle[2]] };
+                if (p[0] == collapse.to || p[1] == collapse.to || p[2] == collapse.to)
+                {
+                    removedCount++;
+                    continue;
+                }
+
+                float3 before[3] = { positions[p[0]], positions[p[1]], positions[p[2]] };
+                float3 after[3] = { before[0], before[1], before[2] };
+                for (int c = 0; c < 3; ++c)
+                    if (p[c] == collapse.from)
+                        after[c] = target;
+
+                float3 n0 = v3Cross(before[1] - before[0], before[2] - before[0]);
+                float3 n1 = v3Cross(after[1] - after[0], after[2] - after[0]);
+                flips = v3Dot(n0, n1) < SIMPLIFY_MIN_NORMAL_DOT * v3Length(n0) * v3Length(n1);
+            }
+            if (flips)
+                continue;
+
+            for (int t = triangleStart[collapse.from]; t < triangleStart[collapse.from + 1]; ++t)
+                for (int c = 0; c < 3; ++c)
+                    touched[positionIds[indices[triangles[t] * 3 + c]]] = 1;
+
+            // Attribute vertices move to the closest one at the target position (same side of a seam)
+            for (int s = siblingStart[collapse.from]; s < siblingStart[collapse.from + 1]; ++s)
+            {
+                const FullVertex& from = unique[siblings[s]];
+                float bestDistance = FLT_MAX;
+                for (int r = siblingStart[collapse.to]; r < siblingStart[collapse.to + 1]; ++r)
+                {
+                    const FullVertex& to = unique[siblings[r]];
+                    float distance = GetAttributeDistance(from, to);
+                    if (distance < bestDistance)
+                    {
+                        bestDistance = distance;
+                        attributeRemap[siblings[s]] = siblings[r];
+                    }
+                }
+            }
+
+            AddQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+            resultError = calc::Max(resultError, collapse.error);
+            triangleCount -= removedCount;
+            appliedCount++;
+        }
+        if (appliedCount == 0)
+            break;
+
+        for (int& v : indices)
+            v = attributeRemap[v];
+        removeDegenerateTriangles();
+        classify();
+    }
 
-    return { *vertexCount - count, count };
+    simplified.resize(indices.size());
+    for (size_t i = 0; i < indices.size(); ++i)
+        simplified[i] = unique[indices[i]];
+    return calc::Sqrt(resultError);
 }
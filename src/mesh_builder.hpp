@@ -1,13 +1,37 @@
 #pragma once
 
+#include <vector>
+
 #include "types.hpp"
+#include "culling.hpp"
+#include "obj_parser.hpp"
 
 struct MeshSlice
 {
-    int start;
-    int count;
+    int start; // First index for indexed meshes, first vertex otherwise
+    int count; // Index or vertex count
+    Bounds bounds; // Object space
+
+    // Vertices referenced by the slice
+    int vertexStart;
+    int vertexCount;
 };
 
+// Storage of a vertex attribute
+enum class VertexFormat : int
+{
+    FLOAT,          // 32 bits floats
+    HALF,           // 16 bits floats
+    SNORM16,        // Positions only: [-1, 1] inside the slice bounds, see GetDequantizeMatrix()
+    UNORM16,        // UVs in [0, 1]
+    OCT16,          // Normals only: octahedral encoding in 2 x snorm16, decode with OctDecode() in the shader
+    SNORM_10_10_10_2, // Normals/tangents: xyz + sign in w (GL_INT_2_10_10_10_REV)
+    UNORM8,         // Colors: RGBA8
+};
+
+// Bytes used by an attribute of componentCount components stored as format
+int GetVertexFormatSize(VertexFormat format, int componentCount);
+
 struct VertexDescriptor
 {
     int size;
@@ -18,14 +42,145 @@ struct VertexDescriptor
     int normalOffset;
     bool hasColor;
     int colorOffset;
-    bool hasTangent; // vec4 (w is sign)
+    bool hasTangent; // vec4 (w is sign), generated following MikkTSpace
     int tangentOffset;
+
+    // Zero initialized descriptors use floats everywhere
+    VertexFormat positionFormat;
+    VertexFormat uvFormat;
+    VertexFormat normalFormat;
+    VertexFormat colorFormat;
+    VertexFormat tangentFormat;
+};
+
+// Transform from stored to object space positions (identity unless positions are SNORM16)
+mat4 GetDequantizeMatrix(const VertexDescriptor& descriptor, const MeshSlice& slice);
+
+// SNORM16 positions are stored relative to the slice bounds, flat axes keep a unit scale
+inline float3 GetQuantizationScale(const Bounds& bounds)
+{
+    const float3& e = bounds.extents;
+    return { e.x > 0.f ? e.x : 1.f, e.y > 0.f ? e.y : 1.f, e.z > 0.f ? e.z : 1.f };
+}
+
+// Post-transform vertex cache efficiency of an index buffer
+struct VertexCacheStats
+{
+    float acmr; // Average cache miss ratio: vertex shader invocations per triangle (3 is the worst, ~0.5 for regular grids)
+    float atvr; // Average transform to vertex ratio: vertex shader invocations per unique vertex (1 is optimal)
 };
 
+// Cluster of triangles of an indexed slice, contiguous in the index buffer
+struct Meshlet
+{
+    int start;       // First index
+    int count;       // Index count
+    int vertexCount; // Unique vertices referenced
+    Bounds bounds;   // Object space
+    NormalCone cone; // Object space, from the face normals
+};
+
+// Convert a Wavefront OBJ to the cache used by MeshBuilder::LoadObj without loading it whole
+// Parsed elements are spilled to temporary files next to the source, memoryBudget bounds the working set
+// Tangents are generated per window of triangles (seams may differ from an in memory load)
+// Each window is stored welded and optimized, LoadObj then emits the mapped windows without loading them whole either
+bool ImportObjToCache(const char* objFile, size_t memoryBudget);
+
+// Full precision vertex produced by the generators, converted to the output format when emitted
+struct FullVertex
+{
+    float3 position;
+    float3 normal;
+    float2 uv;
+    float4 color;
+    float4 tangent;
+};
+
+// Quadric error edge collapse simplification of a triangle soup, down to targetTriangleCount triangles unless the error
+// would exceed maxError (object space distance). Vertices keep their attributes, borders and attribute seams only move along themselves
+// Return the error of the result
+float SimplifyTriangles(const FullVertex* vertices, int count, int targetTriangleCount, float maxError, std::vector<FullVertex>& simplified);
+
+// LOD chain generated with a mesh: each level targets triangleRatio times the triangles of the previous one
+// The chain ends after levelCount levels, when the error would exceed maxError (relative to the bounding radius) or when a level stops reducing
+struct LodSettings
+{
+    int levelCount;
+    float triangleRatio;
+    float maxError;
+};
+
+// Index range of a slice drawn with one material (vertex range for non indexed builders)
+struct MeshSubmesh
+{
+    int start;
+    int count;
+    int materialId; // In ObjModel::materials, -1 if the faces have no material
+};
+
+// Level of detail of a model, all levels are quantized with the full detail bounds so they share one dequantization
+struct MeshLod
+{
+    MeshSlice slice;  // Covers the submeshes of the level
+    float error;      // Object space distance to the full detail surface
+    int firstSubmesh; // In ObjModel::submeshes
+    int submeshCount;
+};
+
+// OBJ split in one submesh per material, with its LOD chain
+struct ObjModel
+{
+    std::vector<MeshLod> lods;            // Full detail first (the slice returned by LoadObj), coarsest last
+    std::vector<MeshSubmesh> submeshes;   // Submeshes of every level, in level then material order
+    std::vector<obj::Material> materials; // Texture paths start with mtlDir
+};
+
+// Descriptor of the output vertices, with an optional conversion specialized for their struct (see vertex_layout.hpp)
+typedef void (*ConvertVerticesFunction)(void* dst, const FullVertex* src, int count, const Bounds& bounds);
+struct VertexLayout
+{
+    VertexLayout(const VertexDescriptor& descriptor, ConvertVerticesFunction convert = nullptr)
+        : descriptor(descriptor), convert(convert)
+    {}
+
+    VertexDescriptor descriptor;
+    ConvertVerticesFunction convert; // Generic conversion from the descriptor if null
+};
+
+// Append generated meshes to a malloc'd vertex array (grown geometrically)
+// If indicesPtr is set, vertices are welded and 32 bits indices are appended to *indicesPtr, startIndex must be null
 class MeshBuilder
 {
 public:
-    MeshBuilder(const VertexDescriptor& descriptor, void** verticesPtr, int* vertexCount);
+    MeshBuilder(const VertexLayout& layout, void** verticesPtr, int* vertexCount, unsigned int** indicesPtr = nullptr, int* indexCount = nullptr);
+
+    // Fixed size destination (e.g. a buffer mapped with glMapBufferRange), only written to so it can be write combined memory
+    // With null vertices nothing is written and only the counts are accumulated: build the same meshes
+    // once this way to size the destination exactly, then again into it
+    MeshBuilder(const VertexLayout& layout, void* vertices, int vertexCapacity, int* vertexCount,
+                unsigned int* indices = nullptr, int indexCapacity = 0, int* indexCount = nullptr);
+
+    MeshBuilder(const MeshBuilder&) = delete;
+    MeshBuilder& operator=(const MeshBuilder&) = delete;
+
+    // Grow the malloc'd arrays once for the given total counts
+    void Reserve(int vertexCapacity, int indexCapacity = 0);
+
+    // Optimize indexed slices (as Optimize) before they are written, for destinations that cannot be read back
+    // If set, stats receives the vertex cache stats of the last slice before and after optimization
+    void OptimizeOnEmit(int cacheSize = 16, VertexCacheStats* stats = nullptr);
+
+    // Reorder the triangles of indexed slices emitted afterwards into meshlets appended to *meshlets (see BuildMeshlets)
+    // Applied after OptimizeOnEmit, stats then include the meshlet order
+    void BuildMeshletsOnEmit(std::vector<Meshlet>* meshlets, int maxVertices = 64, int maxTriangles = 124);
+
+    // Keep the object space position of every vertex written afterwards in *positions, at its index in the vertex array
+    // For CPU work on destinations that cannot be read back (e.g. picking), Optimize() afterwards does not update them
+    void CopyPositionsOnEmit(std::vector<float3>* positions);
+
+    // OBJ files larger than minFileSize are imported out of core with memoryBudget (see ImportObjToCache), then emitted
+    // from the mapped cache without copying it (defaults: files over 512 MB, 256 MB budget)
+    void ImportObjOutOfCore(uint64_t minFileSize, size_t memoryBudget);
 
     MeshSlice GenTriangle(int* startIndex);
     MeshSlice GenQuad(int* startIndex, float halfWidth, float halfHeight);
@@ -33,13 +188,64 @@ public:
     MeshSlice GenUVSphere(int* startIndex, int lat = 8, int lon = 12);
     MeshSlice LoadObj(int* startIndex, const char* objFile, const char* mtlDir, float scale = 1.f);
 
+    // Triangles are grouped by material and each group is emitted as its own slice (optimized and split in meshlets separately)
+    // With a model, the LOD chain (stored in the OBJ cache) is emitted after the full detail level and the materials are loaded
+    // Size queries of a cached OBJ only read the cache tables (materials are not loaded)
+    // Out of core imports have no LOD chain
+    MeshSlice LoadObj(int* startIndex, const char* objFile, const char* mtlDir, float scale, ObjModel* model, const LodSettings& lodSettings = { 4, 0.5f, 0.02f });
+
+    // Indexed slices only, cache is simulated as a FIFO of cacheSize vertices
+    VertexCacheStats AnalyzeVertexCache(const MeshSlice& slice, int cacheSize = 16) const;
+
+    // Reorder the triangles of an indexed slice for the vertex cache then for overdraw, and its vertices for fetch locality
+    void Optimize(const MeshSlice& slice, int cacheSize = 16);
+
+    // Reorder the triangles of an indexed slice into meshlets of at most maxVertices and maxTriangles, appended to meshlets
+    // Meshlets grow over connected triangles, the existing triangle order (e.g. from Optimize) is kept between them
+    // Defaults match common mesh shader limits (64 vertices and 124 triangles fit a 128 bytes aligned primitive block)
+    void BuildMeshlets(const MeshSlice& slice, std::vector<Meshlet>& meshlets, int maxVertices = 64, int maxTriangles = 124);
+
 private:
     VertexDescriptor descriptor;
+    ConvertVerticesFunction convert;
     void** verticesPtr;
     int* vertexCount;
+    unsigned int** indicesPtr;
+    int* indexCount;
+
+    int vertexCapacity;
+    int indexCapacity;
+    bool fixedCapacity = false;
+    bool countOnly = false;
+    void* fixedVertices = nullptr;       // Destination of verticesPtr/indicesPtr for fixed size builders
+    unsigned int* fixedIndices = nullptr;
+
+    int emitCacheSize = 0; // Optimize on emit if > 0
+    VertexCacheStats* emitStats = nullptr;
+    std::vector<Meshlet>* emitMeshlets = nullptr;
+    int meshletMaxVertices = 0;
+    int meshletMaxTriangles = 0;
+    std::vector<float3>* emitPositions = nullptr;
+
+    uint64_t objImportThreshold;
+    size_t objImportBudget;
 
     void* GetDst(int* startIndex, int count);
     void* Grow(int count);
+    unsigned int* GrowIndices(int count);
+
+    void Convert(void* dst, const FullVertex* vertices, int count, const Bounds& bounds) const;
+
+    // Write a triangle list, welded if the builder outputs indices (bounds are computed if not known)
+    MeshSlice Emit(int* startIndex, const FullVertex* vertices, int count, const Bounds* knownBounds = nullptr);
+
+    // Write an indexed triangle list whose vertices are already unique, expanded if the builder outputs no indices
+    // Both arrays are reordered in place when optimizing on emit
+    MeshSlice EmitIndexed(int* startIndex, std::vector<FullVertex>& vertices, std::vector<unsigned int>& localIndices, const Bounds& bounds);
 
-    MeshSlice GenIcosphereFace(int* index, float3 a, float3 b, float3 c, int depth);
+    // Write a read only (e.g. mapped) indexed triangle list whose vertices are unique, positions are multiplied by scale
+    // Indices already optimized for optimizedCacheSize, with optimizedStats before and after, are not optimized again on emit
+    // Indexed builders convert and copy it without intermediate copies unless it must be scaled or optimized for another cache size
+    MeshSlice EmitWelded(int* startIndex, const FullVertex* vertices, int uniqueCount, const unsigned int* localIndices, int count,
+                         const Bounds& bounds, float scale, int optimizedCacheSize, const VertexCacheStats* optimizedStats);
 };
\ No newline at end of file
@@ -0,0 +1,187 @@
+#include <cmath>
+#include <vector>
+
+#include "calc.hpp"
+#include "calc_simd.hpp"
+#include "jobs.hpp"
+
+#include "mip_filter.hpp"
+
+// Destination rows per job
+#define MIP_JOB_ROWS 8
+
+// Kaiser window shape, larger values reduce ringing but blur more
+#define MIP_KAISER_ALPHA 4.f
+
+namespace
+{
+    // In destination texels
+    float GetFilterRadius(MipFilter filter)
+    {
+        return filter == MipFilter::BOX ? 0.5f : 3.f;
+    }
+
+    float Sinc(float x)
+    {
+        if (calc::Abs(x) < 1e-5f)
+            return 1.f;
+
+        float piX = x * (calc::TAU * 0.5f);
+        return std::sin(piX) / piX;
+    }
+
+    // Modified Bessel function of the first kind of order 0 (power series)
+    float BesselI0(float x)
+    {
+        float sum = 1.f;
+        float term = 1.f;
+        for (int k = 1; k < 20; ++k)
+        {
+            term *= x * 0.5f / k;
+            sum += term * term;
+        }
+        return sum;
+    }
+
+    float EvaluateFilter(MipFilter filter, float x)
+    {
+        float radius = GetFilterRadius(filter);
+        x = calc::Abs(x);
+        if (x > radius)
+            return 0.f;
+
+        switch (filter)
+        {
+        case MipFilter::BOX:
+            return x < radius ? 1.f : 0.5f; // Texels on the boundary are shared by 2 destination texels
+
+        case MipFilter::KAISER:
+        {
+            float t = x / radius;
+            return Sinc(x) * BesselI0(MIP_KAISER_ALPHA * calc::Sqrt(1.f - t * t)) / BesselI0(MIP_KAISER_ALPHA);
+        }
+
+        case MipFilter::LANCZOS:
+            return Sinc(x) * Sinc(x / radius);
+        }
+        return 0.f;
+    }
+
+    // Source texels and normalized weights of each destination texel along one axis
+    struct Taps
+    {
+        int count; // Per destination texel
+        std::vector<int> indices; // Clamped to the edges
+        std::vector<float> weights;
+    };
+
+    Taps ComputeTaps(MipFilter filter, int srcSize, int dstSize)
+    {
+        float scale = (float)srcSize / dstSize;
+        float radius = GetFilterRadius(filter) * scale; // In source texels
+
+        Taps taps;
+        taps.count = (int)(2.f * radius) + 1;
+        taps.indices.resize(dstSize * taps.count);
+        taps.weights.resize(dstSize * taps.count);
+        for (int d = 0; d < dstSize; ++d)
+        {
+            float center = (d + 0.5f) * scale;
+            int first = (int)std::ceil(center - radius - 0.5f);
+
+            float sum = 0.f;
+            int* indices = &taps.indices[d * taps.count];
+            float* weights = &taps.weights[d * taps.count];
+            for (int t = 0; t < taps.count; ++t)
+            {
+                indices[t] = calc::Clamp(first + t, 0, srcSize - 1);
+                weights[t] = EvaluateFilter(filter, (first + t + 0.5f - center) / scale);
+                sum += weights[t];
+            }
+
+            for (int t = 0; t < taps.count; ++t)
+                weights[t] /= sum;
+        }
+        return taps;
+    }
+
+    // Vertical pass of one destination row: dst[x] = sum of weights[t] * src[indices[t]][x]
+    void FilterColumns(float4* dst, const float4* src, int width, const int* indices, const float* weights, int tapCount)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+#ifdef CALC_SIMD_SSE
+            __m128 sum = _mm_setzero_ps();
+            for (int t = 0; t < tapCount; ++t)
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[t]), _mm_loadu_ps(src[(size_t)indices[t] * width + x].e)));
+            _mm_storeu_ps(dst[x].e, sum);
+#else
+            float4 sum = { 0.f, 0.f, 0.f, 0.f };
+            for (int t = 0; t < tapCount; ++t)
+            {
+                const float4& texel = src[(size_t)indices[t] * width + x];
+                for (int c = 0; c < 4; ++c)
+                    sum.e[c] += weights[t] * texel.e[c];
+            }
+            dst[x] = sum;
+#endif
+        }
+    }
+
+    // Horizontal pass of one destination row, clamped to 0
+    void FilterRow(float4* dst, const float4* src, int dstWidth, const Taps& taps)
+    {
+        for (int x = 0; x < dstWidth; ++x)
+        {
+            const int* indices = &taps.indices[x * taps.count];
+            const float* weights = &taps.weights[x * taps.count];
+#ifdef CALC_SIMD_SSE
+            __m128 sum = _mm_setzero_ps();
+            for (int t = 0; t < taps.count; ++t)
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[t]), _mm_loadu_ps(src[indices[t]].e)));
+            _mm_storeu_ps(dst[x].e, _mm_max_ps(sum, _mm_setzero_ps()));
+#else
+            float4 sum = { 0.f, 0.f, 0.f, 0.f };
+            for (int t = 0; t < taps.count; ++t)
+            {
+                for (int c = 0; c < 4; ++c)
+                    sum.e[c] += weights[t] * src[indices[t]].e[c];
+            }
+            for (int c = 0; c < 4; ++c)
+                dst[x].e[c] = calc::Max(sum.e[c], 0.f);
+#endif
+        }
+    }
+}
+
+const char* mip::GetFilterName(MipFilter filter)
+{
+    switch (filter)
+    {
+    case MipFilter::BOX:     return "box";
+    case MipFilter::KAISER:  return "kaiser";
+    case MipFilter::LANCZOS: return "lanczos";
+    default:                 return "unknown";
+    }
+}
+
+void mip::Downsample(MipFilter filter, float4* dst, int dstWidth, int dstHeight, const float4* src, int srcWidth, int srcHeight, bool parallel)
+{
+    Taps columnTaps = ComputeTaps(filter, srcWidth, dstWidth);
+    Taps rowTaps = ComputeTaps(filter, srcHeight, dstHeight);
+
+    auto downsampleRows = [&](int begin, int end)
+    {
+        std::vector<float4> filteredRow(srcWidth);
+        for (int y = begin; y < end; ++y)
+        {
+            FilterColumns(filteredRow.data(), src, srcWidth, &rowTaps.indices[y * rowTaps.count], &rowTaps.weights[y * rowTaps.count], rowTaps.count);
+            FilterRow(dst + (size_t)y * dstWidth, filteredRow.data(), dstWidth, columnTaps);
+        }
+    };
+
+    if (parallel)
+        jobs::ParallelFor(dstHeight, MIP_JOB_ROWS, downsampleRows);
+    else
+        downsampleRows(0, dstHeight);
+}
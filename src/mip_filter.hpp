@@ -0,0 +1,22 @@
+#pragma once
+
+#include "types.hpp"
+
+enum class MipFilter
+{
+    BOX,     // 2x2 average, blurriest but cheapest
+    KAISER,  // Kaiser windowed sinc (radius 3, alpha 4), sharp with little ringing
+    LANCZOS, // Lanczos 3, sharpest, rings on hard edges
+};
+
+// CPU mip generation of 4 channels float images (SIMD when available)
+// Filters are separable and evaluated at the destination texel centers, texels outside the image repeat the edges
+// Images should be in linear space so that averages are physically correct
+namespace mip
+{
+    const char* GetFilterName(MipFilter filter);
+
+    // Resample src to dst, negative results of sinc filters are clamped to 0
+    // If parallel is true the rows are split across worker threads
+    void Downsample(MipFilter filter, float4* dst, int dstWidth, int dstHeight, const float4* src, int srcWidth, int srcHeight, bool parallel = true);
+}
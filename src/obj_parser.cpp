@@ -0,0 +1,597 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+#include "jobs.hpp"
+#include "mapped_file.hpp"
+
+#include "obj_parser.hpp"
+
+// Bytes parsed per job, chunks are then extended to the next line
+#define OBJ_CHUNK_SIZE (256 * 1024)
+
+namespace
+{
+    // Exactly representable powers of 10
+    constexpr double POW10[] =
+    {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    inline bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+    inline bool IsDigit(char c) { return (unsigned)(c - '0') < 10u; }
+
+    inline const char* SkipSpaces(const char* p, const char* end)
+    {
+        while (p < end && IsSpace(*p))
+            ++p;
+        return p;
+    }
+
+    // Decimal float with optional exponent, digits after the 19th only move the exponent
+    // The mantissa is scaled by an exact power of 10 in double precision then rounded to float
+    const char* ParseFloat(const char* p, const char* end, float* value)
+    {
+        p = SkipSpaces(p, end);
+
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negative = *p++ == '-';
+
+        uint64_t mantissa = 0;
+        int digitCount = 0;
+        int exponent = 0;
+        for (; p < end && IsDigit(*p); ++p)
+        {
+            if (digitCount < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                digitCount += mantissa != 0;
+            }
+            else
+            {
+                exponent++;
+            }
+        }
+
+        if (p < end && *p == '.')
+        {
+            for (++p; p < end && IsDigit(*p); ++p)
+            {
+                if (digitCount < 19)
+                {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    digitCount += mantissa != 0;
+                    exponent--;
+                }
+            }
+        }
+
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            ++p;
+            bool negativeExponent = false;
+            if (p < end && (*p == '-' || *p == '+'))
+                negativeExponent = *p++ == '-';
+
+            int e = 0;
+            for (; p < end && IsDigit(*p); ++p)
+                e = std::min(e * 10 + (*p - '0'), 10000);
+            exponent += negativeExponent ? -e : e;
+        }
+
+        double result = (double)mantissa;
+        if (mantissa != 0)
+        {
+            // Out of float range exponents saturate to 0 or infinity
+            while (exponent > 22)  { result *= 1e22; exponent -= 22; }
+            while (exponent < -22) { result /= 1e22; exponent += 22; }
+            result = exponent < 0 ? result / POW10[-exponent] : result * POW10[exponent];
+        }
+
+        *value = (float)(negative ? -result : result);
+        return p;
+    }
+
+    const char* ParseInt(const char* p, const char* end, int* value)
+    {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negative = *p++ == '-';
+
+        int result = 0;
+        for (; p < end && IsDigit(*p); ++p)
+            result = result * 10 + (*p - '0');
+
+        *value = negative ? -result : result;
+        return p;
+    }
+
+    enum class Statement
+    {
+        NONE,
+        POSITION,
+        UV,
+        NORMAL,
+        FACE,
+        OBJECT, // 'o' and 'g'
+        MATERIAL,
+        MATERIAL_LIBRARY,
+    };
+
+    // Identify the statement of a line and move p after its keyword
+    Statement ReadStatement(const char*& p, const char* end)
+    {
+        struct Keyword { const char* name; int length; Statement statement; };
+        static const Keyword keywords[] =
+        {
+            { "v",      1, Statement::POSITION },
+            { "vt",     2, Statement::UV },
+            { "vn",     2, Statement::NORMAL },
+            { "f",      1, Statement::FACE },
+            { "o",      1, Statement::OBJECT },
+            { "g",      1, Statement::OBJECT },
+            { "usemtl", 6, Statement::MATERIAL },
+            { "mtllib", 6, Statement::MATERIAL_LIBRARY },
+        };
+
+        p = SkipSpaces(p, end);
+        for (const Keyword& keyword : keywords)
+        {
+            if (end - p > keyword.length && memcmp(p, keyword.name, keyword.length) == 0 && IsSpace(p[keyword.length]))
+            {
+                p += keyword.length;
+                return keyword.statement;
+            }
+        }
+        return Statement::NONE;
+    }
+
+    std::string ReadName(const char* p, const char* end)
+    {
+        p = SkipSpaces(p, end);
+        while (end > p && IsSpace(end[-1]))
+            --end;
+        return std::string(p, end);
+    }
+
+    // 'o', 'g', 'usemtl' or 'mtllib' statement
+    struct Event
+    {
+        Statement statement;
+        int triangle; // First triangle following the statement
+        std::string name;
+    };
+
+    struct Chunk
+    {
+        const char* begin;
+        const char* end;
+
+        // First pass counts, offsets inside the output arrays after the prefix sum
+        int positionCount = 0;
+        int uvCount = 0;
+        int normalCount = 0;
+        int triangleCount = 0;
+        int positionOffset = 0;
+        int uvOffset = 0;
+        int normalOffset = 0;
+        int triangleOffset = 0;
+
+        std::vector<Event> events; // Triangles relative to the chunk
+        bool hasColors = false;
+        int invalidIndexCount = 0;
+    };
+
+    template<typename LineFunc>
+    void ForEachLine(const Chunk& chunk, LineFunc lineFunc)
+    {
+        const char* p = chunk.begin;
+        while (p < chunk.end)
+        {
+            const char* lineEnd = (const char*)memchr(p, '\n', chunk.end - p);
+            if (lineEnd == nullptr)
+                lineEnd = chunk.end;
+
+            const char* content = p;
+            Statement statement = ReadStatement(content, lineEnd);
+            if (statement != Statement::NONE)
+                lineFunc(statement, content, lineEnd);
+
+            p = lineEnd + 1;
+        }
+    }
+
+    // First pass: count elements and record the statements splitting the mesh
+    void CountChunk(Chunk& chunk)
+    {
+        ForEachLine(chunk, [&chunk](Statement statement, const char* p, const char* end)
+        {
+            switch (statement)
+            {
+            case Statement::POSITION: chunk.positionCount++; break;
+            case Statement::UV:       chunk.uvCount++; break;
+            case Statement::NORMAL:   chunk.normalCount++; break;
+            case Statement::FACE:
+            {
+                int vertexCount = 0;
+                for (p = SkipSpaces(p, end); p < end; p = SkipSpaces(p, end))
+                {
+                    vertexCount++;
+                    while (p < end && !IsSpace(*p))
+                        ++p;
+                }
+                chunk.triangleCount += std::max(vertexCount - 2, 0);
+                break;
+            }
+            default:
+                chunk.events.push_back({ statement, chunk.triangleCount, ReadName(p, end) });
+                break;
+            }
+        });
+    }
+
+    // Second pass: parse elements into their final location
+    void ParseChunk(Chunk& chunk, obj::Mesh& mesh)
+    {
+        // Indices in the file, elements are stored relative to mesh.firstXXX
+        int positionIndex = mesh.firstPosition + chunk.positionOffset;
+        int uvIndex       = mesh.firstUV + chunk.uvOffset;
+        int normalIndex   = mesh.firstNormal + chunk.normalOffset;
+        obj::Index* triangles = mesh.indices.data() + (size_t)chunk.triangleOffset * 3;
+
+        int totalPositions = mesh.firstPosition + (int)mesh.positions.size();
+        int totalUVs       = mesh.firstUV + (int)mesh.uvs.size();
+        int totalNormals   = mesh.firstNormal + (int)mesh.normals.size();
+
+        // 1-based or relative to the elements read so far (0 is invalid)
+        auto resolve = [&chunk](int index, int current, int total)
+        {
+            int resolved = index > 0 ? index - 1 : current + index;
+            if (index == 0 || resolved < 0 || resolved >= total)
+            {
+                chunk.invalidIndexCount++;
+                return -1;
+            }
+            return resolved;
+        };
+
+        ForEachLine(chunk, [&](Statement statement, const char* p, const char* end)
+        {
+            switch (statement)
+            {
+            case Statement::POSITION:
+            {
+                float3& position = mesh.positions[positionIndex - mesh.firstPosition];
+                p = ParseFloat(p, end, &position.x);
+                p = ParseFloat(p, end, &position.y);
+                p = ParseFloat(p, end, &position.z);
+
+                // "v x y z w" has an optional weight (ignored), only exactly 3 more values are a vertex color
+                float extra[4];
+                int extraCount = 0;
+                for (p = SkipSpaces(p, end); p < end && extraCount < 4; p = SkipSpaces(p, end))
+                    p = ParseFloat(p, end, &extra[extraCount++]);
+                if (extraCount == 3)
+                {
+                    mesh.colors[positionIndex - mesh.firstPosition] = { extra[0], extra[1], extra[2] };
+                    chunk.hasColors = true;
+                }
+                positionIndex++;
+                break;
+            }
+            case Statement::UV:
+            {
+                float2& uv = mesh.uvs[uvIndex++ - mesh.firstUV];
+                p = ParseFloat(p, end, &uv.x);
+                p = ParseFloat(p, end, &uv.y);
+                break;
+            }
+            case Statement::NORMAL:
+            {
+                float3& normal = mesh.normals[normalIndex++ - mesh.firstNormal];
+                p = ParseFloat(p, end, &normal.x);
+                p = ParseFloat(p, end, &normal.y);
+                p = ParseFloat(p, end, &normal.z);
+                break;
+            }
+            case Statement::FACE:
+            {
+                // Fan triangulation: (first, previous, current)
+                obj::Index first = {}, previous = {};
+                int vertexCount = 0;
+                for (p = SkipSpaces(p, end); p < end; p = SkipSpaces(p, end))
+                {
+                    obj::Index index = { -1, -1, -1 };
+                    int value;
+                    p = ParseInt(p, end, &value);
+                    index.position = resolve(value, positionIndex, totalPositions);
+                    if (p < end && *p == '/')
+                    {
+                        ++p;
+                        if (p < end && *p != '/')
+                        {
+                            p = ParseInt(p, end, &value);
+                            index.uv = resolve(value, uvIndex, totalUVs);
+                        }
+                        if (p < end && *p == '/')
+                        {
+                            p = ParseInt(p + 1, end, &value);
+                            index.normal = resolve(value, normalIndex, totalNormals);
+                        }
+                    }
+
+                    // Skip anything left in the token
+                    while (p < end && !IsSpace(*p))
+                        ++p;
+
+                    if (vertexCount == 0)
+                        first = index;
+                    else if (vertexCount >= 2)
+                    {
+                        *triangles++ = first;
+                        *triangles++ = previous;
+                        *triangles++ = index;
+                    }
+                    previous = index;
+                    vertexCount++;
+                }
+                break;
+            }
+            default:
+                break;
+            }
+        });
+    }
+}
+
+bool obj::Load(Mesh* mesh, const char* filename)
+{
+    MappedFile file;
+    if (!file.Open(filename))
+    {
+        fprintf(stderr, "Failed to open '%s'\n", filename);
+        return false;
+    }
+
+    *mesh = {};
+    Parser parser;
+    parser.Parse(mesh, (const char*)file.Data(), file.Size());
+    parser.Finish(mesh, filename);
+    return true;
+}
+
+void obj::Parser::Parse(Mesh* mesh, const char* text, size_t size)
+{
+    // Split at line boundaries
+    const char* textEnd = text + size;
+    std::vector<Chunk> chunks;
+    for (const char* p = text; p < textEnd;)
+    {
+        const char* end = p + std::min((size_t)OBJ_CHUNK_SIZE, (size_t)(textEnd - p));
+        const char* lineEnd = end < textEnd ? (const char*)memchr(end, '\n', textEnd - end) : nullptr;
+        end = lineEnd ? lineEnd + 1 : textEnd;
+
+        Chunk chunk;
+        chunk.begin = p;
+        chunk.end = end;
+        chunks.push_back(chunk);
+        p = end;
+    }
+
+    jobs::ParallelFor((int)chunks.size(), 1, [&chunks](int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+            CountChunk(chunks[i]);
+    });
+
+    // Prefix sums give the output location of each chunk
+    int textPositionCount = 0, textUVCount = 0, textNormalCount = 0, textTriangleCount = 0;
+    for (Chunk& chunk : chunks)
+    {
+        chunk.positionOffset = textPositionCount;
+        chunk.uvOffset       = textUVCount;
+        chunk.normalOffset   = textNormalCount;
+        chunk.triangleOffset = textTriangleCount;
+        textPositionCount += chunk.positionCount;
+        textUVCount       += chunk.uvCount;
+        textNormalCount   += chunk.normalCount;
+        textTriangleCount += chunk.triangleCount;
+    }
+
+    mesh->firstPosition = positionCount;
+    mesh->firstUV       = uvCount;
+    mesh->firstNormal   = normalCount;
+    mesh->firstTriangle = triangleCount;
+    mesh->positions.assign(textPositionCount, float3{});
+    mesh->colors.assign(textPositionCount, float3{ 1.f, 1.f, 1.f });
+    mesh->uvs.assign(textUVCount, float2{});
+    mesh->normals.assign(textNormalCount, float3{});
+    mesh->indices.assign((size_t)textTriangleCount * 3, Index{});
+    mesh->materialIds.assign(textTriangleCount, -1);
+
+    jobs::ParallelFor((int)chunks.size(), 1, [&chunks, mesh](int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+            ParseChunk(chunks[i], *mesh);
+    });
+
+    // Shapes and materials from the statements, in file order (triangles are local to the text)
+    bool hasColors = false;
+    int materialStart = 0;
+    for (const Chunk& chunk : chunks)
+    {
+        hasColors |= chunk.hasColors;
+        invalidIndexCount += chunk.invalidIndexCount;
+
+        for (const Event& event : chunk.events)
+        {
+            int triangle = chunk.triangleOffset + event.triangle;
+            switch (event.statement)
+            {
+            case Statement::OBJECT:
+                // Statements without faces in between only rename the shape
+                if (triangleCount + triangle > shape.firstTriangle)
+                {
+                    shape.triangleCount = triangleCount + triangle - shape.firstTriangle;
+                    mesh->shapes.push_back(shape);
+                }
+                shape = { event.name, triangleCount + triangle, 0, materialId };
+                break;
+
+            case Statement::MATERIAL:
+            {
+                std::fill(mesh->materialIds.begin() + materialStart, mesh->materialIds.begin() + triangle, materialId);
+                auto inserted = materialMap.insert({ event.name, (int)mesh->materialNames.size() });
+                if (inserted.second)
+                    mesh->materialNames.push_back(event.name);
+                materialId = inserted.first->second;
+                materialStart = triangle;
+
+                // "o" then "usemtl": the material applies to the whole shape
+                if (shape.firstTriangle == triangleCount + triangle)
+                    shape.materialId = materialId;
+                break;
+            }
+
+            case Statement::MATERIAL_LIBRARY:
+                mesh->materialLibraries.push_back(event.name);
+                break;
+
+            default:
+                break;
+            }
+        }
+    }
+    std::fill(mesh->materialIds.begin() + materialStart, mesh->materialIds.end(), materialId);
+
+    if (!hasColors)
+        mesh->colors.clear();
+
+    positionCount += textPositionCount;
+    uvCount       += textUVCount;
+    normalCount   += textNormalCount;
+    triangleCount += textTriangleCount;
+}
+
+void obj::Parser::Finish(Mesh* mesh, const char* filename)
+{
+    if (triangleCount > shape.firstTriangle)
+    {
+        shape.triangleCount = triangleCount - shape.firstTriangle;
+        mesh->shapes.push_back(shape);
+    }
+    shape = { "", triangleCount, 0, materialId };
+
+    if (invalidIndexCount > 0)
+        fprintf(stderr, "'%s': %d invalid face indices\n", filename, invalidIndexCount);
+    invalidIndexCount = 0;
+}
+
+obj::Material obj::GetDefaultMaterial(const std::string& name)
+{
+    Material material;
+    material.name = name;
+    material.diffuseColor = { 1.f, 1.f, 1.f };
+    material.emissiveColor = { 0.f, 0.f, 0.f };
+    return material;
+}
+
+bool obj::LoadMaterials(std::vector<Material>* materials, const char* filename)
+{
+    MappedFile file;
+    if (!file.Open(filename))
+    {
+        fprintf(stderr, "Failed to open '%s'\n", filename);
+        return false;
+    }
+
+    enum class MaterialStatement { NEW, DIFFUSE, EMISSIVE, DIFFUSE_MAP, EMISSIVE_MAP, NORMAL_MAP };
+    struct Keyword { const char* name; int length; MaterialStatement statement; };
+    static const Keyword keywords[] =
+    {
+        { "newmtl",   6, MaterialStatement::NEW },
+        { "Kd",       2, MaterialStatement::DIFFUSE },
+        { "Ke",       2, MaterialStatement::EMISSIVE },
+        { "map_Kd",   6, MaterialStatement::DIFFUSE_MAP },
+        { "map_Ke",   6, MaterialStatement::EMISSIVE_MAP },
+        { "map_Bump", 8, MaterialStatement::NORMAL_MAP },
+        { "bump",     4, MaterialStatement::NORMAL_MAP },
+        { "norm",     4, MaterialStatement::NORMAL_MAP },
+    };
+
+    // Map options ("-bm 0.5 file.png") come first, the file is the last token
+    auto readMap = [](const char* p, const char* end)
+    {
+        std::string name = ReadName(p, end);
+        if (!name.empty() && name[0] == '-')
+        {
+            size_t space = name.find_last_of(" \t");
+            if (space != std::string::npos)
+                name = name.substr(space + 1);
+        }
+        return name;
+    };
+
+    const char* p = (const char*)file.Data();
+    const char* textEnd = p + file.Size();
+    Material* material = nullptr;
+    bool hasEmissiveColor = false;
+    auto finishMaterial = [&]()
+    {
+        if (material && !hasEmissiveColor && !material->emissiveTexture.empty())
+            material->emissiveColor = { 1.f, 1.f, 1.f };
+    };
+
+    while (p < textEnd)
+    {
+        const char* lineEnd = (const char*)memchr(p, '\n', textEnd - p);
+        if (lineEnd == nullptr)
+            lineEnd = textEnd;
+
+        const char* content = SkipSpaces(p, lineEnd);
+        for (const Keyword& keyword : keywords)
+        {
+            if (lineEnd - content <= keyword.length || memcmp(content, keyword.name, keyword.length) != 0 || !IsSpace(content[keyword.length]))
+                continue;
+
+            const char* args = content + keyword.length;
+            if (keyword.statement == MaterialStatement::NEW)
+            {
+                finishMaterial();
+                materials->push_back(GetDefaultMaterial(ReadName(args, lineEnd)));
+                material = &materials->back();
+                hasEmissiveColor = false;
+            }
+            else if (material)
+            {
+                switch (keyword.statement)
+                {
+                case MaterialStatement::DIFFUSE:
+                    args = ParseFloat(args, lineEnd, &material->diffuseColor.x);
+                    args = ParseFloat(args, lineEnd, &material->diffuseColor.y);
+                    ParseFloat(args, lineEnd, &material->diffuseColor.z);
+                    break;
+                case MaterialStatement::EMISSIVE:
+                    args = ParseFloat(args, lineEnd, &material->emissiveColor.x);
+                    args = ParseFloat(args, lineEnd, &material->emissiveColor.y);
+                    ParseFloat(args, lineEnd, &material->emissiveColor.z);
+                    hasEmissiveColor = true;
+                    break;
+                case MaterialStatement::DIFFUSE_MAP:  material->diffuseTexture  = readMap(args, lineEnd); break;
+                case MaterialStatement::EMISSIVE_MAP: material->emissiveTexture = readMap(args, lineEnd); break;
+                case MaterialStatement::NORMAL_MAP:   material->normalTexture   = readMap(args, lineEnd); break;
+                default: break;
+                }
+            }
+            break;
+        }
+
+        p = lineEnd + 1;
+    }
+    finishMaterial();
+    return true;
+}
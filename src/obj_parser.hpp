@@ -0,0 +1,93 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "types.hpp"
+
+// Multithreaded Wavefront OBJ parser (v, vt, vn, f, o, g, usemtl, mtllib)
+// The file is mapped, split at line boundaries and parsed in two passes (count then write into pre-sized arrays)
+// MTL files are small and parsed on the calling thread (newmtl, Kd, Ke, map_Kd, map_Ke, map_Bump/bump/norm)
+namespace obj
+{
+    // 0-based absolute indices, -1 when the attribute is missing
+    struct Index
+    {
+        int position;
+        int uv;
+        int normal;
+    };
+
+    // Range of triangles started by an 'o' or 'g' statement
+    struct Shape
+    {
+        std::string name;
+        int firstTriangle;
+        int triangleCount;
+        int materialId; // Material of the first triangle
+    };
+
+    struct Mesh
+    {
+        std::vector<float3> positions;
+        std::vector<float3> colors; // Same size as positions if any vertex has a color ("v x y z r g b"), empty otherwise
+        std::vector<float2> uvs;
+        std::vector<float3> normals;
+
+        std::vector<Index> indices;     // 3 per triangle, polygons are fan triangulated
+        std::vector<int>   materialIds; // Per triangle, index in materialNames or -1
+        std::vector<Shape> shapes;
+
+        std::vector<std::string> materialNames;     // In order of first use
+        std::vector<std::string> materialLibraries; // mtllib files, relative to the OBJ
+
+        // Index in the file of the first element of each array (0 unless parsed incrementally)
+        int firstPosition = 0;
+        int firstUV = 0;
+        int firstNormal = 0;
+        int firstTriangle = 0;
+    };
+
+    // Texture paths are relative to the MTL file, empty if the map is missing
+    struct Material
+    {
+        std::string name;
+        float3 diffuseColor;  // Kd, multiplies the diffuse map
+        float3 emissiveColor; // Ke, multiplies the emissive map (1 if only the map is given)
+        std::string diffuseTexture;
+        std::string emissiveTexture;
+        std::string normalTexture;
+    };
+
+    // Errors are printed, return false if the file cannot be read
+    bool Load(Mesh* mesh, const char* filename);
+
+    // Append the materials of an MTL file, return false if it cannot be read
+    bool LoadMaterials(std::vector<Material>* materials, const char* filename);
+
+    // White diffuse, no emission and no maps
+    Material GetDefaultMaterial(const std::string& name);
+
+    // Incremental parsing of a file given as consecutive texts, each ending at a line boundary
+    // Element arrays, indices and material ids only hold the last text, shapes and materials accumulate
+    class Parser
+    {
+    public:
+        void Parse(Mesh* mesh, const char* text, size_t size);
+
+        // Close the last shape and report invalid indices
+        void Finish(Mesh* mesh, const char* filename);
+
+    private:
+        int positionCount = 0; // Elements parsed so far
+        int uvCount = 0;
+        int normalCount = 0;
+        int triangleCount = 0;
+        int invalidIndexCount = 0;
+
+        Shape shape = { "", 0, 0, -1 }; // Open shape
+        int materialId = -1;
+        std::unordered_map<std::string, int> materialMap;
+    };
+}
@@ -0,0 +1,95 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "resource_loader.hpp"
+
+ResourceLoader::ResourceLoader(GLFWwindow* loaderWindow)
+    : loaderWindow(loaderWindow)
+{
+    thread = std::thread([this]() { LoaderLoop(); });
+}
+
+ResourceLoader::~ResourceLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wakeUp.notify_one();
+    thread.join();
+
+    for (LoadRequest& request : finished)
+        glDeleteSync(request.fence);
+}
+
+void ResourceLoader::Load(const std::function<void()>& load, const std::function<void()>& done)
+{
+    LoadRequest request;
+    request.load = load;
+    request.done = done;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(std::move(request));
+    }
+    wakeUp.notify_one();
+    pendingCount++;
+}
+
+void ResourceLoader::Update()
+{
+    while (true)
+    {
+        LoadRequest request;
+        {
+            // Later loads complete after the earlier ones, never wait for the GPU
+            std::lock_guard<std::mutex> lock(mutex);
+            if (finished.empty() || glClientWaitSync(finished.front().fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+                return;
+
+            request = std::move(finished.front());
+            finished.pop_front();
+        }
+
+        // Objects modified by the loader context must be bound again to see the changes, which completions do
+        glDeleteSync(request.fence);
+        pendingCount--;
+        if (request.done)
+            request.done(); // Can queue other loads
+    }
+}
+
+void ResourceLoader::LoaderLoop()
+{
+    glfwMakeContextCurrent(loaderWindow);
+
+    // Core profile element buffer bindings are vertex array state
+    GLuint vertexArray;
+    glGenVertexArrays(1, &vertexArray);
+    glBindVertexArray(vertexArray);
+
+    while (true)
+    {
+        LoadRequest request;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeUp.wait(lock, [this]() { return quit || !queue.empty(); });
+            if (quit)
+                break;
+
+            request = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        request.load();
+
+        // Flush so that the render thread does not wait on a fence never submitted
+        request.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        finished.push_back(std::move(request));
+    }
+
+    glDeleteVertexArrays(1, &vertexArray);
+    glfwMakeContextCurrent(nullptr);
+}
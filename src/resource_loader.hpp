@@ -0,0 +1,54 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "glad/glad.h"
+
+struct GLFWwindow;
+
+// Background creation of GL objects (buffers, textures, programs) on a thread owning a context shared with the render thread
+// Each load is followed by a fence, its completion runs on the render thread once the GPU has executed the loader commands
+// Vertex arrays and framebuffers are not shared between contexts: create them in the completion
+class ResourceLoader
+{
+public:
+    // loaderWindow is a hidden window sharing the render context, GLFW windows must be created on the main thread
+    ResourceLoader(GLFWwindow* loaderWindow);
+
+    // Wait for the running load, queued loads and completions are dropped
+    ~ResourceLoader();
+
+    // Call load on the loader thread (a vertex array is bound so element buffers can be filled), then done on the render thread
+    void Load(const std::function<void()>& load, const std::function<void()>& done = nullptr);
+
+    // Run the completions of finished loads in request order, call once per frame on the render thread
+    void Update();
+
+    // Loads whose completion did not run yet
+    int GetPendingCount() const { return pendingCount; }
+
+private:
+    struct LoadRequest
+    {
+        std::function<void()> load;
+        std::function<void()> done;
+        GLsync fence = nullptr;
+    };
+
+    void LoaderLoop();
+
+    GLFWwindow* loaderWindow;
+    std::thread thread;
+
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    bool quit = false;
+    std::deque<LoadRequest> queue;    // Waiting for the loader thread
+    std::deque<LoadRequest> finished; // Loaded, waiting for their fence
+
+    int pendingCount = 0; // Render thread only
+};
@@ -0,0 +1,379 @@
+#include <cfloat>
+#include <cstdint>
+#include <cstring>
+
+#include "calc.hpp"
+#include "calc_simd.hpp"
+#include "jobs.hpp"
+
+#include "texture_compression.hpp"
+
+// Rows of blocks encoded per job
+#define BC_JOB_ROWS 4
+
+// Power iterations to find the principal axis of the block colors
+#define BC_POWER_ITERATIONS 4
+
+namespace
+{
+    // Channels of the 16 texels of a block in [0, 255], one array per channel for SIMD loads
+    struct Block
+    {
+        alignas(16) float channels[4][16];
+    };
+
+    void LoadBlock(Block* block, const unsigned char* texels, int width, int height, int channelCount, int blockX, int blockY)
+    {
+        for (int y = 0; y < 4; ++y)
+        {
+            int texelY = calc::Min(blockY * 4 + y, height - 1);
+            for (int x = 0; x < 4; ++x)
+            {
+                int texelX = calc::Min(blockX * 4 + x, width - 1);
+                const unsigned char* texel = texels + ((size_t)texelY * width + texelX) * channelCount;
+                for (int c = 0; c < 4; ++c)
+                    block->channels[c][y * 4 + x] = c < channelCount ? texel[c] : 255.f;
+            }
+        }
+    }
+
+    void GetRange(const float* values, float* minValue, float* maxValue)
+    {
+#ifdef CALC_SIMD_SSE
+        __m128 v0 = _mm_load_ps(values + 0);
+        __m128 v1 = _mm_load_ps(values + 4);
+        __m128 v2 = _mm_load_ps(values + 8);
+        __m128 v3 = _mm_load_ps(values + 12);
+        __m128 minValues = _mm_min_ps(_mm_min_ps(v0, v1), _mm_min_ps(v2, v3));
+        __m128 maxValues = _mm_max_ps(_mm_max_ps(v0, v1), _mm_max_ps(v2, v3));
+        minValues = _mm_min_ps(minValues, _mm_shuffle_ps(minValues, minValues, CALC_SHUFFLE_MASK(2, 3, 0, 1)));
+        maxValues = _mm_max_ps(maxValues, _mm_shuffle_ps(maxValues, maxValues, CALC_SHUFFLE_MASK(2, 3, 0, 1)));
+        minValues = _mm_min_ps(minValues, _mm_shuffle_ps(minValues, minValues, CALC_SHUFFLE_MASK(1, 0, 3, 2)));
+        maxValues = _mm_max_ps(maxValues, _mm_shuffle_ps(maxValues, maxValues, CALC_SHUFFLE_MASK(1, 0, 3, 2)));
+        *minValue = _mm_cvtss_f32(minValues);
+        *maxValue = _mm_cvtss_f32(maxValues);
+#else
+        *minValue = values[0];
+        *maxValue = values[0];
+        for (int i = 1; i < 16; ++i)
+        {
+            *minValue = calc::Min(*minValue, values[i]);
+            *maxValue = calc::Max(*maxValue, values[i]);
+        }
+#endif
+    }
+
+    // 8 values mode (first endpoint above the second), texels are snapped to the closest of the evenly spaced values
+    uint64_t EncodeBC4(const float* values)
+    {
+        float minValue;
+        float maxValue;
+        GetRange(values, &minValue, &maxValue);
+
+        uint64_t block = (uint64_t)maxValue | (uint64_t)minValue << 8;
+        if (maxValue == minValue)
+            return block;
+
+        // Steps from the min (0) to the max (7) to codes: endpoints first, then interpolants from the max to the min
+        static const uint64_t STEP_CODES[8] = { 1, 7, 6, 5, 4, 3, 2, 0 };
+
+        alignas(16) int steps[16];
+        float scale = 7.f / (maxValue - minValue);
+#ifdef CALC_SIMD_SSE
+        __m128 minValues = _mm_set1_ps(minValue);
+        __m128 scales = _mm_set1_ps(scale);
+        for (int i = 0; i < 16; i += 4)
+            _mm_store_si128((__m128i*)(steps + i), _mm_cvtps_epi32(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(values + i), minValues), scales)));
+#else
+        for (int i = 0; i < 16; ++i)
+            steps[i] = (int)((values[i] - minValue) * scale + 0.5f);
+#endif
+
+        for (int i = 0; i < 16; ++i)
+            block |= STEP_CODES[steps[i]] << (16 + 3 * i);
+        return block;
+    }
+
+    uint16_t ToRGB565(const float* color)
+    {
+        int r = (int)(calc::Clamp(color[0], 0.f, 255.f) * (31.f / 255.f) + 0.5f);
+        int g = (int)(calc::Clamp(color[1], 0.f, 255.f) * (63.f / 255.f) + 0.5f);
+        int b = (int)(calc::Clamp(color[2], 0.f, 255.f) * (31.f / 255.f) + 0.5f);
+        return (uint16_t)(r << 11 | g << 5 | b);
+    }
+
+    // Bit replication, as expanded by the hardware
+    void FromRGB565(uint16_t color, float* rgb)
+    {
+        int r = color >> 11;
+        int g = (color >> 5) & 63;
+        int b = color & 31;
+        rgb[0] = (float)(r << 3 | r >> 2);
+        rgb[1] = (float)(g << 2 | g >> 4);
+        rgb[2] = (float)(b << 3 | b >> 2);
+    }
+
+    // 4 colors mode: the endpoints then the colors 1/3 and 2/3 of the way from the first to the second
+    void GetColorPalette(uint16_t color0, uint16_t color1, float palette[4][3])
+    {
+        FromRGB565(color0, palette[0]);
+        FromRGB565(color1, palette[1]);
+        for (int c = 0; c < 3; ++c)
+        {
+            palette[2][c] = (2.f * palette[0][c] + palette[1][c]) * (1.f / 3.f);
+            palette[3][c] = (palette[0][c] + 2.f * palette[1][c]) * (1.f / 3.f);
+        }
+    }
+
+    // Closest palette color of each texel, return the total squared error
+    float FindColorIndices(const Block& block, const float palette[4][3], int* indices)
+    {
+#ifdef CALC_SIMD_SSE
+        __m128 errors = _mm_setzero_ps();
+        for (int i = 0; i < 16; i += 4)
+        {
+            __m128 r = _mm_load_ps(block.channels[0] + i);
+            __m128 g = _mm_load_ps(block.channels[1] + i);
+            __m128 b = _mm_load_ps(block.channels[2] + i);
+            __m128 best = _mm_set1_ps(FLT_MAX);
+            __m128i bestIndices = _mm_setzero_si128();
+            for (int p = 0; p < 4; ++p)
+            {
+                __m128 dr = _mm_sub_ps(r, _mm_set1_ps(palette[p][0]));
+                __m128 dg = _mm_sub_ps(g, _mm_set1_ps(palette[p][1]));
+                __m128 db = _mm_sub_ps(b, _mm_set1_ps(palette[p][2]));
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+                __m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, best));
+                best = _mm_min_ps(distance, best);
+                bestIndices = _mm_or_si128(_mm_andnot_si128(closer, bestIndices), _mm_and_si128(closer, _mm_set1_epi32(p)));
+            }
+            _mm_storeu_si128((__m128i*)(indices + i), bestIndices);
+            errors = _mm_add_ps(errors, best);
+        }
+
+        errors = _mm_add_ps(errors, _mm_shuffle_ps(errors, errors, CALC_SHUFFLE_MASK(2, 3, 0, 1)));
+        errors = _mm_add_ps(errors, _mm_shuffle_ps(errors, errors, CALC_SHUFFLE_MASK(1, 0, 3, 2)));
+        return _mm_cvtss_f32(errors);
+#else
+        float error = 0.f;
+        for (int i = 0; i < 16; ++i)
+        {
+            float best = FLT_MAX;
+            for (int p = 0; p < 4; ++p)
+            {
+                float distance = 0.f;
+                for (int c = 0; c < 3; ++c)
+                    distance += (block.channels[c][i] - palette[p][c]) * (block.channels[c][i] - palette[p][c]);
+                if (distance < best)
+                {
+                    best = distance;
+                    indices[i] = p;
+                }
+            }
+            error += best;
+        }
+        return error;
+#endif
+    }
+
+    struct ColorFit
+    {
+        uint16_t color0;
+        uint16_t color1;
+        int indices[16];
+        float error;
+    };
+
+    void FitColors(ColorFit* fit, const Block& block, const float* endpoint0, const float* endpoint1)
+    {
+        fit->color0 = ToRGB565(endpoint0);
+        fit->color1 = ToRGB565(endpoint1);
+
+        float palette[4][3];
+        GetColorPalette(fit->color0, fit->color1, palette);
+        fit->error = FindColorIndices(block, palette, fit->indices);
+    }
+
+    uint64_t EncodeBC1(const Block& block)
+    {
+        const float* r = block.channels[0];
+        const float* g = block.channels[1];
+        const float* b = block.channels[2];
+
+        float mean[3] = {};
+        for (int i = 0; i < 16; ++i)
+        {
+            mean[0] += r[i];
+            mean[1] += g[i];
+            mean[2] += b[i];
+        }
+        for (float& m : mean)
+            m *= 1.f / 16.f;
+
+        // xx, xy, xz, yy, yz, zz
+        float covariance[6] = {};
+        for (int i = 0; i < 16; ++i)
+        {
+            float dr = r[i] - mean[0];
+            float dg = g[i] - mean[1];
+            float db = b[i] - mean[2];
+            covariance[0] += dr * dr;
+            covariance[1] += dr * dg;
+            covariance[2] += dr * db;
+            covariance[3] += dg * dg;
+            covariance[4] += dg * db;
+            covariance[5] += db * db;
+        }
+
+        // Principal axis, starting from the diagonal of the block bounds
+        float axis[3];
+        for (int c = 0; c < 3; ++c)
+        {
+            float minValue;
+            float maxValue;
+            GetRange(block.channels[c], &minValue, &maxValue);
+            axis[c] = maxValue - minValue;
+        }
+        for (int i = 0; i < BC_POWER_ITERATIONS; ++i)
+        {
+            float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+            float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+            float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+            float scale = calc::Max(calc::Max(calc::Abs(x), calc::Abs(y)), calc::Abs(z));
+            if (scale == 0.f)
+                break;
+
+            axis[0] = x / scale;
+            axis[1] = y / scale;
+            axis[2] = z / scale;
+        }
+
+        // Texels at both ends of the axis
+        int minTexel = 0;
+        int maxTexel = 0;
+        float minProjection = FLT_MAX;
+        float maxProjection = -FLT_MAX;
+        for (int i = 0; i < 16; ++i)
+        {
+            float projection = r[i] * axis[0] + g[i] * axis[1] + b[i] * axis[2];
+            if (projection < minProjection)
+            {
+                minProjection = projection;
+                minTexel = i;
+            }
+            if (projection > maxProjection)
+            {
+                maxProjection = projection;
+                maxTexel = i;
+            }
+        }
+
+        float endpoint0[3] = { r[maxTexel], g[maxTexel], b[maxTexel] };
+        float endpoint1[3] = { r[minTexel], g[minTexel], b[minTexel] };
+        ColorFit best;
+        FitColors(&best, block, endpoint0, endpoint1);
+
+        // Least squares endpoints for these indices: texel = w * endpoint0 + (1 - w) * endpoint1
+        static const float ENDPOINT0_WEIGHTS[4] = { 1.f, 0.f, 2.f / 3.f, 1.f / 3.f };
+        float aa = 0.f;
+        float ab = 0.f;
+        float bb = 0.f;
+        float ax[3] = {};
+        float bx[3] = {};
+        for (int i = 0; i < 16; ++i)
+        {
+            float wa = ENDPOINT0_WEIGHTS[best.indices[i]];
+            float wb = 1.f - wa;
+            aa += wa * wa;
+            ab += wa * wb;
+            bb += wb * wb;
+            for (int c = 0; c < 3; ++c)
+            {
+                ax[c] += wa * block.channels[c][i];
+                bx[c] += wb * block.channels[c][i];
+            }
+        }
+
+        // Null when every texel uses the same weight
+        float determinant = aa * bb - ab * ab;
+        if (determinant > 1e-3f)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                endpoint0[c] = (bb * ax[c] - ab * bx[c]) / determinant;
+                endpoint1[c] = (aa * bx[c] - ab * ax[c]) / determinant;
+            }
+
+            ColorFit refined;
+            FitColors(&refined, block, endpoint0, endpoint1);
+            if (refined.error < best.error)
+                best = refined;
+        }
+
+        // The 4 colors mode needs color0 > color1, swapping the endpoints swaps codes 0/1 and 2/3
+        if (best.color0 < best.color1)
+        {
+            uint16_t color = best.color0;
+            best.color0 = best.color1;
+            best.color1 = color;
+            for (int& index : best.indices)
+                index ^= 1;
+        }
+
+        // Equal endpoints select the 3 colors mode where code 0 is still color0
+        uint32_t indexBits = 0;
+        if (best.color0 != best.color1)
+        {
+            for (int i = 0; i < 16; ++i)
+                indexBits |= (uint32_t)best.indices[i] << (2 * i);
+        }
+
+        return (uint64_t)best.color0 | (uint64_t)best.color1 << 16 | (uint64_t)indexBits << 32;
+    }
+}
+
+int bc::GetBlockSize(BlockFormat format)
+{
+    return (format == BlockFormat::BC1 || format == BlockFormat::BC4) ? 8 : 16;
+}
+
+size_t bc::GetEncodedSize(BlockFormat format, int width, int height)
+{
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * GetBlockSize(format);
+}
+
+void bc::Encode(BlockFormat format, void* dst, const unsigned char* texels, int width, int height, int channelCount, bool parallel)
+{
+    int blockCountX = (width  + 3) / 4;
+    int blockCountY = (height + 3) / 4;
+    int blockSize = GetBlockSize(format);
+    unsigned char* blocks = (unsigned char*)dst;
+
+    auto encodeRows = [=](int begin, int end)
+    {
+        Block block;
+        for (int blockY = begin; blockY < end; ++blockY)
+        {
+            for (int blockX = 0; blockX < blockCountX; ++blockX)
+            {
+                LoadBlock(&block, texels, width, height, channelCount, blockX, blockY);
+
+                // Little endian words, in block order
+                uint64_t words[2] = {};
+                switch (format)
+                {
+                case BlockFormat::BC1: words[0] = EncodeBC1(block); break;
+                case BlockFormat::BC3: words[0] = EncodeBC4(block.channels[3]); words[1] = EncodeBC1(block); break;
+                case BlockFormat::BC4: words[0] = EncodeBC4(block.channels[0]); break;
+                case BlockFormat::BC5: words[0] = EncodeBC4(block.channels[0]); words[1] = EncodeBC4(block.channels[1]); break;
+                }
+                memcpy(blocks + ((size_t)blockY * blockCountX + blockX) * blockSize, words, blockSize);
+            }
+        }
+    };
+
+    if (parallel)
+        jobs::ParallelFor(blockCountY, BC_JOB_ROWS, encodeRows);
+    else
+        encodeRows(0, blockCountY);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+
+// 4x4 texels blocks (S3TC / RGTC)
+enum class BlockFormat
+{
+    BC1, // RGB, 5:6:5 endpoints and 2 bits indices (8 bytes)
+    BC3, // RGBA, BC4 alpha block followed by a BC1 color block (16 bytes)
+    BC4, // Single channel, 8 bits endpoints and 3 bits indices (8 bytes)
+    BC5, // 2 channels as 2 BC4 blocks (16 bytes), e.g. normal maps xy
+};
+
+// CPU block compression of 8 bits images (SIMD when available)
+// Color endpoints are fitted along the principal axis of the block then refined by least squares, single channel endpoints are the block range
+namespace bc
+{
+    // 8 or 16 bytes
+    int GetBlockSize(BlockFormat format);
+
+    // Partial blocks on the right and bottom edges count as full blocks
+    size_t GetEncodedSize(BlockFormat format, int width, int height);
+
+    // texels holds width * height texels of channelCount bytes each, rows are tightly packed
+    // BC1 reads the first 3 channels, BC3 the first 4 (missing ones read as 255), BC4 the first one and BC5 the first 2
+    // Edge blocks repeat the last row/column, if parallel is true rows of blocks are split across worker threads
+    void Encode(BlockFormat format, void* dst, const unsigned char* texels, int width, int height, int channelCount, bool parallel = true);
+}
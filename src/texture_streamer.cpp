@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <cstring>
+
+#include "calc.hpp"
+#include "jobs.hpp"
+
+#include "texture_streamer.hpp"
+
+// Pixel buffer objects in the ring, each one holds the rows of one upload
+#define TEXTURE_STREAMING_PBO_COUNT 4
+
+// Size of each pixel buffer object, levels with larger rows are uploaded from client memory
+#define TEXTURE_STREAMING_PBO_SIZE (1 << 20)
+
+TextureStreamer::TextureStreamer(size_t bytesPerFrame)
+    : bytesPerFrame(bytesPerFrame)
+{
+    // Loading tasks cannot query the context
+    gl::IsS3TCSupported();
+
+    pixelBuffers.resize(TEXTURE_STREAMING_PBO_COUNT);
+    for (PixelBuffer& pixelBuffer : pixelBuffers)
+    {
+        glGenBuffers(1, &pixelBuffer.buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer.buffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, TEXTURE_STREAMING_PBO_SIZE, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    // Loading tasks still running keep their request alive
+    for (PixelBuffer& pixelBuffer : pixelBuffers)
+    {
+        if (pixelBuffer.fence != nullptr)
+            glDeleteSync(pixelBuffer.fence);
+        glDeleteBuffers(1, &pixelBuffer.buffer);
+    }
+}
+
+GLuint TextureStreamer::Request(const char* file, TextureUsage usage, MipFilter mipFilter, bool flip, float4 placeholder)
+{
+    std::shared_ptr<StreamRequest> request = std::make_shared<StreamRequest>();
+    glGenTextures(1, &request->texture);
+    glBindTexture(GL_TEXTURE_2D, request->texture);
+    gl::UploadColoredTexture(placeholder.x, placeholder.y, placeholder.z, placeholder.w);
+    gl::SetTextureDefaultParams();
+
+    // Loads finished and released by every request are forgotten
+    for (auto it = loads.begin(); it != loads.end();)
+        it = it->second.expired() ? loads.erase(it) : std::next(it);
+
+    std::string filename = file;
+    std::string key = filename + '|' + std::to_string((int)usage) + '|' + std::to_string((int)mipFilter) + (flip ? "|flip" : "|noflip");
+    request->load = loads[key].lock();
+    if (request->load == nullptr)
+    {
+        std::shared_ptr<TextureLoad> load = std::make_shared<TextureLoad>();
+        jobs::Run([load, filename, usage, mipFilter, flip]()
+        {
+            load->failed = !gl::LoadTexture(&load->data, filename.c_str(), usage, mipFilter, flip);
+            load->loaded = true;
+        });
+        loads[key] = load;
+        request->load = load;
+    }
+
+    requests.push_back(request);
+    return request->texture;
+}
+
+void TextureStreamer::Release(GLuint texture)
+{
+    auto found = std::find_if(requests.begin(), requests.end(), [texture](const std::shared_ptr<StreamRequest>& r) { return r->texture == texture; });
+    if (found != requests.end())
+    {
+        if (current == found->get())
+            current = nullptr;
+        requests.erase(found);
+    }
+    glDeleteTextures(1, &texture);
+}
+
+TextureStreamer::StreamRequest* TextureStreamer::SelectRequest()
+{
+    if (current != nullptr)
+        return current;
+
+    // Failed loads keep their placeholder
+    requests.erase(std::remove_if(requests.begin(), requests.end(), [](const std::shared_ptr<StreamRequest>& request)
+    {
+        return request->load->loaded && request->load->failed;
+    }), requests.end());
+
+    StreamRequest* smallest = nullptr;
+    for (const std::shared_ptr<StreamRequest>& request : requests)
+    {
+        if (!request->load->loaded)
+            continue;
+
+        if (request->level < 0)
+            request->level = request->load->data.header.levelCount - 1;
+        if (smallest == nullptr || request->load->data.levels[request->level].size < smallest->load->data.levels[smallest->level].size)
+            smallest = request.get();
+    }
+    return smallest;
+}
+
+void TextureStreamer::FinishLevel(StreamRequest* request)
+{
+    // Sample every level uploaded so far (the placeholder is level 0 until it is replaced)
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, request->level);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, request->load->data.header.levelCount - 1);
+
+    current = nullptr;
+    request->row = 0;
+    if (--request->level >= 0)
+        return;
+
+    requests.erase(std::find_if(requests.begin(), requests.end(), [request](const std::shared_ptr<StreamRequest>& r) { return r.get() == request; }));
+}
+
+void TextureStreamer::Update()
+{
+    uploadedBytes = 0;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    while (uploadedBytes < bytesPerFrame)
+    {
+        StreamRequest* request = SelectRequest();
+        if (request == nullptr)
+            break;
+
+        const TextureData& data = request->load->data;
+        const TextureLevel& level = data.levels[request->level];
+        int rowAlignment = gl::GetTextureRowAlignment(data);
+        int rowGroupCount = (level.height + rowAlignment - 1) / rowAlignment;
+        size_t rowGroupSize = level.size / rowGroupCount;
+
+        glBindTexture(GL_TEXTURE_2D, request->texture);
+
+        // Rows too large for a pixel buffer (very wide uncompressed levels) are uploaded at once from client memory
+        if (rowGroupSize > TEXTURE_STREAMING_PBO_SIZE)
+        {
+            gl::UploadTextureLevel(data, request->level, &data.data[level.offset]);
+            uploadedBytes += level.size;
+            FinishLevel(request);
+            continue;
+        }
+
+        // The oldest buffer is reused once the GPU has read it, never wait for it
+        PixelBuffer& pixelBuffer = pixelBuffers[nextPixelBuffer];
+        if (pixelBuffer.fence != nullptr)
+        {
+            if (glClientWaitSync(pixelBuffer.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+                break;
+
+            glDeleteSync(pixelBuffer.fence);
+            pixelBuffer.fence = nullptr;
+        }
+
+        size_t budget = calc::Min(bytesPerFrame - uploadedBytes, (size_t)TEXTURE_STREAMING_PBO_SIZE);
+        int firstRowGroup = request->row / rowAlignment;
+        int rowGroups = calc::Clamp((int)(budget / rowGroupSize), 1, rowGroupCount - firstRowGroup);
+        size_t size = rowGroups * rowGroupSize;
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer.buffer);
+        void* mappedRows = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (mappedRows != nullptr)
+            memcpy(mappedRows, &data.data[level.offset + firstRowGroup * rowGroupSize], size);
+        if (mappedRows == nullptr || !gl::UnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            break; // Retried next frame
+        }
+
+        // Whole levels are specified from the buffer, larger ones are specified empty then filled by rows
+        if (rowGroups == rowGroupCount)
+        {
+            gl::UploadTextureLevel(data, request->level, nullptr);
+        }
+        else
+        {
+            if (request->row == 0)
+            {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                gl::UploadTextureLevel(data, request->level, nullptr);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer.buffer);
+            }
+            gl::UploadTextureRows(data, request->level, request->row, rowGroups * rowAlignment, nullptr);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        pixelBuffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        nextPixelBuffer = (nextPixelBuffer + 1) % (int)pixelBuffers.size();
+
+        uploadedBytes += size;
+        request->row += rowGroups * rowAlignment;
+        current = request;
+        if (request->row >= level.height)
+            FinishLevel(request);
+    }
+}
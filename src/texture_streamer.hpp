@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "types.hpp"
+#include "gl_helpers.hpp"
+
+// Bytes uploaded per frame by default
+#define TEXTURE_STREAMING_BUDGET (2 << 20)
+
+// Asynchronous texture loading: images are read (or decoded and cached, see gl::LoadTexture) on worker threads,
+// then uploaded through a ring of pixel buffer objects within a per frame byte budget
+// Requested textures sample a placeholder color until their smallest level arrives, then levels are swapped in from the smallest to the largest
+// Requests of the same image with the same settings while it is loading share one load
+// GL calls only happen in the constructor, the destructor, Request and Update, which must be called on the thread owning the context
+class TextureStreamer
+{
+public:
+    TextureStreamer(size_t bytesPerFrame = TEXTURE_STREAMING_BUDGET);
+    ~TextureStreamer();
+
+    // Return a new texture (with default sampling parameters) filled with the placeholder color until its levels are streamed in
+    // Textures are owned by the caller, failed loads keep the placeholder
+    GLuint Request(const char* file, TextureUsage usage = TextureUsage::LINEAR_COLOR, MipFilter mipFilter = MipFilter::KAISER, bool flip = true,
+                   float4 placeholder = { 0.5f, 0.5f, 0.5f, 1.f });
+
+    // Delete a requested texture, levels not uploaded yet are dropped (a running load finishes in the background)
+    void Release(GLuint texture);
+
+    // Upload decoded levels within the byte budget, call once per frame
+    void Update();
+
+    // Textures not fully uploaded yet
+    int GetPendingCount() const { return (int)requests.size(); }
+
+    // During the last Update()
+    size_t GetUploadedBytes() const { return uploadedBytes; }
+
+private:
+    struct TextureLoad
+    {
+        TextureData data;
+        bool failed = false;
+        std::atomic<bool> loaded = { false }; // Set by the worker once data (or failed) is written
+    };
+
+    struct StreamRequest
+    {
+        GLuint texture;
+        std::shared_ptr<TextureLoad> load; // Read only once loaded
+
+        int level = -1; // Next level to upload, from levelCount - 1 down to 0 (-1 until loaded)
+        int row = 0;    // Next row of this level
+    };
+
+    struct PixelBuffer
+    {
+        GLuint buffer = 0;
+        GLsync fence = nullptr; // Last upload reading the buffer
+    };
+
+    // Continue the current level, or start the smallest pending level of any loaded texture
+    StreamRequest* SelectRequest();
+
+    void FinishLevel(StreamRequest* request);
+
+    size_t bytesPerFrame;
+    size_t uploadedBytes = 0;
+
+    std::vector<std::shared_ptr<StreamRequest>> requests;
+    std::unordered_map<std::string, std::weak_ptr<TextureLoad>> loads; // By file and settings, shared with the loading tasks
+    StreamRequest* current = nullptr; // Request with a partially uploaded level
+
+    std::vector<PixelBuffer> pixelBuffers;
+    int nextPixelBuffer = 0;
+};
@@ -6,6 +6,11 @@
 
 union float2
 {
+    float2() = default;
+    constexpr float2(float x, float y)
+        : x(x), y(y)
+    {}
+
     float e[2];
     struct { float x; float y; };
     struct { float u; float v; };
@@ -14,11 +19,11 @@ union float2
 union float3
 {
     float3() = default;
-    float3(float x, float y, float z)
+    constexpr float3(float x, float y, float z)
         : x(x), y(y), z(z)
     {}
 
-    float3(float2 xy, float z)
+    constexpr float3(float2 xy, float z)
         : x(xy.x), y(xy.y), z(z)
     {}
 
@@ -31,15 +36,15 @@ union float3
 union float4
 {
     float4() = default;
-    float4(float x, float y, float z, float w)
+    constexpr float4(float x, float y, float z, float w)
         : x(x), y(y), z(z), w(w)
     {}
 
-    float4(float3 xyz, float w)
+    constexpr float4(float3 xyz, float w)
         : x(xyz.x), y(xyz.y), z(xyz.z), w(w)
     {}
 
-    float4(float2 xy, float z, float w)
+    constexpr float4(float2 xy, float z, float w)
         : x(xy.x), y(xy.y), z(z), w(w)
     {}
 
@@ -63,3 +68,39 @@ union mat3
     float e[9];
     float3 c[3];
 };
+
+// 16 bytes aligned variants (allow aligned SIMD loads/stores, see calc_simd.hpp)
+union alignas(16) float4a
+{
+    float4a() = default;
+    float4a(float4 v)
+        : v(v)
+    {}
+
+    operator float4() const { return v; }
+
+    float4 v;
+    float e[4];
+};
+
+union alignas(16) mat4a
+{
+    mat4a() = default;
+    mat4a(const mat4& m)
+        : m(m)
+    {}
+
+    operator const mat4&() const { return m; }
+
+    mat4 m;
+    float e[16];
+    float4 c[4];
+};
+
+// Points origin + t * direction for 0 <= t <= maxDistance, distances are in units of direction
+struct Ray
+{
+    float3 origin;
+    float3 direction;
+    float maxDistance;
+};
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "calc.hpp"
+#include "calc_pack.hpp"
+#include "mesh_builder.hpp"
+
+// Vertex structs declare their attributes once with a static Reflect function:
+//
+//   struct Vertex
+//   {
+//       float3 position;
+//       uint32_t normal;
+//
+//       template <typename F>
+//       static void Reflect(F&& f)
+//       {
+//           f(VertexAttrib<VertexAttribute::POSITION, VertexFormat::FLOAT>{ 0 }, &Vertex::position);
+//           f(VertexAttrib<VertexAttribute::NORMAL, VertexFormat::SNORM_10_10_10_2>{ 1 }, &Vertex::normal);
+//       }
+//   };
+//
+// GetVertexLayout<Vertex>() gives the MeshBuilder descriptor and a conversion where every format is known at compile time,
+// gl::SetVertexLayout<Vertex>() describes the bound buffer to the vertex array from the same declaration
+
+enum class VertexAttribute : int
+{
+    POSITION,
+    NORMAL,
+    UV,
+    COLOR,
+    TANGENT,
+};
+
+// Components read by the shader
+constexpr int GetVertexAttributeSize(VertexAttribute attribute)
+{
+    return attribute == VertexAttribute::UV ? 2 : (attribute == VertexAttribute::POSITION || attribute == VertexAttribute::NORMAL) ? 3 : 4;
+}
+
+template <VertexAttribute Attribute, VertexFormat Format>
+struct VertexAttrib
+{
+    int location; // Shader input location
+
+    static constexpr VertexAttribute attribute() { return Attribute; }
+    static constexpr VertexFormat format() { return Format; }
+};
+
+namespace vertex_layout
+{
+    template <VertexFormat Format>
+    using FormatTag = std::integral_constant<VertexFormat, Format>;
+
+    // Members can be arrays or float2/3/4, unused components (padding) are zeroed
+    template <int Components, typename Element, typename T, typename Pack>
+    inline void StoreComponents(T& dst, const float4& value, Pack pack)
+    {
+        constexpr int storedCount = (int)(sizeof(T) / sizeof(Element));
+        static_assert(storedCount >= Components, "Vertex member too small for its attribute");
+
+        Element packed[storedCount];
+        for (int c = 0; c < storedCount; ++c)
+            packed[c] = c < Components ? pack(value.e[c]) : Element(0);
+        memcpy(&dst, packed, sizeof(packed));
+    }
+
+    template <int Components, typename T>
+    inline void Store(FormatTag<VertexFormat::FLOAT>, T& dst, const float4& value)
+    {
+        StoreComponents<Components, float>(dst, value, [](float v) { return v; });
+    }
+
+    template <int Components, typename T>
+    inline void Store(FormatTag<VertexFormat::HALF>, T& dst, const float4& value)
+    {
+        StoreComponents<Components, uint16_t>(dst, value, calc::pack::FloatToHalf);
+    }
+
+    template <int Components, typename T>
+    inline void Store(FormatTag<VertexFormat::SNORM16>, T& dst, const float4& value)
+    {
+        StoreComponents<Components, int16_t>(dst, value, calc::pack::FloatToSnorm16);
+    }
+
+    template <int Components, typename T>
+    inline void Store(FormatTag<VertexFormat::UNORM16>, T& dst, const float4& value)
+    {
+        StoreComponents<Components, uint16_t>(dst, value, calc::pack::FloatToUnorm16);
+    }
+
+    template <int Components, typename T>
+    inline void Store(FormatTag<VertexFormat::UNORM8>, T& dst, const float4& value)
+    {
+        StoreComponents<Components, uint8_t>(dst, value, calc::pack::FloatToUnorm8);
+    }
+
+    template <int Components, typename T>
+    inline void Store(FormatTag<VertexFormat::OCT16>, T& dst, const float4& value)
+    {
+        static_assert(sizeof(T) == 4, "OCT16 members are 2 x int16_t");
+        float2 e = calc::pack::OctEncode(value.xyz);
+        int16_t packed[2] = { calc::pack::FloatToSnorm16(e.x), calc::pack::FloatToSnorm16(e.y) };
+        memcpy(&dst, packed, sizeof(packed));
+    }
+
+    template <int Components, typename T>
+    inline void Store(FormatTag<VertexFormat::SNORM_10_10_10_2>, T& dst, const float4& value)
+    {
+        static_assert(sizeof(T) == 4, "SNORM_10_10_10_2 members are uint32_t");
+        uint32_t packed = calc::pack::FloatToSnorm1010102(value);
+        memcpy(&dst, &packed, sizeof(packed));
+    }
+
+    // Positions are quantized relative to the slice bounds (see GetDequantizeMatrix)
+    struct Context
+    {
+        float3 center;
+        float3 inverseScale;
+    };
+
+    template <VertexFormat Format>
+    inline float4 Load(std::integral_constant<VertexAttribute, VertexAttribute::POSITION>, const FullVertex& v, const Context& context)
+    {
+        return float4(Format == VertexFormat::SNORM16 ? (v.position - context.center) * context.inverseScale : v.position, 1.f);
+    }
+
+    template <VertexFormat Format>
+    inline float4 Load(std::integral_constant<VertexAttribute, VertexAttribute::NORMAL>, const FullVertex& v, const Context&)
+    {
+        return float4(v.normal, 0.f);
+    }
+
+    template <VertexFormat Format>
+    inline float4 Load(std::integral_constant<VertexAttribute, VertexAttribute::UV>, const FullVertex& v, const Context&)
+    {
+        return float4(v.uv, 0.f, 0.f);
+    }
+
+    template <VertexFormat Format>
+    inline float4 Load(std::integral_constant<VertexAttribute, VertexAttribute::COLOR>, const FullVertex& v, const Context&)
+    {
+        return v.color;
+    }
+
+    template <VertexFormat Format>
+    inline float4 Load(std::integral_constant<VertexAttribute, VertexAttribute::TANGENT>, const FullVertex& v, const Context&)
+    {
+        return v.tangent;
+    }
+
+    template <typename V, typename Member>
+    inline int GetOffset(Member V::* member)
+    {
+        V probe = {};
+        return (int)((const unsigned char*)&(probe.*member) - (const unsigned char*)&probe);
+    }
+
+    // Each vertex is built in registers then written whole, destinations can be write combined memory
+    template <typename V>
+    void ConvertVertices(void* dst, const FullVertex* src, int count, const Bounds& bounds)
+    {
+        Context context;
+        context.center = bounds.center;
+        context.inverseScale = float3{ 1.f, 1.f, 1.f } / GetQuantizationScale(bounds);
+
+        V* vertices = (V*)dst;
+        for (int i = 0; i < count; ++i)
+        {
+            V vertex = {};
+            const FullVertex& full = src[i];
+            V::Reflect([&vertex, &full, &context](auto attrib, auto member)
+            {
+                constexpr VertexAttribute attribute = decltype(attrib)::attribute();
+                constexpr VertexFormat format = decltype(attrib)::format();
+                float4 value = Load<format>(std::integral_constant<VertexAttribute, attribute>(), full, context);
+                Store<GetVertexAttributeSize(attribute)>(FormatTag<format>(), vertex.*member, value);
+            });
+            vertices[i] = vertex;
+        }
+    }
+}
+
+template <typename V>
+VertexDescriptor GetVertexDescriptor()
+{
+    // Zeroed padding, descriptors can be compared with memcmp
+    VertexDescriptor descriptor;
+    memset(&descriptor, 0, sizeof(descriptor));
+    descriptor.size = sizeof(V);
+
+    V::Reflect([&descriptor](auto attrib, auto member)
+    {
+        int offset = vertex_layout::GetOffset(member);
+        switch (attrib.attribute())
+        {
+        case VertexAttribute::POSITION: descriptor.positionOffset = offset; descriptor.positionFormat = attrib.format(); break;
+        case VertexAttribute::NORMAL:   descriptor.hasNormal  = true; descriptor.normalOffset  = offset; descriptor.normalFormat  = attrib.format(); break;
+        case VertexAttribute::UV:       descriptor.hasUV      = true; descriptor.uvOffset      = offset; descriptor.uvFormat      = attrib.format(); break;
+        case VertexAttribute::COLOR:    descriptor.hasColor   = true; descriptor.colorOffset   = offset; descriptor.colorFormat   = attrib.format(); break;
+        case VertexAttribute::TANGENT:  descriptor.hasTangent = true; descriptor.tangentOffset = offset; descriptor.tangentFormat = attrib.format(); break;
+        }
+    });
+
+    return descriptor;
+}
+
+template <typename V>
+VertexLayout GetVertexLayout()
+{
+    return VertexLayout(GetVertexDescriptor<V>(), &vertex_layout::ConvertVertices<V>);
+}
@@ -0,0 +1,571 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "calc.hpp"
+#include "gl_helpers.hpp"
+
+#include "virtual_texture.hpp"
+
+// Bump the version when the tiled layout changes, outdated files are rebuilt
+#define VT_FILE_VERSION 1
+
+// Feedback readbacks in flight, frames are dropped when the GPU is further behind
+#define VT_FEEDBACK_READBACKS 3
+
+// Feedback texels store tile coordinates and cache slots on 8 bits
+#define VT_MAX_TILES 256
+
+const char* VIRTUAL_TEXTURE_GLSL = R"GLSL(
+uniform sampler2D vtPageTable; // RGBA8 per tile and level: cache slot xy, resident level
+uniform sampler2D vtTileCache; // Tiles with borders, bilinear
+uniform vec2 vtSize;           // Level 0 texels
+uniform float vtMaxLevel;
+uniform float vtTileSize;
+uniform float vtTileBorder;
+uniform float vtLevelBias;
+uniform float vtId;
+
+// Level from the screen space derivatives, rounded to the nearest one (no filtering between levels)
+float GetVirtualLevel(vec2 uv)
+{
+    vec2 dx = dFdx(uv * vtSize);
+    vec2 dy = dFdy(uv * vtSize);
+    float level = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)) + vtLevelBias;
+    return clamp(floor(level + 0.5), 0.0, vtMaxLevel);
+}
+
+// Rounded down like the CPU mip chain
+vec2 GetVirtualLevelSize(float level)
+{
+    return max(floor(vtSize / exp2(level)), vec2(1.0));
+}
+
+vec4 SampleVirtualTexture(vec2 uv)
+{
+    uv = clamp(uv, 0.0, 1.0);
+    float level = GetVirtualLevel(uv);
+    vec2 levelSize = GetVirtualLevelSize(level);
+    ivec2 page = ivec2(min(uv * levelSize, levelSize - 1.0) / vtTileSize);
+    vec3 entry = floor(texelFetch(vtPageTable, page, int(level)).xyz * 255.0 + 0.5);
+
+    // The resident tile is the requested one or a coarser ancestor, both cover uv
+    vec2 residentSize = GetVirtualLevelSize(entry.z);
+    vec2 texel = uv * residentSize;
+    vec2 tileOrigin = floor(min(texel, residentSize - 1.0) / vtTileSize) * vtTileSize;
+    vec2 cacheTexel = entry.xy * (vtTileSize + 2.0 * vtTileBorder) + vtTileBorder + (texel - tileOrigin);
+    return textureLod(vtTileCache, cacheTexel / vec2(textureSize(vtTileCache, 0)), 0.0);
+}
+
+vec4 VirtualTextureFeedback(vec2 uv)
+{
+    uv = clamp(uv, 0.0, 1.0);
+    float level = GetVirtualLevel(uv);
+    vec2 levelSize = GetVirtualLevelSize(level);
+    vec2 page = floor(min(uv * levelSize, levelSize - 1.0) / vtTileSize);
+    return vec4(page, level, vtId) / 255.0;
+}
+)GLSL";
+
+static std::string GetTiledFileName(const char* filename)
+{
+    return std::string(filename) + ".vtex.cache";
+}
+
+static bool OpenTiledFile(MappedFile* file, const char* tiledFilename, VirtualTextureHeader* header, std::vector<VirtualTextureLevel>* levels)
+{
+    if (!file->Open(tiledFilename) || file->Size() < sizeof(VirtualTextureHeader))
+    {
+        file->Close();
+        return false;
+    }
+
+    memcpy(header, file->Data(), sizeof(VirtualTextureHeader));
+    bool valid = memcmp(header->magic, "VTEX", 4) == 0
+              && header->version == VT_FILE_VERSION
+              && header->tileSize == VT_TILE_SIZE
+              && header->tileBorder == VT_TILE_BORDER
+              && header->levelCount > 0 && header->levelCount <= 32
+              && gl::IsFormatSupported(header->internalFormat); // Rebuilt uncompressed on drivers without S3TC
+
+    size_t levelsSize = header->levelCount * sizeof(VirtualTextureLevel);
+    valid = valid && file->Size() == sizeof(VirtualTextureHeader) + levelsSize + (size_t)header->tileCount * header->tileBytes;
+    if (valid)
+    {
+        levels->resize(header->levelCount);
+        memcpy(levels->data(), file->Data() + sizeof(VirtualTextureHeader), levelsSize);
+    }
+    else
+    {
+        // Unmapped so the rebuilt file can replace it
+        file->Close();
+        printf("Virtual texture outdated: %s\n", tiledFilename);
+    }
+    return valid;
+}
+
+// Cut the mip chain of an image into tiles with borders, blocks (or texels) outside a level repeat its edges
+// Compressed blocks are copied as is
+static bool BuildTiledFile(const char* filename, const char* tiledFilename)
+{
+    TextureData texture;
+    if (!gl::LoadTexture(&texture, filename, TextureUsage::LINEAR_COLOR))
+        return false;
+
+    VirtualTextureHeader header = {};
+    memcpy(header.magic, "VTEX", 4);
+    header.version        = VT_FILE_VERSION;
+    header.internalFormat = texture.header.internalFormat;
+    header.format         = texture.header.format;
+    header.type           = texture.header.type;
+    header.width          = texture.header.width;
+    header.height         = texture.header.height;
+    header.tileSize       = VT_TILE_SIZE;
+    header.tileBorder     = VT_TILE_BORDER;
+
+    std::vector<VirtualTextureLevel> levels;
+    for (int l = 0; l < texture.header.levelCount; ++l)
+    {
+        const TextureLevel& textureLevel = texture.levels[l];
+        VirtualTextureLevel level = { textureLevel.width, textureLevel.height,
+            (textureLevel.width + VT_TILE_SIZE - 1) / VT_TILE_SIZE, (textureLevel.height + VT_TILE_SIZE - 1) / VT_TILE_SIZE, header.tileCount };
+        levels.push_back(level);
+        header.tileCount += level.tilesX * level.tilesY;
+        if (level.tilesX == 1 && level.tilesY == 1)
+            break;
+    }
+    header.levelCount = (int)levels.size();
+
+    if (levels[0].tilesX > VT_MAX_TILES || levels[0].tilesY > VT_MAX_TILES)
+    {
+        fprintf(stderr, "Virtual texture '%s' is too large (%dx%d tiles, at most %d per side)\n", filename, levels[0].tilesX, levels[0].tilesY, VT_MAX_TILES);
+        return false;
+    }
+
+    // Units are 4x4 blocks or texels, the border is a whole number of units
+    int unit = gl::GetTextureRowAlignment(texture);
+    int slotUnits = (VT_TILE_SIZE + 2 * VT_TILE_BORDER) / unit;
+    int unitBytes = (int)(texture.levels[0].size / (((texture.levels[0].width + unit - 1) / unit) * ((texture.levels[0].height + unit - 1) / unit)));
+    header.tileBytes = slotUnits * slotUnits * unitBytes;
+
+    // Written next to the tiled file then moved over it, an interrupted build never leaves a truncated file behind
+    std::string tempFilename = std::string(tiledFilename) + ".tmp";
+    FILE* file = fopen(tempFilename.c_str(), "wb");
+    if (file == nullptr)
+        return false;
+
+    bool written = fwrite(&header, sizeof(VirtualTextureHeader), 1, file) == 1
+                && fwrite(levels.data(), sizeof(VirtualTextureLevel), levels.size(), file) == levels.size();
+
+    std::vector<unsigned char> tile(header.tileBytes);
+    for (int l = 0; l < header.levelCount && written; ++l)
+    {
+        const TextureLevel& textureLevel = texture.levels[l];
+        const unsigned char* levelData = &texture.data[textureLevel.offset];
+        int unitsX = (textureLevel.width + unit - 1) / unit;
+        int unitsY = (textureLevel.height + unit - 1) / unit;
+        for (int ty = 0; ty < levels[l].tilesY; ++ty)
+        {
+            for (int tx = 0; tx < levels[l].tilesX; ++tx)
+            {
+                int firstX = (tx * VT_TILE_SIZE - VT_TILE_BORDER) / unit;
+                int firstY = (ty * VT_TILE_SIZE - VT_TILE_BORDER) / unit;
+                for (int y = 0; y < slotUnits; ++y)
+                {
+                    int sourceY = calc::Clamp(firstY + y, 0, unitsY - 1);
+                    for (int x = 0; x < slotUnits; ++x)
+                    {
+                        int sourceX = calc::Clamp(firstX + x, 0, unitsX - 1);
+                        memcpy(&tile[(y * slotUnits + x) * unitBytes], levelData + ((size_t)sourceY * unitsX + sourceX) * unitBytes, unitBytes);
+                    }
+                }
+                written &= fwrite(tile.data(), 1, tile.size(), file) == tile.size();
+            }
+        }
+    }
+    written &= fclose(file) == 0;
+
+    if (!written || !MoveFileOver(tempFilename.c_str(), tiledFilename))
+    {
+        fprintf(stderr, "Virtual texture '%s' could not be saved to %s\n", filename, tiledFilename);
+        remove(tempFilename.c_str());
+        return false;
+    }
+
+    printf("Virtual texture saved: %s (%d tiles of %d bytes, %d levels)\n", filename, header.tileCount, header.tileBytes, header.levelCount);
+    return true;
+}
+
+VirtualTexture::VirtualTexture(const char* file, int id, int cacheTiles)
+    : id(id), cacheTiles(calc::Clamp(cacheTiles, 1, VT_MAX_TILES))
+{
+    std::string tiledFilename = GetTiledFileName(file);
+    if (!OpenTiledFile(&tiledFile, tiledFilename.c_str(), &header, &levels))
+    {
+        tiledFile.Close();
+        if (!BuildTiledFile(file, tiledFilename.c_str()) || !OpenTiledFile(&tiledFile, tiledFilename.c_str(), &header, &levels))
+        {
+            fprintf(stderr, "Virtual texture '%s' could not be loaded\n", file);
+            return;
+        }
+    }
+    tiles = tiledFile.Data() + sizeof(VirtualTextureHeader) + header.levelCount * sizeof(VirtualTextureLevel);
+
+    // Levels of the page table follow the GL mip chain of the next power of two tile counts, the tiles of every level fit in it
+    int pageWidth = 1;
+    int pageHeight = 1;
+    while (pageWidth < levels[0].tilesX)
+        pageWidth *= 2;
+    while (pageHeight < levels[0].tilesY)
+        pageHeight *= 2;
+
+    glGenTextures(1, &pageTable);
+    glBindTexture(GL_TEXTURE_2D, pageTable);
+    for (int l = 0; l < header.levelCount; ++l)
+        glTexImage2D(GL_TEXTURE_2D, l, GL_RGBA8, calc::Max(pageWidth >> l, 1), calc::Max(pageHeight >> l, 1), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header.levelCount - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    // Cache slots are whole tiles with their borders, compressed tiles fill whole blocks
+    int cacheSize = this->cacheTiles * (header.tileSize + 2 * header.tileBorder);
+    glGenTextures(1, &tileCache);
+    glBindTexture(GL_TEXTURE_2D, tileCache);
+    if (gl::IsCompressedFormat(header.internalFormat))
+        glCompressedTexImage2D(GL_TEXTURE_2D, 0, header.internalFormat, cacheSize, cacheSize, 0, this->cacheTiles * this->cacheTiles * header.tileBytes, nullptr);
+    else
+        glTexImage2D(GL_TEXTURE_2D, 0, header.internalFormat, cacheSize, cacheSize, 0, header.format, header.type, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    slots.resize(this->cacheTiles * this->cacheTiles);
+    tileSlots.assign(header.tileCount, -1);
+    tileFrames.assign(header.tileCount, -1);
+    pageEntries.resize(header.tileCount * 4);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    LoadTile(header.tileCount - 1, 0);
+    UpdatePageTable();
+
+    printf("Virtual texture: %s (%dx%d, %d tiles, %d cache slots)\n", file, header.width, header.height, header.tileCount, (int)slots.size());
+}
+
+VirtualTexture::~VirtualTexture()
+{
+    glDeleteTextures(1, &pageTable);
+    glDeleteTextures(1, &tileCache);
+}
+
+int VirtualTexture::GetTileLevel(int tile) const
+{
+    int level = header.levelCount - 1;
+    while (tile < levels[level].firstTile)
+        --level;
+    return level;
+}
+
+int VirtualTexture::GetParentTile(int tile) const
+{
+    int level = GetTileLevel(tile);
+    if (level == header.levelCount - 1)
+        return -1;
+
+    // Texels of the next level are halved, so are the tile coordinates
+    const VirtualTextureLevel& child = levels[level];
+    const VirtualTextureLevel& parent = levels[level + 1];
+    int x = (tile - child.firstTile) % child.tilesX;
+    int y = (tile - child.firstTile) / child.tilesX;
+    return parent.firstTile + calc::Min(y / 2, parent.tilesY - 1) * parent.tilesX + calc::Min(x / 2, parent.tilesX - 1);
+}
+
+void VirtualTexture::LoadTile(int tile, int slot)
+{
+    int slotSize = header.tileSize + 2 * header.tileBorder;
+    int x = (slot % cacheTiles) * slotSize;
+    int y = (slot / cacheTiles) * slotSize;
+    const unsigned char* data = tiles + (size_t)tile * header.tileBytes;
+
+    glBindTexture(GL_TEXTURE_2D, tileCache);
+    if (gl::IsCompressedFormat(header.internalFormat))
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, x, y, slotSize, slotSize, header.internalFormat, header.tileBytes, data);
+    else
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, slotSize, slotSize, header.format, header.type, data);
+
+    CacheSlot& cacheSlot = slots[slot];
+    if (cacheSlot.tile >= 0)
+        tileSlots[cacheSlot.tile] = -1;
+    else
+        residentCount++;
+
+    cacheSlot.tile = tile;
+    cacheSlot.lastUsed = frame;
+    tileSlots[tile] = slot;
+    pageTableDirty = true;
+}
+
+void VirtualTexture::UpdatePageTable()
+{
+    // Coarsest level first, tiles not resident use the entry of their parent
+    for (int l = header.levelCount - 1; l >= 0; --l)
+    {
+        const VirtualTextureLevel& level = levels[l];
+        for (int tile = level.firstTile; tile < level.firstTile + level.tilesX * level.tilesY; ++tile)
+        {
+            int slot = tileSlots[tile];
+            unsigned char* entry = &pageEntries[tile * 4];
+            if (slot < 0)
+            {
+                memcpy(entry, &pageEntries[GetParentTile(tile) * 4], 4);
+                continue;
+            }
+
+            entry[0] = (unsigned char)(slot % cacheTiles);
+            entry[1] = (unsigned char)(slot / cacheTiles);
+            entry[2] = (unsigned char)l;
+            entry[3] = 255;
+        }
+    }
+
+    glBindTexture(GL_TEXTURE_2D, pageTable);
+    for (int l = 0; l < header.levelCount; ++l)
+        glTexSubImage2D(GL_TEXTURE_2D, l, 0, 0, levels[l].tilesX, levels[l].tilesY, GL_RGBA, GL_UNSIGNED_BYTE, &pageEntries[levels[l].firstTile * 4]);
+    pageTableDirty = false;
+}
+
+void VirtualTexture::Bind(GLuint program, int textureUnit, float levelBias) const
+{
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    glBindTexture(GL_TEXTURE_2D, pageTable);
+    glActiveTexture(GL_TEXTURE0 + textureUnit + 1);
+    glBindTexture(GL_TEXTURE_2D, tileCache);
+    glActiveTexture(GL_TEXTURE0);
+
+    glUniform1i(glGetUniformLocation(program, "vtPageTable"), textureUnit);
+    glUniform1i(glGetUniformLocation(program, "vtTileCache"), textureUnit + 1);
+    glUniform2f(glGetUniformLocation(program, "vtSize"), (float)header.width, (float)header.height);
+    glUniform1f(glGetUniformLocation(program, "vtMaxLevel"), (float)(header.levelCount - 1));
+    glUniform1f(glGetUniformLocation(program, "vtTileSize"), (float)header.tileSize);
+    glUniform1f(glGetUniformLocation(program, "vtTileBorder"), (float)header.tileBorder);
+    glUniform1f(glGetUniformLocation(program, "vtLevelBias"), levelBias);
+    glUniform1f(glGetUniformLocation(program, "vtId"), (float)id);
+}
+
+void VirtualTexture::AddFeedback(const unsigned char* texels, int texelCount)
+{
+    if (!IsLoaded())
+        return;
+
+    int previousTile = -1;
+    for (int i = 0; i < texelCount; ++i)
+    {
+        const unsigned char* texel = &texels[i * 4];
+        if (texel[3] != id || texel[2] >= header.levelCount)
+            continue;
+
+        const VirtualTextureLevel& level = levels[texel[2]];
+        if (texel[0] >= level.tilesX || texel[1] >= level.tilesY)
+            continue;
+
+        // Neighbor pixels mostly need the same tile, duplicates are skipped by Update
+        int tile = level.firstTile + texel[1] * level.tilesX + texel[0];
+        if (tile != previousTile)
+            requests.push_back(tile);
+        previousTile = tile;
+    }
+}
+
+void VirtualTexture::Update(int tilesPerFrame)
+{
+    loadedCount = 0;
+    if (!IsLoaded())
+        return;
+
+    // New feedback: requested tiles and their ancestors (the fallbacks of missing tiles) are marked used
+    if (!requests.empty())
+    {
+        frame++;
+        requestedCount = 0;
+        pendingTiles.clear();
+        for (int tile : requests)
+        {
+            for (int t = tile; t >= 0 && tileFrames[t] != frame; t = GetParentTile(t))
+            {
+                tileFrames[t] = frame;
+                requestedCount++;
+                if (tileSlots[t] >= 0)
+                    slots[tileSlots[t]].lastUsed = frame;
+                else
+                    pendingTiles.push_back(t);
+            }
+        }
+        requests.clear();
+
+        // Coarse tiles first, they cover more of the screen and are the fallbacks of finer ones
+        std::stable_sort(pendingTiles.begin(), pendingTiles.end(), [this](int a, int b) { return GetTileLevel(a) > GetTileLevel(b); });
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    int loaded = 0;
+    for (; loaded < (int)pendingTiles.size() && loadedCount < tilesPerFrame; ++loaded)
+    {
+        int tile = pendingTiles[loaded];
+        if (tileSlots[tile] >= 0)
+            continue;
+
+        // A free slot, or the least recently used one not needed by the last feedback
+        int slot = -1;
+        int oldestFrame = frame;
+        for (int s = 1; s < (int)slots.size(); ++s)
+        {
+            if (slots[s].tile < 0)
+            {
+                slot = s;
+                break;
+            }
+
+            if (slots[s].lastUsed < oldestFrame)
+            {
+                slot = s;
+                oldestFrame = slots[s].lastUsed;
+            }
+        }
+
+        // The view needs more tiles than the cache holds, finer tiles stay missing and their ancestors are sampled
+        if (slot < 0)
+            break;
+
+        LoadTile(tile, slot);
+        loadedCount++;
+    }
+    pendingTiles.erase(pendingTiles.begin(), pendingTiles.begin() + loaded);
+
+    if (pageTableDirty)
+        UpdatePageTable();
+}
+
+VirtualTextureFeedback::VirtualTextureFeedback(int downscale)
+    : downscale(calc::Max(downscale, 1))
+{
+    readbacks.resize(VT_FEEDBACK_READBACKS);
+    for (Readback& readback : readbacks)
+        glGenBuffers(1, &readback.buffer);
+}
+
+VirtualTextureFeedback::~VirtualTextureFeedback()
+{
+    for (Readback& readback : readbacks)
+    {
+        if (readback.fence != nullptr)
+            glDeleteSync(readback.fence);
+        glDeleteBuffers(1, &readback.buffer);
+    }
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteTextures(1, &colorTexture);
+    glDeleteRenderbuffers(1, &depthRenderbuffer);
+}
+
+float VirtualTextureFeedback::GetLevelBias() const
+{
+    return -std::log2((float)downscale);
+}
+
+void VirtualTextureFeedback::Begin(int windowWidth, int windowHeight)
+{
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, previousClearColor);
+
+    int newWidth = calc::Max(windowWidth / downscale, 1);
+    int newHeight = calc::Max(windowHeight / downscale, 1);
+    if (framebuffer == 0 || newWidth != width || newHeight != height)
+    {
+        width = newWidth;
+        height = newHeight;
+        if (framebuffer == 0)
+        {
+            glGenFramebuffers(1, &framebuffer);
+            glGenTextures(1, &colorTexture);
+            glGenRenderbuffers(1, &depthRenderbuffer);
+        }
+
+        // Texels hold tile coordinates, never filtered
+        glBindTexture(GL_TEXTURE_2D, colorTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+    }
+
+    // Alpha 0 matches no texture
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, width, height);
+    glClearColor(0.f, 0.f, 0.f, 0.f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void VirtualTextureFeedback::End()
+{
+    // Skipped while the oldest readback is still pending
+    Readback& readback = readbacks[nextReadback];
+    if (readback.fence == nullptr)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+        if (readback.width != width || readback.height != height)
+        {
+            readback.width = width;
+            readback.height = height;
+            glBufferData(GL_PIXEL_PACK_BUFFER, width * height * 4, nullptr, GL_STREAM_READ);
+        }
+
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        nextReadback = (nextReadback + 1) % (int)readbacks.size();
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+    glClearColor(previousClearColor[0], previousClearColor[1], previousClearColor[2], previousClearColor[3]);
+}
+
+void VirtualTextureFeedback::Resolve(VirtualTexture* const* textures, int textureCount)
+{
+    // Oldest first, later readbacks cannot be complete if an earlier one is not
+    for (int i = 0; i < (int)readbacks.size(); ++i)
+    {
+        Readback& readback = readbacks[(nextReadback + i) % readbacks.size()];
+        if (readback.fence == nullptr)
+            continue;
+
+        if (glClientWaitSync(readback.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+            break;
+
+        glDeleteSync(readback.fence);
+        readback.fence = nullptr;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+        int texelCount = readback.width * readback.height;
+        const unsigned char* texels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, texelCount * 4, GL_MAP_READ_BIT);
+        if (texels != nullptr)
+        {
+            for (int t = 0; t < textureCount; ++t)
+                textures[t]->AddFeedback(texels, texelCount);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+}
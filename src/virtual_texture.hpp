@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "glad/glad.h"
+
+#include "mapped_file.hpp"
+
+// Texels per tile side, without borders (multiple of 4 for block compressed tiles)
+#define VT_TILE_SIZE 128
+
+// Texels repeated around each tile for bilinear filtering, one block so that compressed tiles are cut without re-encoding
+#define VT_TILE_BORDER 4
+
+// Physical tile cache size, in tiles per side
+#define VT_CACHE_TILES 16
+
+// Tiles read from disk and uploaded per frame by default
+#define VT_TILES_PER_FRAME 16
+
+// Feedback buffer resolution divisor
+#define VT_FEEDBACK_DOWNSCALE 8
+
+// Tiled file header, then levelCount VirtualTextureLevel and tileCount tiles of tileBytes each
+// Tiles are stored level by level in row major order, in the GPU format of the source texture (see gl::LoadTexture)
+struct VirtualTextureHeader
+{
+    char     magic[4]; // "VTEX"
+    uint32_t version;
+    uint32_t internalFormat;
+    uint32_t format;
+    uint32_t type;
+    int32_t  width;  // Level 0 texels
+    int32_t  height;
+    int32_t  tileSize;
+    int32_t  tileBorder;
+    int32_t  tileBytes;
+    int32_t  levelCount; // Down to the first level made of a single tile
+    int32_t  tileCount;
+};
+
+struct VirtualTextureLevel
+{
+    int32_t width;
+    int32_t height;
+    int32_t tilesX;
+    int32_t tilesY;
+    int32_t firstTile;
+};
+
+// GLSL functions using the uniforms set by VirtualTexture::Bind, add to fragment shader sources:
+//   vec4 SampleVirtualTexture(vec2 uv)   bilinear sample of the most detailed resident tile (uv clamped to [0, 1])
+//   vec4 VirtualTextureFeedback(vec2 uv) tile needed at uv, output of the feedback pass
+extern const char* VIRTUAL_TEXTURE_GLSL;
+
+// Texture much larger than the memory it uses: only the tiles seen by the camera are kept in a physical tile cache texture
+// A page table texture (one texel per tile and level) gives the cache slot of each tile, or of its closest resident ancestor
+// Tiles requested by the feedback pass are read from a tiled file and the least recently used ones are evicted
+// The coarsest level is a single tile always resident, so every texel has a fallback
+class VirtualTexture
+{
+public:
+    // Open the tiled file next to the image, built from the cached mip chain on first use
+    // id (1 to 255) tells the textures apart in the feedback buffer
+    VirtualTexture(const char* file, int id = 1, int cacheTiles = VT_CACHE_TILES);
+    ~VirtualTexture();
+
+    VirtualTexture(const VirtualTexture&) = delete;
+    VirtualTexture& operator=(const VirtualTexture&) = delete;
+
+    bool IsLoaded() const { return pageTable != 0; }
+
+    // Bind the page table to textureUnit and the tile cache to textureUnit + 1 and set the uniforms of the current program
+    // levelBias is added to the sampled level (see VirtualTextureFeedback::GetLevelBias)
+    void Bind(GLuint program, int textureUnit, float levelBias = 0.f) const;
+
+    // Texels of a feedback buffer (RGBA8 written by VirtualTextureFeedback()), texels of other textures are ignored
+    void AddFeedback(const unsigned char* texels, int texelCount);
+
+    // Load the tiles requested since the last call (coarsest first, at most tilesPerFrame) then update the page table
+    // Tiles not requested by the last feedback are evicted first, call once per frame
+    void Update(int tilesPerFrame = VT_TILES_PER_FRAME);
+
+    const VirtualTextureHeader& GetHeader() const { return header; }
+    GLuint GetTileCache() const { return tileCache; }
+
+    int GetSlotCount() const { return (int)slots.size(); }
+    int GetResidentCount() const { return residentCount; }
+    int GetRequestedCount() const { return requestedCount; }         // Tiles and ancestors seen by the last feedback
+    int GetMissingCount() const { return (int)pendingTiles.size(); } // Requested but not resident after the last update
+    int GetLoadedCount() const { return loadedCount; }               // During the last update
+
+private:
+    struct CacheSlot
+    {
+        int tile = -1;     // Resident tile, -1 if free
+        int lastUsed = -1; // Frame of the last request
+    };
+
+    int GetTileLevel(int tile) const;
+    int GetParentTile(int tile) const; // -1 for the coarsest level
+    void LoadTile(int tile, int slot);
+    void UpdatePageTable();
+
+    MappedFile tiledFile;
+    VirtualTextureHeader header = {};
+    std::vector<VirtualTextureLevel> levels;
+    const unsigned char* tiles = nullptr; // In tiledFile
+
+    int id;
+    int cacheTiles;
+    GLuint pageTable = 0;
+    GLuint tileCache = 0;
+
+    std::vector<CacheSlot> slots;  // Slot 0 holds the coarsest tile and is never evicted
+    std::vector<int> tileSlots;    // Per tile, -1 if not resident
+    std::vector<int> tileFrames;   // Per tile, last frame it was requested
+    std::vector<int> requests;     // Tiles of the feedbacks since the last update
+    std::vector<int> pendingTiles; // Requested and not resident, coarsest first
+    std::vector<unsigned char> pageEntries; // RGBA8 per tile (slot x, slot y, resident level), every level tightly packed
+    bool pageTableDirty = true;
+    int frame = 0; // Feedbacks processed, tiles used by the last one are never evicted
+
+    int residentCount = 0;
+    int requestedCount = 0;
+    int loadedCount = 0;
+};
+
+// Low resolution render target where scenes are drawn with VirtualTextureFeedback() outputs
+// Read back asynchronously through pixel buffer objects: requests reach the textures a frame or two later, never stalling
+class VirtualTextureFeedback
+{
+public:
+    VirtualTextureFeedback(int downscale = VT_FEEDBACK_DOWNSCALE);
+    ~VirtualTextureFeedback();
+
+    // Bind and clear the feedback framebuffer, sized for the window
+    void Begin(int windowWidth, int windowHeight);
+
+    // Queue the readback, then restore the framebuffer and viewport bound before Begin
+    void End();
+
+    // Give the completed readbacks to the textures, without waiting for the GPU
+    void Resolve(VirtualTexture* const* textures, int textureCount);
+
+    // Pixels are downscale times larger than on screen, so are the uv derivatives
+    float GetLevelBias() const;
+
+    GLuint GetColorTexture() const { return colorTexture; }
+
+private:
+    struct Readback
+    {
+        GLuint buffer = 0;
+        GLsync fence = nullptr; // Pending readback
+        int width = 0;
+        int height = 0;
+    };
+
+    int downscale;
+    int width = 0;
+    int height = 0;
+    GLuint framebuffer = 0;
+    GLuint colorTexture = 0;
+    GLuint depthRenderbuffer = 0;
+
+    std::vector<Readback> readbacks;
+    int nextReadback = 0; // Oldest pending readback, and next one to queue
+
+    GLint previousFramebuffer = 0;
+    GLint previousViewport[4] = {};
+    float previousClearColor[4] = {};
+};